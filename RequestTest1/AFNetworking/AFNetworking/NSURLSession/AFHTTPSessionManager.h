@@ -86,6 +86,11 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, strong) AFHTTPResponseSerializer <AFURLResponseSerialization> * responseSerializer;
 
+/**
+ The delay before the first retry of a failed chunk in `POST:parameters:headers:constructingBodyWithBlock:chunkSize:maximumRetryCount:progress:success:failure:`. Every further retry of the same chunk waits twice as long as the previous one, up to 60 seconds. `1` second by default.
+ */
+@property (nonatomic, assign) NSTimeInterval chunkedUploadRetryInterval;
+
 ///-------------------------------
 /// @name Managing Security Policy
 ///-------------------------------
@@ -206,6 +211,35 @@ NS_ASSUME_NONNULL_BEGIN
                                 success:(nullable void (^)(NSURLSessionDataTask *task, id _Nullable responseObject))success
                                 failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure;
 
+/**
+ Uploads a multipart `POST` request in chunks, sending each chunk as a separate upload task so that a failed chunk can be retried without restarting the whole body.
+
+ The multipart body is built once, as with `POST:parameters:headers:constructingBodyWithBlock:progress:success:failure:`. Every chunk is sent to the same URL with the body's `Content-Type`, a `Content-Range: bytes <first>-<last>/<total>` header and an `X-Upload-Session-ID` header shared by all chunks of the upload, so that the server can reassemble the body. While a chunk is being sent, the next one is read from the form on a background queue. A chunk that fails with a transient network error or a `5xx` status code is retried, up to `maximumRetryCount` times, with an exponential backoff starting at `chunkedUploadRetryInterval`. Before retrying, the upload asks the server how much of the body it has committed, with an empty request carrying `Content-Range: bytes */<total>`: a `308` response with a `Range: bytes=0-<last>` header resumes the upload after `<last>` (from the start without a `Range` header), a `2xx` response completes the upload, and any other response resends the failed chunk. Chunks are never compressed, whatever the request serializer's `requestBodyCompression`, so that the `Content-Range` of every chunk matches the bytes it carries.
+
+ Parts appended with `appendPartWithInputStream:name:fileName:length:mimeType:` cannot be read out of order, and make the upload fail.
+
+ @param URLString The URL string used to create the request URL.
+ @param parameters The parameters to be encoded according to the client request serializer.
+ @param headers The headers appended to the default headers for every chunk.
+ @param block A block that takes a single argument and appends data to the HTTP body. The block argument is an object adopting the `AFMultipartFormData` protocol.
+ @param chunkSize The maximum number of body bytes sent in each chunk.
+ @param maximumRetryCount The number of times a failed chunk is sent again before the upload fails.
+ @param uploadProgress A block object to be executed when the upload progress is updated. The progress covers the whole body across all chunks. Note this block is called on the `completionQueue`, or on the main queue if `completionQueue` is `NULL`.
+ @param success A block object to be executed when the last chunk finishes successfully. This block has no return value and takes two arguments: the upload task of the last chunk, and the response object created by the client response serializer.
+ @param failure A block object to be executed when a chunk fails and is not retried, or when the upload is cancelled. This block has no return value and takes a two arguments: the upload task of the failed chunk, if any, and the error describing the failure.
+
+ @return The progress of the whole upload, or `nil` if the request could not be serialized. Cancelling the progress cancels the upload.
+ */
+- (nullable NSProgress *)POST:(NSString *)URLString
+                   parameters:(nullable id)parameters
+                      headers:(nullable NSDictionary <NSString *, NSString *> *)headers
+    constructingBodyWithBlock:(nullable void (^)(id <AFMultipartFormData> formData))block
+                    chunkSize:(NSUInteger)chunkSize
+            maximumRetryCount:(NSUInteger)maximumRetryCount
+                     progress:(nullable void (^)(NSProgress *uploadProgress))uploadProgress
+                      success:(nullable void (^)(NSURLSessionDataTask *task, id _Nullable responseObject))success
+                      failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure;
+
 /**
  Creates and runs an `NSURLSessionDataTask` with a `PUT` request.
  
@@ -280,6 +314,42 @@ NS_ASSUME_NONNULL_BEGIN
                                                   success:(nullable void (^)(NSURLSessionDataTask *task, id _Nullable responseObject))success
                                                   failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure;
 
+///--------------------------------------
+/// @name Making Requests From Templates
+///--------------------------------------
+
+/**
+ Creates a request template for the specified HTTP method, using the current request serializer and base URL.
+
+ Building requests from a template skips re-applying the request serializer's properties and headers for every request. Changes made to the request serializer after the template is created are not reflected in it.
+
+ @param method The HTTP method for the requests, such as `GET` or `POST`.
+ */
+- (AFHTTPRequestTemplate *)requestTemplateWithMethod:(NSString *)method;
+
+/**
+ Creates an `NSURLSessionDataTask` with a request built from the specified template.
+
+ @param requestTemplate The template used to create the request.
+ @param path The URL string of the request, relative to the base URL of the template.
+ @param parameters The parameters to be encoded according to the request serializer the template was created from.
+ @param headers The headers appended to the default headers for this request.
+ @param uploadProgress A block object to be executed when the upload progress is updated. Note this block is called on the session queue, not the main queue.
+ @param downloadProgress A block object to be executed when the download progress is updated. Note this block is called on the session queue, not the main queue.
+ @param success A block object to be executed when the task finishes successfully. This block has no return value and takes two arguments: the data task, and the response object created by the client response serializer.
+ @param failure A block object to be executed when the task finishes unsuccessfully, or that finishes successfully, but encountered an error while parsing the response data. This block has no return value and takes a two arguments: the data task and the error describing the network or parsing error that occurred.
+
+ @see -requestTemplateWithMethod:
+ */
+- (nullable NSURLSessionDataTask *)dataTaskWithRequestTemplate:(AFHTTPRequestTemplate *)requestTemplate
+                                                          path:(NSString *)path
+                                                    parameters:(nullable id)parameters
+                                                       headers:(nullable NSDictionary <NSString *, NSString *> *)headers
+                                                uploadProgress:(nullable void (^)(NSProgress *uploadProgress))uploadProgress
+                                              downloadProgress:(nullable void (^)(NSProgress *downloadProgress))downloadProgress
+                                                       success:(nullable void (^)(NSURLSessionDataTask *task, id _Nullable responseObject))success
+                                                       failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -44,6 +44,316 @@
 @property (readwrite, nonatomic, strong) NSURL *baseURL;
 @end
 
+#pragma mark -
+
+// 只有暂时性的网络错误和服务器5xx错误才重传
+static BOOL AFHTTPChunkedUploadShouldRetry(NSURLResponse *response, NSError *error) {
+    if ([response isKindOfClass:[NSHTTPURLResponse class]] && [(NSHTTPURLResponse *)response statusCode] >= 500) {
+        return YES;
+    }
+
+    if (![error.domain isEqualToString:NSURLErrorDomain]) {
+        return NO;
+    }
+
+    switch (error.code) {
+        case NSURLErrorTimedOut:
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorNetworkConnectionLost:
+        case NSURLErrorDNSLookupFailed:
+        case NSURLErrorNotConnectedToInternet:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+// 第retryCount次重传之前等待的时间，每次翻倍，最多60秒
+static NSTimeInterval AFHTTPChunkedUploadRetryDelay(NSTimeInterval retryInterval, NSUInteger retryCount) {
+    NSTimeInterval delay = retryInterval * pow(2.0, (double)(retryCount - 1));
+    return MIN(delay, 60.0);
+}
+
+// 解析服务器已经收到的长度：`Range: bytes=0-<last>`表示收到了last+1个字节，没有Range头表示还没有收到
+static BOOL AFHTTPChunkedUploadCommittedLength(NSHTTPURLResponse *response, unsigned long long *committedLength) {
+    NSString *range = response.allHeaderFields[@"Range"];
+    if (range.length == 0) {
+        *committedLength = 0;
+        return YES;
+    }
+
+    unsigned long long first = 0;
+    unsigned long long last = 0;
+    NSScanner *scanner = [NSScanner scannerWithString:range];
+    if (![scanner scanString:@"bytes=" intoString:NULL] || ![scanner scanUnsignedLongLong:&first] || ![scanner scanString:@"-" intoString:NULL] || ![scanner scanUnsignedLongLong:&last] || first != 0) {
+        return NO;
+    }
+    *committedLength = last + 1;
+    return YES;
+}
+
+// 分块上传：每一块是一个单独的上传任务，失败只重传这一块；发送当前块的同时在后台队列准备下一块
+@interface AFHTTPChunkedUpload : NSObject
+@property (nonatomic, strong) AFHTTPSessionManager *sessionManager;
+@property (nonatomic, copy) NSURLRequest *request;
+@property (nonatomic, strong) NSInputStream *bodyStream;
+@property (nonatomic, assign) unsigned long long contentLength;
+@property (nonatomic, assign) NSUInteger chunkSize;
+@property (nonatomic, assign) NSUInteger maximumRetryCount;
+@property (nonatomic, assign) NSTimeInterval retryInterval;
+@property (nonatomic, copy) NSString *uploadSessionIdentifier;
+@property (nonatomic, strong) NSProgress *progress;
+// 已经上传成功的字节数
+@property (nonatomic, assign) unsigned long long completedLength;
+
+@property (nonatomic, strong) dispatch_queue_t preparationQueue;
+@property (nonatomic, strong) dispatch_group_t preparationGroup;
+// 准备好的下一块：发送的body和它在body中的长度
+@property (nonatomic, strong) NSData *preparedChunk;
+@property (nonatomic, assign) unsigned long long preparedChunkOffset;
+@property (nonatomic, assign) NSUInteger preparedChunkLength;
+@property (nonatomic, strong) NSError *preparationError;
+@property (nonatomic, strong) NSURLSessionDataTask *currentTask;
+
+@property (nonatomic, copy) void (^uploadProgress)(NSProgress *uploadProgress);
+@property (nonatomic, copy) void (^success)(NSURLSessionDataTask *task, id responseObject);
+@property (nonatomic, copy) void (^failure)(NSURLSessionDataTask *task, NSError *error);
+@end
+
+@implementation AFHTTPChunkedUpload
+
+- (instancetype)initWithSessionManager:(AFHTTPSessionManager *)sessionManager
+                               request:(NSURLRequest *)request
+                             chunkSize:(NSUInteger)chunkSize
+                     maximumRetryCount:(NSUInteger)maximumRetryCount
+{
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.sessionManager = sessionManager;
+    self.bodyStream = request.HTTPBodyStream;
+    self.contentLength = (unsigned long long)[[request valueForHTTPHeaderField:@"Content-Length"] longLongValue];
+    self.chunkSize = chunkSize;
+    self.maximumRetryCount = maximumRetryCount;
+    self.uploadSessionIdentifier = [[NSUUID UUID] UUIDString];
+
+    // 每一块的body由上传任务单独提供
+    NSMutableURLRequest *mutableRequest = [request mutableCopy];
+    mutableRequest.HTTPBodyStream = nil;
+    self.request = mutableRequest;
+
+    NSString *queueName = [NSString stringWithFormat:@"com.alamofire.networking.chunkedupload.preparation-%@", self.uploadSessionIdentifier];
+    self.preparationQueue = dispatch_queue_create([queueName cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_SERIAL);
+
+    self.progress = [[NSProgress alloc] initWithParent:nil userInfo:nil];
+    self.progress.totalUnitCount = (int64_t)self.contentLength;
+    __weak __typeof__(self) weakSelf = self;
+    // cancel可能在任意线程调用，currentTask只在completionQueue上读写
+    self.progress.cancellationHandler = ^{
+        __strong __typeof__(weakSelf) strongSelf = weakSelf;
+        if (!strongSelf) {
+            return;
+        }
+        dispatch_async([strongSelf completionQueue], ^{
+            [strongSelf.currentTask cancel];
+        });
+    };
+
+    return self;
+}
+
+- (dispatch_queue_t)completionQueue {
+    return self.sessionManager.completionQueue ?: dispatch_get_main_queue();
+}
+
+- (void)start {
+    [self prepareChunkAtOffset:0];
+    [self sendPreparedChunkAtOffset:0];
+}
+
+- (void)prepareChunkAtOffset:(unsigned long long)offset {
+    NSRange range = NSMakeRange((NSUInteger)offset, (NSUInteger)MIN((unsigned long long)self.chunkSize, self.contentLength - offset));
+    dispatch_group_t group = dispatch_group_create();
+    self.preparationGroup = group;
+    dispatch_group_async(group, self.preparationQueue, ^{
+        NSError *error = nil;
+        NSData *chunk = range.length > 0 ? AFMultipartFormDataInRange(self.bodyStream, range, &error) : [NSData data];
+        self.preparedChunk = chunk;
+        self.preparedChunkOffset = offset;
+        self.preparedChunkLength = range.length;
+        self.preparationError = error;
+    });
+}
+
+- (void)sendPreparedChunkAtOffset:(unsigned long long)offset {
+    dispatch_group_notify(self.preparationGroup, [self completionQueue], ^{
+        NSData *chunk = self.preparedChunk;
+        NSUInteger length = self.preparedChunkLength;
+        NSError *error = self.preparationError;
+        self.preparedChunk = nil;
+        self.preparationError = nil;
+
+        if (self.progress.isCancelled) {
+            [self finishWithTask:nil responseObject:nil error:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+            return;
+        }
+        if (!chunk) {
+            [self finishWithTask:nil responseObject:nil error:error];
+            return;
+        }
+
+        // 发送这一块的同时准备下一块
+        if (offset + length < self.contentLength) {
+            [self prepareChunkAtOffset:offset + length];
+        }
+        [self sendChunk:chunk length:length atOffset:offset retryCount:0];
+    });
+}
+
+- (void)sendChunk:(NSData *)chunk
+           length:(NSUInteger)length
+         atOffset:(unsigned long long)offset
+       retryCount:(NSUInteger)retryCount
+{
+    NSMutableURLRequest *request = [self.request mutableCopy];
+    // Content-Range是这一块在body中的位置，和发送的字节数一致，所以分块上传不压缩
+    if (length > 0) {
+        [request setValue:[NSString stringWithFormat:@"bytes %llu-%llu/%llu", offset, offset + length - 1, self.contentLength] forHTTPHeaderField:@"Content-Range"];
+    } else {
+        [request setValue:[NSString stringWithFormat:@"bytes */%llu", self.contentLength] forHTTPHeaderField:@"Content-Range"];
+    }
+    [request setValue:[NSString stringWithFormat:@"%lu", (unsigned long)[chunk length]] forHTTPHeaderField:@"Content-Length"];
+    [request setValue:self.uploadSessionIdentifier forHTTPHeaderField:@"X-Upload-Session-ID"];
+
+    __block NSURLSessionDataTask *task = [self.sessionManager uploadTaskWithRequest:request fromData:chunk progress:^(NSProgress *chunkProgress) {
+        // 整体进度 = 已完成的块 + 当前块已发送的比例，和其他进度更新一样在completionQueue上回调
+        unsigned long long completedLength = offset + (unsigned long long)(chunkProgress.fractionCompleted * length);
+        dispatch_async([self completionQueue], ^{
+            [self updateProgressWithCompletedLength:completedLength];
+        });
+    } completionHandler:^(NSURLResponse *response, id responseObject, NSError *error) {
+        if (error) {
+            if (retryCount < self.maximumRetryCount && !self.progress.isCancelled && AFHTTPChunkedUploadShouldRetry(response, error)) {
+                [self retryChunk:chunk length:length atOffset:offset retryCount:retryCount + 1];
+            } else {
+                [self finishWithTask:task responseObject:nil error:error];
+            }
+            return;
+        }
+
+        self.completedLength = offset + length;
+        [self updateProgressWithCompletedLength:self.completedLength];
+        if (self.completedLength >= self.contentLength) {
+            [self finishWithTask:task responseObject:responseObject error:nil];
+        } else {
+            [self sendPreparedChunkAtOffset:self.completedLength];
+        }
+    }];
+
+    self.currentTask = task;
+    [task resume];
+}
+
+// 等待一段时间之后先向服务器查询已经收到的长度，再从那里继续
+- (void)retryChunk:(NSData *)chunk
+            length:(NSUInteger)length
+          atOffset:(unsigned long long)offset
+        retryCount:(NSUInteger)retryCount
+{
+    NSTimeInterval delay = AFHTTPChunkedUploadRetryDelay(self.retryInterval, retryCount);
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), [self completionQueue], ^{
+        if (self.progress.isCancelled) {
+            [self finishWithTask:nil responseObject:nil error:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+            return;
+        }
+
+        NSMutableURLRequest *request = [self.request mutableCopy];
+        [request setValue:[NSString stringWithFormat:@"bytes */%llu", self.contentLength] forHTTPHeaderField:@"Content-Range"];
+        [request setValue:@"0" forHTTPHeaderField:@"Content-Length"];
+        [request setValue:self.uploadSessionIdentifier forHTTPHeaderField:@"X-Upload-Session-ID"];
+
+        __block NSURLSessionDataTask *task = [self.sessionManager uploadTaskWithRequest:request fromData:[NSData data] progress:nil completionHandler:^(NSURLResponse *response, id responseObject, NSError *error) {
+            NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response statusCode] : 0;
+            unsigned long long committedLength = 0;
+            if (statusCode == 308 && AFHTTPChunkedUploadCommittedLength((NSHTTPURLResponse *)response, &committedLength) && committedLength < self.contentLength) {
+                [self resumeChunk:chunk length:length atOffset:offset fromCommittedLength:committedLength retryCount:retryCount];
+            } else if (!error) {
+                // 服务器已经收到了整个body
+                self.completedLength = self.contentLength;
+                [self updateProgressWithCompletedLength:self.completedLength];
+                [self finishWithTask:task responseObject:responseObject error:nil];
+            } else if (statusCode > 0 && !AFHTTPChunkedUploadShouldRetry(response, error)) {
+                // 服务器不支持查询，直接重传这一块
+                [self sendChunk:chunk length:length atOffset:offset retryCount:retryCount];
+            } else if (retryCount < self.maximumRetryCount && !self.progress.isCancelled) {
+                [self retryChunk:chunk length:length atOffset:offset retryCount:retryCount + 1];
+            } else {
+                [self finishWithTask:task responseObject:nil error:error];
+            }
+        }];
+
+        self.currentTask = task;
+        [task resume];
+    });
+}
+
+- (void)resumeChunk:(NSData *)chunk
+             length:(NSUInteger)length
+           atOffset:(unsigned long long)offset
+fromCommittedLength:(unsigned long long)committedLength
+         retryCount:(NSUInteger)retryCount
+{
+    if (committedLength == offset) {
+        [self sendChunk:chunk length:length atOffset:offset retryCount:retryCount];
+        return;
+    }
+
+    self.completedLength = committedLength;
+    [self updateProgressWithCompletedLength:committedLength];
+    // 服务器收到的位置和失败的块不一致时，等正在准备的块结束，不是从这个位置开始的话重新准备
+    dispatch_group_notify(self.preparationGroup, [self completionQueue], ^{
+        if (!self.preparedChunk || self.preparedChunkOffset != committedLength) {
+            [self prepareChunkAtOffset:committedLength];
+        }
+        [self sendPreparedChunkAtOffset:committedLength];
+    });
+}
+
+// 只在completionQueue上调用
+- (void)updateProgressWithCompletedLength:(unsigned long long)completedLength {
+    self.progress.completedUnitCount = (int64_t)completedLength;
+    if (self.uploadProgress) {
+        self.uploadProgress(self.progress);
+    }
+}
+
+- (void)finishWithTask:(NSURLSessionDataTask *)task
+        responseObject:(id)responseObject
+                 error:(NSError *)error
+{
+    if (error) {
+        if (self.failure) {
+            self.failure(task, error);
+        }
+    } else {
+        if (self.success) {
+            self.success(task, responseObject);
+        }
+    }
+
+    // 断开和block之间的引用
+    self.uploadProgress = nil;
+    self.success = nil;
+    self.failure = nil;
+    self.currentTask = nil;
+    self.progress.cancellationHandler = nil;
+}
+
+@end
+
 @implementation AFHTTPSessionManager
 @dynamic responseSerializer;
 // 设计模式 工厂模式 非单例
@@ -94,6 +404,7 @@
     ///
     self.requestSerializer = [AFHTTPRequestSerializer serializer];
     self.responseSerializer = [AFJSONResponseSerializer serializer];
+    self.chunkedUploadRetryInterval = 1.0;
 
     return self;
 }
@@ -227,6 +538,50 @@
     return task;
 }
 
+- (NSProgress *)POST:(NSString *)URLString
+          parameters:(nullable id)parameters
+             headers:(nullable NSDictionary<NSString *,NSString *> *)headers
+constructingBodyWithBlock:(nullable void (^)(id<AFMultipartFormData> _Nonnull))block
+           chunkSize:(NSUInteger)chunkSize
+   maximumRetryCount:(NSUInteger)maximumRetryCount
+            progress:(nullable void (^)(NSProgress * _Nonnull))uploadProgress
+             success:(nullable void (^)(NSURLSessionDataTask * _Nonnull, id _Nullable))success
+             failure:(nullable void (^)(NSURLSessionDataTask * _Nullable, NSError * _Nonnull))failure
+{
+    NSParameterAssert(chunkSize > 0);
+
+    // 压缩之后的body不能按位置分块，Content-Range也要和发送的字节一致，所以分块上传不压缩
+    AFHTTPRequestSerializer <AFURLRequestSerialization> *requestSerializer = self.requestSerializer;
+    if (requestSerializer.requestBodyCompression != AFHTTPRequestBodyCompressionNone) {
+        requestSerializer = [requestSerializer copy];
+        requestSerializer.requestBodyCompression = AFHTTPRequestBodyCompressionNone;
+    }
+
+    NSError *serializationError = nil;
+    NSMutableURLRequest *request = [requestSerializer multipartFormRequestWithMethod:@"POST" URLString:[[NSURL URLWithString:URLString relativeToURL:self.baseURL] absoluteString] parameters:parameters constructingBodyWithBlock:block error:&serializationError];
+    for (NSString *headerField in headers.keyEnumerator) {
+        [request setValue:headers[headerField] forHTTPHeaderField:headerField];
+    }
+    if (serializationError) {
+        if (failure) {
+            dispatch_async(self.completionQueue ?: dispatch_get_main_queue(), ^{
+                failure(nil, serializationError);
+            });
+        }
+
+        return nil;
+    }
+
+    AFHTTPChunkedUpload *upload = [[AFHTTPChunkedUpload alloc] initWithSessionManager:self request:request chunkSize:chunkSize maximumRetryCount:maximumRetryCount];
+    upload.retryInterval = self.chunkedUploadRetryInterval;
+    upload.uploadProgress = uploadProgress;
+    upload.success = success;
+    upload.failure = failure;
+    [upload start];
+
+    return upload.progress;
+}
+
 - (NSURLSessionDataTask *)PUT:(NSString *)URLString
                    parameters:(nullable id)parameters
                       headers:(nullable NSDictionary<NSString *,NSString *> *)headers
@@ -283,6 +638,41 @@
      *  relativeToURL:表示将 URLString拼接到baseURL后面
      */
     NSMutableURLRequest *request = [self.requestSerializer requestWithMethod:method URLString:[[NSURL URLWithString:URLString relativeToURL:self.baseURL] absoluteString] parameters:parameters error:&serializationError];
+
+    return [self dataTaskWithRequest:request headers:headers serializationError:serializationError uploadProgress:uploadProgress downloadProgress:downloadProgress success:success failure:failure];
+}
+
+- (AFHTTPRequestTemplate *)requestTemplateWithMethod:(NSString *)method {
+    return [self.requestSerializer requestTemplateWithMethod:method baseURL:self.baseURL];
+}
+
+// 模板已经设置好了HTTP方法、请求属性和请求头，这里只需要拼接path和序列化参数
+- (NSURLSessionDataTask *)dataTaskWithRequestTemplate:(AFHTTPRequestTemplate *)requestTemplate
+                                                 path:(NSString *)path
+                                           parameters:(nullable id)parameters
+                                              headers:(nullable NSDictionary <NSString *, NSString *> *)headers
+                                       uploadProgress:(nullable void (^)(NSProgress *uploadProgress)) uploadProgress
+                                     downloadProgress:(nullable void (^)(NSProgress *downloadProgress)) downloadProgress
+                                              success:(nullable void (^)(NSURLSessionDataTask *task, id _Nullable responseObject))success
+                                              failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure
+{
+    NSParameterAssert(requestTemplate);
+
+    NSError *serializationError = nil;
+    NSMutableURLRequest *request = [requestTemplate requestWithPath:path parameters:parameters error:&serializationError];
+
+    return [self dataTaskWithRequest:request headers:headers serializationError:serializationError uploadProgress:uploadProgress downloadProgress:downloadProgress success:success failure:failure];
+}
+
+// 处理request构建产生的错误，并通过request生成task
+- (NSURLSessionDataTask *)dataTaskWithRequest:(NSMutableURLRequest *)request
+                                      headers:(nullable NSDictionary <NSString *, NSString *> *)headers
+                           serializationError:(NSError *)serializationError
+                               uploadProgress:(nullable void (^)(NSProgress *uploadProgress)) uploadProgress
+                             downloadProgress:(nullable void (^)(NSProgress *downloadProgress)) downloadProgress
+                                      success:(nullable void (^)(NSURLSessionDataTask *task, id _Nullable responseObject))success
+                                      failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure
+{
     for (NSString *headerField in headers.keyEnumerator) {
         [request setValue:headers[headerField] forHTTPHeaderField:headerField];
     }
@@ -376,6 +766,8 @@
     HTTPClient.requestSerializer = [self.requestSerializer copyWithZone:zone];
     HTTPClient.responseSerializer = [self.responseSerializer copyWithZone:zone];
     HTTPClient.securityPolicy = [self.securityPolicy copyWithZone:zone];
+    HTTPClient.responseDataFileThreshold = self.responseDataFileThreshold;
+    HTTPClient.chunkedUploadRetryInterval = self.chunkedUploadRetryInterval;
     return HTTPClient;
 }
 
@@ -0,0 +1,107 @@
+// AFLogging.h
+// Copyright (c) 2011–2016 Alamofire Software Foundation ( http://alamofire.org/ )
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+/**
+ Logging and tracing for AFNetworking's internals.
+
+ Logging is compiled out unless `AF_LOGGING_ENABLED` is defined to `1`, for example in the preprocessor macros of a debug build. When it is disabled, the `AFLog` macros expand to nothing and their arguments are never evaluated.
+
+ When enabled, messages at or below the runtime level and in one of the runtime categories are formatted and written into a fixed-size in-memory ring buffer. Writing never takes a lock or touches the system log; the most recent messages can be read back with `AFLogCopyRecentMessages()`.
+ */
+
+#ifndef AF_LOGGING_ENABLED
+    #define AF_LOGGING_ENABLED 0
+#endif
+
+typedef NS_ENUM(NSInteger, AFLogLevel) {
+    AFLogLevelError = 0,
+    AFLogLevelWarning,
+    AFLogLevelInfo,
+    AFLogLevelDebug,
+    AFLogLevelTrace,
+};
+
+typedef NS_OPTIONS(NSUInteger, AFLogCategory) {
+    AFLogCategoryRequest       = 1 << 0,
+    AFLogCategorySession       = 1 << 1,
+    AFLogCategorySerialization = 1 << 2,
+    AFLogCategoryImage         = 1 << 3,
+    AFLogCategoryAll           = NSUIntegerMax,
+};
+
+/**
+ The most verbose level compiled in when logging is enabled. Messages above it are removed at compile time.
+ */
+#ifndef AF_LOGGING_MAXIMUM_LEVEL
+    #define AF_LOGGING_MAXIMUM_LEVEL AFLogLevelTrace
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+#if AF_LOGGING_ENABLED
+
+/**
+ Sets the most verbose level logged at runtime. The default is `AFLogLevelInfo`.
+ */
+FOUNDATION_EXPORT void AFLogSetLevel(AFLogLevel level);
+
+/**
+ Sets the categories logged at runtime. The default is `AFLogCategoryAll`.
+ */
+FOUNDATION_EXPORT void AFLogSetCategories(AFLogCategory categories);
+
+/**
+ Whether a message of the specified level and category would currently be logged.
+ */
+FOUNDATION_EXPORT BOOL AFLogIsEnabled(AFLogLevel level, AFLogCategory category);
+
+/**
+ Formats the message and writes it into the ring buffer. Use the `AFLog` macros instead of calling this directly.
+ */
+FOUNDATION_EXPORT void AFLogWrite(AFLogLevel level, AFLogCategory category, const char *function, NSString *format, ...) NS_FORMAT_FUNCTION(4,5);
+
+/**
+ Returns the messages currently held in the ring buffer, oldest first, each prefixed with its timestamp, level and thread.
+ */
+FOUNDATION_EXPORT NSArray <NSString *> * AFLogCopyRecentMessages(void);
+
+#define AFLog(level, category, format, ...) \
+    do { \
+        if ((level) <= AF_LOGGING_MAXIMUM_LEVEL && AFLogIsEnabled((level), (category))) { \
+            AFLogWrite((level), (category), __PRETTY_FUNCTION__, (format), ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#else
+
+#define AFLog(level, category, format, ...) do {} while (0)
+
+#endif
+
+#define AFLogError(category, format, ...)   AFLog(AFLogLevelError, category, format, ##__VA_ARGS__)
+#define AFLogWarning(category, format, ...) AFLog(AFLogLevelWarning, category, format, ##__VA_ARGS__)
+#define AFLogInfo(category, format, ...)    AFLog(AFLogLevelInfo, category, format, ##__VA_ARGS__)
+#define AFLogDebug(category, format, ...)   AFLog(AFLogLevelDebug, category, format, ##__VA_ARGS__)
+#define AFLogTrace(category, format, ...)   AFLog(AFLogLevelTrace, category, format, ##__VA_ARGS__)
+
+NS_ASSUME_NONNULL_END
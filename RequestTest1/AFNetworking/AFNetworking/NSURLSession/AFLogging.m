@@ -0,0 +1,122 @@
+// AFLogging.m
+// Copyright (c) 2011–2016 Alamofire Software Foundation ( http://alamofire.org/ )
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "AFLogging.h"
+
+#if AF_LOGGING_ENABLED
+
+#import <stdatomic.h>
+#import <pthread.h>
+
+enum {
+    // 必须是2的幂
+    AFLogRecordCount = 1024,
+    AFLogMessageLength = 200,
+};
+
+typedef struct {
+    // 序号为n的记录写入时为2n+1，写完后为2n+2，读取前后不一致说明被覆盖了
+    _Atomic(uint64_t) sequence;
+    CFAbsoluteTime timestamp;
+    uint64_t threadID;
+    AFLogLevel level;
+    const char *function;
+    CFIndex length;
+    char message[AFLogMessageLength];
+} AFLogRecord;
+
+static AFLogRecord AFLogRecords[AFLogRecordCount];
+static _Atomic(uint64_t) AFLogNextSequence = 0;
+static _Atomic(NSInteger) AFLogCurrentLevel = AFLogLevelInfo;
+static _Atomic(NSUInteger) AFLogCurrentCategories = AFLogCategoryAll;
+
+void AFLogSetLevel(AFLogLevel level) {
+    atomic_store_explicit(&AFLogCurrentLevel, level, memory_order_relaxed);
+}
+
+void AFLogSetCategories(AFLogCategory categories) {
+    atomic_store_explicit(&AFLogCurrentCategories, categories, memory_order_relaxed);
+}
+
+BOOL AFLogIsEnabled(AFLogLevel level, AFLogCategory category) {
+    return level <= atomic_load_explicit(&AFLogCurrentLevel, memory_order_relaxed) && (category & atomic_load_explicit(&AFLogCurrentCategories, memory_order_relaxed)) != 0;
+}
+
+// 每条消息先占一个序号，再写入序号对应的槽位，写入过程不加锁，也不经过syslog
+void AFLogWrite(AFLogLevel level, __unused AFLogCategory category, const char *function, NSString *format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    NSString *message = [[NSString alloc] initWithFormat:format arguments:arguments];
+    va_end(arguments);
+
+    uint64_t sequence = atomic_fetch_add_explicit(&AFLogNextSequence, 1, memory_order_relaxed);
+    AFLogRecord *record = &AFLogRecords[sequence & (AFLogRecordCount - 1)];
+    atomic_store_explicit(&record->sequence, sequence * 2 + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    record->timestamp = CFAbsoluteTimeGetCurrent();
+    pthread_threadid_np(NULL, &record->threadID);
+    record->level = level;
+    record->function = function;
+    // 超长的消息按完整字符截断
+    CFIndex length = 0;
+    CFStringGetBytes((__bridge CFStringRef)message, CFRangeMake(0, (CFIndex)message.length), kCFStringEncodingUTF8, '?', false, (UInt8 *)record->message, AFLogMessageLength, &length);
+    record->length = length;
+
+    atomic_store_explicit(&record->sequence, sequence * 2 + 2, memory_order_release);
+}
+
+NSArray <NSString *> * AFLogCopyRecentMessages(void) {
+    static const char * const levelNames[] = { "E", "W", "I", "D", "T" };
+
+    uint64_t nextSequence = atomic_load_explicit(&AFLogNextSequence, memory_order_acquire);
+    uint64_t firstSequence = nextSequence > AFLogRecordCount ? nextSequence - AFLogRecordCount : 0;
+
+    NSMutableArray *messages = [NSMutableArray array];
+    for (uint64_t sequence = firstSequence; sequence < nextSequence; sequence++) {
+        AFLogRecord *record = &AFLogRecords[sequence & (AFLogRecordCount - 1)];
+        uint64_t completedSequence = sequence * 2 + 2;
+        if (atomic_load_explicit(&record->sequence, memory_order_acquire) != completedSequence) {
+            continue;
+        }
+
+        CFAbsoluteTime timestamp = record->timestamp;
+        uint64_t threadID = record->threadID;
+        AFLogLevel level = record->level;
+        const char *function = record->function;
+        CFIndex length = MIN(record->length, (CFIndex)AFLogMessageLength);
+        char message[AFLogMessageLength];
+        memcpy(message, record->message, (size_t)length);
+
+        // 复制期间被新的消息覆盖了，丢弃
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&record->sequence, memory_order_relaxed) != completedSequence) {
+            continue;
+        }
+
+        NSString *text = [[NSString alloc] initWithBytes:message length:(NSUInteger)length encoding:NSUTF8StringEncoding] ?: @"";
+        [messages addObject:[NSString stringWithFormat:@"%.6f [%s] [%llu] %s %@", timestamp, levelNames[MIN(MAX(level, AFLogLevelError), AFLogLevelTrace)], threadID, function, text]];
+    }
+
+    return messages;
+}
+
+#endif
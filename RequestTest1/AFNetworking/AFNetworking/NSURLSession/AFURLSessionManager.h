@@ -107,6 +107,11 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, strong) id <AFURLResponseSerialization> responseSerializer;
 
+/**
+ The size in bytes above which the response data of data and upload tasks is written to a temporary file instead of being kept in memory. The file is memory-mapped when the data is handed to the response serializer, and deleted once the completion handler returns. The default value is `0`, which keeps response data in memory regardless of its size.
+ */
+@property (nonatomic, assign) NSUInteger responseDataFileThreshold;
+
 ///-------------------------------
 /// @name Managing Security Policy
 ///-------------------------------
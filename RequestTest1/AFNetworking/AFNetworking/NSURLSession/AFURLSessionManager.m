@@ -20,7 +20,11 @@
 // THE SOFTWARE.
 
 #import "AFURLSessionManager.h"
+#import "AFLogging.h"
 #import <objc/runtime.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <pthread.h>
 
 //处理session的并发队列
 //创建一个并发队列，用于在网络请求任务完成后处理数据的，并发队列实现多线程处理多个请求完成后的数据处理
@@ -60,8 +64,6 @@ NSString * const AFNetworkingTaskDidCompleteErrorKey = @"com.alamofire.networkin
 NSString * const AFNetworkingTaskDidCompleteAssetPathKey = @"com.alamofire.networking.task.complete.assetpath";
 NSString * const AFNetworkingTaskDidCompleteSessionTaskMetrics = @"com.alamofire.networking.complete.sessiontaskmetrics";
 
-static NSString * const AFURLSessionManagerLockName = @"com.alamofire.networking.session.manager.lock";
-
 //block的命名
 typedef void (^AFURLSessionDidBecomeInvalidBlock)(NSURLSession *session, NSError *error);
 typedef NSURLSessionAuthChallengeDisposition (^AFURLSessionDidReceiveAuthenticationChallengeBlock)(NSURLSession *session, NSURLAuthenticationChallenge *challenge, NSURLCredential * __autoreleasing *credential);
@@ -90,6 +92,185 @@ typedef void (^AFURLSessionTaskProgressBlock)(NSProgress *);
 
 typedef void (^AFURLSessionTaskCompletionHandler)(NSURLResponse *response, id responseObject, NSError *error);
 
+#pragma mark -
+//响应数据的缓冲区，didReceiveData:收到的数据块只按引用串起来，不做拷贝
+//data返回的NSData由dispatch_data拼接而成：用enumerateByteRangesUsingBlock:遍历时逐块访问，
+//只有序列化器真正需要连续内存（访问bytes）时才会合并成一块
+//超过fileThreshold后，数据改为写入临时文件，完成时把文件映射成NSData交给序列化器
+@interface AFURLSessionManagerBodyBuffer : NSObject
+
+//超过这个长度就转存到临时文件，0表示始终放在内存中
+@property (nonatomic, assign) NSUInteger fileThreshold;
+
+//已经收到的数据长度
+@property (readonly, nonatomic, assign) NSUInteger length;
+
+//写入或映射临时文件失败时的错误
+@property (readonly, nonatomic, strong) NSError *error;
+
+- (void)appendData:(NSData *)data;
+
+- (NSData *)data;
+
+//删除临时文件，在completionHandler返回之后调用
+- (void)removeFile;
+
+@end
+
+static BOOL AFWriteBytesToFileDescriptor(int fileDescriptor, const void *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fileDescriptor, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes = (const char *)bytes + written;
+        length -= (size_t)written;
+    }
+
+    return YES;
+}
+
+@implementation AFURLSessionManagerBodyBuffer {
+    dispatch_data_t _chunks;
+    NSString *_filePath;
+    int _fileDescriptor;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    _chunks = dispatch_data_empty;
+    _fileDescriptor = -1;
+
+    return self;
+}
+
+- (void)dealloc {
+    [self removeFile];
+}
+
+- (void)appendData:(NSData *)data {
+    if (data.length == 0 || self.error) {
+        return;
+    }
+
+    if (!_filePath && self.fileThreshold > 0 && _length + data.length > self.fileThreshold) {
+        [self openFile];
+    }
+
+    if (_fileDescriptor >= 0) {
+        __block BOOL succeeded = YES;
+        [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+            if (!AFWriteBytesToFileDescriptor(self->_fileDescriptor, bytes, byteRange.length)) {
+                succeeded = NO;
+                *stop = YES;
+            }
+        }];
+        if (!succeeded) {
+            [self failWithPOSIXError:errno];
+            return;
+        }
+        _length += data.length;
+        return;
+    }
+
+    //NSURLSession给的数据本身可能就是不连续的，每一段分别包装成dispatch_data，由destructor持有原来的NSData
+    NSData *chunk = [data copy];
+    __block dispatch_data_t chunks = _chunks;
+    [chunk enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, __unused BOOL *stop) {
+        dispatch_data_t region = dispatch_data_create(bytes, byteRange.length, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [chunk self];
+        });
+        chunks = dispatch_data_create_concat(chunks, region);
+    }];
+    _chunks = chunks;
+    _length += chunk.length;
+}
+
+//创建临时文件，并把已经在内存中的数据先写进去；创建失败时继续留在内存中
+- (void)openFile {
+    NSString *fileName = [NSString stringWithFormat:@"com.alamofire.networking.session.manager.data-%@", [NSUUID UUID].UUIDString];
+    NSString *filePath = [NSTemporaryDirectory() stringByAppendingPathComponent:fileName];
+    int fileDescriptor = open(filePath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fileDescriptor < 0) {
+        return;
+    }
+
+    _filePath = filePath;
+    _fileDescriptor = fileDescriptor;
+
+    __block BOOL succeeded = YES;
+    dispatch_data_apply(_chunks, ^bool(__unused dispatch_data_t region, __unused size_t offset, const void *buffer, size_t size) {
+        succeeded = AFWriteBytesToFileDescriptor(fileDescriptor, buffer, size);
+        return succeeded;
+    });
+    if (!succeeded) {
+        [self failWithPOSIXError:errno];
+        return;
+    }
+
+    _chunks = dispatch_data_empty;
+}
+
+- (void)failWithPOSIXError:(int)code {
+    _error = [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil];
+    _chunks = dispatch_data_empty;
+    [self removeFile];
+}
+
+- (NSData *)data {
+    if (self.error) {
+        return nil;
+    }
+
+    if (!_filePath) {
+#if DISPATCH_DATA_IS_BRIDGED_TO_NSDATA
+        //dispatch_data_t与NSData是toll-free bridged的
+        return (NSData *)_chunks;
+#else
+        //32 位下 dispatch_data_t 没有桥接到 NSData，映射成一块连续内存后包装
+        const void *buffer = NULL;
+        size_t size = 0;
+        dispatch_data_t map = dispatch_data_create_map(_chunks, &buffer, &size);
+        return [[NSData alloc] initWithBytesNoCopy:(void *)buffer length:size deallocator:^(__unused void *bytes, __unused NSUInteger length) {
+            (void)map; // 由 block 持有，NSData 释放时一起释放
+        }];
+#endif
+    }
+
+    close(_fileDescriptor);
+    _fileDescriptor = -1;
+
+    NSError *error = nil;
+    NSData *data = [NSData dataWithContentsOfFile:_filePath options:NSDataReadingMappedAlways error:&error];
+    if (!data) {
+        _error = error;
+    }
+
+    return data;
+}
+
+- (void)removeFile {
+    if (_fileDescriptor >= 0) {
+        close(_fileDescriptor);
+        _fileDescriptor = -1;
+    }
+
+    //已经映射的NSData在文件删除后仍然可以访问
+    if (_filePath) {
+        unlink(_filePath.fileSystemRepresentation);
+        _filePath = nil;
+    }
+}
+
+@end
+
 #pragma mark -
 //此类遵守NSURLSession相关协议，方便外部直接调用协议方法
 @interface AFURLSessionManagerTaskDelegate : NSObject <NSURLSessionTaskDelegate, NSURLSessionDataDelegate, NSURLSessionDownloadDelegate>
@@ -99,8 +280,8 @@ typedef void (^AFURLSessionTaskCompletionHandler)(NSURLResponse *response, id re
 //weak防止循环引用（manager持有task，task和delegate是绑定的，相当于manager是持有delegate的）
 @property (nonatomic, weak) AFURLSessionManager *manager;
 
-//可变data用于存储获取到的网络数据
-@property (nonatomic, strong) NSMutableData *mutableData;
+//存储获取到的网络数据，数据块不做拷贝
+@property (nonatomic, strong) AFURLSessionManagerBodyBuffer *bodyBuffer;
 
 //上传进度NSProgress
 @property (nonatomic, strong) NSProgress *uploadProgress;
@@ -126,6 +307,16 @@ typedef void (^AFURLSessionTaskCompletionHandler)(NSURLResponse *response, id re
 
 //网络请求完成的回调块
 @property (nonatomic, copy) AFURLSessionTaskCompletionHandler completionHandler;
+
+//是否已经询问过responseSerializer要不要做增量解析，只在收到第一块数据时决定一次
+@property (nonatomic, assign) BOOL didPrepareIncrementalParser;
+
+//增量解析器以及创建它的序列化器，数据一边到达一边解析
+@property (nonatomic, strong) id <AFURLResponseIncrementalParsing> incrementalParser;
+@property (nonatomic, strong) id <AFURLResponseIncrementalSerialization> incrementalSerializer;
+
+//每个task私有的串行队列，保证数据块按顺序喂给解析器，完成时也在这个队列上收尾
+@property (nonatomic, strong) dispatch_queue_t incrementalParsingQueue;
 @end
 
 @implementation AFURLSessionManagerTaskDelegate
@@ -136,7 +327,7 @@ typedef void (^AFURLSessionTaskCompletionHandler)(NSURLResponse *response, id re
         return nil;
     }
     
-    _mutableData = [NSMutableData data];
+    _bodyBuffer = [[AFURLSessionManagerBodyBuffer alloc] init];
     _uploadProgress = [[NSProgress alloc] initWithParent:nil userInfo:nil];
     _downloadProgress = [[NSProgress alloc] initWithParent:nil userInfo:nil];
     
@@ -231,11 +422,18 @@ didCompleteWithError:(NSError *)error
 
     //Performance Improvement from #2672
     //具体可以查看#issue 2672。这里主要是针对大文件的时候，性能提升会很明显
+    //数据块只是拼接起来，不再像[mutableData copy]那样在完成时把整个响应再复制一份
     NSData *data = nil;
-    if (self.mutableData) {
-        data = [self.mutableData copy];
+    //数据转存在临时文件中时，要等completionHandler返回后才删除文件
+    AFURLSessionManagerBodyBuffer *bodyBuffer = self.bodyBuffer;
+    if (bodyBuffer) {
+        data = [bodyBuffer data];
+        //写临时文件失败时没有完整的数据，按请求失败处理
+        if (!error && bodyBuffer.error) {
+            error = bodyBuffer.error;
+        }
         //We no longer need the reference, so nil it out to gain back some memory.
-        self.mutableData = nil;
+        self.bodyBuffer = nil;
     }
 
 #if AF_CAN_USE_AT_AVAILABLE && AF_CAN_INCLUDE_SESSION_TASK_METRICS
@@ -266,6 +464,7 @@ didCompleteWithError:(NSError *)error
             if (self.completionHandler) {
                 self.completionHandler(task.response, responseObject, error);
             }
+            [bodyBuffer removeFile];
 
             //主线程中发送完成通知
             dispatch_async(dispatch_get_main_queue(), ^{
@@ -275,10 +474,16 @@ didCompleteWithError:(NSError *)error
     } else {//在没有error时，会先对数据进行一次序列化操作，然后下面的处理就和有error的那部分一样了
         // 请求成功了,为什么还要异步呢?
         // response 序列化 : 类型比较多.如 200 300 400 500
-        dispatch_async(url_session_manager_processing_queue(), ^{
+        // 有增量解析器时排在最后一块数据后面执行，此时对象树已经基本构建完成
+        dispatch_queue_t serializationQueue = self.incrementalParsingQueue ?: url_session_manager_processing_queue();
+        dispatch_async(serializationQueue, ^{
             NSError *serializationError = nil;
             // 根据对应的task和data将response data解析成可用的数据格式，比如JSON serializer就将data解析成JSON格式
-            responseObject = [manager.responseSerializer responseObjectForResponse:task.response data:data error:&serializationError];
+            if (self.incrementalParser && self.incrementalSerializer == manager.responseSerializer) {
+                responseObject = [self.incrementalSerializer responseObjectForResponse:task.response data:data incrementalParser:self.incrementalParser error:&serializationError];
+            } else {
+                responseObject = [manager.responseSerializer responseObjectForResponse:task.response data:data error:&serializationError];
+            }
 
              // 注意如果有downloadFileURL，意味着data存放在了磁盘上了，所以此处responseObject保存的是data存放位置，供后面completionHandler处理。没有downloadFileURL，就直接使用内存中的解析后的data数据
             if (self.downloadFileURL) {
@@ -301,6 +506,7 @@ didCompleteWithError:(NSError *)error
                 if (self.completionHandler) {
                     self.completionHandler(task.response, responseObject, serializationError);
                 }
+                [bodyBuffer removeFile];
 
                 //主线程发送通知
                 dispatch_async(dispatch_get_main_queue(), ^{
@@ -328,9 +534,35 @@ didFinishCollectingMetrics:(NSURLSessionTaskMetrics *)metrics AF_API_AVAILABLE(i
     self.downloadProgress.totalUnitCount = dataTask.countOfBytesExpectedToReceive;
     self.downloadProgress.completedUnitCount = dataTask.countOfBytesReceived;
 
-    //拼接数据
-    NSLog(@"delete--%@",[NSThread currentThread]);
-    [self.mutableData appendData:data];
+    //拼接数据，日志记录在内存中，关闭时不会编译进来
+    AFLogTrace(AFLogCategorySession, @"task %lu received %lu bytes", (unsigned long)dataTask.taskIdentifier, (unsigned long)data.length);
+    [self.bodyBuffer appendData:data];
+
+    [self appendIncrementalData:data forDataTask:dataTask];
+}
+
+//responseSerializer支持增量解析时，把数据块异步喂给解析器
+- (void)appendIncrementalData:(NSData *)data forDataTask:(NSURLSessionDataTask *)dataTask {
+    if (!self.didPrepareIncrementalParser) {
+        self.didPrepareIncrementalParser = YES;
+
+        id <AFURLResponseSerialization> responseSerializer = self.manager.responseSerializer;
+        if ([responseSerializer conformsToProtocol:@protocol(AFURLResponseIncrementalSerialization)]) {
+            id <AFURLResponseIncrementalSerialization> incrementalSerializer = (id <AFURLResponseIncrementalSerialization>)responseSerializer;
+            self.incrementalParser = [incrementalSerializer incrementalParserForResponse:dataTask.response];
+            if (self.incrementalParser) {
+                self.incrementalSerializer = incrementalSerializer;
+                self.incrementalParsingQueue = dispatch_queue_create("com.alamofire.networking.session.manager.parsing", DISPATCH_QUEUE_SERIAL);
+            }
+        }
+    }
+
+    id <AFURLResponseIncrementalParsing> parser = self.incrementalParser;
+    if (parser) {
+        dispatch_async(self.incrementalParsingQueue, ^{
+            [parser appendData:data];
+        });
+    }
 }
 
 - (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task
@@ -561,6 +793,200 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
 }
 @end
 
+#pragma mark -
+
+enum {
+    // 必须是2的幂
+    AFTaskDelegateMapStripeCount = 16,
+    AFTaskDelegateMapInitialCapacity = 16,
+};
+
+typedef struct {
+    pthread_mutex_t lock;
+    NSUInteger *keys;
+    // 通过CFBridgingRetain持有的delegate，NULL表示空槽
+    void **values;
+    // 2的幂
+    NSUInteger capacity;
+    NSUInteger count;
+} AFTaskDelegateMapStripe;
+
+static inline NSUInteger AFTaskIdentifierHash(NSUInteger taskIdentifier) {
+    return (NSUInteger)(((uint64_t)taskIdentifier * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static inline NSUInteger AFTaskDelegateMapHomeSlot(const AFTaskDelegateMapStripe *stripe, NSUInteger taskIdentifier) {
+    // 低位已经用来选段了
+    return (AFTaskIdentifierHash(taskIdentifier) / AFTaskDelegateMapStripeCount) & (stripe->capacity - 1);
+}
+
+static void AFTaskDelegateMapStripeResize(AFTaskDelegateMapStripe *stripe, NSUInteger capacity) {
+    NSUInteger *oldKeys = stripe->keys;
+    void **oldValues = stripe->values;
+    NSUInteger oldCapacity = stripe->capacity;
+
+    stripe->keys = calloc(capacity, sizeof(NSUInteger));
+    stripe->values = calloc(capacity, sizeof(void *));
+    stripe->capacity = capacity;
+
+    for (NSUInteger i = 0; i < oldCapacity; i++) {
+        if (!oldValues[i]) {
+            continue;
+        }
+        NSUInteger slot = AFTaskDelegateMapHomeSlot(stripe, oldKeys[i]);
+        while (stripe->values[slot]) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        stripe->keys[slot] = oldKeys[i];
+        stripe->values[slot] = oldValues[i];
+    }
+
+    free(oldKeys);
+    free(oldValues);
+}
+
+//以taskIdentifier为key的线性探测哈希表，按key分成多段，每段一把锁
+//查找时不需要把taskIdentifier装箱成NSNumber，不同task的回调也很少会争用同一把锁
+@interface AFURLSessionManagerTaskDelegateMap : NSObject
+
+- (AFURLSessionManagerTaskDelegate *)delegateForTaskIdentifier:(NSUInteger)taskIdentifier;
+
+- (void)setDelegate:(AFURLSessionManagerTaskDelegate *)delegate forTaskIdentifier:(NSUInteger)taskIdentifier;
+
+- (void)removeDelegateForTaskIdentifier:(NSUInteger)taskIdentifier;
+
+@end
+
+@implementation AFURLSessionManagerTaskDelegateMap {
+    AFTaskDelegateMapStripe _stripes[AFTaskDelegateMapStripeCount];
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    for (NSUInteger i = 0; i < AFTaskDelegateMapStripeCount; i++) {
+        pthread_mutex_init(&_stripes[i].lock, NULL);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    for (NSUInteger i = 0; i < AFTaskDelegateMapStripeCount; i++) {
+        AFTaskDelegateMapStripe *stripe = &_stripes[i];
+        for (NSUInteger slot = 0; slot < stripe->capacity; slot++) {
+            if (stripe->values[slot]) {
+                CFRelease(stripe->values[slot]);
+            }
+        }
+        free(stripe->keys);
+        free(stripe->values);
+        pthread_mutex_destroy(&stripe->lock);
+    }
+}
+
+- (AFTaskDelegateMapStripe *)stripeForTaskIdentifier:(NSUInteger)taskIdentifier {
+    return &_stripes[AFTaskIdentifierHash(taskIdentifier) & (AFTaskDelegateMapStripeCount - 1)];
+}
+
+- (AFURLSessionManagerTaskDelegate *)delegateForTaskIdentifier:(NSUInteger)taskIdentifier {
+    AFTaskDelegateMapStripe *stripe = [self stripeForTaskIdentifier:taskIdentifier];
+    AFURLSessionManagerTaskDelegate *delegate = nil;
+
+    pthread_mutex_lock(&stripe->lock);
+    if (stripe->count > 0) {
+        NSUInteger slot = AFTaskDelegateMapHomeSlot(stripe, taskIdentifier);
+        while (stripe->values[slot]) {
+            if (stripe->keys[slot] == taskIdentifier) {
+                delegate = (__bridge AFURLSessionManagerTaskDelegate *)stripe->values[slot];
+                break;
+            }
+            slot = (slot + 1) & (stripe->capacity - 1);
+        }
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    return delegate;
+}
+
+- (void)setDelegate:(AFURLSessionManagerTaskDelegate *)delegate forTaskIdentifier:(NSUInteger)taskIdentifier {
+    AFTaskDelegateMapStripe *stripe = [self stripeForTaskIdentifier:taskIdentifier];
+    void *value = (void *)CFBridgingRetain(delegate);
+    void *replacedValue = NULL;
+
+    pthread_mutex_lock(&stripe->lock);
+    // 装载率不超过3/4
+    if (stripe->capacity == 0) {
+        AFTaskDelegateMapStripeResize(stripe, AFTaskDelegateMapInitialCapacity);
+    } else if ((stripe->count + 1) * 4 > stripe->capacity * 3) {
+        AFTaskDelegateMapStripeResize(stripe, stripe->capacity * 2);
+    }
+
+    NSUInteger slot = AFTaskDelegateMapHomeSlot(stripe, taskIdentifier);
+    while (stripe->values[slot] && stripe->keys[slot] != taskIdentifier) {
+        slot = (slot + 1) & (stripe->capacity - 1);
+    }
+    if (stripe->values[slot]) {
+        replacedValue = stripe->values[slot];
+    } else {
+        stripe->count++;
+    }
+    stripe->keys[slot] = taskIdentifier;
+    stripe->values[slot] = value;
+    pthread_mutex_unlock(&stripe->lock);
+
+    // 在锁外释放，避免delegate的dealloc在持有锁时执行
+    if (replacedValue) {
+        CFRelease(replacedValue);
+    }
+}
+
+- (void)removeDelegateForTaskIdentifier:(NSUInteger)taskIdentifier {
+    AFTaskDelegateMapStripe *stripe = [self stripeForTaskIdentifier:taskIdentifier];
+    void *removedValue = NULL;
+
+    pthread_mutex_lock(&stripe->lock);
+    if (stripe->count > 0) {
+        NSUInteger mask = stripe->capacity - 1;
+        NSUInteger slot = AFTaskDelegateMapHomeSlot(stripe, taskIdentifier);
+        while (stripe->values[slot] && stripe->keys[slot] != taskIdentifier) {
+            slot = (slot + 1) & mask;
+        }
+
+        if (stripe->values[slot]) {
+            removedValue = stripe->values[slot];
+            stripe->values[slot] = NULL;
+            stripe->count--;
+
+            // 把后面同一探测链上的元素前移，不需要墓碑标记
+            NSUInteger emptySlot = slot;
+            NSUInteger nextSlot = (slot + 1) & mask;
+            while (stripe->values[nextSlot]) {
+                NSUInteger homeSlot = AFTaskDelegateMapHomeSlot(stripe, stripe->keys[nextSlot]);
+                // homeSlot不在(emptySlot, nextSlot]这个循环区间内时，说明它可以移到空出来的位置
+                BOOL canMove = emptySlot <= nextSlot ? (homeSlot <= emptySlot || homeSlot > nextSlot) : (homeSlot <= emptySlot && homeSlot > nextSlot);
+                if (canMove) {
+                    stripe->keys[emptySlot] = stripe->keys[nextSlot];
+                    stripe->values[emptySlot] = stripe->values[nextSlot];
+                    stripe->values[nextSlot] = NULL;
+                    emptySlot = nextSlot;
+                }
+                nextSlot = (nextSlot + 1) & mask;
+            }
+        }
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    if (removedValue) {
+        CFRelease(removedValue);
+    }
+}
+
+@end
+
 #pragma mark -
 /* 隐式声明 */
 @interface AFURLSessionManager ()
@@ -570,12 +996,10 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
 @property (readwrite, nonatomic, strong) NSOperationQueue *operationQueue;
 //管理的session
 @property (readwrite, nonatomic, strong) NSURLSession *session;
-//可变字典，key是NSURLSessionTask的唯一NSUInteger类型标识，value是对应的AFURLSessionManagerTaskDelgate对象
-@property (readwrite, nonatomic, strong) NSMutableDictionary *mutableTaskDelegatesKeyedByTaskIdentifier;
+//key是NSURLSessionTask的唯一NSUInteger类型标识，value是对应的AFURLSessionManagerTaskDelgate对象
+@property (readwrite, nonatomic, strong) AFURLSessionManagerTaskDelegateMap *taskDelegatesKeyedByTaskIdentifier;
 //只读属性，通过getter返回数据
 @property (readonly, nonatomic, copy) NSString *taskDescriptionForSessionTasks;
-//NSLock锁
-@property (readwrite, nonatomic, strong) NSLock *lock;
 @property (readwrite, nonatomic, copy) AFURLSessionDidBecomeInvalidBlock sessionDidBecomeInvalid;
 @property (readwrite, nonatomic, copy) AFURLSessionDidReceiveAuthenticationChallengeBlock sessionDidReceiveAuthenticationChallenge;
 @property (readwrite, nonatomic, copy) AFURLSessionDidFinishEventsForBackgroundURLSessionBlock didFinishEventsForBackgroundURLSession AF_API_UNAVAILABLE(macos);
@@ -643,11 +1067,8 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
 #endif
     //为什么要收集: cancel resume supend : task : id
     //delegate= value taskid = key 设置存储NSURL task与AFURLSessionManagerTaskDelegate的词典（重点，在AFNet中，每一个task都会被匹配一个AFURLSessionManagerTaskDelegate 来做task的delegate事件处理） ===============
-    self.mutableTaskDelegatesKeyedByTaskIdentifier = [[NSMutableDictionary alloc] init];
-
-    //使用NSLock确保线程安全 //  设置AFURLSessionManagerTaskDelegate 词典的锁，确保词典在多线程访问时的线程安全
-    self.lock = [[NSLock alloc] init];
-    self.lock.name = AFURLSessionManagerLockName;
+    //内部按taskIdentifier分段加锁，确保多线程访问时的线程安全
+    self.taskDelegatesKeyedByTaskIdentifier = [[AFURLSessionManagerTaskDelegateMap alloc] init];
 
     //异步的获取当前session的所有未完成的task。其实讲道理来说在初始化中调用这个方法应该里面一个task都不会有
     //后台任务重新回来初始化session，可能就会有先前的任务 // 置空task关联的代理
@@ -726,13 +1147,8 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
 - (AFURLSessionManagerTaskDelegate *)delegateForTask:(NSURLSessionTask *)task {
     //task不能为空
     NSParameterAssert(task);
-    //上锁，通过task的唯一taskIdentifier从字典中取值，这个唯一标识是在创建task的时候NSURLSessionTask为其设置的，不需要手动设置，保证唯一性
-    AFURLSessionManagerTaskDelegate *delegate = nil;
-    [self.lock lock];
-    delegate = self.mutableTaskDelegatesKeyedByTaskIdentifier[@(task.taskIdentifier)];
-    [self.lock unlock];
-
-    return delegate;
+    //通过task的唯一taskIdentifier取值，这个唯一标识是在创建task的时候NSURLSessionTask为其设置的，不需要手动设置，保证唯一性
+    return [self.taskDelegatesKeyedByTaskIdentifier delegateForTaskIdentifier:task.taskIdentifier];
 }
 
 //为task设置关联的delegate
@@ -743,15 +1159,12 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     NSParameterAssert(task);
     NSParameterAssert(delegate);
 
-    //加锁保证字典线程安全
-    [self.lock lock];
-    //将delegate存入字典，以taskid作为key，说明每个task都有各自的代理
-    // 将AF delegate放入以taskIdentifier标记的词典中（同一个NSURLSession中的taskIdentifier是唯一的
+    //将delegate存入表中，以taskid作为key，说明每个task都有各自的代理
+    // 将AF delegate放入以taskIdentifier标记的表中（同一个NSURLSession中的taskIdentifier是唯一的
     // task--->delegate
-    self.mutableTaskDelegatesKeyedByTaskIdentifier[@(task.taskIdentifier)] = delegate;
-    //添加task开始和暂停的通知
+    [self.taskDelegatesKeyedByTaskIdentifier setDelegate:delegate forTaskIdentifier:task.taskIdentifier];
+    //添加task开始和暂停的通知，NSNotificationCenter本身是线程安全的，不需要和表放在同一把锁里
     [self addNotificationObserverForTask:task];
-    [self.lock unlock];
 }
 
 /*
@@ -769,13 +1182,14 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     AFURLSessionManagerTaskDelegate *delegate = [[AFURLSessionManagerTaskDelegate alloc] initWithTask:dataTask];
     delegate.manager = self;
     delegate.completionHandler = completionHandler;
+    delegate.bodyBuffer.fileThreshold = self.responseDataFileThreshold;
 
     /*
     taskidentifier=key delegate=value,确保task唯一
     taskDescription自行设置的，区分是否是当前的session创建的
     */
     dataTask.taskDescription = self.taskDescriptionForSessionTasks;
-    //函数字面意思是将一个session task和一个AFURLSessionManagerTaskDelegate类型的delegate变量绑在一起，而这个绑在一起的工作是由我们的AFURLSessionManager所做。至于绑定的过程，就是以该session task的taskIdentifier为key，delegate为value，赋值给mutableTaskDelegatesKeyedByTaskIdentifier这个NSMutableDictionary类型的变量。知道了这两者是关联在一起的话，马上就会产生另外的问题 —— 为什么要关联以及怎么关联在一起？
+    //函数字面意思是将一个session task和一个AFURLSessionManagerTaskDelegate类型的delegate变量绑在一起，而这个绑在一起的工作是由我们的AFURLSessionManager所做。至于绑定的过程，就是以该session task的taskIdentifier为key，delegate为value，存入taskDelegatesKeyedByTaskIdentifier这张哈希表。知道了这两者是关联在一起的话，马上就会产生另外的问题 —— 为什么要关联以及怎么关联在一起？
     [self setDelegate:delegate forTask:dataTask];
 
     //设置回调块
@@ -796,6 +1210,7 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     AFURLSessionManagerTaskDelegate *delegate = [[AFURLSessionManagerTaskDelegate alloc] initWithTask:uploadTask];
     delegate.manager = self;
     delegate.completionHandler = completionHandler;
+    delegate.bodyBuffer.fileThreshold = self.responseDataFileThreshold;
 
     uploadTask.taskDescription = self.taskDescriptionForSessionTasks;
 
@@ -839,10 +1254,8 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
 - (void)removeDelegateForTask:(NSURLSessionTask *)task {
     NSParameterAssert(task);
 
-    [self.lock lock];
     [self removeNotificationObserverForTask:task];
-    [self.mutableTaskDelegatesKeyedByTaskIdentifier removeObjectForKey:@(task.taskIdentifier)];
-    [self.lock unlock];
+    [self.taskDelegatesKeyedByTaskIdentifier removeDelegateForTaskIdentifier:task.taskIdentifier];
 }
 
 /*
@@ -73,6 +73,14 @@ NS_ASSUME_NONNULL_BEGIN
 // 是否验证证书中的域名domain
 @property (nonatomic, assign) BOOL validatesDomainName;
 
+/**
+ How long, in seconds, a successful evaluation with SSL pinning enabled is remembered. Later challenges presenting the same leaf certificate for the same domain are accepted without evaluating the trust again. Defaults to `60`. Set to `0` to evaluate every challenge.
+
+ The cache is cleared whenever any of the properties affecting evaluation changes.
+ */
+// 开启SSL Pinning时，评估成功的结果按叶子证书摘要和域名缓存的时长。为0时不缓存
+@property (nonatomic, assign) NSTimeInterval evaluationCacheTimeout;
+
 ///-----------------------------------------
 /// @name Getting Certificates from the Bundle
 ///-----------------------------------------
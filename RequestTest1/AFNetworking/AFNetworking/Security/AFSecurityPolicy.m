@@ -22,6 +22,17 @@
 #import "AFSecurityPolicy.h"
 
 #import <AssertMacros.h>
+#import <CommonCrypto/CommonDigest.h>
+
+// 评估结果缓存的最大条数
+static NSUInteger const AFSecurityPolicyEvaluationCacheCountLimit = 64;
+
+static NSData * AFSHA256DigestForData(NSData *data) {
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(data.bytes, (CC_LONG)data.length, digest);
+
+    return [NSData dataWithBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+}
 // 将key转为data
 #if !TARGET_OS_IOS && !TARGET_OS_WATCH && !TARGET_OS_TV
 static NSData * AFSecKeyGetData(SecKeyRef key) {
@@ -49,6 +60,19 @@ static BOOL AFSecKeyIsEqualToKey(SecKeyRef key1, SecKeyRef key2) {
     return [AFSecKeyGetData(key1) isEqual:AFSecKeyGetData(key2)];
 #endif
 }
+// 公钥外部表示的SHA-256摘要，取不到时返回nil，调用方退回到逐个比较公钥
+static NSData * AFSecKeyDigest(SecKeyRef key) {
+    NSData *keyData = nil;
+#if TARGET_OS_IOS || TARGET_OS_WATCH || TARGET_OS_TV
+    if (@available(iOS 10, watchOS 3, tvOS 10, *)) {
+        keyData = (__bridge_transfer NSData *)SecKeyCopyExternalRepresentation(key, NULL);
+    }
+#else
+    keyData = AFSecKeyGetData(key);
+#endif
+
+    return keyData ? AFSHA256DigestForData(keyData) : nil;
+}
 // 此函数没什么特别要提及的，和AFPublicKeyTrustChainForServerTrust实现的原理基本一致
 // 区别仅仅在该函数是返回单个证书的公钥（所以传入的参数是一个证书），而AFPublicKeyTrustChainForServerTrust返回的是serverTrust的证书链中所有证书公钥
 static id AFPublicKeyForCertificate(NSData *certificate) {
@@ -157,6 +181,14 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     for (CFIndex i = 0; i < certificateCount; i++) {
         //从证书链取证书
         SecCertificateRef certificate = SecTrustGetCertificateAtIndex(serverTrust, i);
+        // 系统支持时直接从证书读取公钥，不必为每个证书创建并评估trust
+        if (@available(iOS 12, macOS 10.14, watchOS 5, tvOS 12, *)) {
+            id publicKey = (__bridge_transfer id)SecCertificateCopyKey(certificate);
+            if (publicKey) {
+                [trustChain addObject:publicKey];
+            }
+            continue;
+        }
         //数组
         SecCertificateRef someCertificates[] = {certificate};
         //CF数组
@@ -200,6 +232,12 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
 @property (readwrite, nonatomic, assign) AFSSLPinningMode SSLPinningMode;
 // 公钥集合
 @property (readwrite, nonatomic, strong) NSSet *pinnedPublicKeys;
+// 公钥摘要集合，有任一公钥取不到摘要时为nil
+@property (readwrite, nonatomic, strong) NSSet <NSData *> *pinnedPublicKeyDigests;
+// 转换好的SecCertificateRef，作为锚点证书
+@property (readwrite, nonatomic, strong) NSArray *pinnedCertificateRefs;
+// 叶子证书摘要+域名 -> 过期时间
+@property (readwrite, nonatomic, strong) NSCache <NSData *, NSNumber *> *evaluationCache;
 @end
 
 @implementation AFSecurityPolicy
@@ -247,6 +285,9 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     }
     // 默认验证证书中的域名
     self.validatesDomainName = YES;
+    self.evaluationCacheTimeout = 60;
+    self.evaluationCache = [[NSCache alloc] init];
+    self.evaluationCache.countLimit = AFSecurityPolicyEvaluationCacheCountLimit;
 
     return self;
 }
@@ -258,8 +299,14 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     if (self.pinnedCertificates) {
         //创建公钥集合
         NSMutableSet *mutablePinnedPublicKeys = [NSMutableSet setWithCapacity:[self.pinnedCertificates count]];
+        NSMutableSet *mutablePinnedPublicKeyDigests = [NSMutableSet setWithCapacity:[self.pinnedCertificates count]];
+        NSMutableArray *mutablePinnedCertificateRefs = [NSMutableArray arrayWithCapacity:[self.pinnedCertificates count]];
         //从证书中拿到公钥。publicKey 是用 RSA 加密的
         for (NSData *certificate in self.pinnedCertificates) {
+            id certificateRef = (__bridge_transfer id)SecCertificateCreateWithData(NULL, (__bridge CFDataRef)certificate);
+            if (certificateRef) {
+                [mutablePinnedCertificateRefs addObject:certificateRef];
+            }
             // 取出合法的公钥
             // 传输 -- session -- 验证所有证书信息
             id publicKey = AFPublicKeyForCertificate(certificate);
@@ -267,11 +314,119 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
                 continue;
             }
             [mutablePinnedPublicKeys addObject:publicKey];
+
+            NSData *publicKeyDigest = AFSecKeyDigest((__bridge SecKeyRef)publicKey);
+            if (publicKeyDigest) {
+                [mutablePinnedPublicKeyDigests addObject:publicKeyDigest];
+            } else {
+                mutablePinnedPublicKeyDigests = nil;
+            }
         }
         self.pinnedPublicKeys = [NSSet setWithSet:mutablePinnedPublicKeys];
+        self.pinnedPublicKeyDigests = mutablePinnedPublicKeyDigests ? [NSSet setWithSet:mutablePinnedPublicKeyDigests] : nil;
+        self.pinnedCertificateRefs = [NSArray arrayWithArray:mutablePinnedCertificateRefs];
     } else {
         self.pinnedPublicKeys = nil;
+        self.pinnedPublicKeyDigests = nil;
+        self.pinnedCertificateRefs = nil;
+    }
+
+    [self.evaluationCache removeAllObjects];
+}
+
+// 下面几项会影响评估结果，修改时清空缓存
+- (void)setSSLPinningMode:(AFSSLPinningMode)SSLPinningMode {
+    _SSLPinningMode = SSLPinningMode;
+    [self.evaluationCache removeAllObjects];
+}
+
+- (void)setAllowInvalidCertificates:(BOOL)allowInvalidCertificates {
+    _allowInvalidCertificates = allowInvalidCertificates;
+    [self.evaluationCache removeAllObjects];
+}
+
+- (void)setValidatesDomainName:(BOOL)validatesDomainName {
+    _validatesDomainName = validatesDomainName;
+    [self.evaluationCache removeAllObjects];
+}
+
+- (void)setEvaluationCacheTimeout:(NSTimeInterval)evaluationCacheTimeout {
+    _evaluationCacheTimeout = evaluationCacheTimeout;
+    [self.evaluationCache removeAllObjects];
+}
+
+#pragma mark -
+
+// 缓存的key：叶子证书DER数据的SHA-256摘要，加上需要验证的域名
+- (NSData *)evaluationCacheKeyForServerTrust:(SecTrustRef)serverTrust domain:(NSString *)domain {
+    if (self.evaluationCacheTimeout <= 0 || SecTrustGetCertificateCount(serverTrust) == 0) {
+        return nil;
+    }
+
+    NSData *leafCertificate = (__bridge_transfer NSData *)SecCertificateCopyData(SecTrustGetCertificateAtIndex(serverTrust, 0));
+    if (!leafCertificate) {
+        return nil;
     }
+
+    NSMutableData *key = [AFSHA256DigestForData(leafCertificate) mutableCopy];
+    if (self.validatesDomainName && domain) {
+        [key appendData:[domain dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+
+    return key;
+}
+
+- (BOOL)hasCachedEvaluationForKey:(NSData *)key {
+    if (!key) {
+        return NO;
+    }
+
+    NSNumber *expiration = [self.evaluationCache objectForKey:key];
+    if (!expiration) {
+        return NO;
+    } else if (expiration.doubleValue <= [NSProcessInfo processInfo].systemUptime) {
+        [self.evaluationCache removeObjectForKey:key];
+        return NO;
+    }
+
+    return YES;
+}
+
+// 只缓存成功的评估结果，失败的每次都重新评估
+- (void)cacheEvaluationForKey:(NSData *)key {
+    if (!key) {
+        return;
+    }
+
+    // systemUptime不受系统时间修改的影响
+    [self.evaluationCache setObject:@([NSProcessInfo processInfo].systemUptime + self.evaluationCacheTimeout) forKey:key];
+}
+
+// 服务端公钥链中是否有本地绑定的公钥
+- (BOOL)pinnedPublicKeysContainPublicKeyInServerTrust:(SecTrustRef)serverTrust {
+    NSSet *pinnedPublicKeyDigests = self.pinnedPublicKeyDigests;
+    // 从serverTrust中取出服务器端传过来的所有可用的证书，并依次得到相应的公钥
+    NSArray *publicKeys = AFPublicKeyTrustChainForServerTrust(serverTrust);
+    //遍历服务端公钥
+    for (id trustChainPublicKey in publicKeys) {
+        // 有摘要时查一次集合即可
+        NSData *publicKeyDigest = pinnedPublicKeyDigests ? AFSecKeyDigest((__bridge SecKeyRef)trustChainPublicKey) : nil;
+        if (publicKeyDigest) {
+            if ([pinnedPublicKeyDigests containsObject:publicKeyDigest]) {
+                return YES;
+            }
+            continue;
+        }
+
+        //遍历本地公钥
+        for (id pinnedPublicKey in self.pinnedPublicKeys) {
+            if (AFSecKeyIsEqualToKey((__bridge SecKeyRef)trustChainPublicKey, (__bridge SecKeyRef)pinnedPublicKey)) {
+                return YES;
+            }
+        }
+    }
+
+    return NO;
 }
 
 #pragma mark -
@@ -303,6 +458,12 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
         //不受信任，返回
         return NO;
     }
+
+    // 同一个叶子证书在有效期内已经评估通过，不再重复构建证书链和比较公钥
+    NSData *evaluationCacheKey = self.SSLPinningMode != AFSSLPinningModeNone ? [self evaluationCacheKeyForServerTrust:serverTrust domain:domain] : nil;
+    if ([self hasCachedEvaluationForKey:evaluationCacheKey]) {
+        return YES;
+    }
     //用来装验证策略
     NSMutableArray *policies = [NSMutableArray array];
     //生成验证策略。如果要验证域名，就以域名为参数创建一个策略，否则创建默认的basicX509策略
@@ -335,13 +496,8 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
         // 注意客户端保存的证书存放在self.pinnedCertificates中
         case AFSSLPinningModeCertificate: {
             // 全部校验（nsbundle .cer）
-            NSMutableArray *pinnedCertificates = [NSMutableArray array];
-            //把证书data，用系统api转成 SecCertificateRef 类型的数据,SecCertificateCreateWithData函数对原先的pinnedCertificates做一些处理，保证返回的证书都是DER编码的X.509证书
-            for (NSData *certificateData in self.pinnedCertificates) {
-                //cf arc brige：cf对象和oc对象转化 __bridge_transfer：把cf对象转化成oc对象
-                //brige retain:oc转成cf对象
-                [pinnedCertificates addObject:(__bridge_transfer id)SecCertificateCreateWithData(NULL, (__bridge CFDataRef)certificateData)];
-            }
+            // 设置pinnedCertificates时已经用SecCertificateCreateWithData转成了SecCertificateRef，保证都是DER编码的X.509证书
+            NSArray *pinnedCertificates = self.pinnedCertificateRefs ?: @[];
             // 将pinnedCertificates设置成需要参与验证的Anchor Certificate（锚点证书，通过SecTrustSetAnchorCertificates设置了参与校验锚点证书之后，假如验证的数字证书是这个锚点证书的子节点，即验证的数字证书是由锚点证书对应CA或子CA签发的，或是该证书本身，则信任该证书），具体就是调用SecTrustEvaluate来验证
              //serverTrust是服务器来的验证，有需要被验证的证书
             // 把本地证书设置为根证书，
@@ -363,6 +519,7 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
                 //如果我们的证书中，有一个和它证书链中的证书匹配的，就返回YES
                 // 是否本地包含相同的data
                 if ([self.pinnedCertificates containsObject:trustChainCertificate]) {
+                    [self cacheEvaluationForKey:evaluationCacheKey];
                     return YES;
                 }
             }
@@ -371,20 +528,11 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
         }
             //公钥验证 AFSSLPinningModePublicKey模式同样是用证书绑定(SSL Pinning)方式验证，客户端要有服务端的证书拷贝，只是验证时只验证证书里的公钥，不验证证书的有效期等信息。只要公钥是正确的，就能保证通信不会被窃听，因为中间人没有私钥，无法解开通过公钥加密的数据
         case AFSSLPinningModePublicKey: {
-            NSUInteger trustedPublicKeyCount = 0;
-            // 从serverTrust中取出服务器端传过来的所有可用的证书，并依次得到相应的公钥
-            NSArray *publicKeys = AFPublicKeyTrustChainForServerTrust(serverTrust);
-            //遍历服务端公钥
-            for (id trustChainPublicKey in publicKeys) {
-                //遍历本地公钥
-                for (id pinnedPublicKey in self.pinnedPublicKeys) {
-                    //判断如果相同 trustedPublicKeyCount+1
-                    if (AFSecKeyIsEqualToKey((__bridge SecKeyRef)trustChainPublicKey, (__bridge SecKeyRef)pinnedPublicKey)) {
-                        trustedPublicKeyCount += 1;
-                    }
-                }
+            if (![self pinnedPublicKeysContainPublicKeyInServerTrust:serverTrust]) {
+                return NO;
             }
-            return trustedPublicKeyCount > 0;
+            [self cacheEvaluationForKey:evaluationCacheKey];
+            return YES;
         }
             //上一部分已经判断过了，如果执行到这里的话就返回NO
         default:
@@ -417,6 +565,9 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     self.allowInvalidCertificates = [decoder decodeBoolForKey:NSStringFromSelector(@selector(allowInvalidCertificates))];
     self.validatesDomainName = [decoder decodeBoolForKey:NSStringFromSelector(@selector(validatesDomainName))];
     self.pinnedCertificates = [decoder decodeObjectOfClass:[NSSet class] forKey:NSStringFromSelector(@selector(pinnedCertificates))];
+    if ([decoder containsValueForKey:NSStringFromSelector(@selector(evaluationCacheTimeout))]) {
+        self.evaluationCacheTimeout = [decoder decodeDoubleForKey:NSStringFromSelector(@selector(evaluationCacheTimeout))];
+    }
 
     return self;
 }
@@ -426,6 +577,7 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     [coder encodeBool:self.allowInvalidCertificates forKey:NSStringFromSelector(@selector(allowInvalidCertificates))];
     [coder encodeBool:self.validatesDomainName forKey:NSStringFromSelector(@selector(validatesDomainName))];
     [coder encodeObject:self.pinnedCertificates forKey:NSStringFromSelector(@selector(pinnedCertificates))];
+    [coder encodeDouble:self.evaluationCacheTimeout forKey:NSStringFromSelector(@selector(evaluationCacheTimeout))];
 }
 
 #pragma mark - NSCopying
@@ -436,6 +588,7 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     securityPolicy.allowInvalidCertificates = self.allowInvalidCertificates;
     securityPolicy.validatesDomainName = self.validatesDomainName;
     securityPolicy.pinnedCertificates = [self.pinnedCertificates copyWithZone:zone];
+    securityPolicy.evaluationCacheTimeout = self.evaluationCacheTimeout;
 
     return securityPolicy;
 }
@@ -58,6 +58,19 @@ FOUNDATION_EXPORT NSString * AFPercentEscapedStringFromString(NSString *string);
 // 将{@"name":@"yourname",@"id":@"yourid"} 转换为 name=yourname&id=yourid
 FOUNDATION_EXPORT NSString * AFQueryStringFromParameters(NSDictionary *parameters);
 
+/**
+ Returns the bytes in a range of a multipart form body created by `multipartFormRequestWithMethod:URLString:parameters:constructingBodyWithBlock:error:`, without reading the bytes before it.
+
+ Parts appended from data or file URLs can be read in any order. Parts appended with `appendPartWithInputStream:name:fileName:length:mimeType:` cannot, and make this function fail when the range covers their body.
+
+ @param bodyStream The `HTTPBodyStream` of the multipart form request. Reading a range does not change the position of the stream.
+ @param range The range of bytes to read, within the `Content-Length` of the request.
+ @param error The error that occurred while reading the range.
+
+ @return The bytes in the range, or `nil` if they could not be read.
+ */
+FOUNDATION_EXPORT NSData * _Nullable AFMultipartFormDataInRange(NSInputStream *bodyStream, NSRange range, NSError * _Nullable __autoreleasing * _Nullable error);
+
 /**
  The `AFURLRequestSerialization` protocol is adopted by an object that encodes parameters for a specified HTTP requests. Request serializers may encode parameters as query strings, HTTP bodies, setting the appropriate HTTP header fields as necessary.
 
@@ -91,8 +104,39 @@ FOUNDATION_EXPORT NSString * AFQueryStringFromParameters(NSDictionary *parameter
 typedef NS_ENUM(NSUInteger, AFHTTPRequestQueryStringSerializationStyle) {
     AFHTTPRequestQueryStringDefaultStyle = 0,
 };
+
+/**
+ ## Request Body Compression
+
+ `AFHTTPRequestBodyCompressionNone`
+ Request bodies are sent as they are.
+
+ `AFHTTPRequestBodyCompressionGzip`
+ Request bodies are compressed in the gzip format and sent with `Content-Encoding: gzip`.
+
+ `AFHTTPRequestBodyCompressionDeflate`
+ Request bodies are compressed in the zlib format and sent with `Content-Encoding: deflate`.
+ */
+// 请求body的压缩格式
+typedef NS_ENUM(NSUInteger, AFHTTPRequestBodyCompression) {
+    AFHTTPRequestBodyCompressionNone = 0,
+    AFHTTPRequestBodyCompressionGzip,
+    AFHTTPRequestBodyCompressionDeflate,
+};
+
+/**
+ Compresses data in one step with the given request body compression.
+
+ @param data The data to compress.
+ @param compression The compression to use.
+
+ @return The compressed data, or `nil` if `compression` is `AFHTTPRequestBodyCompressionNone` or the data could not be compressed.
+ */
+FOUNDATION_EXPORT NSData * _Nullable AFHTTPRequestBodyCompressedData(NSData *data, AFHTTPRequestBodyCompression compression);
 // 用于拼接可变data的一个协议
 @protocol AFMultipartFormData;
+@class AFHTTPRequestTemplate;
+@class AFJSONFieldMap;
 
 /**
  `AFHTTPRequestSerializer` conforms to the `AFURLRequestSerialization` & `AFURLResponseSerialization` protocols, offering a concrete base implementation of query string / URL form-encoded parameter serialization and default request headers, as well as response status code and content type validation.
@@ -177,6 +221,19 @@ typedef NS_ENUM(NSUInteger, AFHTTPRequestQueryStringSerializationStyle) {
  */
 @property (nonatomic, assign) NSTimeInterval timeoutInterval;
 
+/**
+ The compression applied to the bodies of created requests. `AFHTTPRequestBodyCompressionNone` by default.
+
+ In-memory bodies of up to 64 KB, such as most URL-form-encoded or JSON bodies, are compressed on the calling thread when the request is created, and sent with the compressed `Content-Length`, so upload progress is reported as usual. Larger in-memory bodies and streamed bodies, such as multipart forms, are replaced with a stream that compresses the original body while the request is being sent, so the compression runs on the session's thread instead of the calling thread. As the compressed length of a streamed body is not known in advance, its `Content-Length` header is removed: the request is sent with chunked transfer encoding, and its upload progress has no total. The `Content-Encoding` header is set in both cases. Requests that already have a `Content-Encoding` header are left unchanged. The server must accept the compressed encoding.
+ */
+// 请求body的压缩格式，默认不压缩。64KB以内的内存body创建请求时压缩一次；更大的body和流式body在发送请求时边读边压缩，没有Content-Length，上传进度没有总长度
+@property (nonatomic, assign) AFHTTPRequestBodyCompression requestBodyCompression;
+
+/**
+ The body length, in bytes, below which request bodies are sent uncompressed. `1024` by default. Streamed bodies without a `Content-Length` header are always compressed.
+ */
+@property (nonatomic, assign) NSUInteger requestBodyCompressionThreshold;
+
 ///---------------------------------------
 /// @name Configuring HTTP Request Headers
 ///---------------------------------------
@@ -286,6 +343,19 @@ forHTTPHeaderField:(NSString *)field;
                                          parameters:(nullable id)parameters
                                               error:(NSError * _Nullable __autoreleasing *)error;
 
+/**
+ Creates a request template with the specified HTTP method and base URL.
+
+ The template captures the current headers and request properties of the serializer, as well as a copy of its parameter serialization settings. Later changes to the serializer do not affect the template.
+
+ @param method The HTTP method for the requests, such as `GET`, `POST`, `PUT`, or `DELETE`. This parameter must not be `nil`.
+ @param baseURL The URL that request paths are resolved against.
+
+ @return An `AFHTTPRequestTemplate` object.
+ */
+- (AFHTTPRequestTemplate *)requestTemplateWithMethod:(NSString *)method
+                                             baseURL:(nullable NSURL *)baseURL;
+
 /**
  Creates an `NSMutableURLRequest` object with the specified HTTP method and URLString, and constructs a `multipart/form-data` HTTP body, using the specified parameters and multipart form data block. See http://www.w3.org/TR/html4/interact/forms.html#h-17.13.4.2
 
@@ -333,6 +403,40 @@ forHTTPHeaderField:(NSString *)field;
 
 #pragma mark -
 
+/**
+ `AFHTTPRequestTemplate` is an immutable, prepared form of a request serializer for one HTTP method and base URL. The method, headers and request properties are applied once when the template is created, so building a request from it only resolves the path and serializes the parameters.
+
+ Templates are created with `-[AFHTTPRequestSerializer requestTemplateWithMethod:baseURL:]`, and can be used from any thread.
+ */
+@interface AFHTTPRequestTemplate : NSObject
+
+/**
+ The HTTP method of the requests created from the template.
+ */
+@property (readonly, nonatomic, copy) NSString *HTTPMethod;
+
+/**
+ The URL that request paths are resolved against.
+ */
+@property (readonly, nonatomic, strong, nullable) NSURL *baseURL;
+
+/**
+ Creates an `NSMutableURLRequest` object for the specified path.
+
+ @param path The URL string of the request, relative to `baseURL`.
+ @param parameters The parameters to be either set as a query string or as the request HTTP body, as the serializer the template was created from would.
+ @param error The error that occurred while constructing the request.
+
+ @return An `NSMutableURLRequest` object.
+ */
+- (nullable NSMutableURLRequest *)requestWithPath:(NSString *)path
+                                       parameters:(nullable id)parameters
+                                            error:(NSError * _Nullable __autoreleasing *)error;
+
+@end
+
+#pragma mark -
+
 /**
  The `AFMultipartFormData` protocol defines the methods supported by the parameter in the block argument of `AFHTTPRequestSerializer -multipartFormRequestWithMethod:URLString:parameters:constructingBodyWithBlock:`.
  */
@@ -453,6 +557,22 @@ forHTTPHeaderField:(NSString *)field;
 // json序列化选项 默认使用NSJSONWritingPrettyPrinted
 @property (nonatomic, assign) NSJSONWritingOptions writingOptions;
 
+/**
+ The expected size of encoded request bodies, in bytes, used to pre-size the output buffer. `0` by default, in which case the size of the previously encoded body is used.
+
+ Parameters are validated and encoded in a single pass, straight into the output buffer. Objects the writer does not handle itself, such as `NSDecimalNumber`, fall back to `NSJSONSerialization`.
+ */
+// 预估的请求体大小，用来预分配输出缓冲区。为0时使用上一次编码出的长度
+@property (nonatomic, assign) NSUInteger bodySizeHint;
+
+/**
+ The field map used to encode model objects found in the parameters, including a top-level model object or array of models. Properties are written in the order of the field map, and `nil` properties are omitted. When the parameters fall back to `NSJSONSerialization`, model objects are first converted to dictionaries using the field map. `nil` by default.
+
+ @warning The field map is not archived with the serializer.
+ */
+// 编码参数中模型对象用的字段表，直接读取属性写出JSON，不需要先转成NSDictionary
+@property (nonatomic, strong, nullable) AFJSONFieldMap *fieldMap;
+
 /**
  Creates and returns a JSON serializer with specified reading and writing options.
 
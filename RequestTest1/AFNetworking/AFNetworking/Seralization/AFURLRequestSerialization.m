@@ -20,6 +20,10 @@
 // THE SOFTWARE.
 
 #import "AFURLRequestSerialization.h"
+#import "AFURLResponseSerialization.h"
+#import "AFLogging.h"
+#import <zlib.h>
+#import <stdatomic.h>
 
 #if TARGET_OS_IOS || TARGET_OS_WATCH || TARGET_OS_TV
 #import <MobileCoreServices/MobileCoreServices.h>
@@ -32,6 +36,97 @@ NSString * const AFNetworkingOperationFailingURLRequestErrorKey = @"com.alamofir
 
 typedef NSString * (^AFQueryStringSerializationBlock)(NSURLRequest *request, id parameters, NSError *__autoreleasing *error);
 
+#pragma mark - AFQueryStringBuffer
+
+// 查询字符串中不需要百分号转义的字节：ALPHA DIGIT - . _ ~ / ?
+// 即URLQueryAllowedCharacterSet去掉通用分隔符":#[]@"和子分隔符"!$&'()*+,;="，非ASCII字节全部转义
+static const uint8_t AFQueryStringUnescapedBytes[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 1,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+// 可增长的字节缓冲区
+typedef struct {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+} AFQueryStringBuffer;
+
+static inline void AFQueryStringBufferReserve(AFQueryStringBuffer *buffer, size_t additionalLength) {
+    size_t requiredCapacity = buffer->length + additionalLength;
+    if (requiredCapacity <= buffer->capacity) {
+        return;
+    }
+
+    size_t capacity = MAX(buffer->capacity * 2, MAX(requiredCapacity, (size_t)64));
+    buffer->bytes = realloc(buffer->bytes, capacity);
+    buffer->capacity = capacity;
+}
+
+static inline void AFQueryStringBufferAppendBytes(AFQueryStringBuffer *buffer, const void *bytes, size_t length) {
+    AFQueryStringBufferReserve(buffer, length);
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+// 把string的UTF-8字节原样追加到buffer末尾
+static void AFQueryStringBufferAppendUTF8String(AFQueryStringBuffer *buffer, CFStringRef string) {
+    if (!string) {
+        return;
+    }
+
+    CFIndex length = CFStringGetLength(string);
+    CFIndex maximumLength = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+    AFQueryStringBufferReserve(buffer, (size_t)maximumLength);
+
+    CFIndex usedLength = 0;
+    CFStringGetBytes(string, CFRangeMake(0, length), kCFStringEncodingUTF8, 0, false, (UInt8 *)buffer->bytes + buffer->length, maximumLength, &usedLength);
+    buffer->length += (size_t)usedLength;
+}
+
+// 查表对每个字节做百分号转义后追加到buffer末尾
+static void AFQueryStringBufferAppendEscapedBytes(AFQueryStringBuffer *buffer, const char *bytes, size_t length) {
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    AFQueryStringBufferReserve(buffer, length * 3);
+    char *output = buffer->bytes + buffer->length;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char byte = (unsigned char)bytes[i];
+        if (AFQueryStringUnescapedBytes[byte]) {
+            *output++ = (char)byte;
+        } else {
+            *output++ = '%';
+            *output++ = hexDigits[byte >> 4];
+            *output++ = hexDigits[byte & 0x0F];
+        }
+    }
+    buffer->length = (size_t)(output - buffer->bytes);
+}
+
+// 转义后的内容只有ASCII字符，直接把缓冲区交给NSString，不再拷贝
+static NSString * AFQueryStringBufferCreateString(AFQueryStringBuffer *buffer) {
+    if (buffer->length == 0) {
+        free(buffer->bytes);
+        return @"";
+    }
+
+    return [[NSString alloc] initWithBytesNoCopy:buffer->bytes length:buffer->length encoding:NSASCIIStringEncoding freeWhenDone:YES];
+}
+
 /**
  Returns a percent-escaped string following RFC 3986 for a query string key or value.
  RFC 3986 states that the following characters are "reserved" characters.
@@ -57,40 +152,20 @@ typedef NSString * (^AFQueryStringSerializationBlock)(NSURLRequest *request, id
  不适合传输，字符会有歧义 q?d=abc&ie=urld
  */
 NSString * AFPercentEscapedStringFromString(NSString *string) {
-    //需要做百分号编码处理的字符串
-    static NSString * const kAFCharactersGeneralDelimitersToEncode = @":#[]@"; // does not include "?" or "/" due to RFC 3986 - Section 3.4
-    static NSString * const kAFCharactersSubDelimitersToEncode = @"!$&'()*+,;=";
-    // 使用NSMutableCharacterSet进行过滤 先得到允许的字符集
-    NSMutableCharacterSet * allowedCharacterSet = [[NSCharacterSet URLQueryAllowedCharacterSet] mutableCopy];
-    //获取目前系统中最终需要做百分号编码转换的字符集合 //将以上两种设置为排除
-    [allowedCharacterSet removeCharactersInString:[kAFCharactersGeneralDelimitersToEncode stringByAppendingString:kAFCharactersSubDelimitersToEncode]];
-
-    // FIXME: https://github.com/AFNetworking/AFNetworking/pull/3028
-    // return [string stringByAddingPercentEncodingWithAllowedCharacters:allowedCharacterSet];
-    // 以50的长度为一个单位 循环处理
-    static NSUInteger const batchSize = 50;
-
-    NSUInteger index = 0;
-    NSMutableString *escaped = @"".mutableCopy;
-
-    while (index < string.length) {
-        NSUInteger length = MIN(string.length - index, batchSize);
-        NSRange range = NSMakeRange(index, length);
+    if (string.length == 0) {
+        return @"";
+    }
 
-        // To avoid breaking up character sequences such as 👴🏻👮🏽
-        // 防止emoji字符串被截断
-        range = [string rangeOfComposedCharacterSequencesForRange:range];
+    // 先取出UTF-8字节，再逐字节查表转义，与按字符集调用stringByAddingPercentEncodingWithAllowedCharacters:的结果相同
+    // 也就不再需要分批处理https://github.com/AFNetworking/AFNetworking/pull/3028中的问题
+    AFQueryStringBuffer UTF8Buffer = {0};
+    AFQueryStringBufferAppendUTF8String(&UTF8Buffer, (__bridge CFStringRef)string);
 
-        NSString *substring = [string substringWithRange:range];
-        // 将不在allowedCharacterSet集合中的字符进行百分比转义
-        NSString *encoded = [substring stringByAddingPercentEncodingWithAllowedCharacters:allowedCharacterSet];
-        // 拼接到escaped中
-        [escaped appendString:encoded];
-        // 进行下一个50批次的循环
-        index += range.length;
-    }
+    AFQueryStringBuffer escapedBuffer = {0};
+    AFQueryStringBufferAppendEscapedBytes(&escapedBuffer, UTF8Buffer.bytes, UTF8Buffer.length);
+    free(UTF8Buffer.bytes);
 
-    return escaped;
+    return AFQueryStringBufferCreateString(&escapedBuffer);
 }
 
 #pragma mark -
@@ -149,22 +224,176 @@ NSString * AFPercentEscapedStringFromString(NSString *string) {
 
 @end
 
+#pragma mark - AFQueryStringEncoder
+
+// 一次遍历参数，直接把转义后的结果写进一个缓冲区，不再生成AFQueryStringPair数组
+// 输出与AFQueryStringPairsFromDictionary + URLEncodedStringValue + componentsJoinedByString:完全一致
+typedef struct {
+    // 最终的查询字符串
+    AFQueryStringBuffer output;
+    // 当前的key（已转义），进入下一层时在末尾追加%5B...%5D，返回时再截断
+    AFQueryStringBuffer field;
+    // 排序用的未转义UTF-8字节，同样按层追加和截断
+    AFQueryStringBuffer sortKeys;
+    // 转义value时的临时缓冲区
+    AFQueryStringBuffer scratch;
+    BOOL hasComponent;
+} AFQueryStringEncoder;
+
+typedef struct {
+    CFStringRef description;
+    size_t offset;
+    size_t length;
+    __unsafe_unretained id object;
+    __unsafe_unretained id value;
+} AFQueryStringSortEntry;
+
+static NSUInteger const AFQueryStringInlineSortEntryCount = 16;
+
+// 与原来的NSSortDescriptor一样按description的compare:排序
+// 全部是ASCII时compare:就是逐字节比较，直接memcmp；否则交给CFStringCompare
+static int AFQueryStringCompareASCIIEntries(void *context, const void *lhs, const void *rhs) {
+    const char *bytes = context;
+    const AFQueryStringSortEntry *left = lhs;
+    const AFQueryStringSortEntry *right = rhs;
+
+    int result = memcmp(bytes + left->offset, bytes + right->offset, MIN(left->length, right->length));
+    if (result != 0) {
+        return result;
+    }
+
+    return (left->length > right->length) - (left->length < right->length);
+}
+
+static int AFQueryStringCompareEntries(__unused void *context, const void *lhs, const void *rhs) {
+    const AFQueryStringSortEntry *left = lhs;
+    const AFQueryStringSortEntry *right = rhs;
+
+    return (int)CFStringCompare(left->description, right->description, 0);
+}
+
+// 记录object的description及其UTF-8字节，返回这些字节是否都是ASCII
+static BOOL AFQueryStringEncoderPrepareSortEntry(AFQueryStringEncoder *encoder, AFQueryStringSortEntry *entry, id object, id value) {
+    entry->object = object;
+    entry->value = value;
+    entry->description = (CFStringRef)CFBridgingRetain([object description]);
+    entry->offset = encoder->sortKeys.length;
+    AFQueryStringBufferAppendUTF8String(&encoder->sortKeys, entry->description);
+    entry->length = encoder->sortKeys.length - entry->offset;
+
+    const unsigned char *bytes = (const unsigned char *)encoder->sortKeys.bytes + entry->offset;
+    for (size_t i = 0; i < entry->length; i++) {
+        if (bytes[i] & 0x80) {
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+static void AFQueryStringEncoderSortEntries(AFQueryStringEncoder *encoder, AFQueryStringSortEntry *entries, NSUInteger count, BOOL isASCII) {
+    if (count < 2) {
+        return;
+    }
+
+    if (isASCII) {
+        qsort_r(entries, count, sizeof(AFQueryStringSortEntry), encoder->sortKeys.bytes, AFQueryStringCompareASCIIEntries);
+    } else {
+        qsort_r(entries, count, sizeof(AFQueryStringSortEntry), NULL, AFQueryStringCompareEntries);
+    }
+}
+
+static void AFQueryStringEncoderAppendKeyAndValue(AFQueryStringEncoder *encoder, BOOL hasKey, id value) {
+    if ([value isKindOfClass:[NSDictionary class]] || [value isKindOfClass:[NSSet class]]) {
+        BOOL isDictionary = [value isKindOfClass:[NSDictionary class]];
+        NSUInteger count = [value count];
+        AFQueryStringSortEntry inlineEntries[AFQueryStringInlineSortEntryCount];
+        AFQueryStringSortEntry *entries = count <= AFQueryStringInlineSortEntryCount ? inlineEntries : malloc(count * sizeof(AFQueryStringSortEntry));
+        size_t sortKeysLength = encoder->sortKeys.length;
+
+        BOOL isASCII = YES;
+        NSUInteger index = 0;
+        for (id object in value) {
+            if (index == count) {
+                break;
+            }
+            id nestedValue = isDictionary ? [(NSDictionary *)value objectForKey:object] : nil;
+            isASCII = AFQueryStringEncoderPrepareSortEntry(encoder, &entries[index++], object, nestedValue) && isASCII;
+        }
+        count = index;
+        AFQueryStringEncoderSortEntries(encoder, entries, count, isASCII);
+
+        size_t fieldLength = encoder->field.length;
+        for (NSUInteger i = 0; i < count; i++) {
+            if (isDictionary) {
+                // 有key时为key[nestedKey]，顶层直接使用nestedKey
+                if (hasKey) {
+                    AFQueryStringBufferAppendBytes(&encoder->field, "%5B", 3);
+                }
+                AFQueryStringBufferAppendEscapedBytes(&encoder->field, encoder->sortKeys.bytes + entries[i].offset, entries[i].length);
+                if (hasKey) {
+                    AFQueryStringBufferAppendBytes(&encoder->field, "%5D", 3);
+                }
+                AFQueryStringEncoderAppendKeyAndValue(encoder, YES, entries[i].value);
+                encoder->field.length = fieldLength;
+            } else {
+                // 集合中的元素都使用同一个key
+                AFQueryStringEncoderAppendKeyAndValue(encoder, hasKey, entries[i].object);
+            }
+        }
+
+        for (NSUInteger i = 0; i < count; i++) {
+            if (entries[i].description) {
+                CFRelease(entries[i].description);
+            }
+        }
+        if (entries != inlineEntries) {
+            free(entries);
+        }
+        encoder->sortKeys.length = sortKeysLength;
+    } else if ([value isKindOfClass:[NSArray class]]) {
+        size_t fieldLength = encoder->field.length;
+        // 与[NSString stringWithFormat:@"%@[]", nil]的结果一致
+        if (!hasKey) {
+            AFQueryStringBufferAppendEscapedBytes(&encoder->field, "(null)", 6);
+        }
+        AFQueryStringBufferAppendBytes(&encoder->field, "%5B%5D", 6);
+        for (id nestedValue in value) {
+            AFQueryStringEncoderAppendKeyAndValue(encoder, YES, nestedValue);
+        }
+        encoder->field.length = fieldLength;
+    } else {
+        if (encoder->hasComponent) {
+            AFQueryStringBufferAppendBytes(&encoder->output, "&", 1);
+        }
+        encoder->hasComponent = YES;
+
+        AFQueryStringBufferAppendBytes(&encoder->output, encoder->field.bytes, encoder->field.length);
+        if (value && ![value isEqual:[NSNull null]]) {
+            AFQueryStringBufferAppendBytes(&encoder->output, "=", 1);
+            encoder->scratch.length = 0;
+            AFQueryStringBufferAppendUTF8String(&encoder->scratch, (__bridge CFStringRef)[value description]);
+            AFQueryStringBufferAppendEscapedBytes(&encoder->output, encoder->scratch.bytes, encoder->scratch.length);
+        }
+    }
+}
+
 #pragma mark -
 
 FOUNDATION_EXPORT NSArray * AFQueryStringPairsFromDictionary(NSDictionary *dictionary);
 FOUNDATION_EXPORT NSArray * AFQueryStringPairsFromKeyAndValue(NSString *key, id value);
 //?count=5&start=1
-//这个方法，是遍历数组中的AFQueryStringPair，然后以&符号拼接。AFQueryStringPair是一个数据处理类，只有两个属性:field和value；一个方法：-URLEncodedStringValue。它的作用就是上面我们说的，以key=value的形式，用URL Encode编码，拼接成字符串
+//以key=value的形式，用URL Encode编码，以&符号拼接成字符串。结果与逐个拼接AFQueryStringPair的URLEncodedStringValue相同，但只遍历一次参数
 // 内部方法: C : OC--->C
 NSString * AFQueryStringFromParameters(NSDictionary *parameters) {
-    NSMutableArray *mutablePairs = [NSMutableArray array];//一对
-    //把参数传给AFQueryStringPairsFromDictionary，AFQueryStringPair数据处理类
-    for (AFQueryStringPair *pair in AFQueryStringPairsFromDictionary(parameters)) {
-        //百分号编码
-        [mutablePairs addObject:[pair URLEncodedStringValue]];
-    }
-    //拆分数组返回参数字符串
-    return [mutablePairs componentsJoinedByString:@"&"];
+    AFQueryStringEncoder encoder = {0};
+    AFQueryStringEncoderAppendKeyAndValue(&encoder, NO, parameters);
+
+    free(encoder.field.bytes);
+    free(encoder.sortKeys.bytes);
+    free(encoder.scratch.bytes);
+
+    return AFQueryStringBufferCreateString(&encoder.output);
 }
 
 //过渡
@@ -264,17 +493,41 @@ static NSArray * AFHTTPRequestSerializerObservedKeyPaths() {
 
 static void *AFHTTPRequestSerializerObserverContext = &AFHTTPRequestSerializerObserverContext;
 
+//把headers中request还没有设置的请求头写入mutableRequest
+//request本身没有任何请求头时（通过requestWithMethod:创建的都是这种情况）直接整体赋值，不再逐个查询和设置
+static void AFHTTPRequestApplyHeaders(NSDictionary *headers, NSURLRequest *request, NSMutableURLRequest *mutableRequest) {
+    if (headers.count == 0) {
+        return;
+    }
+
+    if (request.allHTTPHeaderFields.count == 0) {
+        mutableRequest.allHTTPHeaderFields = headers;
+        return;
+    }
+
+    [headers enumerateKeysAndObjectsUsingBlock:^(id field, id value, BOOL * __unused stop) {
+        if (![request valueForHTTPHeaderField:field]) {
+            [mutableRequest setValue:value forHTTPHeaderField:field];
+        }
+    }];
+}
+
 @interface AFHTTPRequestSerializer ()
 //某个request需要观察的属性集合
 @property (readwrite, nonatomic, strong) NSMutableSet *mutableObservedChangedKeyPaths;
 //存储request的请求头域
 @property (readwrite, nonatomic, strong) NSMutableDictionary *mutableHTTPRequestHeaders;
+//mutableHTTPRequestHeaders的不可变快照，每次修改请求头后重新生成，构建request时直接读取，不需要加锁和拷贝
+@property (readwrite, atomic, copy) NSDictionary *HTTPRequestHeadersSnapshot;
+//只用来串行化对请求头的修改
 @property (readwrite, nonatomic, strong) dispatch_queue_t requestHeaderModificationQueue;
 @property (readwrite, nonatomic, assign) AFHTTPRequestQueryStringSerializationStyle queryStringSerializationStyle;
 //手动指定parameters参数序列化的Block
 @property (readwrite, nonatomic, copy) AFQueryStringSerializationBlock queryStringSerialization;
 @end
 
+static void AFHTTPRequestCompressBody(NSMutableURLRequest *request, AFHTTPRequestBodyCompression compression, NSUInteger threshold);
+
 @implementation AFHTTPRequestSerializer
 
 + (instancetype)serializer {
@@ -332,6 +585,9 @@ static void *AFHTTPRequestSerializerObserverContext = &AFHTTPRequestSerializerOb
     // HTTP Method Definitions; see http://www.w3.org/Protocols/rfc2616/rfc2616-sec9.html
     self.HTTPMethodsEncodingParametersInURI = [NSSet setWithObjects:@"GET", @"HEAD", @"DELETE", nil];
 
+    // 小于1KB的body压缩收益不大，默认不压缩
+    self.requestBodyCompressionThreshold = 1024;
+
     self.mutableObservedChangedKeyPaths = [NSMutableSet set];
     for (NSString *keyPath in AFHTTPRequestSerializerObservedKeyPaths()) {
         if ([self respondsToSelector:NSSelectorFromString(keyPath)]) {
@@ -395,28 +651,27 @@ static void *AFHTTPRequestSerializerObserverContext = &AFHTTPRequestSerializerOb
 
 #pragma mark -
 
+- (void)setMutableHTTPRequestHeaders:(NSMutableDictionary *)mutableHTTPRequestHeaders {
+    _mutableHTTPRequestHeaders = mutableHTTPRequestHeaders;
+    self.HTTPRequestHeadersSnapshot = mutableHTTPRequestHeaders ?: @{};
+}
+
+// 读取的是不可变快照，快照只会被整体替换，不会被修改
 - (NSDictionary *)HTTPRequestHeaders {
-    NSDictionary __block *value;
-    dispatch_sync(self.requestHeaderModificationQueue, ^{
-        value = [NSDictionary dictionaryWithDictionary:self.mutableHTTPRequestHeaders];
-    });
-    return value;
+    return self.HTTPRequestHeadersSnapshot;
 }
-// 串行写，注意barrier block的具体执行时机
+// 串行写，注意barrier block的具体执行时机，修改完成后发布新的快照
 - (void)setValue:(NSString *)value
 forHTTPHeaderField:(NSString *)field
 {
     dispatch_barrier_sync(self.requestHeaderModificationQueue, ^{
         [self.mutableHTTPRequestHeaders setValue:value forKey:field];
+        self.HTTPRequestHeadersSnapshot = self.mutableHTTPRequestHeaders;
     });
 }
-// 并行读，注意和上面写操作同时执行时的执行顺序
+
 - (NSString *)valueForHTTPHeaderField:(NSString *)field {
-    NSString __block *value;
-    dispatch_sync(self.requestHeaderModificationQueue, ^{
-        value = [self.mutableHTTPRequestHeaders valueForKey:field];
-    });
-    return value;
+    return [self.HTTPRequestHeadersSnapshot valueForKey:field];
 }
 // 如果请求需要授权证书，这里设置用户名和密码
 - (void)setAuthorizationHeaderFieldWithUsername:(NSString *)username
@@ -430,6 +685,7 @@ forHTTPHeaderField:(NSString *)field
 - (void)clearAuthorizationHeader {
     dispatch_barrier_sync(self.requestHeaderModificationQueue, ^{
         [self.mutableHTTPRequestHeaders removeObjectForKey:@"Authorization"];
+        self.HTTPRequestHeadersSnapshot = self.mutableHTTPRequestHeaders;
     });
 }
 
@@ -478,14 +734,35 @@ forHTTPHeaderField:(NSString *)field
     for (NSString *keyPath in self.mutableObservedChangedKeyPaths) {
         //通过kvc动态的给mutableRequest添加value
         [mutableRequest setValue:[self valueForKeyPath:keyPath] forKey:keyPath];
-        NSLog(@"[%@ %@]",keyPath,[self valueForKeyPath:keyPath]);
+        AFLogTrace(AFLogCategoryRequest, @"[%@ %@]", keyPath, [self valueForKeyPath:keyPath]);
     }
     //将传入的参数进行编码，拼接到url后并返回 coount=5&start=1
     mutableRequest = [[self requestBySerializingRequest:mutableRequest withParameters:parameters error:error] mutableCopy];
-    NSLog(@"request'''''''''%@",mutableRequest);
+    AFHTTPRequestCompressBody(mutableRequest, self.requestBodyCompression, self.requestBodyCompressionThreshold);
+    AFLogDebug(AFLogCategoryRequest, @"request: %@", mutableRequest);
     
     return mutableRequest;
 }
+
+- (AFHTTPRequestTemplate *)requestTemplateWithMethod:(NSString *)method
+                                             baseURL:(NSURL *)baseURL
+{
+    NSParameterAssert(method);
+
+    //request的属性和请求头只在这里设置一次，之后每个request都从这个原型拷贝
+    NSMutableURLRequest *prototypeRequest = [[NSMutableURLRequest alloc] init];
+    prototypeRequest.HTTPMethod = method;
+    for (NSString *keyPath in self.mutableObservedChangedKeyPaths) {
+        [prototypeRequest setValue:[self valueForKeyPath:keyPath] forKey:keyPath];
+    }
+    prototypeRequest.allHTTPHeaderFields = self.HTTPRequestHeaders;
+
+    //参数序列化使用一个不带请求头的副本，原型已经带上了请求头，序列化时不需要再合并；之后修改self也不会影响模板
+    AFHTTPRequestSerializer *serializer = [self copy];
+    serializer.mutableHTTPRequestHeaders = [NSMutableDictionary dictionary];
+
+    return [[AFHTTPRequestTemplate alloc] initWithHTTPMethod:method baseURL:baseURL prototypeRequest:prototypeRequest serializer:serializer];
+}
 //构建一个multipartForm的request。并且通过`AFMultipartFormData`类型的formData来构建请求体
 - (NSMutableURLRequest *)multipartFormRequestWithMethod:(NSString *)method
                                               URLString:(NSString *)URLString
@@ -529,7 +806,10 @@ forHTTPHeaderField:(NSString *)field
         block(formData);
     }
     // 做最终的处理，比如设置一下MultipartRequest的bodyStream或者其特有的content-type等等，后面也会详解
-    return [formData requestByFinalizingMultipartFormData];
+    NSMutableURLRequest *multipartRequest = [formData requestByFinalizingMultipartFormData];
+    AFHTTPRequestCompressBody(multipartRequest, self.requestBodyCompression, self.requestBodyCompressionThreshold);
+
+    return multipartRequest;
 }
 /*
  通过一个Multipart-Form的request创建一个request。新request的httpBody是`fileURL`指定的文件。
@@ -604,11 +884,7 @@ forHTTPHeaderField:(NSString *)field
      2.请求头:conttent-type,accept-language
      3.请求体:get/post get参数拼接在url后面 post数据放在body
      */
-    [self.HTTPRequestHeaders enumerateKeysAndObjectsUsingBlock:^(id field, id value, BOOL * __unused stop) {
-        if (![request valueForHTTPHeaderField:field]) {
-            [mutableRequest setValue:value forHTTPHeaderField:field];
-        }
-    }];
+    AFHTTPRequestApplyHeaders(self.HTTPRequestHeaders, request, mutableRequest);
     
     // 重点 -- 参数
     //将我们传入的参数字典转成字符串
@@ -638,7 +914,7 @@ forHTTPHeaderField:(NSString *)field
     }
     
     //count=5&start=1
-    NSLog(@"query:%@",query);
+    AFLogDebug(AFLogCategoryRequest, @"query: %@", query);
     //最后判断该request中是否包含了GET、HEAD、DELETE（都包含在HTTPMethodsEncodingParametersInURI）。因为这几个method的query是拼接到url后面的。而POST、PUT是把query拼接到http body中的。
     if ([self.HTTPMethodsEncodingParametersInURI containsObject:[[request HTTPMethod] uppercaseString]]) {
         if (query && query.length > 0) {
@@ -704,6 +980,11 @@ forHTTPHeaderField:(NSString *)field
 
     self.mutableHTTPRequestHeaders = [[decoder decodeObjectOfClass:[NSDictionary class] forKey:NSStringFromSelector(@selector(mutableHTTPRequestHeaders))] mutableCopy];
     self.queryStringSerializationStyle = (AFHTTPRequestQueryStringSerializationStyle)[[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(queryStringSerializationStyle))] unsignedIntegerValue];
+    self.requestBodyCompression = (AFHTTPRequestBodyCompression)[[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(requestBodyCompression))] unsignedIntegerValue];
+    NSNumber *requestBodyCompressionThreshold = [decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(requestBodyCompressionThreshold))];
+    if (requestBodyCompressionThreshold) {
+        self.requestBodyCompressionThreshold = [requestBodyCompressionThreshold unsignedIntegerValue];
+    }
 
     return self;
 }
@@ -713,6 +994,8 @@ forHTTPHeaderField:(NSString *)field
         [coder encodeObject:self.mutableHTTPRequestHeaders forKey:NSStringFromSelector(@selector(mutableHTTPRequestHeaders))];
     });
     [coder encodeObject:@(self.queryStringSerializationStyle) forKey:NSStringFromSelector(@selector(queryStringSerializationStyle))];
+    [coder encodeObject:@(self.requestBodyCompression) forKey:NSStringFromSelector(@selector(requestBodyCompression))];
+    [coder encodeObject:@(self.requestBodyCompressionThreshold) forKey:NSStringFromSelector(@selector(requestBodyCompressionThreshold))];
 }
 
 #pragma mark - NSCopying
@@ -722,8 +1005,16 @@ forHTTPHeaderField:(NSString *)field
     dispatch_sync(self.requestHeaderModificationQueue, ^{
         serializer.mutableHTTPRequestHeaders = [self.mutableHTTPRequestHeaders mutableCopyWithZone:zone];
     });
+    serializer.stringEncoding = self.stringEncoding;
+    //通过setter设置，副本同样会记录这些被修改过的request属性
+    for (NSString *keyPath in self.mutableObservedChangedKeyPaths) {
+        [serializer setValue:[self valueForKeyPath:keyPath] forKey:keyPath];
+    }
+    serializer.HTTPMethodsEncodingParametersInURI = self.HTTPMethodsEncodingParametersInURI;
     serializer.queryStringSerializationStyle = self.queryStringSerializationStyle;
     serializer.queryStringSerialization = self.queryStringSerialization;
+    serializer.requestBodyCompression = self.requestBodyCompression;
+    serializer.requestBodyCompressionThreshold = self.requestBodyCompressionThreshold;
 
     return serializer;
 }
@@ -732,6 +1023,68 @@ forHTTPHeaderField:(NSString *)field
 
 #pragma mark -
 
+@interface AFHTTPRequestTemplate ()
+@property (readwrite, nonatomic, copy) NSString *HTTPMethod;
+@property (readwrite, nonatomic, strong) NSURL *baseURL;
+//设置好HTTP方法、请求属性和请求头的request原型
+@property (readwrite, nonatomic, copy) NSURLRequest *prototypeRequest;
+//只用来序列化参数的AFHTTPRequestSerializer副本
+@property (readwrite, nonatomic, strong) AFHTTPRequestSerializer *serializer;
+
+- (instancetype)initWithHTTPMethod:(NSString *)HTTPMethod
+                           baseURL:(NSURL *)baseURL
+                  prototypeRequest:(NSURLRequest *)prototypeRequest
+                        serializer:(AFHTTPRequestSerializer *)serializer;
+@end
+
+@implementation AFHTTPRequestTemplate
+
+- (instancetype)initWithHTTPMethod:(NSString *)HTTPMethod
+                           baseURL:(NSURL *)baseURL
+                  prototypeRequest:(NSURLRequest *)prototypeRequest
+                        serializer:(AFHTTPRequestSerializer *)serializer
+{
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.HTTPMethod = HTTPMethod;
+    self.baseURL = baseURL;
+    self.prototypeRequest = prototypeRequest;
+    self.serializer = serializer;
+
+    return self;
+}
+
+- (NSMutableURLRequest *)requestWithPath:(NSString *)path
+                              parameters:(id)parameters
+                                   error:(NSError *__autoreleasing *)error
+{
+    NSParameterAssert(path);
+
+    //只解析一次URL，不再先拼成字符串再交给requestWithMethod:重新解析
+    NSURL *url = [[NSURL URLWithString:path relativeToURL:self.baseURL] absoluteURL];
+
+    NSParameterAssert(url);
+
+    NSMutableURLRequest *mutableRequest = [self.prototypeRequest mutableCopy];
+    mutableRequest.URL = url;
+
+    mutableRequest = [[self.serializer requestBySerializingRequest:mutableRequest withParameters:parameters error:error] mutableCopy];
+    AFHTTPRequestCompressBody(mutableRequest, self.serializer.requestBodyCompression, self.serializer.requestBodyCompressionThreshold);
+
+    return mutableRequest;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p, HTTPMethod: %@, baseURL: %@>", NSStringFromClass([self class]), self, self.HTTPMethod, [self.baseURL absoluteString]];
+}
+
+@end
+
+#pragma mark -
+
 static NSString * AFCreateMultipartFormBoundary() {
     // 使用两个十六进制随机数拼接在Boundary后面来表示分隔符
     return [NSString stringWithFormat:@"Boundary+%08X%08X", arc4random(), arc4random()];
@@ -780,8 +1133,11 @@ NSTimeInterval const kAFUploadStream3GSuggestedDelay = 0.2;
 @property (readonly, nonatomic, assign, getter = hasBytesAvailable) BOOL bytesAvailable;
 @property (readonly, nonatomic, assign) unsigned long long contentLength;
 
+- (void)encodeBoundariesAndHeaders;
 - (NSInteger)read:(uint8_t *)buffer
         maxLength:(NSUInteger)length;
+- (BOOL)appendBytesInRange:(NSRange)range
+                    toData:(NSMutableData *)data;
 @end
 
 @interface AFMultipartBodyStream : NSInputStream <NSStreamDelegate>
@@ -794,6 +1150,8 @@ NSTimeInterval const kAFUploadStream3GSuggestedDelay = 0.2;
 - (instancetype)initWithStringEncoding:(NSStringEncoding)encoding;
 - (void)setInitialAndFinalBoundaries;
 - (void)appendHTTPBodyPart:(AFHTTPBodyPart *)bodyPart;
+- (NSData *)dataInRange:(NSRange)range
+                  error:(NSError * __autoreleasing *)error;
 @end
 
 #pragma mark -
@@ -1000,6 +1358,8 @@ NSTimeInterval const kAFUploadStream3GSuggestedDelay = 0.2;
 @property (readwrite, nonatomic, strong) AFHTTPBodyPart *currentHTTPBodyPart;
 @property (readwrite, nonatomic, strong) NSOutputStream *outputStream;
 @property (readwrite, nonatomic, strong) NSMutableData *buffer;
+// 各个part的长度之和，添加part或者重新设置边界之后失效
+@property (readwrite, nonatomic, strong) NSNumber *cachedContentLength;
 @end
 
 @implementation AFMultipartBodyStream
@@ -1023,6 +1383,7 @@ NSTimeInterval const kAFUploadStream3GSuggestedDelay = 0.2;
 }
 
 - (void)setInitialAndFinalBoundaries {
+    self.cachedContentLength = nil;
     if ([self.HTTPBodyParts count] > 0) {
         for (AFHTTPBodyPart *bodyPart in self.HTTPBodyParts) {
             bodyPart.hasInitialBoundary = NO;
@@ -1035,7 +1396,10 @@ NSTimeInterval const kAFUploadStream3GSuggestedDelay = 0.2;
 }
 
 - (void)appendHTTPBodyPart:(AFHTTPBodyPart *)bodyPart {
+    // 添加的时候就把分隔符和header编码好，读取时不再重复生成
+    [bodyPart encodeBoundariesAndHeaders];
     [self.HTTPBodyParts addObject:bodyPart];
+    self.cachedContentLength = nil;
 }
 
 - (BOOL)isEmpty {
@@ -1075,14 +1439,15 @@ NSTimeInterval const kAFUploadStream3GSuggestedDelay = 0.2;
             } else {
                 // 当前总大小
                 totalNumberOfBytesRead += numberOfBytesRead;
-                // 延迟
-                if (self.delay > 0.0f) {
-                    [NSThread sleepForTimeInterval:self.delay];
-                }
             }
         }
     }
 
+    // 限制带宽时每个包读完之后延迟一次
+    if (self.delay > 0.0f && totalNumberOfBytesRead > 0) {
+        [NSThread sleepForTimeInterval:self.delay];
+    }
+
     return totalNumberOfBytesRead;
 }
 // 重写关闭读取缓存
@@ -1134,15 +1499,59 @@ NSTimeInterval const kAFUploadStream3GSuggestedDelay = 0.2;
 // AFMultipartBodyStream函数
 // 计算上面那个bodyStream的总长度作为Content-Length
 - (unsigned long long)contentLength {
+    if (self.cachedContentLength) {
+        return [self.cachedContentLength unsignedLongLongValue];
+    }
+
     unsigned long long length = 0;
     // 注意bodyStream是由多个AFHTTPBodyPart对象组成的，比如上面那个例子就是有三个对象组成
     for (AFHTTPBodyPart *bodyPart in self.HTTPBodyParts) {
         length += [bodyPart contentLength];
     }
+    self.cachedContentLength = @(length);
 
     return length;
 }
 
+// 不移动读取位置，直接取出整个body中range范围内的字节
+- (NSData *)dataInRange:(NSRange)range
+                  error:(NSError * __autoreleasing *)error
+{
+    NSMutableData *data = [NSMutableData dataWithCapacity:range.length];
+    unsigned long long position = 0;
+    for (AFHTTPBodyPart *bodyPart in self.HTTPBodyParts) {
+        if (position >= NSMaxRange(range)) {
+            break;
+        }
+
+        unsigned long long partLength = [bodyPart contentLength];
+        if (position + partLength > range.location) {
+            NSUInteger lower = (NSUInteger)(MAX((unsigned long long)range.location, position) - position);
+            NSUInteger upper = (NSUInteger)(MIN((unsigned long long)NSMaxRange(range), position + partLength) - position);
+            if (![bodyPart appendBytesInRange:NSMakeRange(lower, upper - lower) toData:data]) {
+                if (error) {
+                    NSDictionary *userInfo = @{NSLocalizedFailureReasonErrorKey: NSLocalizedStringFromTable(@"Multipart form parts appended from an input stream cannot be read out of order.", @"AFNetworking", nil)};
+                    *error = [[NSError alloc] initWithDomain:AFURLRequestSerializationErrorDomain code:NSURLErrorRequestBodyStreamExhausted userInfo:userInfo];
+                }
+
+                return nil;
+            }
+        }
+        position += partLength;
+    }
+
+    if ([data length] != range.length) {
+        if (error) {
+            NSDictionary *userInfo = @{NSLocalizedFailureReasonErrorKey: NSLocalizedStringFromTable(@"The range is outside of the multipart form body.", @"AFNetworking", nil)};
+            *error = [[NSError alloc] initWithDomain:AFURLRequestSerializationErrorDomain code:NSURLErrorRequestBodyStreamExhausted userInfo:userInfo];
+        }
+
+        return nil;
+    }
+
+    return data;
+}
+
 #pragma mark - Undocumented CFReadStream Bridged Methods
 
 - (void)_scheduleInCFRunLoop:(__unused CFRunLoopRef)aRunLoop
@@ -1175,6 +1584,19 @@ NSTimeInterval const kAFUploadStream3GSuggestedDelay = 0.2;
 
 @end
 
+NSData * AFMultipartFormDataInRange(NSInputStream *bodyStream, NSRange range, NSError * __autoreleasing *error) {
+    if (![bodyStream isKindOfClass:[AFMultipartBodyStream class]]) {
+        if (error) {
+            NSDictionary *userInfo = @{NSLocalizedFailureReasonErrorKey: NSLocalizedStringFromTable(@"The body stream is not a multipart form body.", @"AFNetworking", nil)};
+            *error = [[NSError alloc] initWithDomain:AFURLRequestSerializationErrorDomain code:NSURLErrorRequestBodyStreamExhausted userInfo:userInfo];
+        }
+
+        return nil;
+    }
+
+    return [(AFMultipartBodyStream *)bodyStream dataInRange:range error:error];
+}
+
 #pragma mark -
 
 typedef enum {
@@ -1182,12 +1604,23 @@ typedef enum {
     AFHeaderPhase                = 2,
     AFBodyPhase                  = 3,
     AFFinalBoundaryPhase         = 4,
+    AFCompletedPhase             = 5,
 } AFHTTPBodyPartReadPhase;
 
 @interface AFHTTPBodyPart () <NSCopying> {
     AFHTTPBodyPartReadPhase _phase;
     NSInputStream *_inputStream;
     unsigned long long _phaseReadOffset;
+
+    // 添加part时编码好的分隔符和header
+    NSData *_initialBoundaryData;
+    NSData *_encapsulationBoundaryData;
+    NSData *_finalBoundaryData;
+    NSData *_headersData;
+
+    // NSData的body或者映射到内存的文件，直接从这里拷贝到读取的buffer，不经过NSInputStream
+    NSData *_bodyData;
+    BOOL _bodyDataLoaded;
 }
 
 - (BOOL)transitionToNextPhase;
@@ -1242,29 +1675,65 @@ typedef enum {
     return [NSString stringWithString:headerString];
 }
 
+// 分隔符和header只编码一次
+- (void)encodeBoundariesAndHeaders {
+    if (_headersData) {
+        return;
+    }
+
+    _initialBoundaryData = [AFMultipartFormInitialBoundary(self.boundary) dataUsingEncoding:self.stringEncoding];
+    _encapsulationBoundaryData = [AFMultipartFormEncapsulationBoundary(self.boundary) dataUsingEncoding:self.stringEncoding];
+    _finalBoundaryData = [AFMultipartFormFinalBoundary(self.boundary) dataUsingEncoding:self.stringEncoding];
+    _headersData = [[self stringForHeaders] dataUsingEncoding:self.stringEncoding];
+}
+
+// 文件映射失败时_bodyData为nil，仍然通过inputStream读取
+- (void)loadBodyDataIfNeeded {
+    if (_bodyDataLoaded) {
+        return;
+    }
+    _bodyDataLoaded = YES;
+
+    if ([self.body isKindOfClass:[NSData class]]) {
+        _bodyData = self.body;
+    } else if ([self.body isKindOfClass:[NSURL class]] && [self.body isFileURL]) {
+        _bodyData = [NSData dataWithContentsOfURL:self.body options:NSDataReadingMappedAlways error:nil];
+    }
+}
+
 - (unsigned long long)contentLength {
+    [self encodeBoundariesAndHeaders];
+
     unsigned long long length = 0;
     // 需要拼接上分割符
-    NSData *encapsulationBoundaryData = [([self hasInitialBoundary] ? AFMultipartFormInitialBoundary(self.boundary) : AFMultipartFormEncapsulationBoundary(self.boundary)) dataUsingEncoding:self.stringEncoding];
-    length += [encapsulationBoundaryData length];
+    length += [([self hasInitialBoundary] ? _initialBoundaryData : _encapsulationBoundaryData) length];
     // 每个AFHTTPBodyPart对象中还有Content-Disposition等header-使用stringForHeader获取
-    NSData *headersData = [[self stringForHeaders] dataUsingEncoding:self.stringEncoding];
-    length += [headersData length];
+    length += [_headersData length];
     // 加上每个AFHTTPBodyPart对象具体的数据（比如文件内容）长度
     length += _bodyContentLength;
     // 如果是最后一个AFHTTPBodyPart，还需要加上“--分隔符--”的长度
-    NSData *closingBoundaryData = ([self hasFinalBoundary] ? [AFMultipartFormFinalBoundary(self.boundary) dataUsingEncoding:self.stringEncoding] : [NSData data]);
-    length += [closingBoundaryData length];
+    if ([self hasFinalBoundary]) {
+        length += [_finalBoundaryData length];
+    }
 
     return length;
 }
 
 - (BOOL)hasBytesAvailable {
+    if (_phase == AFCompletedPhase) {
+        return NO;
+    }
+
     // Allows `read:maxLength:` to be called again if `AFMultipartFormFinalBoundary` doesn't fit into the available buffer
     if (_phase == AFFinalBoundaryPhase) {
         return YES;
     }
 
+    // 还没到body或者直接读取_bodyData时不需要检查inputStream的状态
+    if (_bodyData || !_bodyDataLoaded) {
+        return YES;
+    }
+
     switch (self.inputStream.streamStatus) {
         case NSStreamStatusNotOpen:
         case NSStreamStatusOpening:
@@ -1283,20 +1752,23 @@ typedef enum {
 - (NSInteger)read:(uint8_t *)buffer
         maxLength:(NSUInteger)length
 {
+    [self encodeBoundariesAndHeaders];
+
     NSInteger totalNumberOfBytesRead = 0;
     //part --- 分隔符 + dict + data
     // stream--:默认是close的,那么什么时候open的呢???
     if (_phase == AFEncapsulationBoundaryPhase) {
-        NSData *encapsulationBoundaryData = [([self hasInitialBoundary] ? AFMultipartFormInitialBoundary(self.boundary) : AFMultipartFormEncapsulationBoundary(self.boundary)) dataUsingEncoding:self.stringEncoding];
+        NSData *encapsulationBoundaryData = [self hasInitialBoundary] ? _initialBoundaryData : _encapsulationBoundaryData;
         totalNumberOfBytesRead += [self readData:encapsulationBoundaryData intoBuffer:&buffer[totalNumberOfBytesRead] maxLength:(length - (NSUInteger)totalNumberOfBytesRead)];
     }
 
     if (_phase == AFHeaderPhase) {
-        NSData *headersData = [[self stringForHeaders] dataUsingEncoding:self.stringEncoding];
-        totalNumberOfBytesRead += [self readData:headersData intoBuffer:&buffer[totalNumberOfBytesRead] maxLength:(length - (NSUInteger)totalNumberOfBytesRead)];
+        totalNumberOfBytesRead += [self readData:_headersData intoBuffer:&buffer[totalNumberOfBytesRead] maxLength:(length - (NSUInteger)totalNumberOfBytesRead)];
     }
 
-    if (_phase == AFBodyPhase) {
+    if (_phase == AFBodyPhase && _bodyData) {
+        totalNumberOfBytesRead += [self readData:_bodyData intoBuffer:&buffer[totalNumberOfBytesRead] maxLength:(length - (NSUInteger)totalNumberOfBytesRead)];
+    } else if (_phase == AFBodyPhase) {
         NSInteger numberOfBytesRead = 0;
 
         numberOfBytesRead = [self.inputStream read:&buffer[totalNumberOfBytesRead] maxLength:(length - (NSUInteger)totalNumberOfBytesRead)];
@@ -1312,13 +1784,51 @@ typedef enum {
     }
 
     if (_phase == AFFinalBoundaryPhase) {
-        NSData *closingBoundaryData = ([self hasFinalBoundary] ? [AFMultipartFormFinalBoundary(self.boundary) dataUsingEncoding:self.stringEncoding] : [NSData data]);
+        NSData *closingBoundaryData = ([self hasFinalBoundary] ? _finalBoundaryData : [NSData data]);
         totalNumberOfBytesRead += [self readData:closingBoundaryData intoBuffer:&buffer[totalNumberOfBytesRead] maxLength:(length - (NSUInteger)totalNumberOfBytesRead)];
     }
 
     return totalNumberOfBytesRead;
 }
 
+// range是相对这个part开头的位置，依次是分隔符、header、body、结束分隔符
+- (BOOL)appendBytesInRange:(NSRange)range
+                    toData:(NSMutableData *)data
+{
+    [self encodeBoundariesAndHeaders];
+
+    NSData *boundaryData = [self hasInitialBoundary] ? _initialBoundaryData : _encapsulationBoundaryData;
+    NSData *finalBoundaryData = [self hasFinalBoundary] ? _finalBoundaryData : [NSData data];
+    unsigned long long position = 0;
+    for (NSUInteger index = 0; index < 4; index++) {
+        NSData *segment = nil;
+        unsigned long long segmentLength = 0;
+        switch (index) {
+            case 0: segment = boundaryData; segmentLength = [boundaryData length]; break;
+            case 1: segment = _headersData; segmentLength = [_headersData length]; break;
+            case 2: segmentLength = _bodyContentLength; break;
+            default: segment = finalBoundaryData; segmentLength = [finalBoundaryData length]; break;
+        }
+
+        unsigned long long lower = MAX((unsigned long long)range.location, position);
+        unsigned long long upper = MIN((unsigned long long)NSMaxRange(range), position + segmentLength);
+        if (lower < upper) {
+            if (index == 2) {
+                // 只有NSData和文件可以按位置读取
+                [self loadBodyDataIfNeeded];
+                segment = _bodyData;
+            }
+            if (!segment || upper - position > [segment length]) {
+                return NO;
+            }
+            [data appendBytes:(const uint8_t *)[segment bytes] + (lower - position) length:(NSUInteger)(upper - lower)];
+        }
+        position += segmentLength;
+    }
+
+    return YES;
+}
+
 - (NSInteger)readData:(NSData *)data
            intoBuffer:(uint8_t *)buffer
             maxLength:(NSUInteger)length
@@ -1336,8 +1846,13 @@ typedef enum {
 }
 
 - (BOOL)transitionToNextPhase {
-    // 保障代码在主线程
-    if (![[NSThread currentThread] isMainThread]) {
+    if (_phase == AFHeaderPhase) {
+        [self loadBodyDataIfNeeded];
+    }
+
+    // 需要打开或关闭inputStream时保障代码在主线程，直接读取_bodyData时不需要
+    BOOL opensOrClosesInputStream = !_bodyData && (_phase == AFHeaderPhase || _phase == AFBodyPhase);
+    if (opensOrClosesInputStream && ![[NSThread currentThread] isMainThread]) {
         dispatch_sync(dispatch_get_main_queue(), ^{
             [self transitionToNextPhase];
         });
@@ -1350,16 +1865,22 @@ typedef enum {
             break;
         case AFHeaderPhase:
             //打开流,准备接收数据
-            [self.inputStream scheduleInRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
-            [self.inputStream open];
+            if (!_bodyData) {
+                [self.inputStream scheduleInRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
+                [self.inputStream open];
+            }
             _phase = AFBodyPhase;
             break;
         case AFBodyPhase:
             //关闭流
-            [self.inputStream close];
+            if (!_bodyData) {
+                [self.inputStream close];
+            }
             _phase = AFFinalBoundaryPhase;
             break;
         case AFFinalBoundaryPhase:
+            _phase = AFCompletedPhase;
+            break;
         default:
             _phase = AFEncapsulationBoundaryPhase;
             break;
@@ -1379,6 +1900,10 @@ typedef enum {
     bodyPart.bodyContentLength = self.bodyContentLength;
     bodyPart.body = self.body;
     bodyPart.boundary = self.boundary;
+    bodyPart->_initialBoundaryData = _initialBoundaryData;
+    bodyPart->_encapsulationBoundaryData = _encapsulationBoundaryData;
+    bodyPart->_finalBoundaryData = _finalBoundaryData;
+    bodyPart->_headersData = _headersData;
 
     return bodyPart;
 }
@@ -1387,61 +1912,674 @@ typedef enum {
 
 #pragma mark -
 
-@implementation AFJSONRequestSerializer
-
-+ (instancetype)serializer {
-    return [self serializerWithWritingOptions:(NSJSONWritingOptions)0];
+static NSString * AFHTTPRequestBodyContentEncoding(AFHTTPRequestBodyCompression compression) {
+    switch (compression) {
+        case AFHTTPRequestBodyCompressionGzip:
+            return @"gzip";
+        case AFHTTPRequestBodyCompressionDeflate:
+            return @"deflate";
+        case AFHTTPRequestBodyCompressionNone:
+        default:
+            return nil;
+    }
 }
 
-+ (instancetype)serializerWithWritingOptions:(NSJSONWritingOptions)writingOptions
-{
-    AFJSONRequestSerializer *serializer = [[self alloc] init];
-    serializer.writingOptions = writingOptions;
+// gzip和deflate只是外层格式不同：windowBits加16输出gzip头，否则输出zlib头
+static BOOL AFHTTPRequestBodyDeflateInit(z_stream *stream, AFHTTPRequestBodyCompression compression) {
+    memset(stream, 0, sizeof(z_stream));
+    int windowBits = compression == AFHTTPRequestBodyCompressionGzip ? MAX_WBITS + 16 : MAX_WBITS;
 
-    return serializer;
+    return deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
 }
 
-#pragma mark - AFURLRequestSerialization
+NSData * AFHTTPRequestBodyCompressedData(NSData *data, AFHTTPRequestBodyCompression compression) {
+    if (!AFHTTPRequestBodyContentEncoding(compression) || [data length] > UINT_MAX) {
+        return nil;
+    }
 
-- (NSURLRequest *)requestBySerializingRequest:(NSURLRequest *)request
-                               withParameters:(id)parameters
-                                        error:(NSError *__autoreleasing *)error
-{
-    NSParameterAssert(request);
-    /*
-     对于`GET`,`HEAD`,`DELETE`等方法中。直接使用父类的处理方式
-     */
-    if ([self.HTTPMethodsEncodingParametersInURI containsObject:[[request HTTPMethod] uppercaseString]]) {
-        return [super requestBySerializingRequest:request withParameters:parameters error:error];
+    z_stream stream;
+    if (!AFHTTPRequestBodyDeflateInit(&stream, compression)) {
+        return nil;
     }
 
-    NSMutableURLRequest *mutableRequest = [request mutableCopy];
-    //把`HTTPRequestHeaders`中的值添加进入请求头中。
-    [self.HTTPRequestHeaders enumerateKeysAndObjectsUsingBlock:^(id field, id value, BOOL * __unused stop) {
-        if (![request valueForHTTPHeaderField:field]) {
-            [mutableRequest setValue:value forHTTPHeaderField:field];
-        }
-    }];
+    // deflateBound给出的长度保证一次Z_FINISH就能压缩完
+    NSMutableData *compressedData = [NSMutableData dataWithLength:deflateBound(&stream, (uLong)[data length])];
+    stream.next_in = (Bytef *)[data bytes];
+    stream.avail_in = (uInt)[data length];
+    stream.next_out = [compressedData mutableBytes];
+    stream.avail_out = (uInt)[compressedData length];
 
-    if (parameters) {
-        if (![mutableRequest valueForHTTPHeaderField:@"Content-Type"]) {
-            [mutableRequest setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
-        }
+    int result = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        return nil;
+    }
+    [compressedData setLength:stream.total_out];
 
-        if (![NSJSONSerialization isValidJSONObject:parameters]) {
-            if (error) {
-                NSDictionary *userInfo = @{NSLocalizedFailureReasonErrorKey: NSLocalizedStringFromTable(@"The `parameters` argument is not valid JSON.", @"AFNetworking", nil)};
-                *error = [[NSError alloc] initWithDomain:AFURLRequestSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:userInfo];
-            }
-            return nil;
+    return compressedData;
+}
+
+// 边读边压缩的body，由NSURLSession在自己的线程上读取，压缩不占用创建请求的线程
+@interface AFCompressedBodyStream : NSInputStream <NSCopying> {
+    z_stream _zStream;
+    BOOL _zStreamInitialized;
+    BOOL _sourceAtEnd;
+    uint8_t _sourceBuffer[16 * 1024];
+}
+@property (readwrite, nonatomic, strong) id body;
+@property (readwrite, nonatomic, assign) AFHTTPRequestBodyCompression compression;
+@property (readwrite, nonatomic, strong) NSInputStream *sourceStream;
+
+- (instancetype)initWithBody:(id)body compression:(AFHTTPRequestBodyCompression)compression;
+@end
+
+@implementation AFCompressedBodyStream
+#if (defined(__IPHONE_OS_VERSION_MAX_ALLOWED) && __IPHONE_OS_VERSION_MAX_ALLOWED >= 80000) || (defined(__MAC_OS_X_VERSION_MAX_ALLOWED) && __MAC_OS_X_VERSION_MAX_ALLOWED >= 1100)
+@synthesize delegate;
+#endif
+@synthesize streamStatus;
+@synthesize streamError;
+
+- (instancetype)initWithBody:(id)body compression:(AFHTTPRequestBodyCompression)compression {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.body = body;
+    self.compression = compression;
+
+    return self;
+}
+
+- (void)dealloc {
+    if (_zStreamInitialized) {
+        deflateEnd(&_zStream);
+    }
+}
+
+#pragma mark - NSInputStream
+
+- (NSInteger)read:(uint8_t *)buffer
+        maxLength:(NSUInteger)length
+{
+    if (self.streamStatus == NSStreamStatusError) {
+        return -1;
+    }
+    if (self.streamStatus != NSStreamStatusOpen) {
+        return 0;
+    }
+
+    _zStream.next_out = buffer;
+    _zStream.avail_out = (uInt)MIN(length, (NSUInteger)UINT_MAX);
+    while (_zStream.avail_out > 0) {
+        // 上一次读到的原始数据已经压缩完，再从原始body读取一段
+        if (_zStream.avail_in == 0 && !_sourceAtEnd) {
+            NSInteger numberOfBytesRead = [self.sourceStream read:_sourceBuffer maxLength:sizeof(_sourceBuffer)];
+            if (numberOfBytesRead < 0) {
+                self.streamError = self.sourceStream.streamError;
+                self.streamStatus = NSStreamStatusError;
+                return -1;
+            }
+            _sourceAtEnd = numberOfBytesRead == 0;
+            _zStream.next_in = _sourceBuffer;
+            _zStream.avail_in = (uInt)numberOfBytesRead;
+        }
+
+        int result = deflate(&_zStream, _sourceAtEnd ? Z_FINISH : Z_NO_FLUSH);
+        if (result == Z_STREAM_END) {
+            self.streamStatus = NSStreamStatusAtEnd;
+            break;
+        } else if (result != Z_OK && result != Z_BUF_ERROR) {
+            NSDictionary *userInfo = @{NSLocalizedFailureReasonErrorKey: NSLocalizedStringFromTable(@"The request body could not be compressed.", @"AFNetworking", nil)};
+            self.streamError = [[NSError alloc] initWithDomain:AFURLRequestSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:userInfo];
+            self.streamStatus = NSStreamStatusError;
+            return -1;
         }
+    }
+
+    return (NSInteger)(length - _zStream.avail_out);
+}
+
+- (BOOL)getBuffer:(__unused uint8_t **)buffer
+           length:(__unused NSUInteger *)len
+{
+    return NO;
+}
+
+- (BOOL)hasBytesAvailable {
+    return [self streamStatus] == NSStreamStatusOpen;
+}
+
+#pragma mark - NSStream
+
+- (void)open {
+    if (self.streamStatus == NSStreamStatusOpen) {
+        return;
+    }
+
+    if ([self.body isKindOfClass:[NSData class]]) {
+        self.sourceStream = [NSInputStream inputStreamWithData:self.body];
+    } else {
+        self.sourceStream = self.body;
+    }
+    [self.sourceStream open];
+
+    _zStreamInitialized = AFHTTPRequestBodyDeflateInit(&_zStream, self.compression);
+    self.streamStatus = _zStreamInitialized ? NSStreamStatusOpen : NSStreamStatusError;
+}
+
+- (void)close {
+    if (_zStreamInitialized) {
+        deflateEnd(&_zStream);
+        _zStreamInitialized = NO;
+    }
+    [self.sourceStream close];
+    self.streamStatus = NSStreamStatusClosed;
+}
+
+- (id)propertyForKey:(__unused NSString *)key {
+    return nil;
+}
+
+- (BOOL)setProperty:(__unused id)property
+             forKey:(__unused NSString *)key
+{
+    return NO;
+}
+
+- (void)scheduleInRunLoop:(__unused NSRunLoop *)aRunLoop
+                  forMode:(__unused NSString *)mode
+{}
+
+- (void)removeFromRunLoop:(__unused NSRunLoop *)aRunLoop
+                  forMode:(__unused NSString *)mode
+{}
+
+#pragma mark - Undocumented CFReadStream Bridged Methods
+
+- (void)_scheduleInCFRunLoop:(__unused CFRunLoopRef)aRunLoop
+                     forMode:(__unused CFStringRef)aMode
+{}
+
+- (void)_unscheduleFromCFRunLoop:(__unused CFRunLoopRef)aRunLoop
+                         forMode:(__unused CFStringRef)aMode
+{}
+
+- (BOOL)_setCFClientFlags:(__unused CFOptionFlags)inFlags
+                 callback:(__unused CFReadStreamClientCallBack)inCallback
+                  context:(__unused CFStreamClientContext *)inContext {
+    return NO;
+}
+
+#pragma mark - NSCopying
+
+// NSURLSession需要重新发送body时会拷贝一份，原始body能拷贝的话从头重新压缩
+- (instancetype)copyWithZone:(NSZone *)zone {
+    id body = [self.body conformsToProtocol:@protocol(NSCopying)] ? [self.body copyWithZone:zone] : self.body;
+
+    return [[[self class] allocWithZone:zone] initWithBody:body compression:self.compression];
+}
+
+@end
+
+// 不超过这个长度的内存body在调用方线程直接压缩，耗时很短；更大的body用流在发送时压缩，不占用调用方线程
+static const NSUInteger AFHTTPRequestBodyInlineCompressionLimit = 64 * 1024;
+
+static void AFHTTPRequestCompressBody(NSMutableURLRequest *request, AFHTTPRequestBodyCompression compression, NSUInteger threshold) {
+    NSString *contentEncoding = AFHTTPRequestBodyContentEncoding(compression);
+    if (!contentEncoding || [request valueForHTTPHeaderField:@"Content-Encoding"]) {
+        return;
+    }
+
+    id body = nil;
+    if (request.HTTPBody && [request.HTTPBody length] > AFHTTPRequestBodyInlineCompressionLimit) {
+        body = request.HTTPBody;
+    } else if (request.HTTPBody) {
+        if ([request.HTTPBody length] < threshold) {
+            return;
+        }
+        // 较小的内存body直接压缩一次，带上压缩后的Content-Length，不会变成分块传输，上传进度也有总长度
+        NSData *compressedBody = AFHTTPRequestBodyCompressedData(request.HTTPBody, compression);
+        if (!compressedBody || [compressedBody length] >= [request.HTTPBody length]) {
+            return;
+        }
+        request.HTTPBody = compressedBody;
+        [request setValue:contentEncoding forHTTPHeaderField:@"Content-Encoding"];
+        [request setValue:[NSString stringWithFormat:@"%lu", (unsigned long)[compressedBody length]] forHTTPHeaderField:@"Content-Length"];
+        return;
+    } else if (request.HTTPBodyStream) {
+        NSString *contentLength = [request valueForHTTPHeaderField:@"Content-Length"];
+        if (contentLength && (unsigned long long)[contentLength longLongValue] < threshold) {
+            return;
+        }
+        body = request.HTTPBodyStream;
+    } else {
+        return;
+    }
+
+    // 设置HTTPBodyStream会同时清空HTTPBody
+    request.HTTPBodyStream = [[AFCompressedBodyStream alloc] initWithBody:body compression:compression];
+    [request setValue:contentEncoding forHTTPHeaderField:@"Content-Encoding"];
+    [request setValue:nil forHTTPHeaderField:@"Content-Length"];
+}
+
+#pragma mark - AFJSONWriter
+
+// 模型编码用到的字段表接口，实现在AFURLResponseSerialization.m
+@interface AFJSONFieldMap (AFJSONRequestSerialization)
+- (void)af_enumerateValuesOfModel:(id)model usingBlock:(void (NS_NOESCAPE ^)(const char *key, size_t keyLength, id value, AFJSONFieldMap *fieldMap, BOOL *stop))block;
+@end
+
+// NSJSONWritingSortedKeys和NSJSONWritingWithoutEscapingSlashes的取值，直接用常量会引入系统版本的可用性检查
+static const NSJSONWritingOptions AFJSONWritingSortedKeys = (1UL << 1);
+static const NSJSONWritingOptions AFJSONWritingWithoutEscapingSlashes = (1UL << 3);
+
+// 嵌套过深时交给NSJSONSerialization处理，也避免循环引用导致栈溢出
+static const NSUInteger AFJSONWriterMaximumDepth = 512;
+
+// 边校验边编码的JSON写入器，输出直接写进可增长的字节缓冲区
+typedef struct {
+    AFQueryStringBuffer buffer;
+    // 字符串转成UTF-8时复用的临时缓冲区
+    AFQueryStringBuffer scratch;
+    NSUInteger depth;
+    BOOL prettyPrinted;
+    BOOL sortedKeys;
+    BOOL escapesSlashes;
+} AFJSONWriter;
+
+static BOOL AFJSONWriterWriteValue(AFJSONWriter *writer, id value, AFJSONFieldMap *fieldMap);
+
+static inline void AFJSONWriterAppendLiteral(AFJSONWriter *writer, const char *literal) {
+    AFQueryStringBufferAppendBytes(&writer->buffer, literal, strlen(literal));
+}
+
+static void AFJSONWriterAppendNewline(AFJSONWriter *writer) {
+    if (!writer->prettyPrinted) {
+        return;
+    }
+
+    size_t indentLength = writer->depth * 2;
+    AFQueryStringBufferReserve(&writer->buffer, indentLength + 1);
+    writer->buffer.bytes[writer->buffer.length++] = '\n';
+    memset(writer->buffer.bytes + writer->buffer.length, ' ', indentLength);
+    writer->buffer.length += indentLength;
+}
+
+// 容器中每个元素之前的逗号和缩进
+static inline void AFJSONWriterBeginElement(AFJSONWriter *writer, BOOL first) {
+    if (!first) {
+        AFQueryStringBufferAppendBytes(&writer->buffer, ",", 1);
+    }
+    AFJSONWriterAppendNewline(writer);
+}
+
+static inline void AFJSONWriterAppendNameSeparator(AFJSONWriter *writer) {
+    AFJSONWriterAppendLiteral(writer, writer->prettyPrinted ? " : " : ":");
+}
+
+static inline void AFJSONWriterEndContainer(AFJSONWriter *writer, const char *terminator, BOOL empty) {
+    writer->depth--;
+    if (!empty) {
+        AFJSONWriterAppendNewline(writer);
+    }
+    AFJSONWriterAppendLiteral(writer, terminator);
+}
+
+// 把UTF-8字节转义成带引号的JSON字符串，不需要转义的字节整段拷贝
+static void AFJSONWriterAppendEscapedBytes(AFJSONWriter *writer, const char *bytes, size_t length) {
+    static const char hexDigits[] = "0123456789abcdef";
+
+    AFQueryStringBufferReserve(&writer->buffer, length + 2);
+    writer->buffer.bytes[writer->buffer.length++] = '"';
+
+    size_t runStart = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char byte = (unsigned char)bytes[i];
+        if (byte >= 0x20 && byte != '"' && byte != '\\' && (byte != '/' || !writer->escapesSlashes)) {
+            continue;
+        }
+
+        AFQueryStringBufferAppendBytes(&writer->buffer, bytes + runStart, i - runStart);
+        runStart = i + 1;
+
+        char escape[6] = {'\\', 0, 0, 0, 0, 0};
+        size_t escapeLength = 2;
+        switch (byte) {
+            case '"': escape[1] = '"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '/': escape[1] = '/'; break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = hexDigits[byte >> 4];
+                escape[5] = hexDigits[byte & 0x0F];
+                escapeLength = 6;
+                break;
+        }
+        AFQueryStringBufferAppendBytes(&writer->buffer, escape, escapeLength);
+    }
 
-        NSData *jsonData = [NSJSONSerialization dataWithJSONObject:parameters options:self.writingOptions error:error];
+    AFQueryStringBufferAppendBytes(&writer->buffer, bytes + runStart, length - runStart);
+    AFQueryStringBufferAppendBytes(&writer->buffer, "\"", 1);
+}
+
+static BOOL AFJSONWriterWriteString(AFJSONWriter *writer, CFStringRef string) {
+    CFIndex length = CFStringGetLength(string);
+    CFIndex maximumLength = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+    writer->scratch.length = 0;
+    AFQueryStringBufferReserve(&writer->scratch, (size_t)maximumLength);
+
+    CFIndex usedLength = 0;
+    CFIndex convertedLength = CFStringGetBytes(string, CFRangeMake(0, length), kCFStringEncodingUTF8, 0, false, (UInt8 *)writer->scratch.bytes, maximumLength, &usedLength);
+    // 落单的代理项等无法转成UTF-8的字符串交给NSJSONSerialization处理
+    if (convertedLength != length) {
+        return NO;
+    }
+
+    AFJSONWriterAppendEscapedBytes(writer, writer->scratch.bytes, (size_t)usedLength);
+
+    return YES;
+}
+
+static BOOL AFJSONWriterWriteNumber(AFJSONWriter *writer, NSNumber *number) {
+    if ((__bridge CFBooleanRef)number == kCFBooleanTrue) {
+        AFJSONWriterAppendLiteral(writer, "true");
+        return YES;
+    } else if ((__bridge CFBooleanRef)number == kCFBooleanFalse) {
+        AFJSONWriterAppendLiteral(writer, "false");
+        return YES;
+    } else if ([number isKindOfClass:[NSDecimalNumber class]]) {
+        // NSDecimalNumber的精度超过double，保持NSJSONSerialization的输出
+        return NO;
+    }
+
+    char digits[32];
+    int length = 0;
+    switch (number.objCType[0]) {
+        case 'f':
+        case 'd': {
+            double value = number.doubleValue;
+            if (!isfinite(value)) {
+                return NO;
+            }
+            // 取能精确还原的最短表示
+            for (int precision = 15; precision <= 17; precision++) {
+                length = snprintf(digits, sizeof(digits), "%.*g", precision, value);
+                if (strtod(digits, NULL) == value) {
+                    break;
+                }
+            }
+            break;
+        }
+        case 'Q':
+            length = snprintf(digits, sizeof(digits), "%llu", number.unsignedLongLongValue);
+            break;
+        default:
+            length = snprintf(digits, sizeof(digits), "%lld", number.longLongValue);
+            break;
+    }
+    AFQueryStringBufferAppendBytes(&writer->buffer, digits, (size_t)length);
+
+    return YES;
+}
+
+static BOOL AFJSONWriterWriteDictionary(AFJSONWriter *writer, NSDictionary *dictionary, AFJSONFieldMap *fieldMap) {
+    AFJSONWriterAppendLiteral(writer, "{");
+    writer->depth++;
+
+    __block BOOL success = YES;
+    __block BOOL empty = YES;
+    void (^writeMember)(id, id, BOOL *) = ^(id key, id value, BOOL *stop) {
+        if (![key isKindOfClass:[NSString class]]) {
+            success = NO;
+            *stop = YES;
+            return;
+        }
+
+        AFJSONWriterBeginElement(writer, empty);
+        empty = NO;
+        if (!AFJSONWriterWriteString(writer, (__bridge CFStringRef)key)) {
+            success = NO;
+            *stop = YES;
+            return;
+        }
+        AFJSONWriterAppendNameSeparator(writer);
+        if (!AFJSONWriterWriteValue(writer, value, fieldMap)) {
+            success = NO;
+            *stop = YES;
+        }
+    };
+
+    if (writer->sortedKeys) {
+        NSArray *keys = dictionary.allKeys;
+        for (id key in keys) {
+            if (![key isKindOfClass:[NSString class]]) {
+                return NO;
+            }
+        }
+
+        BOOL stop = NO;
+        for (NSString *key in [keys sortedArrayUsingSelector:@selector(compare:)]) {
+            writeMember(key, dictionary[key], &stop);
+            if (stop) {
+                break;
+            }
+        }
+    } else {
+        [dictionary enumerateKeysAndObjectsUsingBlock:writeMember];
+    }
+
+    if (!success) {
+        return NO;
+    }
+    AFJSONWriterEndContainer(writer, "}", empty);
+
+    return YES;
+}
+
+static BOOL AFJSONWriterWriteArray(AFJSONWriter *writer, NSArray *array, AFJSONFieldMap *fieldMap) {
+    AFJSONWriterAppendLiteral(writer, "[");
+    writer->depth++;
+
+    BOOL empty = YES;
+    for (id element in array) {
+        AFJSONWriterBeginElement(writer, empty);
+        empty = NO;
+        if (!AFJSONWriterWriteValue(writer, element, fieldMap)) {
+            return NO;
+        }
+    }
+    AFJSONWriterEndContainer(writer, "]", empty);
+
+    return YES;
+}
+
+// 按字段表读取模型的属性直接写出，值为nil的属性不输出
+static BOOL AFJSONWriterWriteModel(AFJSONWriter *writer, id model, AFJSONFieldMap *fieldMap) {
+    AFJSONWriterAppendLiteral(writer, "{");
+    writer->depth++;
+
+    __block BOOL success = YES;
+    __block BOOL empty = YES;
+    [fieldMap af_enumerateValuesOfModel:model usingBlock:^(const char *key, size_t keyLength, id value, AFJSONFieldMap *nestedFieldMap, BOOL *stop) {
+        if (!value) {
+            return;
+        }
+
+        AFJSONWriterBeginElement(writer, empty);
+        empty = NO;
+        AFJSONWriterAppendEscapedBytes(writer, key, keyLength);
+        AFJSONWriterAppendNameSeparator(writer);
+        if (!AFJSONWriterWriteValue(writer, value, nestedFieldMap)) {
+            success = NO;
+            *stop = YES;
+        }
+    }];
+
+    if (!success) {
+        return NO;
+    }
+    AFJSONWriterEndContainer(writer, "}", empty);
+
+    return YES;
+}
+
+// fieldMap描述value中可能出现的模型对象，数组和字典会把它传给自己的元素
+static BOOL AFJSONWriterWriteValue(AFJSONWriter *writer, id value, AFJSONFieldMap *fieldMap) {
+    if (writer->depth >= AFJSONWriterMaximumDepth) {
+        return NO;
+    }
+
+    if ([value isKindOfClass:[NSString class]]) {
+        return AFJSONWriterWriteString(writer, (__bridge CFStringRef)value);
+    } else if ([value isKindOfClass:[NSNumber class]]) {
+        return AFJSONWriterWriteNumber(writer, value);
+    } else if ([value isKindOfClass:[NSDictionary class]]) {
+        return AFJSONWriterWriteDictionary(writer, value, fieldMap);
+    } else if ([value isKindOfClass:[NSArray class]]) {
+        return AFJSONWriterWriteArray(writer, value, fieldMap);
+    } else if (value == [NSNull null]) {
+        AFJSONWriterAppendLiteral(writer, "null");
+        return YES;
+    } else if (fieldMap && [value isKindOfClass:fieldMap.modelClass]) {
+        return AFJSONWriterWriteModel(writer, value, fieldMap);
+    }
+
+    return NO;
+}
+
+/**
+ Encodes `object` in a single pass, validating it along the way. Returns `nil` if `object` contains anything the writer does not handle, in which case the caller falls back to `NSJSONSerialization`.
+ */
+static NSData * AFJSONWriterCreateData(id object, AFJSONFieldMap *fieldMap, NSJSONWritingOptions writingOptions, NSUInteger sizeHint) {
+    // 与isValidJSONObject:一致，顶层只能是容器或者模型
+    if (![object isKindOfClass:[NSDictionary class]] && ![object isKindOfClass:[NSArray class]] && !(fieldMap && [object isKindOfClass:fieldMap.modelClass])) {
+        return nil;
+    }
+
+    AFJSONWriter writer = {0};
+    writer.prettyPrinted = (writingOptions & NSJSONWritingPrettyPrinted) != 0;
+    writer.sortedKeys = (writingOptions & AFJSONWritingSortedKeys) != 0;
+    writer.escapesSlashes = (writingOptions & AFJSONWritingWithoutEscapingSlashes) == 0;
+    AFQueryStringBufferReserve(&writer.buffer, sizeHint);
+
+    BOOL success = AFJSONWriterWriteValue(&writer, object, fieldMap);
+    free(writer.scratch.bytes);
+    if (!success) {
+        free(writer.buffer.bytes);
+        return nil;
+    }
+
+    // 按实际长度收缩后直接把缓冲区交给NSData，不再拷贝
+    char *bytes = realloc(writer.buffer.bytes, writer.buffer.length) ?: writer.buffer.bytes;
+    return [[NSData alloc] initWithBytesNoCopy:bytes length:writer.buffer.length freeWhenDone:YES];
+}
+
+// 写入器处理不了时，先按字段表把模型转成字典，NSJSONSerialization才能编码；超过深度限制的部分原样保留，交给NSJSONSerialization校验
+static id AFJSONObjectByConvertingModels(id value, AFJSONFieldMap *fieldMap, NSUInteger depth) {
+    if (!fieldMap || depth >= AFJSONWriterMaximumDepth) {
+        return value;
+    }
+
+    if ([value isKindOfClass:[NSDictionary class]]) {
+        NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:[value count]];
+        [(NSDictionary *)value enumerateKeysAndObjectsUsingBlock:^(id key, id object, BOOL *stop) {
+            dictionary[key] = AFJSONObjectByConvertingModels(object, fieldMap, depth + 1);
+        }];
+        return dictionary;
+    } else if ([value isKindOfClass:[NSArray class]]) {
+        NSMutableArray *array = [NSMutableArray arrayWithCapacity:[value count]];
+        for (id element in value) {
+            [array addObject:AFJSONObjectByConvertingModels(element, fieldMap, depth + 1)];
+        }
+        return array;
+    } else if ([value isKindOfClass:fieldMap.modelClass]) {
+        NSMutableDictionary *dictionary = [NSMutableDictionary dictionary];
+        [fieldMap af_enumerateValuesOfModel:value usingBlock:^(const char *key, size_t keyLength, id object, AFJSONFieldMap *nestedFieldMap, BOOL *stop) {
+            if (!object) {
+                return;
+            }
+            NSString *name = [[NSString alloc] initWithBytes:key length:keyLength encoding:NSUTF8StringEncoding];
+            dictionary[name] = AFJSONObjectByConvertingModels(object, nestedFieldMap, depth + 1);
+        }];
+        return dictionary;
+    }
+
+    return value;
+}
+
+#pragma mark -
+
+@implementation AFJSONRequestSerializer {
+    // 上一次编码出的请求体长度，没有设置bodySizeHint时用来预分配缓冲区
+    _Atomic(NSUInteger) _lastBodyLength;
+}
+
++ (instancetype)serializer {
+    return [self serializerWithWritingOptions:(NSJSONWritingOptions)0];
+}
+
++ (instancetype)serializerWithWritingOptions:(NSJSONWritingOptions)writingOptions
+{
+    AFJSONRequestSerializer *serializer = [[self alloc] init];
+    serializer.writingOptions = writingOptions;
+
+    return serializer;
+}
+
+#pragma mark - AFURLRequestSerialization
+
+- (NSURLRequest *)requestBySerializingRequest:(NSURLRequest *)request
+                               withParameters:(id)parameters
+                                        error:(NSError *__autoreleasing *)error
+{
+    NSParameterAssert(request);
+    /*
+     对于`GET`,`HEAD`,`DELETE`等方法中。直接使用父类的处理方式
+     */
+    if ([self.HTTPMethodsEncodingParametersInURI containsObject:[[request HTTPMethod] uppercaseString]]) {
+        return [super requestBySerializingRequest:request withParameters:parameters error:error];
+    }
+
+    NSMutableURLRequest *mutableRequest = [request mutableCopy];
+    //把`HTTPRequestHeaders`中的值添加进入请求头中。
+    AFHTTPRequestApplyHeaders(self.HTTPRequestHeaders, request, mutableRequest);
+
+    if (parameters) {
+        if (![mutableRequest valueForHTTPHeaderField:@"Content-Type"]) {
+            [mutableRequest setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+        }
+
+        // 一遍完成校验和编码，遇到写入器不处理的对象再退回到NSJSONSerialization
+        NSUInteger sizeHint = self.bodySizeHint ?: atomic_load_explicit(&_lastBodyLength, memory_order_relaxed);
+        NSData *jsonData = AFJSONWriterCreateData(parameters, self.fieldMap, self.writingOptions, sizeHint);
+
+        if (!jsonData) {
+            id JSONObject = AFJSONObjectByConvertingModels(parameters, self.fieldMap, 0);
+            if (![NSJSONSerialization isValidJSONObject:JSONObject]) {
+                if (error) {
+                    NSDictionary *userInfo = @{NSLocalizedFailureReasonErrorKey: NSLocalizedStringFromTable(@"The `parameters` argument is not valid JSON.", @"AFNetworking", nil)};
+                    *error = [[NSError alloc] initWithDomain:AFURLRequestSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:userInfo];
+                }
+                return nil;
+            }
+
+            jsonData = [NSJSONSerialization dataWithJSONObject:JSONObject options:self.writingOptions error:error];
+        }
         
         if (!jsonData) {
             return nil;
         }
-        
+
+        atomic_store_explicit(&_lastBodyLength, jsonData.length, memory_order_relaxed);
         [mutableRequest setHTTPBody:jsonData];
     }
 
@@ -1457,6 +2595,7 @@ typedef enum {
     }
 
     self.writingOptions = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(writingOptions))] unsignedIntegerValue];
+    self.bodySizeHint = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(bodySizeHint))] unsignedIntegerValue];
 
     return self;
 }
@@ -1465,6 +2604,7 @@ typedef enum {
     [super encodeWithCoder:coder];
 
     [coder encodeObject:@(self.writingOptions) forKey:NSStringFromSelector(@selector(writingOptions))];
+    [coder encodeObject:@(self.bodySizeHint) forKey:NSStringFromSelector(@selector(bodySizeHint))];
 }
 
 #pragma mark - NSCopying
@@ -1472,6 +2612,8 @@ typedef enum {
 - (instancetype)copyWithZone:(NSZone *)zone {
     AFJSONRequestSerializer *serializer = [super copyWithZone:zone];
     serializer.writingOptions = self.writingOptions;
+    serializer.bodySizeHint = self.bodySizeHint;
+    serializer.fieldMap = self.fieldMap;
 
     return serializer;
 }
@@ -1510,11 +2652,7 @@ typedef enum {
 
     NSMutableURLRequest *mutableRequest = [request mutableCopy];
 
-    [self.HTTPRequestHeaders enumerateKeysAndObjectsUsingBlock:^(id field, id value, BOOL * __unused stop) {
-        if (![request valueForHTTPHeaderField:field]) {
-            [mutableRequest setValue:value forHTTPHeaderField:field];
-        }
-    }];
+    AFHTTPRequestApplyHeaders(self.HTTPRequestHeaders, request, mutableRequest);
 
     if (parameters) {
         if (![mutableRequest valueForHTTPHeaderField:@"Content-Type"]) {
@@ -107,6 +107,43 @@ FOUNDATION_EXPORT id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJ
 
 #pragma mark -
 
+/**
+ The `AFJSONParsing` protocol is adopted by objects that decode JSON data on behalf of `AFJSONResponseSerializer`, in place of `NSJSONSerialization`.
+ */
+@protocol AFJSONParsing <NSObject>
+
+/**
+ Decodes the specified JSON data.
+
+ @param data The JSON data to decode.
+ @param options The reading options, see `NSJSONReadingOptions`.
+ @param removesKeysWithNullValues Whether `NSNull` values must be left out of the decoded containers.
+ @param error The error that occurred while attempting to decode the data.
+
+ @return The decoded object, or `nil` if the data could not be decoded.
+ */
+- (nullable id)JSONObjectWithData:(NSData *)data
+                          options:(NSJSONReadingOptions)options
+        removesKeysWithNullValues:(BOOL)removesKeysWithNullValues
+                            error:(NSError * _Nullable __autoreleasing *)error;
+
+@end
+
+/**
+ `AFJSONScanner` is a high-throughput `AFJSONParsing` backend. It scans string contents eight bytes at a time, reuses the string objects of repeated dictionary keys, and leaves out `NSNull` values while parsing rather than copying the decoded tree a second time.
+
+ Containers are always created mutable. Input it does not handle, such as UTF-16 or UTF-32 encoded JSON, is decoded with `NSJSONSerialization`.
+ */
+@interface AFJSONScanner : NSObject <AFJSONParsing>
+
+/**
+ Creates and returns a scanner.
+ */
++ (instancetype)scanner;
+
+@end
+
+#pragma mark -
 
 /**
  `AFJSONResponseSerializer` is a subclass of `AFHTTPResponseSerializer` that validates and decodes JSON responses.
@@ -133,6 +170,11 @@ FOUNDATION_EXPORT id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJ
  */
 @property (nonatomic, assign) BOOL removesKeysWithNullValues;
 
+/**
+ The parser used to decode response data, for example an `AFJSONScanner`. When `nil` (default), `NSJSONSerialization` is used. The parser is not archived with the serializer.
+ */
+@property (nonatomic, strong, nullable) id <AFJSONParsing> JSONParser;
+
 /**
  Creates and returns a JSON serializer with specified reading and writing options.
 
@@ -144,6 +186,132 @@ FOUNDATION_EXPORT id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJ
 
 #pragma mark -
 
+/**
+ The `AFURLResponseIncrementalParsing` protocol is adopted by an object that consumes response data chunk by chunk as it arrives from the network, so that most of the decoding work is done by the time the last byte is received.
+ */
+@protocol AFURLResponseIncrementalParsing <NSObject>
+
+/**
+ Consumes the next chunk of response data. Chunks are appended in the order they were received, on a serial queue owned by the task.
+
+ @param data The received chunk.
+ */
+- (void)appendData:(NSData *)data;
+
+@end
+
+/**
+ The `AFURLResponseIncrementalSerialization` protocol is adopted by response serializers which can decode a response while its data is still arriving.
+
+ `AFURLSessionManager` asks the serializer for an incremental parser when the first chunk of a data task arrives, feeds every chunk to that parser, and calls `responseObjectForResponse:data:incrementalParser:error:` instead of `responseObjectForResponse:data:error:` when the task completes.
+ */
+// 增量解析协议，数据一边到达一边解析，请求结束时对象树基本已经构建完成
+@protocol AFURLResponseIncrementalSerialization <AFURLResponseSerialization>
+
+/**
+ Creates a parser for the data of the specified response.
+
+ @param response The response whose data will be parsed.
+
+ @return A new parser, or `nil` if the response should be decoded the regular way once all of its data has arrived.
+ */
+- (nullable id <AFURLResponseIncrementalParsing>)incrementalParserForResponse:(nullable NSURLResponse *)response;
+
+/**
+ The response object decoded by the specified incremental parser.
+
+ @param response The response to be processed.
+ @param data The complete response data. Serializers fall back to decoding it directly when the incremental parser failed.
+ @param parser The parser which has been fed all of the response data.
+ @param error The error that occurred while attempting to decode the response data.
+
+ @return The object decoded from the specified response data.
+ */
+- (nullable id)responseObjectForResponse:(nullable NSURLResponse *)response
+                                    data:(nullable NSData *)data
+                       incrementalParser:(id <AFURLResponseIncrementalParsing>)parser
+                                   error:(NSError * _Nullable __autoreleasing *)error NS_SWIFT_NOTHROW;
+
+@end
+
+#pragma mark -
+
+/**
+ `AFStreamingJSONResponseSerializer` is a subclass of `AFJSONResponseSerializer` that parses UTF-8 JSON responses incrementally as their data arrives, instead of handing the whole buffer to `NSJSONSerialization` after the last byte.
+
+ Containers are always created mutable. Responses in other encodings, or input the incremental parser does not accept, are decoded with `NSJSONSerialization` once the response completes, so errors are reported exactly as by `AFJSONResponseSerializer`.
+ */
+@interface AFStreamingJSONResponseSerializer : AFJSONResponseSerializer <AFURLResponseIncrementalSerialization>
+
+@end
+
+#pragma mark -
+
+/**
+ `AFJSONFieldMap` describes how the keys of a JSON object map onto the properties of a model class. The map is compiled once, resolving every property's accessors and type ahead of time, so decoding, and encoding with `AFJSONRequestSerializer`, does not have to go through `NSDictionary` or key-value coding.
+
+ Supported property types are the integer, floating point and `BOOL` scalars, `NSString`, `NSNumber`, `id`, `NSArray` and nested model objects. Properties which are readonly or of any other type are ignored, as are JSON keys missing from the map.
+ */
+@interface AFJSONFieldMap : NSObject
+
+/**
+ The class of the objects decoded with this map. It is instantiated with `-init`.
+ */
+@property (readonly, nonatomic, strong) Class modelClass;
+
+/**
+ Creates and returns a field map for the specified model class.
+
+ @param modelClass The model class.
+ @param propertiesByJSONKey The names of the properties of `modelClass`, keyed by the JSON keys they are decoded from.
+ */
++ (instancetype)fieldMapWithModelClass:(Class)modelClass
+                   propertiesByJSONKey:(NSDictionary <NSString *, NSString *> *)propertiesByJSONKey;
+
+/**
+ Creates and returns a field map for the specified model class, decoding nested JSON objects into model objects.
+
+ @param modelClass The model class.
+ @param propertiesByJSONKey The names of the properties of `modelClass`, keyed by the JSON keys they are decoded from.
+ @param fieldMapsByProperty The field maps of nested models, keyed by property name. For `NSArray` properties, the field map describes the elements of the array.
+ */
++ (instancetype)fieldMapWithModelClass:(Class)modelClass
+                   propertiesByJSONKey:(NSDictionary <NSString *, NSString *> *)propertiesByJSONKey
+                   fieldMapsByProperty:(nullable NSDictionary <NSString *, AFJSONFieldMap *> *)fieldMapsByProperty;
+
+@end
+
+#pragma mark -
+
+/**
+ `AFJSONModelResponseSerializer` is a subclass of `AFHTTPResponseSerializer` that decodes UTF-8 JSON responses directly into model objects described by an `AFJSONFieldMap`, as the data arrives, without building the intermediate `NSDictionary` and `NSArray` objects.
+
+ A top-level JSON object is decoded into a model object, and a top-level array into an array of model objects. `null` values leave the corresponding property untouched.
+
+ By default, `AFJSONModelResponseSerializer` accepts the following MIME types:
+
+ - `application/json`
+ - `text/json`
+ - `text/javascript`
+ */
+@interface AFJSONModelResponseSerializer : AFHTTPResponseSerializer <AFURLResponseIncrementalSerialization>
+
+/**
+ The field map of the top-level model. If `nil`, responses are decoded with `NSJSONSerialization` into Foundation objects, as `AFJSONResponseSerializer` does.
+ */
+@property (nonatomic, strong, nullable) AFJSONFieldMap *fieldMap;
+
+/**
+ Creates and returns a model serializer with the specified field map.
+
+ @param fieldMap The field map of the top-level model.
+ */
++ (instancetype)serializerWithFieldMap:(nullable AFJSONFieldMap *)fieldMap;
+
+@end
+
+#pragma mark -
+
 /**
  `AFXMLParserResponseSerializer` is a subclass of `AFHTTPResponseSerializer` that validates and decodes XML responses as an `NSXMLParser` objects.
 
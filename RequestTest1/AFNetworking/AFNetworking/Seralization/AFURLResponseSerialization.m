@@ -22,6 +22,7 @@
 #import "AFURLResponseSerialization.h"
 
 #import <TargetConditionals.h>
+#import <objc/runtime.h>
 
 #if TARGET_OS_IOS
 #import <UIKit/UIKit.h>
@@ -290,54 +291,1503 @@ id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingOptions
     
     NSError *serializationError = nil;
     
-    id responseObject = [NSJSONSerialization JSONObjectWithData:data options:self.readingOptions error:&serializationError];
+    id responseObject = nil;
+    if (self.JSONParser) {
+        responseObject = [self.JSONParser JSONObjectWithData:data options:self.readingOptions removesKeysWithNullValues:self.removesKeysWithNullValues error:&serializationError];
+    } else {
+        responseObject = [NSJSONSerialization JSONObjectWithData:data options:self.readingOptions error:&serializationError];
+    }
+
+    if (!responseObject)
+    {
+        if (error) {
+            *error = AFErrorWithUnderlyingError(serializationError, *error);
+        }
+        return nil;
+    }
+    //移除json中的null，自定义解析器在解析过程中已经处理过了
+    if (self.removesKeysWithNullValues && !self.JSONParser) {
+        return AFJSONObjectByRemovingKeysWithNullValues(responseObject, self.readingOptions);
+    }
+
+    return responseObject;
+}
+
+#pragma mark - NSSecureCoding
+
++ (BOOL)supportsSecureCoding {
+    return YES;
+}
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+    self = [super initWithCoder:decoder];
+    if (!self) {
+        return nil;
+    }
+
+    self.readingOptions = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(readingOptions))] unsignedIntegerValue];
+    self.removesKeysWithNullValues = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(removesKeysWithNullValues))] boolValue];
+
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+    [super encodeWithCoder:coder];
+
+    [coder encodeObject:@(self.readingOptions) forKey:NSStringFromSelector(@selector(readingOptions))];
+    [coder encodeObject:@(self.removesKeysWithNullValues) forKey:NSStringFromSelector(@selector(removesKeysWithNullValues))];
+}
+
+#pragma mark - NSCopying
+
+- (instancetype)copyWithZone:(NSZone *)zone {
+    AFJSONResponseSerializer *serializer = [super copyWithZone:zone];
+    serializer.readingOptions = self.readingOptions;
+    serializer.removesKeysWithNullValues = self.removesKeysWithNullValues;
+    serializer.JSONParser = self.JSONParser;
+
+    return serializer;
+}
+
+@end
+
+#pragma mark - AFJSONTokenizer
+
+// 增量JSON词法/语法分析器，纯C实现，可以分块喂数据，token跨块时暂存在buffer里
+// 解析到的每个值通过回调交给上层构建对象，遇到任何不认识的输入直接失败，由上层回退到NSJSONSerialization
+#define AFJSONTokenizerMaximumDepth 512
+
+typedef enum {
+    AFJSONTokenNone = 0,
+    AFJSONTokenString,
+    AFJSONTokenStringEscape,
+    AFJSONTokenStringUnicode,
+    AFJSONTokenNumber,
+    AFJSONTokenLiteral,
+} AFJSONTokenState;
+
+typedef enum {
+    AFJSONExpectValue = 0,
+    AFJSONExpectFirstValueOrEnd,
+    AFJSONExpectFirstKeyOrEnd,
+    AFJSONExpectKey,
+    AFJSONExpectColon,
+    AFJSONExpectCommaOrEnd,
+    AFJSONExpectNothing,
+} AFJSONGrammarState;
+
+typedef enum {
+    AFJSONLiteralNull = 0,
+    AFJSONLiteralTrue,
+    AFJSONLiteralFalse,
+} AFJSONLiteral;
+
+typedef struct {
+    BOOL (*beginContainer)(void *context, BOOL isObject);
+    BOOL (*endContainer)(void *context, BOOL isObject);
+    BOOL (*key)(void *context, const char *bytes, size_t length);
+    BOOL (*string)(void *context, const char *bytes, size_t length);
+    BOOL (*number)(void *context, const char *bytes, size_t length, BOOL isInteger);
+    BOOL (*literal)(void *context, AFJSONLiteral literal);
+} AFJSONTokenizerCallbacks;
+
+typedef struct {
+    AFJSONTokenizerCallbacks callbacks;
+    void *context;
+    AFJSONGrammarState state;
+    AFJSONTokenState token;
+    BOOL stringIsKey;
+    BOOL allowsFragments;
+    BOOL failed;
+    // 容器栈，YES为object，NO为array
+    BOOL stack[AFJSONTokenizerMaximumDepth];
+    size_t depth;
+    // 当前token的内容（字符串已经反转义为UTF-8），始终以'\0'结尾
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    uint32_t codePoint;
+    uint32_t highSurrogate;
+    int codePointDigits;
+} AFJSONTokenizer;
+
+static void AFJSONTokenizerInit(AFJSONTokenizer *tokenizer, AFJSONTokenizerCallbacks callbacks, void *context, BOOL allowsFragments) {
+    memset(tokenizer, 0, sizeof(AFJSONTokenizer));
+    tokenizer->callbacks = callbacks;
+    tokenizer->context = context;
+    tokenizer->allowsFragments = allowsFragments;
+}
+
+static void AFJSONTokenizerDestroy(AFJSONTokenizer *tokenizer) {
+    free(tokenizer->buffer);
+    tokenizer->buffer = NULL;
+    tokenizer->length = tokenizer->capacity = 0;
+}
+
+static BOOL AFJSONTokenizerAppendBytes(AFJSONTokenizer *tokenizer, const void *bytes, size_t length) {
+    if (tokenizer->length + length + 1 > tokenizer->capacity) {
+        size_t capacity = tokenizer->capacity ? tokenizer->capacity : 64;
+        while (tokenizer->length + length + 1 > capacity) {
+            capacity *= 2;
+        }
+        char *buffer = realloc(tokenizer->buffer, capacity);
+        if (!buffer) {
+            return NO;
+        }
+        tokenizer->buffer = buffer;
+        tokenizer->capacity = capacity;
+    }
+    memcpy(tokenizer->buffer + tokenizer->length, bytes, length);
+    tokenizer->length += length;
+    tokenizer->buffer[tokenizer->length] = '\0';
+
+    return YES;
+}
+
+static BOOL AFJSONTokenizerAppendCodePoint(AFJSONTokenizer *tokenizer, uint32_t codePoint) {
+    unsigned char utf8[4];
+    size_t length = 0;
+    if (codePoint < 0x80) {
+        utf8[length++] = (unsigned char)codePoint;
+    } else if (codePoint < 0x800) {
+        utf8[length++] = (unsigned char)(0xC0 | (codePoint >> 6));
+        utf8[length++] = (unsigned char)(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        utf8[length++] = (unsigned char)(0xE0 | (codePoint >> 12));
+        utf8[length++] = (unsigned char)(0x80 | ((codePoint >> 6) & 0x3F));
+        utf8[length++] = (unsigned char)(0x80 | (codePoint & 0x3F));
+    } else {
+        utf8[length++] = (unsigned char)(0xF0 | (codePoint >> 18));
+        utf8[length++] = (unsigned char)(0x80 | ((codePoint >> 12) & 0x3F));
+        utf8[length++] = (unsigned char)(0x80 | ((codePoint >> 6) & 0x3F));
+        utf8[length++] = (unsigned char)(0x80 | (codePoint & 0x3F));
+    }
+
+    return AFJSONTokenizerAppendBytes(tokenizer, utf8, length);
+}
+
+// 按JSON语法校验数字：-?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static BOOL AFJSONNumberIsValid(const char *bytes, size_t length, BOOL *isInteger) {
+    size_t i = 0;
+    *isInteger = YES;
+    if (i < length && bytes[i] == '-') {
+        i++;
+    }
+    if (i >= length) {
+        return NO;
+    }
+    if (bytes[i] == '0') {
+        i++;
+    } else if (bytes[i] >= '1' && bytes[i] <= '9') {
+        while (i < length && bytes[i] >= '0' && bytes[i] <= '9') {
+            i++;
+        }
+    } else {
+        return NO;
+    }
+    if (i < length && bytes[i] == '.') {
+        *isInteger = NO;
+        size_t start = ++i;
+        while (i < length && bytes[i] >= '0' && bytes[i] <= '9') {
+            i++;
+        }
+        if (i == start) {
+            return NO;
+        }
+    }
+    if (i < length && (bytes[i] == 'e' || bytes[i] == 'E')) {
+        *isInteger = NO;
+        i++;
+        if (i < length && (bytes[i] == '+' || bytes[i] == '-')) {
+            i++;
+        }
+        size_t start = i;
+        while (i < length && bytes[i] >= '0' && bytes[i] <= '9') {
+            i++;
+        }
+        if (i == start) {
+            return NO;
+        }
+    }
+
+    return i == length;
+}
+
+static inline void AFJSONTokenizerValueCompleted(AFJSONTokenizer *tokenizer) {
+    tokenizer->state = tokenizer->depth == 0 ? AFJSONExpectNothing : AFJSONExpectCommaOrEnd;
+}
+
+// 当前位置能否开始一个值，顶层的非容器值需要NSJSONReadingAllowFragments
+static inline BOOL AFJSONTokenizerCanBeginValue(AFJSONTokenizer *tokenizer, BOOL isContainer) {
+    if (tokenizer->state != AFJSONExpectValue && tokenizer->state != AFJSONExpectFirstValueOrEnd) {
+        return NO;
+    }
+
+    return isContainer || tokenizer->depth > 0 || tokenizer->allowsFragments;
+}
+
+static BOOL AFJSONTokenizerEmitToken(AFJSONTokenizer *tokenizer) {
+    AFJSONTokenState token = tokenizer->token;
+    tokenizer->token = AFJSONTokenNone;
+
+    if (token == AFJSONTokenNumber) {
+        BOOL isInteger = YES;
+        if (!AFJSONNumberIsValid(tokenizer->buffer, tokenizer->length, &isInteger) ||
+            !tokenizer->callbacks.number(tokenizer->context, tokenizer->buffer, tokenizer->length, isInteger)) {
+            return NO;
+        }
+    } else if (token == AFJSONTokenLiteral) {
+        AFJSONLiteral literal;
+        if (tokenizer->length == 4 && memcmp(tokenizer->buffer, "null", 4) == 0) {
+            literal = AFJSONLiteralNull;
+        } else if (tokenizer->length == 4 && memcmp(tokenizer->buffer, "true", 4) == 0) {
+            literal = AFJSONLiteralTrue;
+        } else if (tokenizer->length == 5 && memcmp(tokenizer->buffer, "false", 5) == 0) {
+            literal = AFJSONLiteralFalse;
+        } else {
+            return NO;
+        }
+        if (!tokenizer->callbacks.literal(tokenizer->context, literal)) {
+            return NO;
+        }
+    } else if (token == AFJSONTokenString) {
+        if (tokenizer->highSurrogate) {
+            return NO;
+        }
+        if (tokenizer->stringIsKey) {
+            if (!tokenizer->callbacks.key(tokenizer->context, tokenizer->buffer, tokenizer->length)) {
+                return NO;
+            }
+            tokenizer->state = AFJSONExpectColon;
+            return YES;
+        }
+        if (!tokenizer->callbacks.string(tokenizer->context, tokenizer->buffer, tokenizer->length)) {
+            return NO;
+        }
+    }
+
+    AFJSONTokenizerValueCompleted(tokenizer);
+
+    return YES;
+}
+
+static BOOL AFJSONTokenizerBeginToken(AFJSONTokenizer *tokenizer, AFJSONTokenState token, unsigned char byte) {
+    tokenizer->token = token;
+    tokenizer->length = 0;
+    if (token == AFJSONTokenString) {
+        return AFJSONTokenizerAppendBytes(tokenizer, "", 0);
+    }
+
+    return AFJSONTokenizerAppendBytes(tokenizer, &byte, 1);
+}
+
+static BOOL AFJSONTokenizerConsumeStructural(AFJSONTokenizer *tokenizer, unsigned char byte) {
+    switch (byte) {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            return YES;
+        case '{':
+        case '[': {
+            BOOL isObject = byte == '{';
+            if (!AFJSONTokenizerCanBeginValue(tokenizer, YES) || tokenizer->depth >= AFJSONTokenizerMaximumDepth) {
+                return NO;
+            }
+            if (!tokenizer->callbacks.beginContainer(tokenizer->context, isObject)) {
+                return NO;
+            }
+            tokenizer->stack[tokenizer->depth++] = isObject;
+            tokenizer->state = isObject ? AFJSONExpectFirstKeyOrEnd : AFJSONExpectFirstValueOrEnd;
+            return YES;
+        }
+        case '}':
+        case ']': {
+            BOOL isObject = byte == '}';
+            BOOL canEnd = tokenizer->state == (isObject ? AFJSONExpectFirstKeyOrEnd : AFJSONExpectFirstValueOrEnd) ||
+                          (tokenizer->state == AFJSONExpectCommaOrEnd && tokenizer->depth > 0 && tokenizer->stack[tokenizer->depth - 1] == isObject);
+            if (!canEnd) {
+                return NO;
+            }
+            tokenizer->depth--;
+            if (!tokenizer->callbacks.endContainer(tokenizer->context, isObject)) {
+                return NO;
+            }
+            AFJSONTokenizerValueCompleted(tokenizer);
+            return YES;
+        }
+        case ',':
+            if (tokenizer->state != AFJSONExpectCommaOrEnd) {
+                return NO;
+            }
+            tokenizer->state = tokenizer->stack[tokenizer->depth - 1] ? AFJSONExpectKey : AFJSONExpectValue;
+            return YES;
+        case ':':
+            if (tokenizer->state != AFJSONExpectColon) {
+                return NO;
+            }
+            tokenizer->state = AFJSONExpectValue;
+            return YES;
+        case '"':
+            if (tokenizer->state == AFJSONExpectFirstKeyOrEnd || tokenizer->state == AFJSONExpectKey) {
+                tokenizer->stringIsKey = YES;
+            } else if (AFJSONTokenizerCanBeginValue(tokenizer, NO)) {
+                tokenizer->stringIsKey = NO;
+            } else {
+                return NO;
+            }
+            return AFJSONTokenizerBeginToken(tokenizer, AFJSONTokenString, byte);
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            if (!AFJSONTokenizerCanBeginValue(tokenizer, NO)) {
+                return NO;
+            }
+            return AFJSONTokenizerBeginToken(tokenizer, AFJSONTokenNumber, byte);
+        case 't':
+        case 'f':
+        case 'n':
+            if (!AFJSONTokenizerCanBeginValue(tokenizer, NO)) {
+                return NO;
+            }
+            return AFJSONTokenizerBeginToken(tokenizer, AFJSONTokenLiteral, byte);
+        default:
+            return NO;
+    }
+}
+
+static inline int AFJSONHexDigitValue(unsigned char byte) {
+    if (byte >= '0' && byte <= '9') {
+        return byte - '0';
+    } else if (byte >= 'a' && byte <= 'f') {
+        return byte - 'a' + 10;
+    } else if (byte >= 'A' && byte <= 'F') {
+        return byte - 'A' + 10;
+    }
+
+    return -1;
+}
+
+static BOOL AFJSONTokenizerConsumeEscape(AFJSONTokenizer *tokenizer, unsigned char byte) {
+    // 高代理项后面必须紧跟\uXXXX形式的低代理项
+    if (tokenizer->highSurrogate && byte != 'u') {
+        return NO;
+    }
+
+    char unescaped;
+    switch (byte) {
+        case '"':  unescaped = '"';  break;
+        case '\\': unescaped = '\\'; break;
+        case '/':  unescaped = '/';  break;
+        case 'b':  unescaped = '\b'; break;
+        case 'f':  unescaped = '\f'; break;
+        case 'n':  unescaped = '\n'; break;
+        case 'r':  unescaped = '\r'; break;
+        case 't':  unescaped = '\t'; break;
+        case 'u':
+            tokenizer->token = AFJSONTokenStringUnicode;
+            tokenizer->codePoint = 0;
+            tokenizer->codePointDigits = 0;
+            return YES;
+        default:
+            return NO;
+    }
+    tokenizer->token = AFJSONTokenString;
+
+    return AFJSONTokenizerAppendBytes(tokenizer, &unescaped, 1);
+}
+
+static BOOL AFJSONTokenizerConsumeUnicode(AFJSONTokenizer *tokenizer, unsigned char byte) {
+    int digit = AFJSONHexDigitValue(byte);
+    if (digit < 0) {
+        return NO;
+    }
+    tokenizer->codePoint = (tokenizer->codePoint << 4) | (uint32_t)digit;
+    if (++tokenizer->codePointDigits < 4) {
+        return YES;
+    }
+    tokenizer->token = AFJSONTokenString;
+
+    uint32_t codePoint = tokenizer->codePoint;
+    if (tokenizer->highSurrogate) {
+        if (codePoint < 0xDC00 || codePoint > 0xDFFF) {
+            return NO;
+        }
+        codePoint = 0x10000 + ((tokenizer->highSurrogate - 0xD800) << 10) + (codePoint - 0xDC00);
+        tokenizer->highSurrogate = 0;
+    } else if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+        tokenizer->highSurrogate = codePoint;
+        return YES;
+    } else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+        return NO;
+    }
+
+    return AFJSONTokenizerAppendCodePoint(tokenizer, codePoint);
+}
+
+// SWAR：把8个字节当成一个uint64_t，一次判断其中有没有引号、反斜杠或控制字符（(x - 0x01..) & ~x & 0x80..不为0说明有字节为0）
+static inline BOOL AFJSONWordHasSpecialStringByte(uint64_t word) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highBits = 0x8080808080808080ULL;
+    uint64_t quote = word ^ (ones * '"');
+    uint64_t backslash = word ^ (ones * '\\');
+    uint64_t special = ((quote - ones) & ~quote) | ((backslash - ones) & ~backslash) | ((word - ones * 0x20) & ~word);
+
+    return (special & highBits) != 0;
+}
+
+// 返回从start开始第一个需要特殊处理的字符串字节的位置，没有则返回length
+static inline size_t AFJSONScanStringBytes(const unsigned char *bytes, size_t start, size_t length) {
+    size_t i = start;
+    while (i + sizeof(uint64_t) <= length) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(uint64_t));
+        if (AFJSONWordHasSpecialStringByte(word)) {
+            break;
+        }
+        i += sizeof(uint64_t);
+    }
+    while (i < length && bytes[i] != '"' && bytes[i] != '\\' && bytes[i] >= 0x20) {
+        i++;
+    }
+
+    return i;
+}
+
+static BOOL AFJSONTokenizerConsume(AFJSONTokenizer *tokenizer, const unsigned char *bytes, size_t length) {
+    if (tokenizer->failed) {
+        return NO;
+    }
+
+    size_t i = 0;
+    while (i < length) {
+        unsigned char byte = bytes[i];
+        BOOL succeeded = YES;
+        switch (tokenizer->token) {
+            case AFJSONTokenString: {
+                // 字符串内部的普通字符批量拷贝，只有遇到引号、反斜杠和控制字符才逐个处理
+                size_t start = i;
+                i = AFJSONScanStringBytes(bytes, i, length);
+                if (i > start && (tokenizer->highSurrogate || !AFJSONTokenizerAppendBytes(tokenizer, bytes + start, i - start))) {
+                    succeeded = NO;
+                    break;
+                }
+                if (i == length) {
+                    continue;
+                }
+                byte = bytes[i];
+                if (byte == '"') {
+                    succeeded = AFJSONTokenizerEmitToken(tokenizer);
+                } else if (byte == '\\') {
+                    tokenizer->token = AFJSONTokenStringEscape;
+                } else {
+                    succeeded = NO;
+                }
+                i++;
+                break;
+            }
+            case AFJSONTokenStringEscape:
+                succeeded = AFJSONTokenizerConsumeEscape(tokenizer, byte);
+                i++;
+                break;
+            case AFJSONTokenStringUnicode:
+                succeeded = AFJSONTokenizerConsumeUnicode(tokenizer, byte);
+                i++;
+                break;
+            case AFJSONTokenNumber:
+                if ((byte >= '0' && byte <= '9') || byte == '-' || byte == '+' || byte == '.' || byte == 'e' || byte == 'E') {
+                    succeeded = AFJSONTokenizerAppendBytes(tokenizer, &byte, 1);
+                    i++;
+                } else {
+                    // 数字没有结束符，遇到其他字符时才算结束，这个字符还要继续按结构字符处理
+                    succeeded = AFJSONTokenizerEmitToken(tokenizer);
+                }
+                break;
+            case AFJSONTokenLiteral:
+                if (byte >= 'a' && byte <= 'z') {
+                    succeeded = tokenizer->length < 5 && AFJSONTokenizerAppendBytes(tokenizer, &byte, 1);
+                    i++;
+                } else {
+                    succeeded = AFJSONTokenizerEmitToken(tokenizer);
+                }
+                break;
+            case AFJSONTokenNone:
+                succeeded = AFJSONTokenizerConsumeStructural(tokenizer, byte);
+                i++;
+                break;
+        }
+
+        if (!succeeded) {
+            tokenizer->failed = YES;
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+// 数据全部到达，结束最后一个数字或字面量，并确认得到了一个完整的JSON值
+static BOOL AFJSONTokenizerFinish(AFJSONTokenizer *tokenizer) {
+    if (tokenizer->failed) {
+        return NO;
+    }
+    if (tokenizer->token == AFJSONTokenNumber || tokenizer->token == AFJSONTokenLiteral) {
+        if (!AFJSONTokenizerEmitToken(tokenizer)) {
+            tokenizer->failed = YES;
+            return NO;
+        }
+    }
+
+    return tokenizer->token == AFJSONTokenNone && tokenizer->state == AFJSONExpectNothing;
+}
+
+#pragma mark -
+
+// FNV-1a
+static inline uint32_t AFJSONHashBytes(const char *bytes, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// bytes以'\0'结尾，返回YES表示得到的是整数，整数溢出时按浮点数处理
+static BOOL AFJSONParseNumber(const char *bytes, BOOL isInteger, long long *integerValue, double *doubleValue) {
+    if (isInteger) {
+        errno = 0;
+        *integerValue = strtoll(bytes, NULL, 10);
+        if (errno != ERANGE) {
+            return YES;
+        }
+    }
+    *doubleValue = strtod(bytes, NULL);
+
+    return NO;
+}
+
+static NSNumber * AFJSONNumberWithBytes(const char *bytes, BOOL isInteger) {
+    long long integerValue = 0;
+    double doubleValue = 0;
+    if (AFJSONParseNumber(bytes, isInteger, &integerValue, &doubleValue)) {
+        return @(integerValue);
+    }
+
+    return @(doubleValue);
+}
+
+#pragma mark - AFJSONStreamingParser
+
+@interface AFJSONStreamingParser : NSObject <AFURLResponseIncrementalParsing>
+
+- (instancetype)initWithReadingOptions:(NSJSONReadingOptions)readingOptions
+             removesKeysWithNullValues:(BOOL)removesKeysWithNullValues;
+
+/**
+ Finishes parsing. Returns `NO` if the data fed so far is not one complete JSON value.
+ */
+- (BOOL)finish;
+
+@property (readonly, nonatomic, strong) id JSONObject;
+
+@end
+
+// 对象数组里同样的key会反复出现，用一个直接映射的小缓存复用key字符串，减少NSString的创建
+#define AFJSONKeyCacheSize 64
+#define AFJSONKeyCacheMaximumKeyLength 32
+
+typedef struct {
+    CFStringRef string;
+    size_t length;
+    char bytes[AFJSONKeyCacheMaximumKeyLength];
+} AFJSONKeyCacheEntry;
+
+@implementation AFJSONStreamingParser {
+    AFJSONTokenizer _tokenizer;
+    NSJSONReadingOptions _readingOptions;
+    BOOL _removesKeysWithNullValues;
+    AFJSONKeyCacheEntry _keyCache[AFJSONKeyCacheSize];
+    // 正在构建的容器栈，与_tokenizer.stack一一对应
+    NSMutableArray *_containers;
+    NSString *_pendingKey;
+    id _JSONObject;
+}
+
+// 把解析出的值挂到当前容器上，没有容器时就是根对象
+static BOOL AFJSONStreamingParserAddValue(AFJSONStreamingParser *parser, id value) {
+    if (!value) {
+        return NO;
+    }
+
+    AFJSONTokenizer *tokenizer = &parser->_tokenizer;
+    if (tokenizer->depth == 0) {
+        parser->_JSONObject = value;
+    } else if (tokenizer->stack[tokenizer->depth - 1]) {
+        [(NSMutableDictionary *)parser->_containers.lastObject setObject:value forKey:parser->_pendingKey];
+        parser->_pendingKey = nil;
+    } else {
+        [(NSMutableArray *)parser->_containers.lastObject addObject:value];
+    }
+
+    return YES;
+}
+
+static BOOL AFJSONStreamingParserBeginContainer(void *context, BOOL isObject) {
+    AFJSONStreamingParser *parser = (__bridge AFJSONStreamingParser *)context;
+    id container = isObject ? [NSMutableDictionary dictionary] : [NSMutableArray array];
+    if (!AFJSONStreamingParserAddValue(parser, container)) {
+        return NO;
+    }
+    [parser->_containers addObject:container];
+
+    return YES;
+}
+
+static BOOL AFJSONStreamingParserEndContainer(void *context, __unused BOOL isObject) {
+    AFJSONStreamingParser *parser = (__bridge AFJSONStreamingParser *)context;
+    [parser->_containers removeLastObject];
+
+    return YES;
+}
+
+static NSString * AFJSONStreamingParserKeyString(AFJSONStreamingParser *parser, const char *bytes, size_t length) {
+    if (length > AFJSONKeyCacheMaximumKeyLength) {
+        return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    }
+
+    AFJSONKeyCacheEntry *entry = &parser->_keyCache[AFJSONHashBytes(bytes, length) % AFJSONKeyCacheSize];
+    if (entry->string && entry->length == length && memcmp(entry->bytes, bytes, length) == 0) {
+        return (__bridge NSString *)entry->string;
+    }
+
+    NSString *key = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    if (key) {
+        if (entry->string) {
+            CFRelease(entry->string);
+        }
+        entry->string = (__bridge_retained CFStringRef)key;
+        entry->length = length;
+        memcpy(entry->bytes, bytes, length);
+    }
+
+    return key;
+}
+
+static BOOL AFJSONStreamingParserKey(void *context, const char *bytes, size_t length) {
+    AFJSONStreamingParser *parser = (__bridge AFJSONStreamingParser *)context;
+    parser->_pendingKey = AFJSONStreamingParserKeyString(parser, bytes, length);
+
+    return parser->_pendingKey != nil;
+}
+
+static BOOL AFJSONStreamingParserString(void *context, const char *bytes, size_t length) {
+    AFJSONStreamingParser *parser = (__bridge AFJSONStreamingParser *)context;
+    Class stringClass = (parser->_readingOptions & NSJSONReadingMutableLeaves) ? [NSMutableString class] : [NSString class];
+
+    return AFJSONStreamingParserAddValue(parser, [[stringClass alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding]);
+}
+
+static BOOL AFJSONStreamingParserNumber(void *context, const char *bytes, __unused size_t length, BOOL isInteger) {
+    AFJSONStreamingParser *parser = (__bridge AFJSONStreamingParser *)context;
+
+    return AFJSONStreamingParserAddValue(parser, AFJSONNumberWithBytes(bytes, isInteger));
+}
+
+static BOOL AFJSONStreamingParserLiteral(void *context, AFJSONLiteral literal) {
+    AFJSONStreamingParser *parser = (__bridge AFJSONStreamingParser *)context;
+    switch (literal) {
+        case AFJSONLiteralNull:
+            // 解析时直接丢掉容器里的null，不需要再用AFJSONObjectByRemovingKeysWithNullValues把整棵树复制一遍
+            if (parser->_removesKeysWithNullValues && parser->_tokenizer.depth > 0) {
+                parser->_pendingKey = nil;
+                return YES;
+            }
+            return AFJSONStreamingParserAddValue(parser, [NSNull null]);
+        case AFJSONLiteralTrue:
+            return AFJSONStreamingParserAddValue(parser, @YES);
+        case AFJSONLiteralFalse:
+            return AFJSONStreamingParserAddValue(parser, @NO);
+    }
+
+    return NO;
+}
+
+- (instancetype)initWithReadingOptions:(NSJSONReadingOptions)readingOptions
+             removesKeysWithNullValues:(BOOL)removesKeysWithNullValues
+{
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    _readingOptions = readingOptions;
+    _removesKeysWithNullValues = removesKeysWithNullValues;
+    _containers = [NSMutableArray array];
+
+    AFJSONTokenizerCallbacks callbacks = {
+        .beginContainer = AFJSONStreamingParserBeginContainer,
+        .endContainer = AFJSONStreamingParserEndContainer,
+        .key = AFJSONStreamingParserKey,
+        .string = AFJSONStreamingParserString,
+        .number = AFJSONStreamingParserNumber,
+        .literal = AFJSONStreamingParserLiteral,
+    };
+    AFJSONTokenizerInit(&_tokenizer, callbacks, (__bridge void *)self, (readingOptions & NSJSONReadingAllowFragments) != 0);
+
+    return self;
+}
+
+- (void)dealloc {
+    AFJSONTokenizerDestroy(&_tokenizer);
+    for (NSUInteger i = 0; i < AFJSONKeyCacheSize; i++) {
+        if (_keyCache[i].string) {
+            CFRelease(_keyCache[i].string);
+        }
+    }
+}
+
+- (void)appendData:(NSData *)data {
+    // 使用enumerateByteRangesUsingBlock遍历，避免把不连续的dispatch_data拍平
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        if (!AFJSONTokenizerConsume(&self->_tokenizer, bytes, byteRange.length)) {
+            *stop = YES;
+        }
+    }];
+}
+
+- (BOOL)finish {
+    BOOL finished = AFJSONTokenizerFinish(&_tokenizer);
+    AFJSONTokenizerDestroy(&_tokenizer);
+    [_containers removeAllObjects];
+    _pendingKey = nil;
+
+    return finished;
+}
+
+@end
+
+#pragma mark -
+
+@implementation AFJSONScanner
+
++ (instancetype)scanner {
+    return [[self alloc] init];
+}
+
+#pragma mark - AFJSONParsing
+
+- (id)JSONObjectWithData:(NSData *)data
+                 options:(NSJSONReadingOptions)options
+removesKeysWithNullValues:(BOOL)removesKeysWithNullValues
+                   error:(NSError *__autoreleasing *)error
+{
+    AFJSONStreamingParser *parser = [[AFJSONStreamingParser alloc] initWithReadingOptions:options removesKeysWithNullValues:removesKeysWithNullValues];
+    [parser appendData:data];
+    if ([parser finish]) {
+        return parser.JSONObject;
+    }
+
+    // 处理不了的输入交给NSJSONSerialization，由它给出标准的错误信息
+    id JSONObject = [NSJSONSerialization JSONObjectWithData:data options:options error:error];
+    if (JSONObject && removesKeysWithNullValues) {
+        JSONObject = AFJSONObjectByRemovingKeysWithNullValues(JSONObject, options);
+    }
+
+    return JSONObject;
+}
+
+@end
+
+#pragma mark -
+
+@implementation AFStreamingJSONResponseSerializer
+
+#pragma mark - AFURLResponseIncrementalSerialization
+
+- (id <AFURLResponseIncrementalParsing>)incrementalParserForResponse:(NSURLResponse *)response {
+    // 状态码或content-type不合法时不做增量解析，等数据到齐后走完整流程生成对应的错误
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:nil error:NULL]) {
+        return nil;
+    }
+
+    return [[AFJSONStreamingParser alloc] initWithReadingOptions:self.readingOptions removesKeysWithNullValues:self.removesKeysWithNullValues];
+}
+
+- (id)responseObjectForResponse:(NSURLResponse *)response
+                           data:(NSData *)data
+              incrementalParser:(id <AFURLResponseIncrementalParsing>)parser
+                          error:(NSError *__autoreleasing *)error
+{
+    // 增量解析失败（非UTF-8编码、格式错误等）时，回退到NSJSONSerialization，保证错误信息和父类一致
+    if (![parser isKindOfClass:[AFJSONStreamingParser class]] || ![(AFJSONStreamingParser *)parser finish]) {
+        return [self responseObjectForResponse:response data:data error:error];
+    }
+
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error]) {
+        if (!error || AFErrorOrUnderlyingErrorHasCodeInDomain(*error, NSURLErrorCannotDecodeContentData, AFURLResponseSerializationErrorDomain)) {
+            return nil;
+        }
+    }
+
+    return [(AFJSONStreamingParser *)parser JSONObject];
+}
+
+@end
+
+#pragma mark - AFJSONFieldMap
+
+typedef enum {
+    AFJSONFieldTypeScalar = 0,
+    AFJSONFieldTypeString,
+    AFJSONFieldTypeNumber,
+    AFJSONFieldTypeObject,
+    AFJSONFieldTypeModel,
+    AFJSONFieldTypeArray,
+} AFJSONFieldType;
+
+// 一个JSON key编译后的结果：key的UTF-8字节、setter以及属性类型
+typedef struct {
+    char *key;
+    size_t keyLength;
+    uint32_t hash;
+    SEL setter;
+    IMP setterIMP;
+    // 编码请求体时按字段表读取属性值
+    SEL getter;
+    IMP getterIMP;
+    // 属性的类型编码，标量按它选择setter的参数类型
+    char encoding;
+    AFJSONFieldType type;
+    // 数组元素的类型，只有AFJSONFieldTypeArray使用
+    AFJSONFieldType elementType;
+    // 嵌套模型或数组元素模型的字段表，由_fieldMapsByProperty持有
+    __unsafe_unretained AFJSONFieldMap *fieldMap;
+} AFJSONField;
+
+static BOOL AFJSONFieldCompile(AFJSONField *field, Class modelClass, NSString *propertyName, AFJSONFieldMap *fieldMap) {
+    memset(field, 0, sizeof(AFJSONField));
+
+    objc_property_t property = class_getProperty(modelClass, propertyName.UTF8String);
+    if (!property) {
+        return NO;
+    }
+
+    char *readonly = property_copyAttributeValue(property, "R");
+    if (readonly) {
+        free(readonly);
+        return NO;
+    }
+
+    char *setterName = property_copyAttributeValue(property, "S");
+    if (setterName) {
+        field->setter = sel_registerName(setterName);
+        free(setterName);
+    } else {
+        field->setter = NSSelectorFromString([NSString stringWithFormat:@"set%@%@:", [[propertyName substringToIndex:1] uppercaseString], [propertyName substringFromIndex:1]]);
+    }
+    if (!class_getInstanceMethod(modelClass, field->setter)) {
+        return NO;
+    }
+    field->setterIMP = class_getMethodImplementation(modelClass, field->setter);
+
+    char *getterName = property_copyAttributeValue(property, "G");
+    if (getterName) {
+        field->getter = sel_registerName(getterName);
+        free(getterName);
+    } else {
+        field->getter = NSSelectorFromString(propertyName);
+    }
+    // 没有getter的属性仍然可以解码，只是编码时跳过
+    if (class_getInstanceMethod(modelClass, field->getter)) {
+        field->getterIMP = class_getMethodImplementation(modelClass, field->getter);
+    }
+
+    char *type = property_copyAttributeValue(property, "T");
+    if (!type) {
+        return NO;
+    }
+
+    BOOL supported = YES;
+    field->encoding = type[0];
+    switch (type[0]) {
+        case '@': {
+            // 形如 @"NSString" 或 @"NSArray<Protocol>"，取出类名
+            Class propertyClass = Nil;
+            size_t typeLength = strlen(type);
+            if (typeLength > 3 && type[1] == '"') {
+                size_t classNameLength = strcspn(type + 2, "\"<");
+                NSString *className = [[NSString alloc] initWithBytes:type + 2 length:classNameLength encoding:NSUTF8StringEncoding];
+                propertyClass = NSClassFromString(className);
+            }
+
+            if (!propertyClass) {
+                field->type = AFJSONFieldTypeObject;
+            } else if ([propertyClass isSubclassOfClass:[NSString class]]) {
+                field->type = AFJSONFieldTypeString;
+            } else if ([propertyClass isSubclassOfClass:[NSNumber class]]) {
+                field->type = AFJSONFieldTypeNumber;
+            } else if ([propertyClass isSubclassOfClass:[NSArray class]]) {
+                field->type = AFJSONFieldTypeArray;
+                field->elementType = fieldMap ? AFJSONFieldTypeModel : AFJSONFieldTypeObject;
+                field->fieldMap = fieldMap;
+            } else if (fieldMap) {
+                field->type = AFJSONFieldTypeModel;
+                field->fieldMap = fieldMap;
+            } else {
+                supported = NO;
+            }
+            break;
+        }
+        case 'B':
+        case 'c':
+        case 'C':
+        case 's':
+        case 'S':
+        case 'i':
+        case 'I':
+        case 'l':
+        case 'L':
+        case 'q':
+        case 'Q':
+        case 'f':
+        case 'd':
+            field->type = AFJSONFieldTypeScalar;
+            break;
+        default:
+            supported = NO;
+            break;
+    }
+    free(type);
+
+    return supported;
+}
+
+// 按属性的类型编码调用setter，标量不经过NSNumber
+static void AFJSONFieldSetScalar(id model, const AFJSONField *field, BOOL isInteger, long long integerValue, double doubleValue) {
+    long long integer = isInteger ? integerValue : (long long)doubleValue;
+    double floating = isInteger ? (double)integerValue : doubleValue;
+    SEL setter = field->setter;
+    IMP imp = field->setterIMP;
+
+    switch (field->encoding) {
+        case 'B': ((void (*)(id, SEL, bool))imp)(model, setter, isInteger ? integerValue != 0 : doubleValue != 0); break;
+        case 'c': ((void (*)(id, SEL, char))imp)(model, setter, (char)integer); break;
+        case 'C': ((void (*)(id, SEL, unsigned char))imp)(model, setter, (unsigned char)integer); break;
+        case 's': ((void (*)(id, SEL, short))imp)(model, setter, (short)integer); break;
+        case 'S': ((void (*)(id, SEL, unsigned short))imp)(model, setter, (unsigned short)integer); break;
+        case 'i': ((void (*)(id, SEL, int))imp)(model, setter, (int)integer); break;
+        case 'I': ((void (*)(id, SEL, unsigned int))imp)(model, setter, (unsigned int)integer); break;
+        case 'l': ((void (*)(id, SEL, long))imp)(model, setter, (long)integer); break;
+        case 'L': ((void (*)(id, SEL, unsigned long))imp)(model, setter, (unsigned long)integer); break;
+        case 'q': ((void (*)(id, SEL, long long))imp)(model, setter, integer); break;
+        case 'Q': ((void (*)(id, SEL, unsigned long long))imp)(model, setter, (unsigned long long)integer); break;
+        case 'f': ((void (*)(id, SEL, float))imp)(model, setter, (float)floating); break;
+        case 'd': ((void (*)(id, SEL, double))imp)(model, setter, floating); break;
+        default: break;
+    }
+}
+
+static inline void AFJSONFieldSetObject(id model, const AFJSONField *field, id value) {
+    ((void (*)(id, SEL, id))field->setterIMP)(model, field->setter, value);
+}
+
+// 按属性的类型编码调用getter，标量装箱成NSNumber
+static id AFJSONFieldGetValue(id model, const AFJSONField *field) {
+    SEL getter = field->getter;
+    IMP imp = field->getterIMP;
+    if (!imp) {
+        return nil;
+    }
+
+    switch (field->encoding) {
+        case '@': return ((id (*)(id, SEL))imp)(model, getter);
+        case 'B': return ((bool (*)(id, SEL))imp)(model, getter) ? (__bridge id)kCFBooleanTrue : (__bridge id)kCFBooleanFalse;
+#if OBJC_BOOL_IS_CHAR
+        // 32位上BOOL的类型编码是'c'，与char无法区分，按BOOL输出true/false
+        case 'c': return ((char (*)(id, SEL))imp)(model, getter) ? (__bridge id)kCFBooleanTrue : (__bridge id)kCFBooleanFalse;
+#else
+        case 'c': return @(((char (*)(id, SEL))imp)(model, getter));
+#endif
+        case 'C': return @(((unsigned char (*)(id, SEL))imp)(model, getter));
+        case 's': return @(((short (*)(id, SEL))imp)(model, getter));
+        case 'S': return @(((unsigned short (*)(id, SEL))imp)(model, getter));
+        case 'i': return @(((int (*)(id, SEL))imp)(model, getter));
+        case 'I': return @(((unsigned int (*)(id, SEL))imp)(model, getter));
+        case 'l': return @(((long (*)(id, SEL))imp)(model, getter));
+        case 'L': return @(((unsigned long (*)(id, SEL))imp)(model, getter));
+        case 'q': return @(((long long (*)(id, SEL))imp)(model, getter));
+        case 'Q': return @(((unsigned long long (*)(id, SEL))imp)(model, getter));
+        case 'f': return @(((float (*)(id, SEL))imp)(model, getter));
+        case 'd': return @(((double (*)(id, SEL))imp)(model, getter));
+        default: return nil;
+    }
+}
 
-    if (!responseObject)
-    {
-        if (error) {
-            *error = AFErrorWithUnderlyingError(serializationError, *error);
-        }
+@implementation AFJSONFieldMap {
+    AFJSONField *_fields;
+    NSUInteger _fieldCount;
+    // 开放寻址的哈希表，存放_fields的下标，-1表示空槽
+    int32_t *_slots;
+    NSUInteger _slotMask;
+    NSDictionary *_fieldMapsByProperty;
+}
+
++ (instancetype)fieldMapWithModelClass:(Class)modelClass
+                   propertiesByJSONKey:(NSDictionary<NSString *, NSString *> *)propertiesByJSONKey
+{
+    return [self fieldMapWithModelClass:modelClass propertiesByJSONKey:propertiesByJSONKey fieldMapsByProperty:nil];
+}
+
++ (instancetype)fieldMapWithModelClass:(Class)modelClass
+                   propertiesByJSONKey:(NSDictionary<NSString *, NSString *> *)propertiesByJSONKey
+                   fieldMapsByProperty:(NSDictionary<NSString *, AFJSONFieldMap *> *)fieldMapsByProperty
+{
+    return [[self alloc] initWithModelClass:modelClass propertiesByJSONKey:propertiesByJSONKey fieldMapsByProperty:fieldMapsByProperty];
+}
+
+- (instancetype)initWithModelClass:(Class)modelClass
+               propertiesByJSONKey:(NSDictionary<NSString *, NSString *> *)propertiesByJSONKey
+               fieldMapsByProperty:(NSDictionary<NSString *, AFJSONFieldMap *> *)fieldMapsByProperty
+{
+    NSParameterAssert(modelClass);
+    NSParameterAssert(propertiesByJSONKey);
+
+    self = [super init];
+    if (!self) {
         return nil;
     }
-    //移除json中的null
-    if (self.removesKeysWithNullValues) {
-        return AFJSONObjectByRemovingKeysWithNullValues(responseObject, self.readingOptions);
+
+    _modelClass = modelClass;
+    _fieldMapsByProperty = [fieldMapsByProperty copy] ?: @{};
+    _fields = calloc(MAX(propertiesByJSONKey.count, 1), sizeof(AFJSONField));
+
+    for (NSString *JSONKey in propertiesByJSONKey) {
+        NSString *propertyName = propertiesByJSONKey[JSONKey];
+        AFJSONField field;
+        // 找不到、只读或者类型不支持的属性直接忽略，对应的key解析时会被跳过
+        if (propertyName.length == 0 || !AFJSONFieldCompile(&field, modelClass, propertyName, _fieldMapsByProperty[propertyName])) {
+            continue;
+        }
+
+        const char *key = JSONKey.UTF8String;
+        field.keyLength = strlen(key);
+        field.key = malloc(MAX(field.keyLength, 1));
+        memcpy(field.key, key, field.keyLength);
+        field.hash = AFJSONHashBytes(field.key, field.keyLength);
+        _fields[_fieldCount++] = field;
     }
 
-    return responseObject;
+    NSUInteger slotCount = 4;
+    while (slotCount < _fieldCount * 2) {
+        slotCount <<= 1;
+    }
+    _slotMask = slotCount - 1;
+    _slots = malloc(slotCount * sizeof(int32_t));
+    memset(_slots, 0xFF, slotCount * sizeof(int32_t));
+    for (NSUInteger i = 0; i < _fieldCount; i++) {
+        NSUInteger slot = _fields[i].hash & _slotMask;
+        while (_slots[slot] >= 0) {
+            slot = (slot + 1) & _slotMask;
+        }
+        _slots[slot] = (int32_t)i;
+    }
+
+    return self;
 }
 
-#pragma mark - NSSecureCoding
+- (void)dealloc {
+    for (NSUInteger i = 0; i < _fieldCount; i++) {
+        free(_fields[i].key);
+    }
+    free(_fields);
+    free(_slots);
+}
+
+// 直接用解析出的key字节查表，不需要为key创建NSString
+static const AFJSONField * AFJSONFieldMapLookup(AFJSONFieldMap *fieldMap, const char *bytes, size_t length) {
+    uint32_t hash = AFJSONHashBytes(bytes, length);
+    NSUInteger slot = hash & fieldMap->_slotMask;
+    int32_t index;
+    while ((index = fieldMap->_slots[slot]) >= 0) {
+        const AFJSONField *field = &fieldMap->_fields[index];
+        if (field->hash == hash && field->keyLength == length && memcmp(field->key, bytes, length) == 0) {
+            return field;
+        }
+        slot = (slot + 1) & fieldMap->_slotMask;
+    }
+
+    return NULL;
+}
+
+// AFJSONRequestSerializer编码模型对象时使用，key直接给出编译好的UTF-8字节
+- (void)af_enumerateValuesOfModel:(id)model usingBlock:(void (NS_NOESCAPE ^)(const char *key, size_t keyLength, id value, AFJSONFieldMap *fieldMap, BOOL *stop))block {
+    BOOL stop = NO;
+    for (NSUInteger i = 0; i < _fieldCount && !stop; i++) {
+        const AFJSONField *field = &_fields[i];
+        block(field->key, field->keyLength, AFJSONFieldGetValue(model, field), field->fieldMap, &stop);
+    }
+}
+
+@end
+
+#pragma mark - AFJSONModelDecoder
+
+typedef struct {
+    // YES为模型对象，NO为数组
+    BOOL isModel;
+    // 模型的字段表，或数组元素模型的字段表
+    __unsafe_unretained AFJSONFieldMap *fieldMap;
+    // 数组元素的类型
+    AFJSONFieldType elementType;
+    // 模型中下一个值要写入的字段，NULL表示跳过这个值
+    const AFJSONField *pendingField;
+} AFJSONModelFrame;
+
+// 根据字段表把JSON直接解码成模型对象，不经过NSDictionary/NSArray的中间结构
+@interface AFJSONModelDecoder : NSObject <AFURLResponseIncrementalParsing>
+
+- (instancetype)initWithFieldMap:(AFJSONFieldMap *)fieldMap;
+
+- (BOOL)finish;
+
+@property (readonly, nonatomic, strong) id result;
+
+@end
+
+@implementation AFJSONModelDecoder {
+    AFJSONTokenizer _tokenizer;
+    AFJSONFieldMap *_fieldMap;
+    AFJSONModelFrame _frames[AFJSONTokenizerMaximumDepth];
+    NSUInteger _frameCount;
+    // 大于0时表示正在跳过一个不需要的容器
+    NSUInteger _skipDepth;
+    // 正在构建的模型和数组，与_frames一一对应
+    NSMutableArray *_objects;
+    id _result;
+}
+
+static void AFJSONModelDecoderPushFrame(AFJSONModelDecoder *decoder, BOOL isModel, AFJSONFieldMap *fieldMap, AFJSONFieldType elementType) {
+    id object = isModel ? [[fieldMap.modelClass alloc] init] : [NSMutableArray array];
+    [decoder->_objects addObject:object];
+    decoder->_frames[decoder->_frameCount++] = (AFJSONModelFrame){
+        .isModel = isModel,
+        .fieldMap = fieldMap,
+        .elementType = elementType,
+        .pendingField = NULL,
+    };
+}
+
+// 取出当前值要写入的字段，模型以外的容器返回NULL
+static const AFJSONField * AFJSONModelDecoderTakePendingField(AFJSONModelDecoder *decoder) {
+    AFJSONModelFrame *frame = &decoder->_frames[decoder->_frameCount - 1];
+    const AFJSONField *field = frame->pendingField;
+    frame->pendingField = NULL;
+
+    return field;
+}
+
+static BOOL AFJSONModelDecoderBeginContainer(void *context, BOOL isObject) {
+    AFJSONModelDecoder *decoder = (__bridge AFJSONModelDecoder *)context;
+    if (decoder->_skipDepth > 0) {
+        decoder->_skipDepth++;
+        return YES;
+    }
+
+    // 顶层是对象时解码成一个模型，是数组时解码成模型数组
+    if (decoder->_frameCount == 0) {
+        AFJSONModelDecoderPushFrame(decoder, isObject, decoder->_fieldMap, AFJSONFieldTypeModel);
+        return YES;
+    }
+
+    AFJSONModelFrame *frame = &decoder->_frames[decoder->_frameCount - 1];
+    if (frame->isModel) {
+        const AFJSONField *field = frame->pendingField;
+        if (isObject && field && field->type == AFJSONFieldTypeModel) {
+            AFJSONModelDecoderPushFrame(decoder, YES, field->fieldMap, AFJSONFieldTypeModel);
+            return YES;
+        } else if (!isObject && field && field->type == AFJSONFieldTypeArray) {
+            AFJSONModelDecoderPushFrame(decoder, NO, field->fieldMap, field->elementType);
+            return YES;
+        }
+        frame->pendingField = NULL;
+    } else if (isObject && frame->elementType == AFJSONFieldTypeModel) {
+        AFJSONModelDecoderPushFrame(decoder, YES, frame->fieldMap, AFJSONFieldTypeModel);
+        return YES;
+    }
+
+    decoder->_skipDepth = 1;
 
-+ (BOOL)supportsSecureCoding {
     return YES;
 }
 
-- (instancetype)initWithCoder:(NSCoder *)decoder {
-    self = [super initWithCoder:decoder];
+static BOOL AFJSONModelDecoderEndContainer(void *context, __unused BOOL isObject) {
+    AFJSONModelDecoder *decoder = (__bridge AFJSONModelDecoder *)context;
+    if (decoder->_skipDepth > 0) {
+        decoder->_skipDepth--;
+        return YES;
+    }
+
+    id object = decoder->_objects.lastObject;
+    [decoder->_objects removeLastObject];
+    decoder->_frameCount--;
+
+    if (decoder->_frameCount == 0) {
+        decoder->_result = object;
+    } else if (decoder->_frames[decoder->_frameCount - 1].isModel) {
+        const AFJSONField *field = AFJSONModelDecoderTakePendingField(decoder);
+        if (field) {
+            AFJSONFieldSetObject(decoder->_objects.lastObject, field, object);
+        }
+    } else {
+        [(NSMutableArray *)decoder->_objects.lastObject addObject:object];
+    }
+
+    return YES;
+}
+
+static BOOL AFJSONModelDecoderKey(void *context, const char *bytes, size_t length) {
+    AFJSONModelDecoder *decoder = (__bridge AFJSONModelDecoder *)context;
+    if (decoder->_skipDepth == 0) {
+        AFJSONModelFrame *frame = &decoder->_frames[decoder->_frameCount - 1];
+        frame->pendingField = AFJSONFieldMapLookup(frame->fieldMap, bytes, length);
+    }
+
+    return YES;
+}
+
+// 把一个非容器值交给当前容器：模型按字段类型写入，数组只收集NSString和NSNumber
+static void AFJSONModelDecoderAddObject(AFJSONModelDecoder *decoder, AFJSONFieldType valueType, id (^makeValue)(void)) {
+    AFJSONModelFrame *frame = &decoder->_frames[decoder->_frameCount - 1];
+    if (!frame->isModel) {
+        if (frame->elementType == AFJSONFieldTypeObject) {
+            id value = makeValue();
+            if (value) {
+                [(NSMutableArray *)decoder->_objects.lastObject addObject:value];
+            }
+        }
+        return;
+    }
+
+    const AFJSONField *field = AFJSONModelDecoderTakePendingField(decoder);
+    if (field && (field->type == valueType || field->type == AFJSONFieldTypeObject)) {
+        AFJSONFieldSetObject(decoder->_objects.lastObject, field, makeValue());
+    }
+}
+
+static BOOL AFJSONModelDecoderString(void *context, const char *bytes, size_t length) {
+    AFJSONModelDecoder *decoder = (__bridge AFJSONModelDecoder *)context;
+    if (decoder->_skipDepth > 0 || decoder->_frameCount == 0) {
+        return YES;
+    }
+
+    AFJSONModelDecoderAddObject(decoder, AFJSONFieldTypeString, ^id{
+        return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    });
+
+    return YES;
+}
+
+static BOOL AFJSONModelDecoderNumber(void *context, const char *bytes, __unused size_t length, BOOL isInteger) {
+    AFJSONModelDecoder *decoder = (__bridge AFJSONModelDecoder *)context;
+    if (decoder->_skipDepth > 0 || decoder->_frameCount == 0) {
+        return YES;
+    }
+
+    AFJSONModelFrame *frame = &decoder->_frames[decoder->_frameCount - 1];
+    if (frame->isModel && frame->pendingField && frame->pendingField->type == AFJSONFieldTypeScalar) {
+        const AFJSONField *field = AFJSONModelDecoderTakePendingField(decoder);
+        long long integerValue = 0;
+        double doubleValue = 0;
+        BOOL parsedInteger = AFJSONParseNumber(bytes, isInteger, &integerValue, &doubleValue);
+        AFJSONFieldSetScalar(decoder->_objects.lastObject, field, parsedInteger, integerValue, doubleValue);
+        return YES;
+    }
+
+    AFJSONModelDecoderAddObject(decoder, AFJSONFieldTypeNumber, ^id{
+        return AFJSONNumberWithBytes(bytes, isInteger);
+    });
+
+    return YES;
+}
+
+static BOOL AFJSONModelDecoderLiteral(void *context, AFJSONLiteral literal) {
+    AFJSONModelDecoder *decoder = (__bridge AFJSONModelDecoder *)context;
+    if (decoder->_skipDepth > 0 || decoder->_frameCount == 0) {
+        return YES;
+    }
+
+    AFJSONModelFrame *frame = &decoder->_frames[decoder->_frameCount - 1];
+    // null保留属性的默认值
+    if (literal == AFJSONLiteralNull) {
+        if (frame->isModel) {
+            frame->pendingField = NULL;
+        }
+        return YES;
+    }
+
+    BOOL value = literal == AFJSONLiteralTrue;
+    if (frame->isModel && frame->pendingField && frame->pendingField->type == AFJSONFieldTypeScalar) {
+        AFJSONFieldSetScalar(decoder->_objects.lastObject, AFJSONModelDecoderTakePendingField(decoder), YES, value, 0);
+        return YES;
+    }
+
+    AFJSONModelDecoderAddObject(decoder, AFJSONFieldTypeNumber, ^id{
+        return @(value);
+    });
+
+    return YES;
+}
+
+- (instancetype)initWithFieldMap:(AFJSONFieldMap *)fieldMap {
+    NSParameterAssert(fieldMap);
+
+    self = [super init];
     if (!self) {
         return nil;
     }
 
-    self.readingOptions = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(readingOptions))] unsignedIntegerValue];
-    self.removesKeysWithNullValues = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(removesKeysWithNullValues))] boolValue];
+    _fieldMap = fieldMap;
+    _objects = [NSMutableArray array];
+
+    AFJSONTokenizerCallbacks callbacks = {
+        .beginContainer = AFJSONModelDecoderBeginContainer,
+        .endContainer = AFJSONModelDecoderEndContainer,
+        .key = AFJSONModelDecoderKey,
+        .string = AFJSONModelDecoderString,
+        .number = AFJSONModelDecoderNumber,
+        .literal = AFJSONModelDecoderLiteral,
+    };
+    AFJSONTokenizerInit(&_tokenizer, callbacks, (__bridge void *)self, NO);
 
     return self;
 }
 
-- (void)encodeWithCoder:(NSCoder *)coder {
-    [super encodeWithCoder:coder];
+- (void)dealloc {
+    AFJSONTokenizerDestroy(&_tokenizer);
+}
 
-    [coder encodeObject:@(self.readingOptions) forKey:NSStringFromSelector(@selector(readingOptions))];
-    [coder encodeObject:@(self.removesKeysWithNullValues) forKey:NSStringFromSelector(@selector(removesKeysWithNullValues))];
+- (void)appendData:(NSData *)data {
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        if (!AFJSONTokenizerConsume(&self->_tokenizer, bytes, byteRange.length)) {
+            *stop = YES;
+        }
+    }];
+}
+
+- (BOOL)finish {
+    BOOL finished = AFJSONTokenizerFinish(&_tokenizer);
+    AFJSONTokenizerDestroy(&_tokenizer);
+    [_objects removeAllObjects];
+
+    return finished;
+}
+
+@end
+
+#pragma mark -
+
+@implementation AFJSONModelResponseSerializer
+
++ (instancetype)serializerWithFieldMap:(AFJSONFieldMap *)fieldMap {
+    AFJSONModelResponseSerializer *serializer = [self serializer];
+    serializer.fieldMap = fieldMap;
+
+    return serializer;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.acceptableContentTypes = [NSSet setWithObjects:@"application/json", @"text/json", @"text/javascript", nil];
+
+    return self;
+}
+
+#pragma mark - AFURLResponseSerialization
+
+- (id)responseObjectForResponse:(NSURLResponse *)response
+                           data:(NSData *)data
+                          error:(NSError *__autoreleasing *)error
+{
+    // 先校验，内容类型或状态码不对的响应不用解码整个body
+    AFJSONModelDecoder *decoder = nil;
+    if (self.fieldMap && [self validateResponse:(NSHTTPURLResponse *)response data:data error:NULL]) {
+        decoder = [[AFJSONModelDecoder alloc] initWithFieldMap:self.fieldMap];
+        [decoder appendData:data];
+    }
+
+    return [self responseObjectForResponse:response data:data incrementalParser:decoder error:error];
+}
+
+#pragma mark - AFURLResponseIncrementalSerialization
+
+- (id <AFURLResponseIncrementalParsing>)incrementalParserForResponse:(NSURLResponse *)response {
+    if (!self.fieldMap || ![self validateResponse:(NSHTTPURLResponse *)response data:nil error:NULL]) {
+        return nil;
+    }
+
+    return [[AFJSONModelDecoder alloc] initWithFieldMap:self.fieldMap];
+}
+
+- (id)responseObjectForResponse:(NSURLResponse *)response
+                           data:(NSData *)data
+              incrementalParser:(id <AFURLResponseIncrementalParsing>)parser
+                          error:(NSError *__autoreleasing *)error
+{
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error]) {
+        if (!error || AFErrorOrUnderlyingErrorHasCodeInDomain(*error, NSURLErrorCannotDecodeContentData, AFURLResponseSerializationErrorDomain)) {
+            return nil;
+        }
+    }
+
+    // 与AFJSONResponseSerializer一样，空数据和单个空格都不解析
+    BOOL isSpace = [data isEqualToData:[NSData dataWithBytes:" " length:1]];
+    if (data.length == 0 || isSpace) {
+        return nil;
+    }
+
+    // 没有字段表时和AFJSONResponseSerializer一样返回JSON对象
+    if (!self.fieldMap) {
+        NSError *serializationError = nil;
+        id responseObject = [NSJSONSerialization JSONObjectWithData:data options:(NSJSONReadingOptions)0 error:&serializationError];
+        if (!responseObject && error) {
+            *error = AFErrorWithUnderlyingError(serializationError, *error);
+        }
+        return responseObject;
+    }
+
+    if (![parser isKindOfClass:[AFJSONModelDecoder class]]) {
+        return nil;
+    }
+
+    AFJSONModelDecoder *decoder = (AFJSONModelDecoder *)parser;
+    if (![decoder finish]) {
+        if (error) {
+            NSMutableDictionary *mutableUserInfo = [@{
+                                                      NSLocalizedDescriptionKey: NSLocalizedStringFromTable(@"Request failed: response could not be decoded into model objects", @"AFNetworking", nil),
+                                                      AFNetworkingOperationFailingURLResponseDataErrorKey: data,
+                                                    } mutableCopy];
+            if (response) {
+                mutableUserInfo[AFNetworkingOperationFailingURLResponseErrorKey] = response;
+            }
+            NSError *decodingError = [NSError errorWithDomain:AFURLResponseSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:mutableUserInfo];
+            *error = AFErrorWithUnderlyingError(decodingError, *error);
+        }
+        return nil;
+    }
+
+    return decoder.result;
 }
 
 #pragma mark - NSCopying
 
 - (instancetype)copyWithZone:(NSZone *)zone {
-    AFJSONResponseSerializer *serializer = [super copyWithZone:zone];
-    serializer.readingOptions = self.readingOptions;
-    serializer.removesKeysWithNullValues = self.removesKeysWithNullValues;
+    AFJSONModelResponseSerializer *serializer = [super copyWithZone:zone];
+    serializer.fieldMap = self.fieldMap;
 
     return serializer;
 }
@@ -570,6 +2020,7 @@ id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingOptions
 #if TARGET_OS_IOS || TARGET_OS_TV || TARGET_OS_WATCH
 #import <CoreGraphics/CoreGraphics.h>
 #import <UIKit/UIKit.h>
+#import <ImageIO/ImageIO.h>
 // uiimage的分类
 @interface UIImage (AFNetworkingSafeImageLoading)
 + (UIImage *)af_safeImageWithData:(NSData *)data;
@@ -594,8 +2045,84 @@ static NSLock* imageLock = nil;
 
 @end
 
+// 同时进行的图片解码数量不超过CPU核数，多张图片同时下载完成时可以并行解码，又不会占满所有线程
+static dispatch_semaphore_t AFImageDecodeSemaphore() {
+    static dispatch_semaphore_t af_image_decode_semaphore;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        af_image_decode_semaphore = dispatch_semaphore_create((long)MAX([NSProcessInfo processInfo].activeProcessorCount, (NSUInteger)1));
+    });
+
+    return af_image_decode_semaphore;
+}
+
+// ImageIO可以在多个线程上同时解码的格式，其他格式仍然通过af_safeImageWithData串行解码
+static BOOL AFImageSourceTypeSupportsConcurrentDecoding(CFStringRef type) {
+    static NSSet *types = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        types = [NSSet setWithObjects:@"public.jpeg", @"public.png", @"com.compuserve.gif", @"public.tiff", @"com.microsoft.bmp", @"com.microsoft.ico", nil];
+    });
+
+    return type && [types containsObject:(__bridge NSString *)type];
+}
+
+// EXIF方向转换为UIImageOrientation，与[UIImage imageWithData:]的结果一致
+static UIImageOrientation AFImageOrientationFromImageSource(CGImageSourceRef source) {
+    UIImageOrientation orientation = UIImageOrientationUp;
+    CFDictionaryRef properties = CGImageSourceCopyPropertiesAtIndex(source, 0, NULL);
+    if (!properties) {
+        return orientation;
+    }
+
+    NSNumber *EXIFOrientation = (__bridge NSNumber *)CFDictionaryGetValue(properties, kCGImagePropertyOrientation);
+    switch (EXIFOrientation.integerValue) {
+        case 2: orientation = UIImageOrientationUpMirrored; break;
+        case 3: orientation = UIImageOrientationDown; break;
+        case 4: orientation = UIImageOrientationDownMirrored; break;
+        case 5: orientation = UIImageOrientationLeftMirrored; break;
+        case 6: orientation = UIImageOrientationRight; break;
+        case 7: orientation = UIImageOrientationRightMirrored; break;
+        case 8: orientation = UIImageOrientationLeft; break;
+        default: break;
+    }
+    CFRelease(properties);
+
+    return orientation;
+}
+
+// 用ImageIO创建一个还没有解码的CGImage，格式不支持并行解码或者是多帧图片时返回NULL
+// 只有马上绘制到位图上下文的CGImage才不缓存解码结果；直接显示的CGImage要缓存，否则每次绘制都会在主线程重新解码
+static CGImageRef AFCreateImageFromData(NSData *data, BOOL shouldCache, UIImageOrientation *orientation) {
+    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
+    if (!source) {
+        return NULL;
+    }
+
+    CGImageRef imageRef = NULL;
+    if (AFImageSourceTypeSupportsConcurrentDecoding(CGImageSourceGetType(source)) && CGImageSourceGetCount(source) == 1) {
+        NSDictionary *options = @{(__bridge NSString *)kCGImageSourceShouldCache: @(shouldCache)};
+        imageRef = CGImageSourceCreateImageAtIndex(source, 0, (__bridge CFDictionaryRef)options);
+        if (imageRef) {
+            *orientation = AFImageOrientationFromImageSource(source);
+        }
+    }
+    CFRelease(source);
+
+    return imageRef;
+}
+
 static UIImage * AFImageWithDataAtScale(NSData *data, CGFloat scale) {
-    // 首先获取UIImage对象
+    UIImageOrientation orientation = UIImageOrientationUp;
+    CGImageRef imageRef = AFCreateImageFromData(data, YES, &orientation);
+    if (imageRef) {
+        UIImage *image = [[UIImage alloc] initWithCGImage:imageRef scale:scale orientation:orientation];
+        CGImageRelease(imageRef);
+
+        return image;
+    }
+
+    // 其他格式仍然通过加锁的系统方法生成
     UIImage *image = [UIImage af_safeImageWithData:data];
     if (image.images) {
         return image;
@@ -604,42 +2131,24 @@ static UIImage * AFImageWithDataAtScale(NSData *data, CGFloat scale) {
     return [[UIImage alloc] initWithCGImage:[image CGImage] scale:scale orientation:image.imageOrientation];
 }
 // 根据response和scale转换为位图，这里因为解码的过程都是在网络请求回来调用的，在非主线程解码，显示图片的时候直接绘制，节省GPU 开销
-static UIImage * AFInflatedImageFromResponseWithDataAtScale(NSHTTPURLResponse *response, NSData *data, CGFloat scale) {
+// 每张图片只解码一次：ImageIO创建的CGImage在绘制到位图上下文时才真正解码
+static UIImage * AFInflatedImageFromResponseWithDataAtScale(__unused NSHTTPURLResponse *response, NSData *data, CGFloat scale) {
     if (!data || [data length] == 0) {
         return nil;
     }
 
-    CGImageRef imageRef = NULL;
-    // CoreGraphics对data的封装
-    CGDataProviderRef dataProvider = CGDataProviderCreateWithCFData((__bridge CFDataRef)data);
-    // 根据不同的格式进行转化
-    if ([response.MIMEType isEqualToString:@"image/png"]) {
-        imageRef = CGImageCreateWithPNGDataProvider(dataProvider,  NULL, true, kCGRenderingIntentDefault);
-    } else if ([response.MIMEType isEqualToString:@"image/jpeg"]) {
-        imageRef = CGImageCreateWithJPEGDataProvider(dataProvider, NULL, true, kCGRenderingIntentDefault);
-
-        if (imageRef) {
-            CGColorSpaceRef imageColorSpace = CGImageGetColorSpace(imageRef);
-            CGColorSpaceModel imageColorSpaceModel = CGColorSpaceGetModel(imageColorSpace);
-
-            // CGImageCreateWithJPEGDataProvider does not properly handle CMKY, so fall back to AFImageWithDataAtScale
-            // 不能支持cmyk 转为位图
-            if (imageColorSpaceModel == kCGColorSpaceModelCMYK) {
-                CGImageRelease(imageRef);
-                imageRef = NULL;
-            }
-        }
-    }
-
-    CGDataProviderRelease(dataProvider);
-    //根据创建原格式图片
-    UIImage *image = AFImageWithDataAtScale(data, scale);
+    UIImageOrientation orientation = UIImageOrientationUp;
+    //这个CGImage马上绘制到位图上下文，不缓存解码结果
+    CGImageRef imageRef = AFCreateImageFromData(data, NO, &orientation);
+    //串行流程生成的图片，不需要解压时直接返回；ImageIO的CGImage不解压时要换成缓存解码结果的
+    UIImage *image = nil;
     if (!imageRef) {
-        //如果imageRef为空，说明不是压缩格式的图片，或者无法进一步转成Bitmap格式，直接返回原格式图片
+        //ImageIO不能并行处理的格式，走原来的串行流程
+        image = AFImageWithDataAtScale(data, scale);
         if (image.images || !image) {
             return image;
         }
-        // 如果imageRef为空
+        orientation = image.imageOrientation;
         imageRef = CGImageCreateCopy([image CGImage]);
         if (!imageRef) {
             return nil;
@@ -654,7 +2163,7 @@ static UIImage * AFInflatedImageFromResponseWithDataAtScale(NSHTTPURLResponse *r
     if (width * height > 1024 * 1024 || bitsPerComponent > 8) {
         CGImageRelease(imageRef);
 
-        return image;
+        return image ?: AFImageWithDataAtScale(data, scale);
     }
     //获取图片相关信息
     // CGImageGetBytesPerRow() calculates incorrectly in iOS 5.0, so defer to CGBitmapContextCreate
@@ -684,16 +2193,18 @@ static UIImage * AFInflatedImageFromResponseWithDataAtScale(NSHTTPURLResponse *r
     if (!context) {
         CGImageRelease(imageRef);
 
-        return image;
+        return image ?: AFImageWithDataAtScale(data, scale);
     }
-    //渲染到画布上
+    //渲染到画布上，这一步才真正解码
+    dispatch_semaphore_wait(AFImageDecodeSemaphore(), DISPATCH_TIME_FOREVER);
     CGContextDrawImage(context, CGRectMake(0.0f, 0.0f, width, height), imageRef);
+    dispatch_semaphore_signal(AFImageDecodeSemaphore());
     //获取Bitmap格式的图片
     CGImageRef inflatedImageRef = CGBitmapContextCreateImage(context);
 
     CGContextRelease(context);
     //转化为UIImage对象
-    UIImage *inflatedImage = [[UIImage alloc] initWithCGImage:inflatedImageRef scale:scale orientation:image.imageOrientation];
+    UIImage *inflatedImage = [[UIImage alloc] initWithCGImage:inflatedImageRef scale:scale orientation:orientation];
 
     CGImageRelease(inflatedImageRef);
     CGImageRelease(imageRef);
@@ -24,18 +24,29 @@
 #if TARGET_OS_IOS || TARGET_OS_TV 
 
 #import "AFAutoPurgingImageCache.h"
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <stdatomic.h>
 
 @interface AFCachedImage : NSObject
 
 @property (nonatomic, strong) UIImage *image;//持有image
 @property (nonatomic, copy) NSString *identifier;//唯一标识
 @property (nonatomic, assign) UInt64 totalBytes;//图片占用的总字节数
-@property (nonatomic, strong) NSDate *lastAccessDate;//上次获取的时间
+@property (nonatomic, assign, readonly) uint64_t lastAccessTime;//上次获取的时间，mach_absolute_time
+@property (nonatomic, assign) uint64_t linkedAccessTime;//放到链表头时的lastAccessTime，两者不同说明之后又被访问过
 @property (nonatomic, assign) UInt64 currentMemoryUsage;//当前使用的内存
 
+// LRU双向链表，链表头是最近放入的，由cachedImages字典持有，这里不持有
+@property (nonatomic, unsafe_unretained) AFCachedImage *previousCachedImage;
+@property (nonatomic, unsafe_unretained) AFCachedImage *nextCachedImage;
+
 @end
 
-@implementation AFCachedImage
+@implementation AFCachedImage {
+    // 读取图片时可能有多个线程同时更新
+    _Atomic(uint64_t) _lastAccessTime;
+}
 //生成一个image 计算占用空间的大小和最后的访问日期
 - (instancetype)initWithImage:(UIImage *)image identifier:(NSString *)identifier {
     if (self = [self init]) {
@@ -49,31 +60,103 @@
         CGFloat bytesPerPixel = 4.0;
         CGFloat bytesPerSize = imageSize.width * imageSize.height;
         self.totalBytes = (UInt64)bytesPerPixel * (UInt64)bytesPerSize;
-        self.lastAccessDate = [NSDate date];
+        atomic_init(&_lastAccessTime, mach_absolute_time());
     }
     return self;
 }
 
+- (uint64_t)lastAccessTime {
+    return atomic_load_explicit(&_lastAccessTime, memory_order_relaxed);
+}
+
+// 只更新时间戳，不移动链表节点，清理时再把访问过的节点移回链表头
 - (UIImage *)accessImage {
-    self.lastAccessDate = [NSDate date];
+    atomic_store_explicit(&_lastAccessTime, mach_absolute_time(), memory_order_relaxed);
     return self.image;
 }
 
 - (NSString *)description {
-    NSString *descriptionString = [NSString stringWithFormat:@"Idenfitier: %@  lastAccessDate: %@ ", self.identifier, self.lastAccessDate];
+    NSString *descriptionString = [NSString stringWithFormat:@"Idenfitier: %@  lastAccessTime: %llu ", self.identifier, self.lastAccessTime];
     return descriptionString;
 
 }
 
 @end
 
-@interface AFAutoPurgingImageCache ()
+// 缓存按identifier的hash分成多个分片，每个分片有自己的读写锁、字典和LRU链表，不同分片的读写互不影响
+static NSUInteger const AFAutoPurgingImageCacheShardCount = 8;
+
+@interface AFAutoPurgingImageCacheShard : NSObject {
+    @public
+    pthread_rwlock_t _lock;
+}
 // 用来管理缓存图片的字典
 @property (nonatomic, strong) NSMutableDictionary <NSString* , AFCachedImage*> *cachedImages;
-// 当前使用的内存
-@property (nonatomic, assign) UInt64 currentMemoryUsage;
-// 保证安全性的队列
-@property (nonatomic, strong) dispatch_queue_t synchronizationQueue;
+// LRU链表的头和尾，淘汰时从尾部取
+@property (nonatomic, unsafe_unretained) AFCachedImage *headCachedImage;
+@property (nonatomic, unsafe_unretained) AFCachedImage *tailCachedImage;
+@end
+
+@implementation AFAutoPurgingImageCacheShard
+
+- (instancetype)init {
+    if (self = [super init]) {
+        pthread_rwlock_init(&_lock, NULL);
+        self.cachedImages = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    pthread_rwlock_destroy(&_lock);
+}
+
+// 以下方法只能在持有写锁时调用
+- (void)linkCachedImageAtHead:(AFCachedImage *)cachedImage {
+    cachedImage.linkedAccessTime = cachedImage.lastAccessTime;
+    cachedImage.previousCachedImage = nil;
+    cachedImage.nextCachedImage = self.headCachedImage;
+    if (self.headCachedImage != nil) {
+        self.headCachedImage.previousCachedImage = cachedImage;
+    } else {
+        self.tailCachedImage = cachedImage;
+    }
+    self.headCachedImage = cachedImage;
+}
+
+- (void)unlinkCachedImage:(AFCachedImage *)cachedImage {
+    if (cachedImage.previousCachedImage != nil) {
+        cachedImage.previousCachedImage.nextCachedImage = cachedImage.nextCachedImage;
+    } else {
+        self.headCachedImage = cachedImage.nextCachedImage;
+    }
+    if (cachedImage.nextCachedImage != nil) {
+        cachedImage.nextCachedImage.previousCachedImage = cachedImage.previousCachedImage;
+    } else {
+        self.tailCachedImage = cachedImage.previousCachedImage;
+    }
+    cachedImage.previousCachedImage = nil;
+    cachedImage.nextCachedImage = nil;
+}
+
+- (AFCachedImage *)removeCachedImageWithIdentifier:(NSString *)identifier {
+    AFCachedImage *cachedImage = self.cachedImages[identifier];
+    if (cachedImage != nil) {
+        [self unlinkCachedImage:cachedImage];
+        [self.cachedImages removeObjectForKey:identifier];
+    }
+    return cachedImage;
+}
+
+@end
+
+@interface AFAutoPurgingImageCache () {
+    // 当前使用的内存
+    _Atomic(UInt64) _currentMemoryUsage;
+    // 同一时间只有一个线程在清理，其他线程添加图片后发现正在清理就直接返回
+    pthread_mutex_t _purgeLock;
+}
+@property (nonatomic, copy) NSArray <AFAutoPurgingImageCacheShard *> *shards;
 @end
 
 @implementation AFAutoPurgingImageCache
@@ -87,12 +170,15 @@
     if (self = [super init]) {
         self.memoryCapacity = memoryCapacity;
         self.preferredMemoryUsageAfterPurge = preferredMemoryCapacity;
-        // 缓存集合 内存缓存 : 可变字典 Image id(url)
-        self.cachedImages = [[NSMutableDictionary alloc] init];
+        atomic_init(&_currentMemoryUsage, 0);
+        pthread_mutex_init(&_purgeLock, NULL);
 
-        NSString *queueName = [NSString stringWithFormat:@"com.alamofire.autopurgingimagecache-%@", [[NSUUID UUID] UUIDString]];
-        // 从它的命名我们知道它是同步的,现在把他初始化为并发的,哈哈为什么这么设计呢?---并发的,为了保证顺序,是不是有一个栅栏函数呢?哈哈
-        self.synchronizationQueue = dispatch_queue_create([queueName cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_CONCURRENT);
+        // 缓存集合 内存缓存 : 可变字典 Image id(url)
+        NSMutableArray *shards = [[NSMutableArray alloc] initWithCapacity:AFAutoPurgingImageCacheShardCount];
+        for (NSUInteger index = 0; index < AFAutoPurgingImageCacheShardCount; index++) {
+            [shards addObject:[[AFAutoPurgingImageCacheShard alloc] init]];
+        }
+        self.shards = shards;
 
         [[NSNotificationCenter defaultCenter]
          addObserver:self
@@ -106,97 +192,161 @@
 
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
+    pthread_mutex_destroy(&_purgeLock);
+}
+
+- (AFAutoPurgingImageCacheShard *)shardForIdentifier:(NSString *)identifier {
+    return self.shards[identifier.hash % AFAutoPurgingImageCacheShardCount];
 }
-//队列中同步执行 返回当前内存使用大小 为什么同步呢?
-//因为没有计算，只是读取值大小，只需在队列中同步执行即可。
-//同步不会锁死？不是mainqueue，不会锁死。
-// 多读单写
+
+// 只是读取一个原子变量，不需要加锁
 - (UInt64)memoryUsage {
-    __block UInt64 result = 0;
-    dispatch_sync(self.synchronizationQueue, ^{
-        result = self.currentMemoryUsage;
-    });
-    return result;
+    return atomic_load_explicit(&_currentMemoryUsage, memory_order_relaxed);
 }
-/**添加图片，这里使用的是栅栏函数，主要就是多读单写，这里添加图片，相当于写，单写的，每次添加图片额时候,根据ID判断缓存中是否有缓存，如果有，那么就先将当前总共占用额缓存减去已经存在的ID对应额那个图片额缓
-存，然后将新的ID图片添加到缓存，然后当前总缓存加上新的图片额缓存，接下来，判断当前的总缓存，是不是超过我们
-预定号的总额memoryCapacity缓存，如果超过，就遍历所有图片，根据访问时间进行淘汰，直到剩余preferredMem
+/**添加图片，在对应分片的写锁里完成，每次添加图片的时候,根据ID判断缓存中是否有缓存，如果有，那么就先将当前总共占用的缓存减去已经存在的ID对应的那个图片的缓存，然后将新的ID图片添加到缓存，然后当前总缓存加上新的图片的缓存，接下来在同一步里判断当前的总缓存，是不是超过我们
+预定好的总额memoryCapacity缓存，如果超过，就从各个分片的链表尾部按访问时间进行淘汰，直到剩余preferredMem
 oryUsageAfterPurge这么大为止，可以比这个值小，那么就符合要求了
  */
 // 缓存 : 下载 --> 图片 + id
 - (void)addImage:(UIImage *)image withIdentifier:(NSString *)identifier {
-    // 来了老弟,栅栏函数来了
-    dispatch_barrier_async(self.synchronizationQueue, ^{
-        AFCachedImage *cacheImage = [[AFCachedImage alloc] initWithImage:image identifier:identifier];
-        // 字典 KVC ---> AFCachedImage -->跟新内存
-        AFCachedImage *previousCachedImage = self.cachedImages[identifier];
-        if (previousCachedImage != nil) {
-            self.currentMemoryUsage -= previousCachedImage.totalBytes;
-        }
+    AFCachedImage *cacheImage = [[AFCachedImage alloc] initWithImage:image identifier:identifier];
+    AFAutoPurgingImageCacheShard *shard = [self shardForIdentifier:identifier];
+
+    pthread_rwlock_wrlock(&shard->_lock);
+    // 字典 KVC ---> AFCachedImage -->跟新内存
+    AFCachedImage *previousCachedImage = [shard removeCachedImageWithIdentifier:identifier];
+    [shard linkCachedImageAtHead:cacheImage];
+    shard.cachedImages[identifier] = cacheImage;
+    // 在锁里加上占用的内存，保证图片被清理掉之前已经计入
+    if (previousCachedImage != nil) {
+        atomic_fetch_sub_explicit(&_currentMemoryUsage, previousCachedImage.totalBytes, memory_order_relaxed);
+    }
+    UInt64 currentMemoryUsage = atomic_fetch_add_explicit(&_currentMemoryUsage, cacheImage.totalBytes, memory_order_relaxed) + cacheImage.totalBytes;
+    pthread_rwlock_unlock(&shard->_lock);
 
-        self.cachedImages[identifier] = cacheImage;
-        self.currentMemoryUsage += cacheImage.totalBytes;
-    });
-    //通过栅栏函数异步执行 刷新内存image
     // 每次添加图片之后都会判定是否超出规定的最大内存空间
-    dispatch_barrier_async(self.synchronizationQueue, ^{
-        if (self.currentMemoryUsage > self.memoryCapacity) {
-            // 需要清理的内存大小
-            UInt64 bytesToPurge = self.currentMemoryUsage - self.preferredMemoryUsageAfterPurge;
-            NSMutableArray <AFCachedImage*> *sortedImages = [NSMutableArray arrayWithArray:self.cachedImages.allValues];
-            // 按照时间lastAccessDate属性进行排序
-            NSSortDescriptor *sortDescriptor = [[NSSortDescriptor alloc] initWithKey:@"lastAccessDate"
-                                                                           ascending:YES];
-            [sortedImages sortUsingDescriptors:@[sortDescriptor]];
-
-            UInt64 bytesPurged = 0;
-
-            for (AFCachedImage *cachedImage in sortedImages) {
-                // 移除使用时间距今最久的图片
-                [self.cachedImages removeObjectForKey:cachedImage.identifier];
-                bytesPurged += cachedImage.totalBytes;
-                // 当前内存图片大小达到preferredMemoryCapacity 60M时,退出循环
-                if (bytesPurged >= bytesToPurge) {
-                    break;
+    if (currentMemoryUsage > self.memoryCapacity) {
+        [self purgeIfNecessary];
+    }
+}
+
+- (void)purgeIfNecessary {
+    if (pthread_mutex_trylock(&_purgeLock) != 0) {
+        return;
+    }
+
+    UInt64 currentMemoryUsage = self.memoryUsage;
+    if (currentMemoryUsage > self.memoryCapacity) {
+        // 需要清理的内存大小
+        UInt64 bytesToPurge = currentMemoryUsage - self.preferredMemoryUsageAfterPurge;
+        UInt64 bytesPurged = 0;
+        // 最多把链表过一遍：尾部的图片一直被读取时，重新放回链表头的次数用完之后照样淘汰，避免一直循环
+        NSUInteger relinksRemaining = [self cachedImageCount];
+
+        // 当前内存图片大小达到preferredMemoryCapacity 60M时,退出循环
+        while (bytesPurged < bytesToPurge) {
+            AFAutoPurgingImageCacheShard *shard = [self shardWithLeastRecentlyLinkedImage];
+            if (shard == nil) {
+                break;
+            }
+
+            pthread_rwlock_wrlock(&shard->_lock);
+            AFCachedImage *cachedImage = shard.tailCachedImage;
+            if (cachedImage != nil) {
+                // 放到链表头之后又被访问过，重新放回链表头，这次不淘汰
+                if (cachedImage.lastAccessTime != cachedImage.linkedAccessTime && relinksRemaining > 0) {
+                    relinksRemaining--;
+                    [shard unlinkCachedImage:cachedImage];
+                    [shard linkCachedImageAtHead:cachedImage];
+                    cachedImage = nil;
+                } else {
+                    // 移除使用时间距今最久的图片
+                    [shard removeCachedImageWithIdentifier:cachedImage.identifier];
                 }
             }
-            self.currentMemoryUsage -= bytesPurged;
+            pthread_rwlock_unlock(&shard->_lock);
+
+            if (cachedImage != nil) {
+                bytesPurged += cachedImage.totalBytes;
+                atomic_fetch_sub_explicit(&_currentMemoryUsage, cachedImage.totalBytes, memory_order_relaxed);
+            }
         }
-    });
+    }
+
+    pthread_mutex_unlock(&_purgeLock);
 }
 
-- (BOOL)removeImageWithIdentifier:(NSString *)identifier {
-    __block BOOL removed = NO;
-    //栅栏函数 同步执行删除操作 占用内存大小更新
-    dispatch_barrier_sync(self.synchronizationQueue, ^{
-        AFCachedImage *cachedImage = self.cachedImages[identifier];
-        if (cachedImage != nil) {
-            [self.cachedImages removeObjectForKey:identifier];
-            self.currentMemoryUsage -= cachedImage.totalBytes;
-            removed = YES;
+- (NSUInteger)cachedImageCount {
+    NSUInteger count = 0;
+    for (AFAutoPurgingImageCacheShard *shard in self.shards) {
+        pthread_rwlock_rdlock(&shard->_lock);
+        count += shard.cachedImages.count;
+        pthread_rwlock_unlock(&shard->_lock);
+    }
+    return count;
+}
+
+// 各分片链表尾部的图片里，放入链表头时间最早的那个所在的分片
+- (AFAutoPurgingImageCacheShard *)shardWithLeastRecentlyLinkedImage {
+    AFAutoPurgingImageCacheShard *result = nil;
+    uint64_t leastLinkedAccessTime = UINT64_MAX;
+    for (AFAutoPurgingImageCacheShard *shard in self.shards) {
+        pthread_rwlock_rdlock(&shard->_lock);
+        AFCachedImage *tailCachedImage = shard.tailCachedImage;
+        if (tailCachedImage != nil && (result == nil || tailCachedImage.linkedAccessTime < leastLinkedAccessTime)) {
+            leastLinkedAccessTime = tailCachedImage.linkedAccessTime;
+            result = shard;
         }
-    });
-    return removed;
+        pthread_rwlock_unlock(&shard->_lock);
+    }
+    return result;
+}
+
+- (BOOL)removeImageWithIdentifier:(NSString *)identifier {
+    AFAutoPurgingImageCacheShard *shard = [self shardForIdentifier:identifier];
+
+    //写锁 同步执行删除操作 占用内存大小更新
+    pthread_rwlock_wrlock(&shard->_lock);
+    AFCachedImage *cachedImage = [shard removeCachedImageWithIdentifier:identifier];
+    pthread_rwlock_unlock(&shard->_lock);
+
+    if (cachedImage != nil) {
+        atomic_fetch_sub_explicit(&_currentMemoryUsage, cachedImage.totalBytes, memory_order_relaxed);
+        return YES;
+    }
+    return NO;
 }
-//栅栏函数同步删除all image 当前使用内存大小设置为0
+//逐个分片删除all image 当前使用内存大小减去删除的部分
 - (BOOL)removeAllImages {
-    __block BOOL removed = NO;
-    dispatch_barrier_sync(self.synchronizationQueue, ^{
-        if (self.cachedImages.count > 0) {
-            [self.cachedImages removeAllObjects];
-            self.currentMemoryUsage = 0;
+    BOOL removed = NO;
+    for (AFAutoPurgingImageCacheShard *shard in self.shards) {
+        UInt64 bytesRemoved = 0;
+
+        pthread_rwlock_wrlock(&shard->_lock);
+        if (shard.cachedImages.count > 0) {
+            for (AFCachedImage *cachedImage in shard.cachedImages.objectEnumerator) {
+                bytesRemoved += cachedImage.totalBytes;
+            }
+            shard.headCachedImage = nil;
+            shard.tailCachedImage = nil;
+            [shard.cachedImages removeAllObjects];
             removed = YES;
         }
-    });
+        pthread_rwlock_unlock(&shard->_lock);
+
+        atomic_fetch_sub_explicit(&_currentMemoryUsage, bytesRemoved, memory_order_relaxed);
+    }
     return removed;
 }
 
+// 读锁下可以有多个线程同时读取同一个分片，访问时间是原子变量
 - (nullable UIImage *)imageWithIdentifier:(NSString *)identifier {
-    __block UIImage *image = nil;
-    dispatch_sync(self.synchronizationQueue, ^{
-        AFCachedImage *cachedImage = self.cachedImages[identifier];
-        image = [cachedImage accessImage];
-    });
+    AFAutoPurgingImageCacheShard *shard = [self shardForIdentifier:identifier];
+
+    pthread_rwlock_rdlock(&shard->_lock);
+    UIImage *image = [shard.cachedImages[identifier] accessImage];
+    pthread_rwlock_unlock(&shard->_lock);
+
     return image;
 }
 
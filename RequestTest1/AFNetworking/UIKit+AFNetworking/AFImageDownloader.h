@@ -69,6 +69,18 @@ typedef NS_ENUM(NSInteger, AFImageDownloadPrioritization) {
  */
 @property (nonatomic, assign) AFImageDownloadPrioritization downloadPrioritization;
 
+/**
+ The maximum number of active downloads allowed for a single host at any given time. Pending downloads for a host that has reached this limit stay in the queue while downloads for other hosts are started. `0`, the default, means no per-host limit.
+ */
+@property (nonatomic, assign) NSInteger maximumActiveDownloadsPerHost;
+
+/**
+ Whether the success block of a download served from the image cache is executed synchronously when the download is requested on the main thread. `NO` by default, which dispatches the success block asynchronously to the main queue.
+
+ When enabled, the success block runs before `downloadImageForURLRequest:withReceiptID:success:failure:` returns, so it must not depend on the returned receipt, which is `nil` for cached images.
+ */
+@property (nonatomic, assign) BOOL deliversCachedImagesSynchronously;
+
 /**
  The shared default instance of `AFImageDownloader` initialized with default values.
  */
@@ -164,6 +176,16 @@ typedef NS_ENUM(NSInteger, AFImageDownloadPrioritization) {
  */
 - (void)cancelTaskForImageDownloadReceipt:(AFImageDownloadReceipt *)imageDownloadReceipt;
 
+/**
+ Changes the priority of the data task in the receipt.
+
+ Pending data tasks with a higher priority are started first. Data tasks with the same priority are started in the order defined by `downloadPrioritization`. The priority is also applied to the data task itself. Every data task starts with `NSURLSessionTaskPriorityDefault`.
+
+ @param priority The new priority, between `0.0` and `1.0`.
+ @param imageDownloadReceipt The image download receipt of the data task.
+ */
+- (void)setPriority:(float)priority forImageDownloadReceipt:(AFImageDownloadReceipt *)imageDownloadReceipt;
+
 @end
 
 #endif
@@ -51,11 +51,22 @@
 
 @end
 
-@interface AFImageDownloaderMergedTask : NSObject
+// 堆里的元素记录自己在堆数组里的位置，不在堆里时为NSNotFound
+@protocol AFImageDownloaderHeapElement <NSObject>
+@property (nonatomic, assign) NSUInteger queueIndex;
+@end
+
+@interface AFImageDownloaderMergedTask : NSObject <AFImageDownloaderHeapElement>
 @property (nonatomic, strong) NSString *URLIdentifier;
 @property (nonatomic, strong) NSUUID *identifier;
 @property (nonatomic, strong) NSURLSessionDataTask *task;
 @property (nonatomic, strong) NSMutableArray <AFImageDownloaderResponseHandler*> *responseHandlers;
+@property (nonatomic, copy) NSString *host;
+@property (nonatomic, assign) float priority;
+// 同优先级时的先后顺序，入队时根据FIFO/LIFO生成，越小越先出队
+@property (nonatomic, assign) int64_t order;
+// 在所属host等待堆数组里的位置，不在队列里时为NSNotFound
+@property (nonatomic, assign) NSUInteger queueIndex;
 
 @end
 
@@ -67,6 +78,9 @@
         self.task = task;
         self.identifier = identifier;
         self.responseHandlers = [[NSMutableArray alloc] init];
+        self.host = [task.originalRequest.URL.host lowercaseString] ?: @"";
+        self.priority = NSURLSessionTaskPriorityDefault;
+        self.queueIndex = NSNotFound;
     }
     return self;
 }
@@ -81,6 +95,221 @@
 
 @end
 
+typedef BOOL (*AFImageDownloaderHeapPrecedes)(id lhs, id rhs);
+
+static void AFImageDownloaderHeapSwap(NSMutableArray <id<AFImageDownloaderHeapElement>> *heap, NSUInteger index, NSUInteger otherIndex) {
+    [heap exchangeObjectAtIndex:index withObjectAtIndex:otherIndex];
+    heap[index].queueIndex = index;
+    heap[otherIndex].queueIndex = otherIndex;
+}
+
+static void AFImageDownloaderHeapSiftUp(NSMutableArray *heap, NSUInteger index, AFImageDownloaderHeapPrecedes precedes) {
+    while (index > 0) {
+        NSUInteger parent = (index - 1) / 2;
+        if (!precedes(heap[index], heap[parent])) {
+            break;
+        }
+        AFImageDownloaderHeapSwap(heap, index, parent);
+        index = parent;
+    }
+}
+
+static void AFImageDownloaderHeapSiftDown(NSMutableArray *heap, NSUInteger index, AFImageDownloaderHeapPrecedes precedes) {
+    NSUInteger count = heap.count;
+    while (YES) {
+        NSUInteger first = index;
+        NSUInteger left = 2 * index + 1;
+        NSUInteger right = left + 1;
+        if (left < count && precedes(heap[left], heap[first])) {
+            first = left;
+        }
+        if (right < count && precedes(heap[right], heap[first])) {
+            first = right;
+        }
+        if (first == index) {
+            break;
+        }
+        AFImageDownloaderHeapSwap(heap, index, first);
+        index = first;
+    }
+}
+
+static void AFImageDownloaderHeapAdd(NSMutableArray *heap, id<AFImageDownloaderHeapElement> element, AFImageDownloaderHeapPrecedes precedes) {
+    element.queueIndex = heap.count;
+    [heap addObject:element];
+    AFImageDownloaderHeapSiftUp(heap, element.queueIndex, precedes);
+}
+
+// 元素的排序依据变化之后调用
+static void AFImageDownloaderHeapUpdate(NSMutableArray *heap, id<AFImageDownloaderHeapElement> element, AFImageDownloaderHeapPrecedes precedes) {
+    AFImageDownloaderHeapSiftUp(heap, element.queueIndex, precedes);
+    AFImageDownloaderHeapSiftDown(heap, element.queueIndex, precedes);
+}
+
+static void AFImageDownloaderHeapRemove(NSMutableArray <id<AFImageDownloaderHeapElement>> *heap, id<AFImageDownloaderHeapElement> element, AFImageDownloaderHeapPrecedes precedes) {
+    NSUInteger index = element.queueIndex;
+    NSUInteger lastIndex = heap.count - 1;
+    if (index != lastIndex) {
+        AFImageDownloaderHeapSwap(heap, index, lastIndex);
+    }
+    [heap removeLastObject];
+    element.queueIndex = NSNotFound;
+
+    if (index < heap.count) {
+        AFImageDownloaderHeapUpdate(heap, heap[index], precedes);
+    }
+}
+
+// 一个host的等待任务，按优先级排成堆
+@interface AFImageDownloaderHostQueue : NSObject <AFImageDownloaderHeapElement>
+@property (nonatomic, copy) NSString *host;
+@property (nonatomic, strong) NSMutableArray <AFImageDownloaderMergedTask *> *heap;
+// 在可用host堆里的位置，host没有空闲并发数或者没有等待任务时为NSNotFound
+@property (nonatomic, assign) NSUInteger queueIndex;
+@end
+
+@implementation AFImageDownloaderHostQueue
+
+- (instancetype)initWithHost:(NSString *)host {
+    if (self = [super init]) {
+        self.host = host;
+        self.heap = [[NSMutableArray alloc] init];
+        self.queueIndex = NSNotFound;
+    }
+    return self;
+}
+
+@end
+
+// 优先级高的在前，优先级相同时order小的在前
+static BOOL AFImageDownloaderMergedTaskPrecedes(AFImageDownloaderMergedTask *lhs, AFImageDownloaderMergedTask *rhs) {
+    if (lhs.priority != rhs.priority) {
+        return lhs.priority > rhs.priority;
+    }
+    return lhs.order < rhs.order;
+}
+
+// 可用host堆里的host都有等待任务，按各自最靠前的任务排序
+static BOOL AFImageDownloaderHostQueuePrecedes(AFImageDownloaderHostQueue *lhs, AFImageDownloaderHostQueue *rhs) {
+    return AFImageDownloaderMergedTaskPrecedes(lhs.heap[0], rhs.heap[0]);
+}
+
+// 等待中的任务按host分成多个优先级堆，还有空闲并发数的host再按各自最靠前的任务排成一个堆，
+// 并用identifier索引任务。入队、取消、调整优先级和取出下一个任务都是O(log n)，不需要跳过已经满载的host
+@interface AFImageDownloaderTaskQueue : NSObject
+@property (nonatomic, assign, readonly) NSUInteger count;
+- (void)addMergedTask:(AFImageDownloaderMergedTask *)mergedTask;
+- (nullable AFImageDownloaderMergedTask *)removeMergedTaskWithIdentifier:(NSUUID *)identifier;
+- (void)setPriority:(float)priority forMergedTaskWithIdentifier:(NSUUID *)identifier;
+// 取出还有空闲并发数的host中优先级最高的任务
+- (nullable AFImageDownloaderMergedTask *)removeFirstMergedTask;
+// host达到并发上限时设置为NO，有空闲并发数时设置为YES
+- (void)setHost:(NSString *)host available:(BOOL)available;
+
+@property (nonatomic, strong) NSMutableDictionary <NSString *, AFImageDownloaderHostQueue *> *hostQueues;
+@property (nonatomic, strong) NSMutableArray <AFImageDownloaderHostQueue *> *availableHostQueues;
+@property (nonatomic, strong) NSMutableSet <NSString *> *unavailableHosts;
+@property (nonatomic, strong) NSMutableDictionary <NSUUID *, AFImageDownloaderMergedTask *> *mergedTasksByIdentifier;
+@end
+
+@implementation AFImageDownloaderTaskQueue
+
+- (instancetype)init {
+    if (self = [super init]) {
+        self.hostQueues = [[NSMutableDictionary alloc] init];
+        self.availableHostQueues = [[NSMutableArray alloc] init];
+        self.unavailableHosts = [[NSMutableSet alloc] init];
+        self.mergedTasksByIdentifier = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return self.mergedTasksByIdentifier.count;
+}
+
+- (void)addMergedTask:(AFImageDownloaderMergedTask *)mergedTask {
+    AFImageDownloaderHostQueue *hostQueue = self.hostQueues[mergedTask.host];
+    if (!hostQueue) {
+        hostQueue = [[AFImageDownloaderHostQueue alloc] initWithHost:mergedTask.host];
+        self.hostQueues[mergedTask.host] = hostQueue;
+    }
+    AFImageDownloaderHeapAdd(hostQueue.heap, mergedTask, (AFImageDownloaderHeapPrecedes)AFImageDownloaderMergedTaskPrecedes);
+    self.mergedTasksByIdentifier[mergedTask.identifier] = mergedTask;
+    [self updateHostQueue:hostQueue];
+}
+
+- (AFImageDownloaderMergedTask *)removeMergedTaskWithIdentifier:(NSUUID *)identifier {
+    AFImageDownloaderMergedTask *mergedTask = self.mergedTasksByIdentifier[identifier];
+    if (mergedTask) {
+        [self removeMergedTask:mergedTask];
+    }
+    return mergedTask;
+}
+
+- (void)setPriority:(float)priority forMergedTaskWithIdentifier:(NSUUID *)identifier {
+    AFImageDownloaderMergedTask *mergedTask = self.mergedTasksByIdentifier[identifier];
+    if (!mergedTask) {
+        return;
+    }
+
+    mergedTask.priority = priority;
+    AFImageDownloaderHostQueue *hostQueue = self.hostQueues[mergedTask.host];
+    AFImageDownloaderHeapUpdate(hostQueue.heap, mergedTask, (AFImageDownloaderHeapPrecedes)AFImageDownloaderMergedTaskPrecedes);
+    [self updateHostQueue:hostQueue];
+}
+
+- (AFImageDownloaderMergedTask *)removeFirstMergedTask {
+    AFImageDownloaderHostQueue *hostQueue = self.availableHostQueues.firstObject;
+    if (!hostQueue) {
+        return nil;
+    }
+
+    AFImageDownloaderMergedTask *mergedTask = hostQueue.heap[0];
+    [self removeMergedTask:mergedTask];
+    return mergedTask;
+}
+
+- (void)setHost:(NSString *)host available:(BOOL)available {
+    if (available) {
+        [self.unavailableHosts removeObject:host];
+    } else {
+        [self.unavailableHosts addObject:host];
+    }
+
+    AFImageDownloaderHostQueue *hostQueue = self.hostQueues[host];
+    if (hostQueue) {
+        [self updateHostQueue:hostQueue];
+    }
+}
+
+- (void)removeMergedTask:(AFImageDownloaderMergedTask *)mergedTask {
+    AFImageDownloaderHostQueue *hostQueue = self.hostQueues[mergedTask.host];
+    AFImageDownloaderHeapRemove(hostQueue.heap, mergedTask, (AFImageDownloaderHeapPrecedes)AFImageDownloaderMergedTaskPrecedes);
+    [self.mergedTasksByIdentifier removeObjectForKey:mergedTask.identifier];
+    [self updateHostQueue:hostQueue];
+}
+
+// host的等待任务或者可用状态变化之后，调整它在可用host堆里的位置；没有等待任务的host直接丢掉
+- (void)updateHostQueue:(AFImageDownloaderHostQueue *)hostQueue {
+    BOOL available = hostQueue.heap.count > 0 && ![self.unavailableHosts containsObject:hostQueue.host];
+    if (hostQueue.queueIndex != NSNotFound) {
+        if (available) {
+            AFImageDownloaderHeapUpdate(self.availableHostQueues, hostQueue, (AFImageDownloaderHeapPrecedes)AFImageDownloaderHostQueuePrecedes);
+        } else {
+            AFImageDownloaderHeapRemove(self.availableHostQueues, hostQueue, (AFImageDownloaderHeapPrecedes)AFImageDownloaderHostQueuePrecedes);
+        }
+    } else if (available) {
+        AFImageDownloaderHeapAdd(self.availableHostQueues, hostQueue, (AFImageDownloaderHeapPrecedes)AFImageDownloaderHostQueuePrecedes);
+    }
+
+    if (hostQueue.heap.count == 0) {
+        [self.hostQueues removeObjectForKey:hostQueue.host];
+    }
+}
+
+@end
+
 @implementation AFImageDownloadReceipt
 
 - (instancetype)initWithReceiptID:(NSUUID *)receiptID task:(NSURLSessionDataTask *)task {
@@ -101,8 +330,13 @@
 @property (nonatomic, assign) NSInteger maximumActiveDownloads;
 @property (nonatomic, assign) NSInteger activeRequestCount;
 
-@property (nonatomic, strong) NSMutableArray *queuedMergedTasks;
+@property (nonatomic, strong) AFImageDownloaderTaskQueue *queuedMergedTasks;
 @property (nonatomic, strong) NSMutableDictionary *mergedTasks;
+@property (nonatomic, assign) int64_t queuedMergedTaskSequence;
+
+// 正在下载的任务所属的host，以及每个host正在下载的数量
+@property (nonatomic, strong) NSMutableDictionary <NSUUID *, NSString *> *activeMergedTaskHosts;
+@property (nonatomic, strong) NSMutableDictionary <NSString *, NSNumber *> *activeRequestCountsByHost;
 
 @end
 
@@ -171,9 +405,11 @@
         self.maximumActiveDownloads = maximumActiveDownloads;
         self.imageCache = imageCache;
 
-        self.queuedMergedTasks = [[NSMutableArray alloc] init];
+        self.queuedMergedTasks = [[AFImageDownloaderTaskQueue alloc] init];
         self.mergedTasks = [[NSMutableDictionary alloc] init];
         self.activeRequestCount = 0;
+        self.activeMergedTaskHosts = [[NSMutableDictionary alloc] init];
+        self.activeRequestCountsByHost = [[NSMutableDictionary alloc] init];
 
         NSString *name = [NSString stringWithFormat:@"com.alamofire.imagedownloader.synchronizationqueue-%@", [[NSUUID UUID] UUIDString]];
         self.synchronizationQueue = dispatch_queue_create([name cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_SERIAL);
@@ -204,6 +440,21 @@
                                                   withReceiptID:(nonnull NSUUID *)receiptID
                                                         success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
                                                         failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure {
+    // 0) 内存缓存命中时不进入synchronizationQueue，允许的话在主线程直接同步回调
+    UIImage *cachedImage = [self cachedImageForRequest:request];
+    if (cachedImage != nil) {
+        if (success) {
+            if (self.deliversCachedImagesSynchronously && [NSThread isMainThread]) {
+                success(request, nil, cachedImage);
+            } else {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    success(request, nil, cachedImage);
+                });
+            }
+        }
+        return nil;
+    }
+
     __block NSURLSessionDataTask *task = nil;
     dispatch_sync(self.synchronizationQueue, ^{
         NSString *URLIdentifier = request.URL.absoluteString;
@@ -289,7 +540,7 @@
                                    }
                                }
                                // 最大并发数 -- 当前下载数-1 即4-1 = 3;
-                               [strongSelf safelyDecrementActiveTaskCount];
+                               [strongSelf safelyDecrementActiveTaskCountForMergedTaskIdentifier:mergedTaskIdentifier];
                                // 排队的task 可以 resume了
                                [strongSelf safelyStartNextTaskIfNecessary];
                            });
@@ -308,7 +559,7 @@
 
         // 5) Either start the request or enqueue it depending on the current active request count
         // 最大并发数maximumActiveDownloads默认为4
-        if ([self isActiveRequestCountBelowMaximumLimit]) {
+        if ([self isActiveRequestCountBelowMaximumLimit] && [self isActiveRequestCountBelowMaximumLimitForHost:mergedTask.host]) {
             [self startMergedTask:mergedTask]; // 这里面调用[task resume]
         } else { //超过 4 的时候,排队 队列里面的task,需要等待前面的下载完成后,才resume
             [self enqueueMergedTask:mergedTask];
@@ -323,6 +574,22 @@
     }
 }
 
+// imageCache自己保证线程安全，这里可以在任意线程调用
+- (UIImage *)cachedImageForRequest:(NSURLRequest *)request {
+    if (request.URL.absoluteString == nil) {
+        return nil;
+    }
+
+    switch (request.cachePolicy) {
+        case NSURLRequestUseProtocolCachePolicy:
+        case NSURLRequestReturnCacheDataElseLoad:
+        case NSURLRequestReturnCacheDataDontLoad:
+            return [self.imageCache imageforRequest:request withAdditionalIdentifier:nil];
+        default:
+            return nil;
+    }
+}
+
 - (void)cancelTaskForImageDownloadReceipt:(AFImageDownloadReceipt *)imageDownloadReceipt {
     dispatch_sync(self.synchronizationQueue, ^{
         NSString *URLIdentifier = imageDownloadReceipt.task.originalRequest.URL.absoluteString;
@@ -345,12 +612,27 @@
         }
 
         if (mergedTask.responseHandlers.count == 0) {
+            [self.queuedMergedTasks removeMergedTaskWithIdentifier:mergedTask.identifier];
             [mergedTask.task cancel];
             [self removeMergedTaskWithURLIdentifier:URLIdentifier];
         }
     });
 }
 
+- (void)setPriority:(float)priority forImageDownloadReceipt:(AFImageDownloadReceipt *)imageDownloadReceipt {
+    dispatch_sync(self.synchronizationQueue, ^{
+        NSString *URLIdentifier = imageDownloadReceipt.task.originalRequest.URL.absoluteString;
+        AFImageDownloaderMergedTask *mergedTask = self.mergedTasks[URLIdentifier];
+        if (mergedTask.task != imageDownloadReceipt.task) {
+            return;
+        }
+
+        mergedTask.priority = priority;
+        mergedTask.task.priority = priority;
+        [self.queuedMergedTasks setPriority:priority forMergedTaskWithIdentifier:mergedTask.identifier];
+    });
+}
+
 - (AFImageDownloaderMergedTask *)safelyRemoveMergedTaskWithURLIdentifier:(NSString *)URLIdentifier {
     __block AFImageDownloaderMergedTask *mergedTask = nil;
     dispatch_sync(self.synchronizationQueue, ^{
@@ -366,8 +648,23 @@
     return mergedTask;
 }
 
-- (void)safelyDecrementActiveTaskCount {
+- (void)safelyDecrementActiveTaskCountForMergedTaskIdentifier:(NSUUID *)mergedTaskIdentifier {
     dispatch_sync(self.synchronizationQueue, ^{
+        // 还在排队就被取消的任务没有占用并发数
+        NSString *host = self.activeMergedTaskHosts[mergedTaskIdentifier];
+        if (host == nil) {
+            return;
+        }
+        [self.activeMergedTaskHosts removeObjectForKey:mergedTaskIdentifier];
+
+        NSInteger hostCount = [self.activeRequestCountsByHost[host] integerValue] - 1;
+        if (hostCount > 0) {
+            self.activeRequestCountsByHost[host] = @(hostCount);
+        } else {
+            [self.activeRequestCountsByHost removeObjectForKey:host];
+        }
+        [self.queuedMergedTasks setHost:host available:[self isActiveRequestCountBelowMaximumLimitForHost:host]];
+
         if (self.activeRequestCount > 0) {
             self.activeRequestCount -= 1;
         }
@@ -376,13 +673,13 @@
 
 - (void)safelyStartNextTaskIfNecessary {
     dispatch_sync(self.synchronizationQueue, ^{
-        if ([self isActiveRequestCountBelowMaximumLimit]) {
-            while (self.queuedMergedTasks.count > 0) {
-                AFImageDownloaderMergedTask *mergedTask = [self dequeueMergedTask];
-                if (mergedTask.task.state == NSURLSessionTaskStateSuspended) {
-                    [self startMergedTask:mergedTask];
-                    break;
-                }
+        while ([self isActiveRequestCountBelowMaximumLimit]) {
+            AFImageDownloaderMergedTask *mergedTask = [self dequeueMergedTask];
+            if (mergedTask == nil) {
+                break;
+            }
+            if (mergedTask.task.state == NSURLSessionTaskStateSuspended) {
+                [self startMergedTask:mergedTask];
             }
         }
     });
@@ -391,30 +688,56 @@
 - (void)startMergedTask:(AFImageDownloaderMergedTask *)mergedTask {
     [mergedTask.task resume];
     ++self.activeRequestCount;
+    self.activeMergedTaskHosts[mergedTask.identifier] = mergedTask.host;
+    self.activeRequestCountsByHost[mergedTask.host] = @([self.activeRequestCountsByHost[mergedTask.host] integerValue] + 1);
+    [self.queuedMergedTasks setHost:mergedTask.host available:[self isActiveRequestCountBelowMaximumLimitForHost:mergedTask.host]];
 }
 
 - (void)enqueueMergedTask:(AFImageDownloaderMergedTask *)mergedTask {
+    int64_t sequence = ++self.queuedMergedTaskSequence;
     switch (self.downloadPrioritization) {
         case AFImageDownloadPrioritizationFIFO:
-            [self.queuedMergedTasks addObject:mergedTask];
+            mergedTask.order = sequence;
             break;
         case AFImageDownloadPrioritizationLIFO:
-            [self.queuedMergedTasks insertObject:mergedTask atIndex:0];
+            mergedTask.order = -sequence;
             break;
     }
+    [self.queuedMergedTasks addMergedTask:mergedTask];
 }
 
+// 取出优先级最高、并且所在host还没有达到并发上限的任务
 - (AFImageDownloaderMergedTask *)dequeueMergedTask {
-    AFImageDownloaderMergedTask *mergedTask = nil;
-    mergedTask = [self.queuedMergedTasks firstObject];
-    [self.queuedMergedTasks removeObject:mergedTask];
-    return mergedTask;
+    return [self.queuedMergedTasks removeFirstMergedTask];
+}
+
+- (void)setMaximumActiveDownloadsPerHost:(NSInteger)maximumActiveDownloadsPerHost {
+    if (!self.synchronizationQueue) {
+        _maximumActiveDownloadsPerHost = maximumActiveDownloadsPerHost;
+        return;
+    }
+
+    // 上限变化之后，正在下载的host是否还有空闲并发数要重新计算
+    dispatch_sync(self.synchronizationQueue, ^{
+        self->_maximumActiveDownloadsPerHost = maximumActiveDownloadsPerHost;
+        for (NSString *host in self.activeRequestCountsByHost) {
+            [self.queuedMergedTasks setHost:host available:[self isActiveRequestCountBelowMaximumLimitForHost:host]];
+        }
+    });
+    [self safelyStartNextTaskIfNecessary];
 }
 
 - (BOOL)isActiveRequestCountBelowMaximumLimit {
     return self.activeRequestCount < self.maximumActiveDownloads;
 }
 
+- (BOOL)isActiveRequestCountBelowMaximumLimitForHost:(NSString *)host {
+    if (self.maximumActiveDownloadsPerHost <= 0) {
+        return YES;
+    }
+    return [self.activeRequestCountsByHost[host] integerValue] < self.maximumActiveDownloadsPerHost;
+}
+
 - (AFImageDownloaderMergedTask *)safelyGetMergedTask:(NSString *)URLIdentifier {
     __block AFImageDownloaderMergedTask *mergedTask;
     dispatch_sync(self.synchronizationQueue, ^(){
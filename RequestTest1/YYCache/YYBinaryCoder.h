@@ -0,0 +1,107 @@
+//
+//  YYBinaryCoder.h
+//  YYCache <https://github.com/ibireme/YYCache>
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class YYBinaryEncoder, YYBinaryDecoder;
+
+/**
+ A model implements `YYBinaryCoding` to be written by `YYBinaryCoder` field by field,
+ without going through `NSKeyedArchiver`.
+
+ @discussion Fields are not keyed: `initWithBinaryDecoder:` must decode the fields in
+ the same order and with the same types as `encodeWithBinaryEncoder:` encoded them.
+ Fields appended at the end by a newer version of the model are skipped when an
+ older version decodes the data, and fields missing at the end of data written by
+ an older version decode as zero or nil.
+ */
+@protocol YYBinaryCoding <NSObject>
+@required
+- (void)encodeWithBinaryEncoder:(YYBinaryEncoder *)encoder;
+- (nullable instancetype)initWithBinaryDecoder:(YYBinaryDecoder *)decoder;
+@end
+
+
+/**
+ Writes the fields of a `YYBinaryCoding` model.
+ */
+@interface YYBinaryEncoder : NSObject
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+- (void)encodeBool:(BOOL)value;
+- (void)encodeInt64:(int64_t)value;
+- (void)encodeDouble:(double)value;
+
+/**
+ Encode an object supported by `YYBinaryCoder`, or nil.
+ If the object is not supported, the whole encoding fails.
+ */
+- (void)encodeObject:(nullable id)object;
+@end
+
+
+/**
+ Reads the fields of a `YYBinaryCoding` model.
+
+ @discussion If a field does not match the encoded data, the decoder returns zero
+ or nil, and the whole decoding fails.
+ */
+@interface YYBinaryDecoder : NSObject
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+- (BOOL)decodeBool;
+- (int64_t)decodeInt64;
+- (double)decodeDouble;
+- (nullable id)decodeObject;
+@end
+
+
+/**
+ YYBinaryCoder is a compact binary codec for the common Foundation types, used by
+ `YYDiskCache` as a faster alternative to `NSKeyedArchiver`.
+
+ @discussion Supported types are NSNull, NSNumber (except NSDecimalNumber), NSString,
+ NSData, NSDate, NSArray and NSDictionary with supported elements, and objects which
+ conform to `YYBinaryCoding`. Numbers are written as varints, and there is no class
+ table or object graph: an object referenced twice is written twice.
+
+ Collections and strings are decoded as instances of the base classes, which may be
+ mutable; mutability and subclasses of the encoded objects are not preserved.
+ */
+@interface YYBinaryCoder : NSObject
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+/**
+ Encode the object.
+
+ @param object An object.
+ @return The encoded data, or nil if the object (or one of its children) is not supported.
+ */
++ (nullable NSData *)dataWithObject:(id)object;
+
+/**
+ Decode the object.
+
+ @param data Data created by `dataWithObject:`.
+ @return The decoded object, or nil if the data is invalid.
+ */
++ (nullable id)objectWithData:(NSData *)data;
+
+/**
+ Whether the data was created by `dataWithObject:`.
+ It only checks the header of the data.
+ */
++ (BOOL)isBinaryCodedData:(NSData *)data;
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,460 @@
+//
+//  YYBinaryCoder.m
+//  YYCache <https://github.com/ibireme/YYCache>
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import "YYBinaryCoder.h"
+
+/// Header of the encoded data: "YYB" and the format version.
+static const uint8_t kYYBinaryHeader[4] = {'Y', 'Y', 'B', 1};
+
+/// Maximum nesting of collections and models, guards against cycles and bad data.
+static const NSUInteger kYYBinaryMaxDepth = 256;
+
+typedef NS_ENUM(uint8_t, YYBinaryTag) {
+    YYBinaryTagNil = 0,
+    YYBinaryTagNull,
+    YYBinaryTagFalse,
+    YYBinaryTagTrue,
+    YYBinaryTagInt,        ///< zigzag varint
+    YYBinaryTagUInt,       ///< varint, for unsigned values larger than INT64_MAX
+    YYBinaryTagDouble,     ///< 8 bytes, little endian
+    YYBinaryTagString,     ///< varint length + UTF-8 bytes
+    YYBinaryTagData,       ///< varint length + bytes
+    YYBinaryTagDate,       ///< 8 bytes, timeIntervalSinceReferenceDate
+    YYBinaryTagArray,      ///< varint count + elements
+    YYBinaryTagDictionary, ///< varint count + key/value pairs
+    YYBinaryTagModel,      ///< class name + 4 bytes payload length + fields
+};
+
+static inline uint64_t _YYZigZagEncode(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t _YYZigZagDecode(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+
+@interface YYBinaryEncoder () {
+    @package
+    uint8_t *_bytes;
+    size_t _length;
+    size_t _capacity;
+    NSUInteger _depth;
+    BOOL _failed;
+}
+- (instancetype)initWithCapacity:(size_t)capacity;
+- (void)_writeBytes:(const void *)bytes length:(size_t)length;
+@end
+
+@implementation YYBinaryEncoder
+
+- (instancetype)initWithCapacity:(size_t)capacity {
+    self = [super init];
+    _capacity = capacity > 16 ? capacity : 16;
+    _bytes = malloc(_capacity);
+    return self;
+}
+
+- (void)dealloc {
+    if (_bytes) free(_bytes);
+}
+
+- (void)_reserve:(size_t)length {
+    if (_length + length <= _capacity) return;
+    size_t capacity = _capacity * 2;
+    while (capacity < _length + length) capacity *= 2;
+    _bytes = realloc(_bytes, capacity);
+    _capacity = capacity;
+}
+
+- (void)_writeBytes:(const void *)bytes length:(size_t)length {
+    [self _reserve:length];
+    memcpy(_bytes + _length, bytes, length);
+    _length += length;
+}
+
+- (void)_writeTag:(YYBinaryTag)tag {
+    [self _reserve:1];
+    _bytes[_length++] = tag;
+}
+
+- (void)_writeVarint:(uint64_t)value {
+    [self _reserve:10];
+    while (value >= 0x80) {
+        _bytes[_length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    _bytes[_length++] = (uint8_t)value;
+}
+
+- (void)_writeDouble:(double)value {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits = CFSwapInt64HostToLittle(bits);
+    [self _writeBytes:&bits length:sizeof(bits)];
+}
+
+- (void)_writeString:(NSString *)string {
+    CFStringRef cfString = (__bridge CFStringRef)string;
+    CFIndex length = CFStringGetLength(cfString);
+    CFIndex maxLength = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+    // 长度前缀最多 10 字节，先按最大长度预留，写完再把字节挪到前缀后面
+    [self _reserve:10 + maxLength];
+    uint8_t *buffer = _bytes + _length + 10;
+    CFIndex usedLength = 0;
+    CFIndex converted = CFStringGetBytes(cfString, CFRangeMake(0, length), kCFStringEncodingUTF8, 0, false, buffer, maxLength, &usedLength);
+    if (converted != length) {
+        _failed = YES;
+        return;
+    }
+    [self _writeVarint:(uint64_t)usedLength];
+    memmove(_bytes + _length, buffer, usedLength);
+    _length += usedLength;
+}
+
+- (void)_writeNumber:(NSNumber *)number {
+    if ((__bridge CFBooleanRef)number == kCFBooleanTrue) {
+        [self _writeTag:YYBinaryTagTrue];
+    } else if ((__bridge CFBooleanRef)number == kCFBooleanFalse) {
+        [self _writeTag:YYBinaryTagFalse];
+    } else if ([number isKindOfClass:[NSDecimalNumber class]]) {
+        _failed = YES;
+    } else if (CFNumberIsFloatType((__bridge CFNumberRef)number)) {
+        [self _writeTag:YYBinaryTagDouble];
+        [self _writeDouble:number.doubleValue];
+    } else if (*number.objCType == 'Q' && number.unsignedLongLongValue > INT64_MAX) {
+        [self _writeTag:YYBinaryTagUInt];
+        [self _writeVarint:number.unsignedLongLongValue];
+    } else {
+        [self _writeTag:YYBinaryTagInt];
+        [self _writeVarint:_YYZigZagEncode(number.longLongValue)];
+    }
+}
+
+- (void)_writeModel:(id<YYBinaryCoding>)model {
+    [self _writeTag:YYBinaryTagModel];
+    [self _writeString:NSStringFromClass(model.class)];
+    // 先占住 4 字节的长度，写完字段再回填，解码时可以跳过不认识的字段
+    size_t lengthOffset = _length;
+    [self _reserve:4];
+    _length += 4;
+    [model encodeWithBinaryEncoder:self];
+    uint32_t payloadLength = CFSwapInt32HostToLittle((uint32_t)(_length - lengthOffset - 4));
+    memcpy(_bytes + lengthOffset, &payloadLength, 4);
+}
+
+- (void)encodeBool:(BOOL)value {
+    [self _writeTag:value ? YYBinaryTagTrue : YYBinaryTagFalse];
+}
+
+- (void)encodeInt64:(int64_t)value {
+    [self _writeTag:YYBinaryTagInt];
+    [self _writeVarint:_YYZigZagEncode(value)];
+}
+
+- (void)encodeDouble:(double)value {
+    [self _writeTag:YYBinaryTagDouble];
+    [self _writeDouble:value];
+}
+
+- (void)encodeObject:(id)object {
+    if (_failed) return;
+    if (_depth >= kYYBinaryMaxDepth) {
+        _failed = YES;
+        return;
+    }
+
+    if (!object) {
+        [self _writeTag:YYBinaryTagNil];
+    } else if ([object isKindOfClass:[NSString class]]) {
+        [self _writeTag:YYBinaryTagString];
+        [self _writeString:object];
+    } else if ([object isKindOfClass:[NSNumber class]]) {
+        [self _writeNumber:object];
+    } else if ([object isKindOfClass:[NSData class]]) {
+        NSData *data = object;
+        [self _writeTag:YYBinaryTagData];
+        [self _writeVarint:data.length];
+        [self _writeBytes:data.bytes length:data.length];
+    } else if ([object isKindOfClass:[NSDate class]]) {
+        [self _writeTag:YYBinaryTagDate];
+        [self _writeDouble:[(NSDate *)object timeIntervalSinceReferenceDate]];
+    } else if ([object isKindOfClass:[NSArray class]]) {
+        NSArray *array = object;
+        [self _writeTag:YYBinaryTagArray];
+        [self _writeVarint:array.count];
+        _depth++;
+        for (id element in array) {
+            [self encodeObject:element];
+            if (_failed) break;
+        }
+        _depth--;
+    } else if ([object isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dictionary = object;
+        [self _writeTag:YYBinaryTagDictionary];
+        [self _writeVarint:dictionary.count];
+        _depth++;
+        [dictionary enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            [self encodeObject:key];
+            [self encodeObject:value];
+            if (self->_failed) *stop = YES;
+        }];
+        _depth--;
+    } else if (object == [NSNull null]) {
+        [self _writeTag:YYBinaryTagNull];
+    } else if ([object conformsToProtocol:@protocol(YYBinaryCoding)]) {
+        _depth++;
+        [self _writeModel:object];
+        _depth--;
+    } else {
+        _failed = YES;
+    }
+}
+
+@end
+
+
+@interface YYBinaryDecoder () {
+    @package
+    const uint8_t *_pos;
+    const uint8_t *_end;
+    NSUInteger _depth;
+    BOOL _failed;
+}
+- (instancetype)initWithBytes:(const uint8_t *)bytes length:(size_t)length;
+@end
+
+@implementation YYBinaryDecoder
+
+- (instancetype)initWithBytes:(const uint8_t *)bytes length:(size_t)length {
+    self = [super init];
+    _pos = bytes;
+    _end = bytes + length;
+    return self;
+}
+
+/// Reads the tag of the next field. At the end of a model written by an older
+/// version, returns nil tag so that missing fields decode as zero or nil.
+- (YYBinaryTag)_readTag {
+    if (_failed || _pos >= _end) return YYBinaryTagNil;
+    return *_pos++;
+}
+
+- (uint64_t)_readVarint {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (_pos >= _end) break;
+        uint8_t byte = *_pos++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    _failed = YES;
+    return 0;
+}
+
+- (double)_readDouble {
+    if (_end - _pos < 8) {
+        _failed = YES;
+        return 0;
+    }
+    uint64_t bits;
+    memcpy(&bits, _pos, sizeof(bits));
+    _pos += 8;
+    bits = CFSwapInt64LittleToHost(bits);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/// Reads a varint length and checks that many bytes remain.
+- (size_t)_readLength {
+    uint64_t length = [self _readVarint];
+    if (_failed || length > (uint64_t)(_end - _pos)) {
+        _failed = YES;
+        return 0;
+    }
+    return (size_t)length;
+}
+
+- (NSString *)_readString {
+    size_t length = [self _readLength];
+    if (_failed) return nil;
+    NSString *string = [[NSString alloc] initWithBytes:_pos length:length encoding:NSUTF8StringEncoding];
+    _pos += length;
+    if (!string) _failed = YES;
+    return string;
+}
+
+- (id)_readModel {
+    NSString *className = [self _readString];
+    if (_end - _pos < 4) _failed = YES;
+    if (_failed) return nil;
+    uint32_t payloadLength;
+    memcpy(&payloadLength, _pos, 4);
+    _pos += 4;
+    payloadLength = CFSwapInt32LittleToHost(payloadLength);
+    if (payloadLength > (uint64_t)(_end - _pos)) {
+        _failed = YES;
+        return nil;
+    }
+
+    Class cls = NSClassFromString(className);
+    if (![cls conformsToProtocol:@protocol(YYBinaryCoding)]) {
+        _failed = YES;
+        return nil;
+    }
+
+    // 字段只能在 payload 范围内读取，读完后跳过没有读到的字段
+    const uint8_t *end = _end;
+    const uint8_t *payloadEnd = _pos + payloadLength;
+    _end = payloadEnd;
+    id model = [[cls alloc] initWithBinaryDecoder:self];
+    _end = end;
+    _pos = payloadEnd;
+    if (!model) _failed = YES;
+    return model;
+}
+
+- (BOOL)decodeBool {
+    YYBinaryTag tag = [self _readTag];
+    if (tag == YYBinaryTagTrue) return YES;
+    if (tag != YYBinaryTagFalse && tag != YYBinaryTagNil) _failed = YES;
+    return NO;
+}
+
+- (int64_t)decodeInt64 {
+    YYBinaryTag tag = [self _readTag];
+    if (tag == YYBinaryTagInt) return _YYZigZagDecode([self _readVarint]);
+    if (tag != YYBinaryTagNil) _failed = YES;
+    return 0;
+}
+
+- (double)decodeDouble {
+    YYBinaryTag tag = [self _readTag];
+    if (tag == YYBinaryTagDouble) return [self _readDouble];
+    if (tag != YYBinaryTagNil) _failed = YES;
+    return 0;
+}
+
+- (id)decodeObject {
+    YYBinaryTag tag = [self _readTag];
+    if (_failed) return nil;
+    if (_depth >= kYYBinaryMaxDepth) {
+        _failed = YES;
+        return nil;
+    }
+
+    switch (tag) {
+        case YYBinaryTagNil: return nil;
+        case YYBinaryTagNull: return [NSNull null];
+        case YYBinaryTagFalse: return (__bridge id)kCFBooleanFalse;
+        case YYBinaryTagTrue: return (__bridge id)kCFBooleanTrue;
+        case YYBinaryTagInt: {
+            int64_t value = _YYZigZagDecode([self _readVarint]);
+            return _failed ? nil : @(value);
+        }
+        case YYBinaryTagUInt: {
+            uint64_t value = [self _readVarint];
+            return _failed ? nil : @(value);
+        }
+        case YYBinaryTagDouble: {
+            double value = [self _readDouble];
+            return _failed ? nil : @(value);
+        }
+        case YYBinaryTagString: return [self _readString];
+        case YYBinaryTagData: {
+            size_t length = [self _readLength];
+            if (_failed) return nil;
+            NSData *data = [NSData dataWithBytes:_pos length:length];
+            _pos += length;
+            return data;
+        }
+        case YYBinaryTagDate: {
+            double value = [self _readDouble];
+            return _failed ? nil : [NSDate dateWithTimeIntervalSinceReferenceDate:value];
+        }
+        case YYBinaryTagArray: {
+            // 每个元素至少 1 字节，用剩余长度限制 count，避免坏数据导致巨大的分配
+            size_t count = [self _readLength];
+            if (_failed) return nil;
+            NSMutableArray *array = [NSMutableArray arrayWithCapacity:count];
+            _depth++;
+            for (size_t i = 0; i < count; i++) {
+                id element = [self decodeObject];
+                if (_failed || !element) {
+                    _failed = YES;
+                    break;
+                }
+                [array addObject:element];
+            }
+            _depth--;
+            return _failed ? nil : array;
+        }
+        case YYBinaryTagDictionary: {
+            size_t count = [self _readLength];
+            if (_failed) return nil;
+            NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:count];
+            _depth++;
+            for (size_t i = 0; i < count; i++) {
+                id key = [self decodeObject];
+                id value = [self decodeObject];
+                if (_failed || !key || !value) {
+                    _failed = YES;
+                    break;
+                }
+                dictionary[key] = value;
+            }
+            _depth--;
+            return _failed ? nil : dictionary;
+        }
+        case YYBinaryTagModel: {
+            _depth++;
+            id model = [self _readModel];
+            _depth--;
+            return model;
+        }
+        default: {
+            _failed = YES;
+            return nil;
+        }
+    }
+}
+
+@end
+
+
+@implementation YYBinaryCoder
+
++ (NSData *)dataWithObject:(id)object {
+    if (!object) return nil;
+    YYBinaryEncoder *encoder = [[YYBinaryEncoder alloc] initWithCapacity:256];
+    [encoder _writeBytes:kYYBinaryHeader length:sizeof(kYYBinaryHeader)];
+    [encoder encodeObject:object];
+    if (encoder->_failed) return nil;
+
+    // 把缓冲区直接交给 NSData，不再拷贝
+    NSData *data = [NSData dataWithBytesNoCopy:encoder->_bytes length:encoder->_length freeWhenDone:YES];
+    encoder->_bytes = NULL;
+    return data;
+}
+
++ (id)objectWithData:(NSData *)data {
+    if (![self isBinaryCodedData:data]) return nil;
+    YYBinaryDecoder *decoder = [[YYBinaryDecoder alloc] initWithBytes:(const uint8_t *)data.bytes + sizeof(kYYBinaryHeader)
+                                                               length:data.length - sizeof(kYYBinaryHeader)];
+    id object = [decoder decodeObject];
+    if (decoder->_failed || decoder->_pos != decoder->_end) return nil;
+    return object;
+}
+
++ (BOOL)isBinaryCodedData:(NSData *)data {
+    if (data.length < sizeof(kYYBinaryHeader)) return NO;
+    return memcmp(data.bytes, kYYBinaryHeader, sizeof(kYYBinaryHeader)) == 0;
+}
+
+@end
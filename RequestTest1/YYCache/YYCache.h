@@ -17,14 +17,17 @@ FOUNDATION_EXPORT const unsigned char YYCacheVersionString[];
 #import <YYCache/YYMemoryCache.h>
 #import <YYCache/YYDiskCache.h>
 #import <YYCache/YYKVStorage.h>
+#import <YYCache/YYBinaryCoder.h>
 #elif __has_include(<YYWebImage/YYCache.h>)
 #import <YYWebImage/YYMemoryCache.h>
 #import <YYWebImage/YYDiskCache.h>
 #import <YYWebImage/YYKVStorage.h>
+#import <YYWebImage/YYBinaryCoder.h>
 #else
 #import "YYMemoryCache.h"
 #import "YYDiskCache.h"
 #import "YYKVStorage.h"
+#import "YYBinaryCoder.h"
 #endif
 
 NS_ASSUME_NONNULL_BEGIN
@@ -140,7 +143,8 @@ NS_ASSUME_NONNULL_BEGIN
 
 /**
  Sets the value of the specified key in the cache.
- This method may blocks the calling thread until file write finished.
+ This method may blocks the calling thread until file write finished, unless
+ `diskCache.writeBehindEnabled` is YES.
  
  @param object The object to be stored in the cache. If nil, it calls `removeObjectForKey:`.
  @param key    The key with which to associate the value. If nil, this method has no effect.
@@ -11,6 +11,14 @@
 
 #import <Foundation/Foundation.h>
 
+#if __has_include(<YYCache/YYCache.h>)
+#import <YYCache/YYKVStorage.h>
+#elif __has_include(<YYWebImage/YYCache.h>)
+#import <YYWebImage/YYKVStorage.h>
+#else
+#import "YYKVStorage.h"
+#endif
+
 NS_ASSUME_NONNULL_BEGIN
 
 /**
@@ -79,6 +87,19 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nullable, copy) NSString *(^customFileNameBlock)(NSString *key);
 
+/**
+ Set `YES` to archive objects with `YYBinaryCoder` instead of NSKeyedArchiver.
+ Objects which are not supported by `YYBinaryCoder` are still archived with
+ NSKeyedArchiver. It is ignored if `customArchiveBlock` is not nil.
+ 
+ @discussion The binary format has no class table, so it is usually several times
+ smaller and faster to encode and decode than keyed archives. Data written in either
+ format can always be read back, whatever this value is.
+ 
+ The default value is NO.
+ */
+@property BOOL binaryCodingEnabled;
+
 
 
 #pragma mark - Limit
@@ -140,6 +161,63 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property BOOL errorLogsEnabled;
 
+/**
+ The compression of the values written to disk. Default is YYKVStorageCompressionNone.
+ 
+ @discussion Only values larger than 1KB which shrink by more than 10% are stored
+ compressed; values written before changing this property are still readable.
+ The `totalCost` counts the stored (compressed) size.
+ */
+@property YYKVStorageCompression compression;
+
+
+#pragma mark - Write-behind
+///=============================================================================
+/// @name Write-behind
+///=============================================================================
+
+/**
+ Set `YES` to defer disk writes. Default is NO.
+ 
+ @discussion When enabled, `setObject:forKey:` and `removeObjectForKey:` return
+ immediately and the writes are kept in a pending queue, where a later write of a
+ key replaces the earlier one. A background flusher archives the pending objects
+ and persists them in a single sqlite transaction `writeBehindInterval` seconds
+ after the first pending write. Reads see pending writes. Pending writes are also
+ flushed on memory warning, when the app enters background and before the app
+ terminates.
+ 
+ The pending queue keeps immutable objects (those whose `copy` returns the object
+ itself) as they are, and archives them on the flusher. Mutable collections are
+ archived when they are set, and other mutable objects that conform to `NSCopying`
+ are copied. Objects that do not conform to `NSCopying` are kept as they are, so
+ you should not mutate them, or the mutable objects inside an immutable
+ collection, after setting them; reads of a pending key return the object that
+ was set. After disabling write-behind, call `flushPendingWrites`
+ before writing the same keys again.
+ */
+// 延迟写入磁盘，同一个key只保留最后一次写入，后台批量提交
+@property BOOL writeBehindEnabled;
+
+/**
+ The maximum number of keys waiting to be written. Default is 256.
+ 
+ @discussion When the pending queue reaches this limit, the write that fills it 
+ flushes the queue on the calling thread.
+ */
+@property NSUInteger writeBehindLimit;
+
+/**
+ The delay in seconds between the first pending write and the flush. Default is 1.
+ */
+@property NSTimeInterval writeBehindInterval;
+
+/**
+ Writes all pending writes to disk.
+ This method may blocks the calling thread until file write finished.
+ */
+- (void)flushPendingWrites;
+
 #pragma mark - Initializer
 ///=============================================================================
 /// @name Initializer
@@ -11,6 +11,7 @@
 
 #import "YYDiskCache.h"
 #import "YYKVStorage.h"
+#import "YYBinaryCoder.h"
 #import <UIKit/UIKit.h>
 #import <CommonCrypto/CommonCrypto.h>
 #import <objc/runtime.h>
@@ -18,9 +19,26 @@
 
 #define Lock() dispatch_semaphore_wait(self->_lock, DISPATCH_TIME_FOREVER)
 #define Unlock() dispatch_semaphore_signal(self->_lock)
+#define PendingLock() dispatch_semaphore_wait(self->_pendingLock, DISPATCH_TIME_FOREVER)
+#define PendingUnlock() dispatch_semaphore_signal(self->_pendingLock)
 
 static const int extended_data_key;
 
+/// Returns nil in App Extension.
+static UIApplication *_YYSharedApplication() {
+    static BOOL isAppExtension = NO;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        Class cls = NSClassFromString(@"UIApplication");
+        if(!cls || ![cls respondsToSelector:@selector(sharedApplication)]) isAppExtension = YES;
+        if ([[[NSBundle mainBundle] bundlePath] hasSuffix:@".appex"]) isAppExtension = YES;
+    });
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wundeclared-selector"
+    return isAppExtension ? nil : [UIApplication performSelector:@selector(sharedApplication)];
+#pragma clang diagnostic pop
+}
+
 /// Free disk space in bytes.
 static int64_t _YYDiskSpaceFree() {
     NSError *error = nil;
@@ -81,6 +99,17 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     YYKVStorage *_kv;
     dispatch_semaphore_t _lock;
     dispatch_queue_t _queue;
+    
+    // write-behind：key -> object 或已归档的 YYKVStorageItem，[NSNull null] 表示删除
+    NSMutableDictionary *_pendingWrites;
+    // 正在写入磁盘的一批，写完之前读取仍然要能看到
+    NSDictionary *_flushingWrites;
+    BOOL _flushScheduled;
+    dispatch_semaphore_t _pendingLock;
+    dispatch_queue_t _flushQueue;
+    
+    // 和 _kv.compression 相同，写入时在加锁之前读取
+    YYKVStorageCompression _compression;
 }
 
 - (void)_trimRecursively {
@@ -150,7 +179,182 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     return filename;
 }
 
+- (YYKVStorageItem *)_itemWithObject:(id<NSCoding>)object forKey:(NSString *)key {
+    // 获取到扩展数据
+    NSData *extendedData = [YYDiskCache getExtendedDataFromObject:object];
+    NSData *value = nil;
+    // 外部压缩
+    if (_customArchiveBlock) {
+        value = _customArchiveBlock(object);
+    } else {
+        // 二进制编码不支持的对象继续使用 NSKeyedArchiver
+        if (self.binaryCodingEnabled) {
+            value = [YYBinaryCoder dataWithObject:object];
+        }
+        if (!value) {
+            @try {
+                // 内部压缩
+                value = [NSKeyedArchiver archivedDataWithRootObject:object];
+            }
+            @catch (NSException *exception) {
+                // nothing to do...
+            }
+        }
+    }
+    // 如果压缩的值为空，就不用存数据了
+    if (!value) return nil;
+    NSString *filename = nil;
+    // 判断缓存存储方式，如果不是 数据库存储，则进入条件
+    if (_kv.type != YYKVStorageTypeSQLite) {
+        // 如果值的长度大于临界值，则以文件的形式进行存储
+        if (value.length > _inlineThreshold) {
+            // 获取文件名
+            filename = [self _filenameForKey:key];
+        }
+    }
+    YYKVStorageItem *item = [YYKVStorageItem new];
+    item.key = key;
+    item.value = value;
+    item.filename = filename;
+    item.extendedData = extendedData;
+    // 在加锁之前压缩，读取不用等待压缩大的 value
+    [YYKVStorage compressItem:item withCompression:_compression];
+    return item;
+}
+
+#pragma mark - write-behind
+
+/// Returns the pending object for the key. `found` is set to YES if the key has
+/// a pending write, in which case a nil result means a pending removal.
+- (id)_pendingObjectForKey:(NSString *)key found:(BOOL *)found {
+    PendingLock();
+    id object = _pendingWrites[key];
+    if (!object) object = _flushingWrites[key];
+    PendingUnlock();
+    *found = object != nil;
+    if (object == [NSNull null]) return nil;
+    // 已归档的值每次读取都解出新对象，和从磁盘读取一致
+    if ([object isKindOfClass:[YYKVStorageItem class]]) return [self _objectWithItem:object];
+    return object;
+}
+
+/// Returns the snapshot kept in the pending queue, so that later mutations of
+/// the object do not change what is written.
+- (id)_pendingValueWithObject:(id<NSCoding>)object forKey:(NSString *)key {
+    if (![(id)object conformsToProtocol:@protocol(NSCopying)]) return object;
+    id copy = [(id<NSCopying>)object copyWithZone:NULL];
+    // copy 返回自身说明是不可变对象，原样放入队列，到 _flushQueue 上再归档
+    if (copy == object) return object;
+    // 可变集合的 copy 是浅拷贝，元素仍然可能被修改，直接归档
+    if ([(id)object isKindOfClass:[NSArray class]] ||
+        [(id)object isKindOfClass:[NSDictionary class]] ||
+        [(id)object isKindOfClass:[NSSet class]] ||
+        [(id)object isKindOfClass:[NSOrderedSet class]]) {
+        return [self _itemWithObject:object forKey:key];
+    }
+    [YYDiskCache setExtendedData:[YYDiskCache getExtendedDataFromObject:object] toObject:copy];
+    return copy;
+}
+
+/// Pass nil object to enqueue a removal. The last write of a key wins.
+- (void)_enqueueWrite:(id<NSCoding>)object forKey:(NSString *)key {
+    id value = [NSNull null];
+    if (object) {
+        value = [self _pendingValueWithObject:object forKey:key];
+        if (!value) return;
+    }
+    PendingLock();
+    _pendingWrites[key] = value;
+    NSUInteger count = _pendingWrites.count;
+    BOOL needSchedule = !_flushScheduled;
+    _flushScheduled = YES;
+    PendingUnlock();
+    
+    // 队列满了由调用方同步写入，避免积压
+    if (count >= self.writeBehindLimit) {
+        [self flushPendingWrites];
+    } else if (needSchedule) {
+        __weak typeof(self) _self = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.writeBehindInterval * NSEC_PER_SEC)), _flushQueue, ^{
+            __strong typeof(_self) self = _self;
+            if (!self) return;
+            [self _flushPendingWrites];
+        });
+    }
+}
+
+/// Must be called on `_flushQueue` (or in dealloc).
+- (void)_flushPendingWrites {
+    PendingLock();
+    _flushScheduled = NO;
+    NSDictionary *writes = _pendingWrites;
+    if (writes.count == 0) {
+        PendingUnlock();
+        return;
+    }
+    _flushingWrites = writes;
+    _pendingWrites = [NSMutableDictionary new];
+    PendingUnlock();
+    
+    NSMutableArray *items = [NSMutableArray new];
+    NSMutableArray *removedKeys = [NSMutableArray new];
+    [writes enumerateKeysAndObjectsUsingBlock:^(NSString *key, id object, BOOL *stop) {
+        if (object == [NSNull null]) {
+            [removedKeys addObject:key];
+        } else if ([object isKindOfClass:[YYKVStorageItem class]]) {
+            [items addObject:object];
+        } else {
+            YYKVStorageItem *item = [self _itemWithObject:object forKey:key];
+            if (item) [items addObject:item];
+        }
+    }];
+    
+    // 一批写入只提交一次事务
+    Lock();
+    [_kv saveItems:items removeItemsForKeys:removedKeys];
+    Unlock();
+    
+    PendingLock();
+    _flushingWrites = nil;
+    PendingUnlock();
+}
+
+/// Drops the pending writes and waits for the in-flight flush to finish.
+- (void)_discardPendingWrites {
+    PendingLock();
+    [_pendingWrites removeAllObjects];
+    PendingUnlock();
+    dispatch_sync(_flushQueue, ^{});
+}
+
+- (void)_appDidReceiveMemoryWarning {
+    __weak typeof(self) _self = self;
+    dispatch_async(_flushQueue, ^{
+        __strong typeof(_self) self = _self;
+        if (!self) return;
+        [self _flushPendingWrites];
+    });
+}
+
+- (void)_appDidEnterBackground {
+    UIApplication *app = _YYSharedApplication();
+    if (!app) return;
+    // 进入后台后可能被系统挂起或杀掉，在后台任务中把待写队列写完
+    __block UIBackgroundTaskIdentifier taskID = UIBackgroundTaskInvalid;
+    void (^endTask)(void) = ^{
+        if (taskID == UIBackgroundTaskInvalid) return;
+        [app endBackgroundTask:taskID];
+        taskID = UIBackgroundTaskInvalid;
+    };
+    taskID = [app beginBackgroundTaskWithExpirationHandler:endTask];
+    dispatch_async(_flushQueue, ^{
+        [self _flushPendingWrites];
+        dispatch_async(dispatch_get_main_queue(), endTask);
+    });
+}
+
 - (void)_appWillBeTerminated {
+    [self flushPendingWrites];
     Lock();
     _kv = nil;
     Unlock();
@@ -160,6 +364,9 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationWillTerminateNotification object:nil];
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidEnterBackgroundNotification object:nil];
+    [self _flushPendingWrites];
 }
 
 - (instancetype)init {
@@ -201,16 +408,28 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     _ageLimit = DBL_MAX;
     _freeDiskSpaceLimit = 0;
     _autoTrimInterval = 60;
+    _pendingWrites = [NSMutableDictionary new];
+    _pendingLock = dispatch_semaphore_create(1);
+    _flushQueue = dispatch_queue_create("com.ibireme.cache.disk.flush", DISPATCH_QUEUE_SERIAL);
+    _binaryCodingEnabled = NO;
+    _writeBehindEnabled = NO;
+    _writeBehindLimit = 256;
+    _writeBehindInterval = 1;
     
     [self _trimRecursively];
     _YYDiskCacheSetGlobal(self);
     
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appWillBeTerminated) name:UIApplicationWillTerminateNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appDidReceiveMemoryWarning) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appDidEnterBackground) name:UIApplicationDidEnterBackgroundNotification object:nil];
     return self;
 }
 
 - (BOOL)containsObjectForKey:(NSString *)key {
     if (!key) return NO;
+    BOOL pending = NO;
+    id object = [self _pendingObjectForKey:key found:&pending];
+    if (pending) return object != nil;
     Lock();
     BOOL contains = [_kv itemExistsForKey:key];
     Unlock();
@@ -229,14 +448,23 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (id<NSCoding>)objectForKey:(NSString *)key {
     if (!key) return nil;
+    BOOL pending = NO;
+    id object = [self _pendingObjectForKey:key found:&pending];
+    if (pending) return object;
     Lock();
     YYKVStorageItem *item = [_kv getItemForKey:key];
     Unlock();
+    return [self _objectWithItem:item];
+}
+
+- (id)_objectWithItem:(YYKVStorageItem *)item {
     if (!item.value) return nil;
-    
     id object = nil;
     if (_customUnarchiveBlock) {
         object = _customUnarchiveBlock(item.value);
+    } else if ([YYBinaryCoder isBinaryCodedData:item.value]) {
+        // 不管是否开启 binaryCodingEnabled，都能读出之前以二进制编码写入的数据
+        object = [YYBinaryCoder objectWithData:item.value];
     } else {
         @try {
             object = [NSKeyedUnarchiver unarchiveObjectWithData:item.value];
@@ -268,37 +496,18 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
         [self removeObjectForKey:key];
         return;
     }
-    // 获取到扩展数据
-    NSData *extendedData = [YYDiskCache getExtendedDataFromObject:object];
-    NSData *value = nil;
-    // 外部压缩
-    if (_customArchiveBlock) {
-        value = _customArchiveBlock(object);
-    } else {
-        @try {
-            // 内部压缩
-            value = [NSKeyedArchiver archivedDataWithRootObject:object];
-        }
-        @catch (NSException *exception) {
-            // nothing to do...
-        }
-    }
-    // 如果压缩的值为空，就不用存数据了
-    if (!value) return;
-    NSString *filename = nil;
-    // 判断缓存存储方式，如果不是 数据库存储，则进入条件
-    if (_kv.type != YYKVStorageTypeSQLite) {
-        // 如果值的长度大于临界值，则以文件的形式进行存储
-        if (value.length > _inlineThreshold) {
-            // 获取文件名
-            filename = [self _filenameForKey:key];
-        }
+    // write-behind 模式下只放入待写队列，由后台批量写入
+    if (self.writeBehindEnabled) {
+        [self _enqueueWrite:object forKey:key];
+        return;
     }
+    YYKVStorageItem *item = [self _itemWithObject:object forKey:key];
+    if (!item) return;
     // 数据写入本地磁盘
     // 上锁，没什么好说的，为了安全起见
     
     Lock();
-    [_kv saveItemWithKey:key value:value filename:filename extendedData:extendedData];
+    [_kv saveItem:item];
     Unlock();
 }
 
@@ -313,6 +522,10 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (void)removeObjectForKey:(NSString *)key {
     if (!key) return;
+    if (self.writeBehindEnabled) {
+        [self _enqueueWrite:nil forKey:key];
+        return;
+    }
     Lock();
     [_kv removeItemForKey:key];
     Unlock();
@@ -328,6 +541,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 }
 
 - (void)removeAllObjects {
+    [self _discardPendingWrites];
     Lock();
     [_kv removeAllItems];
     Unlock();
@@ -351,6 +565,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
             if (end) end(YES);
             return;
         }
+        [self _discardPendingWrites];
         Lock();
         [_kv removeAllItemsWithProgressBlock:progress endBlock:end];
         Unlock();
@@ -358,6 +573,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 }
 
 - (NSInteger)totalCount {
+    if (self.writeBehindEnabled) [self flushPendingWrites];
     Lock();
     int count = [_kv getItemsCount];
     Unlock();
@@ -375,6 +591,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 }
 
 - (NSInteger)totalCost {
+    if (self.writeBehindEnabled) [self flushPendingWrites];
     Lock();
     int count = [_kv getItemsSize];
     Unlock();
@@ -436,6 +653,12 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     });
 }
 
+- (void)flushPendingWrites {
+    dispatch_sync(_flushQueue, ^{
+        [self _flushPendingWrites];
+    });
+}
+
 + (NSData *)getExtendedDataFromObject:(id)object {
     if (!object) return nil;
     return (NSData *)objc_getAssociatedObject(object, &extended_data_key);
@@ -464,4 +687,15 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     Unlock();
 }
 
+- (YYKVStorageCompression)compression {
+    return _compression;
+}
+
+- (void)setCompression:(YYKVStorageCompression)compression {
+    Lock();
+    _compression = compression;
+    _kv.compression = compression;
+    Unlock();
+}
+
 @end
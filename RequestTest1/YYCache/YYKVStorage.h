@@ -13,6 +13,21 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+/**
+ Compression applied to the stored values, see `YYKVStorage.compression`.
+ */
+typedef NS_ENUM(NSUInteger, YYKVStorageCompression) {
+    
+    /// The value is stored as is.
+    YYKVStorageCompressionNone = 0,
+    
+    /// LZ4, fastest to compress and decompress.
+    YYKVStorageCompressionLZ4 = 1,
+    
+    /// LZFSE, better compression ratio at a lower speed.
+    YYKVStorageCompressionLZFSE = 2,
+};
+
 /**
  YYKVStorageItem is used by `YYKVStorage` to store key-value pair and meta data.
  Typically, you should not use this class directly.
@@ -21,7 +36,9 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, strong) NSString *key;                ///< key
 @property (nonatomic, strong) NSData *value;                ///< value
 @property (nullable, nonatomic, strong) NSString *filename; ///< filename (nil if inline)
-@property (nonatomic) int size;                             ///< value's size in bytes
+@property (nonatomic) int size;                             ///< value's stored size in bytes
+@property (nonatomic) int rawSize;                          ///< value's size in bytes before compression (0 if not compressed yet)
+@property (nonatomic) YYKVStorageCompression compression;   ///< compression of the stored value
 @property (nonatomic) int modTime;                          ///< modification unix timestamp
 @property (nonatomic) int accessTime;                       ///< last access unix timestamp
 @property (nullable, nonatomic, strong) NSData *extendedData; ///< extended data (nil if no extended data)
@@ -84,6 +101,16 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
 @property (nonatomic, readonly) YYKVStorageType type;  ///< The type of this storage.
 @property (nonatomic) BOOL errorLogsEnabled;           ///< Set `YES` to enable error logs for debug.
 
+/**
+ The compression applied to newly saved values. Default is YYKVStorageCompressionNone.
+ 
+ @discussion Values smaller than 1KB are stored as is. For larger values, the first
+ 4KB are compressed as a probe, and the value is compressed only if the probe and 
+ then the whole value shrink by more than 10%. Items keep the compression they were
+ saved with, and `getItem...` methods always return the uncompressed value.
+ */
+@property (nonatomic) YYKVStorageCompression compression;
+
 #pragma mark - Initializer
 ///=============================================================================
 /// @name Initializer
@@ -122,11 +149,26 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
  It the `type` is YYKVStorageTypeMixed, then the item.value will be saved to file 
  system if the item.filename is not empty, otherwise it will be saved to sqlite.
  
+ If item.rawSize is not zero, the item has been prepared with `compressItem:withCompression:`
+ and is saved as is; otherwise the item.value is compressed with `compression`.
+ 
  @param item  An item.
  @return Whether succeed.
  */
 - (BOOL)saveItem:(YYKVStorageItem *)item;
 
+/**
+ Compress the item.value, and set the item.compression and item.rawSize.
+ 
+ @discussion The value is compressed the same way as `compression` describes. This
+ method does not access the storage, so it can be called before taking the lock
+ that guards the storage, and `saveItem:` does not compress the item again.
+ 
+ @param item         An item, item.value should not be empty.
+ @param compression  The compression to apply.
+ */
++ (void)compressItem:(YYKVStorageItem *)item withCompression:(YYKVStorageCompression)compression;
+
 /**
  Save an item or update the item with 'key' if it already exists.
  
@@ -160,6 +202,20 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
                filename:(nullable NSString *)filename
            extendedData:(nullable NSData *)extendedData;
 
+/**
+ Save items and remove items with keys in a single sqlite transaction.
+ 
+ @discussion Each item is saved the same way as `saveItem:`. Batching many writes 
+ in one transaction is much faster than saving them one by one, as sqlite only 
+ has to commit once. If the transaction fails to commit, the files written for
+ the items are deleted.
+ 
+ @param items  An array of items to save, pass nil to ignore it.
+ @param keys   An array of keys to remove, pass nil to ignore it.
+ @return Whether succeed.
+ */
+- (BOOL)saveItems:(nullable NSArray<YYKVStorageItem *> *)items removeItemsForKeys:(nullable NSArray<NSString *> *)keys;
+
 #pragma mark - Remove Items
 ///=============================================================================
 /// @name Remove Items
@@ -315,11 +371,17 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
 - (int)getItemsCount;
 
 /**
- Get item value's total size in bytes.
+ Get item value's total stored size in bytes, after compression.
  @return Total size in bytes, -1 when an error occurs.
  */
 - (int)getItemsSize;
 
+/**
+ Get item value's total size in bytes before compression.
+ @return Total size in bytes, -1 when an error occurs.
+ */
+- (int)getItemsRawSize;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -12,6 +12,7 @@
 #import "YYKVStorage.h"
 #import <UIKit/UIKit.h>
 #import <time.h>
+#import <compression.h>
 
 #if __has_include(<sqlite3.h>)
 #import <sqlite3.h>
@@ -28,6 +29,8 @@ static NSString *const kDBShmFileName = @"manifest.sqlite-shm";
 static NSString *const kDBWalFileName = @"manifest.sqlite-wal";
 static NSString *const kDataDirectoryName = @"data";
 static NSString *const kTrashDirectoryName = @"trash";
+static const size_t kMinCompressionSize = 1024;
+static const size_t kCompressionProbeSize = 1024 * 4;
 
 
 /*
@@ -51,11 +54,54 @@ static NSString *const kTrashDirectoryName = @"trash";
     modification_time   integer,
     last_access_time    integer,
     extended_data       blob,
+    compression         integer,
+    raw_size            integer,
     primary key(key)
  ); 
  create index if not exists last_access_time_idx on manifest(last_access_time);
  */
 
+static compression_algorithm _YYCompressionAlgorithm(YYKVStorageCompression compression) {
+    return compression == YYKVStorageCompressionLZFSE ? COMPRESSION_LZFSE : COMPRESSION_LZ4;
+}
+
+/// Returns nil if the data is too small or does not shrink by more than 10%.
+static NSData *_YYCompressData(NSData *data, YYKVStorageCompression compression) {
+    if (compression == YYKVStorageCompressionNone || data.length < kMinCompressionSize) return nil;
+    compression_algorithm algorithm = _YYCompressionAlgorithm(compression);
+    
+    // 先试着压缩开头一段，图片等已压缩过的数据就不用再压缩整个 value
+    if (data.length > kCompressionProbeSize) {
+        size_t probeCapacity = kCompressionProbeSize * 9 / 10;
+        uint8_t *probe = malloc(probeCapacity);
+        size_t probeLength = compression_encode_buffer(probe, probeCapacity, data.bytes, kCompressionProbeSize, NULL, algorithm);
+        free(probe);
+        if (probeLength == 0) return nil;
+    }
+    
+    // 输出超过 capacity 时返回 0，即压缩率不够
+    size_t capacity = data.length * 9 / 10;
+    uint8_t *buffer = malloc(capacity);
+    size_t length = compression_encode_buffer(buffer, capacity, data.bytes, data.length, NULL, algorithm);
+    if (length == 0) {
+        free(buffer);
+        return nil;
+    }
+    buffer = realloc(buffer, length);
+    return [NSData dataWithBytesNoCopy:buffer length:length freeWhenDone:YES];
+}
+
+static NSData *_YYDecompressData(NSData *data, YYKVStorageCompression compression, int rawSize) {
+    if (compression > YYKVStorageCompressionLZFSE || rawSize <= 0) return nil;
+    uint8_t *buffer = malloc(rawSize);
+    size_t length = compression_decode_buffer(buffer, rawSize, data.bytes, data.length, NULL, _YYCompressionAlgorithm(compression));
+    if (length != (size_t)rawSize) {
+        free(buffer);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:buffer length:length freeWhenDone:YES];
+}
+
 /// Returns nil in App Extension.
 static UIApplication *_YYSharedApplication() {
     static BOOL isAppExtension = NO;
@@ -162,8 +208,26 @@ static UIApplication *_YYSharedApplication() {
 }
 
 - (BOOL)_dbInitialize {
-    NSString *sql = @"pragma journal_mode = wal; pragma synchronous = normal; create table if not exists manifest (key text, filename text, size integer, inline_data blob, modification_time integer, last_access_time integer, extended_data blob, primary key(key)); create index if not exists last_access_time_idx on manifest(last_access_time);";
-    return [self _dbExecute:sql];
+    NSString *sql = @"pragma journal_mode = wal; pragma synchronous = normal; create table if not exists manifest (key text, filename text, size integer, inline_data blob, modification_time integer, last_access_time integer, extended_data blob, compression integer, raw_size integer, primary key(key)); create index if not exists last_access_time_idx on manifest(last_access_time);";
+    return [self _dbExecute:sql] && [self _dbMigrate];
+}
+
+/// Add the compression columns to the manifest created by older version.
+- (BOOL)_dbMigrate {
+    sqlite3_stmt *stmt = NULL;
+    int result = sqlite3_prepare_v2(_db, "pragma table_info(manifest);", -1, &stmt, NULL);
+    if (result != SQLITE_OK) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite stmt prepare error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    BOOL hasCompression = NO;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 1);
+        if (name && strcmp(name, "compression") == 0) hasCompression = YES;
+    }
+    sqlite3_finalize(stmt);
+    if (hasCompression) return YES;
+    return [self _dbExecute:@"alter table manifest add column compression integer; alter table manifest add column raw_size integer;"];
 }
 
 - (void)_dbCheckpoint {
@@ -220,8 +284,8 @@ static UIApplication *_YYSharedApplication() {
     }
 }
 
-- (BOOL)_dbSaveWithKey:(NSString *)key value:(NSData *)value fileName:(NSString *)fileName extendedData:(NSData *)extendedData {
-    NSString *sql = @"insert or replace into manifest (key, filename, size, inline_data, modification_time, last_access_time, extended_data) values (?1, ?2, ?3, ?4, ?5, ?6, ?7);";
+- (BOOL)_dbSaveWithKey:(NSString *)key value:(NSData *)value rawSize:(int)rawSize compression:(YYKVStorageCompression)compression fileName:(NSString *)fileName extendedData:(NSData *)extendedData {
+    NSString *sql = @"insert or replace into manifest (key, filename, size, inline_data, modification_time, last_access_time, extended_data, compression, raw_size) values (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9);";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return NO;
     
@@ -237,6 +301,8 @@ static UIApplication *_YYSharedApplication() {
     sqlite3_bind_int(stmt, 5, timestamp);
     sqlite3_bind_int(stmt, 6, timestamp);
     sqlite3_bind_blob(stmt, 7, extendedData.bytes, (int)extendedData.length, 0);
+    sqlite3_bind_int(stmt, 8, (int)compression);
+    sqlite3_bind_int(stmt, 9, rawSize);
     
     int result = sqlite3_step(stmt);
     if (result != SQLITE_DONE) {
@@ -353,11 +419,17 @@ static UIApplication *_YYSharedApplication() {
     int last_access_time = sqlite3_column_int(stmt, i++);
     const void *extended_data = sqlite3_column_blob(stmt, i);
     int extended_data_bytes = sqlite3_column_bytes(stmt, i++);
+    int compression = sqlite3_column_int(stmt, i++);
+    // 旧版本写入的记录没有 raw_size
+    int raw_size = sqlite3_column_type(stmt, i) == SQLITE_NULL ? size : sqlite3_column_int(stmt, i);
+    i++;
     
     YYKVStorageItem *item = [YYKVStorageItem new];
     if (key) item.key = [NSString stringWithUTF8String:key];
     if (filename && *filename != 0) item.filename = [NSString stringWithUTF8String:filename];
     item.size = size;
+    item.rawSize = raw_size;
+    item.compression = compression;
     if (inline_data_bytes > 0 && inline_data) item.value = [NSData dataWithBytes:inline_data length:inline_data_bytes];
     item.modTime = modification_time;
     item.accessTime = last_access_time;
@@ -366,7 +438,7 @@ static UIApplication *_YYSharedApplication() {
 }
 
 - (YYKVStorageItem *)_dbGetItemWithKey:(NSString *)key excludeInlineData:(BOOL)excludeInlineData {
-    NSString *sql = excludeInlineData ? @"select key, filename, size, modification_time, last_access_time, extended_data from manifest where key = ?1;" : @"select key, filename, size, inline_data, modification_time, last_access_time, extended_data from manifest where key = ?1;";
+    NSString *sql = excludeInlineData ? @"select key, filename, size, modification_time, last_access_time, extended_data, compression, raw_size from manifest where key = ?1;" : @"select key, filename, size, inline_data, modification_time, last_access_time, extended_data, compression, raw_size from manifest where key = ?1;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return nil;
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
@@ -387,9 +459,9 @@ static UIApplication *_YYSharedApplication() {
     if (![self _dbCheck]) return nil;
     NSString *sql;
     if (excludeInlineData) {
-        sql = [NSString stringWithFormat:@"select key, filename, size, modification_time, last_access_time, extended_data from manifest where key in (%@);", [self _dbJoinedKeys:keys]];
+        sql = [NSString stringWithFormat:@"select key, filename, size, modification_time, last_access_time, extended_data, compression, raw_size from manifest where key in (%@);", [self _dbJoinedKeys:keys]];
     } else {
-        sql = [NSString stringWithFormat:@"select key, filename, size, inline_data, modification_time, last_access_time, extended_data from manifest where key in (%@)", [self _dbJoinedKeys:keys]];
+        sql = [NSString stringWithFormat:@"select key, filename, size, inline_data, modification_time, last_access_time, extended_data, compression, raw_size from manifest where key in (%@)", [self _dbJoinedKeys:keys]];
     }
     
     sqlite3_stmt *stmt = NULL;
@@ -418,26 +490,6 @@ static UIApplication *_YYSharedApplication() {
     return items;
 }
 
-- (NSData *)_dbGetValueWithKey:(NSString *)key {
-    NSString *sql = @"select inline_data from manifest where key = ?1;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
-    if (!stmt) return nil;
-    sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
-    
-    int result = sqlite3_step(stmt);
-    if (result == SQLITE_ROW) {
-        const void *inline_data = sqlite3_column_blob(stmt, 0);
-        int inline_data_bytes = sqlite3_column_bytes(stmt, 0);
-        if (!inline_data || inline_data_bytes <= 0) return nil;
-        return [NSData dataWithBytes:inline_data length:inline_data_bytes];
-    } else {
-        if (result != SQLITE_DONE) {
-            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-        }
-        return nil;
-    }
-}
-
 - (NSString *)_dbGetFilenameWithKey:(NSString *)key {
     NSString *sql = @"select filename from manifest where key = ?1;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
@@ -598,6 +650,18 @@ static UIApplication *_YYSharedApplication() {
     return sqlite3_column_int(stmt, 0);
 }
 
+- (int)_dbGetTotalItemRawSize {
+    NSString *sql = @"select sum(ifnull(raw_size, size)) from manifest;";
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    if (!stmt) return -1;
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_ROW) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return -1;
+    }
+    return sqlite3_column_int(stmt, 0);
+}
+
 - (int)_dbGetTotalItemCount {
     NSString *sql = @"select count(*) from manifest;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
@@ -670,6 +734,19 @@ static UIApplication *_YYSharedApplication() {
     [self _fileEmptyTrashInBackground];
 }
 
+/// Replace the stored value of the item with the uncompressed value.
+/// Returns NO if the value is broken.
+- (BOOL)_decompressItem:(YYKVStorageItem *)item {
+    if (item.compression == YYKVStorageCompressionNone || !item.value) return YES;
+    NSData *value = _YYDecompressData(item.value, item.compression, item.rawSize);
+    if (!value) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d decompress error, key: %@", __FUNCTION__, __LINE__, item.key);
+        return NO;
+    }
+    item.value = value;
+    return YES;
+}
+
 #pragma mark - public
 
 - (instancetype)init {
@@ -735,15 +812,42 @@ static UIApplication *_YYSharedApplication() {
 }
 
 - (BOOL)saveItem:(YYKVStorageItem *)item {
+    if (item.rawSize > 0) {
+        return [self _saveItemWithKey:item.key value:item.value rawSize:item.rawSize compression:item.compression filename:item.filename extendedData:item.extendedData];
+    }
     return [self saveItemWithKey:item.key value:item.value filename:item.filename extendedData:item.extendedData];
 }
 
++ (void)compressItem:(YYKVStorageItem *)item withCompression:(YYKVStorageCompression)compression {
+    item.rawSize = (int)item.value.length;
+    item.compression = YYKVStorageCompressionNone;
+    NSData *compressedValue = _YYCompressData(item.value, compression);
+    if (compressedValue) {
+        item.value = compressedValue;
+        item.compression = compression;
+    }
+}
+
 - (BOOL)saveItemWithKey:(NSString *)key value:(NSData *)value {
     return [self saveItemWithKey:key value:value filename:nil extendedData:nil];
 }
 
 - (BOOL)saveItemWithKey:(NSString *)key value:(NSData *)value filename:(NSString *)filename extendedData:(NSData *)extendedData {
     if (key.length == 0 || value.length == 0) return NO;
+    
+    int rawSize = (int)value.length;
+    YYKVStorageCompression compression = YYKVStorageCompressionNone;
+    NSData *compressedValue = _YYCompressData(value, _compression);
+    if (compressedValue) {
+        value = compressedValue;
+        compression = _compression;
+    }
+    return [self _saveItemWithKey:key value:value rawSize:rawSize compression:compression filename:filename extendedData:extendedData];
+}
+
+/// The value is stored as is, it's already compressed with `compression`.
+- (BOOL)_saveItemWithKey:(NSString *)key value:(NSData *)value rawSize:(int)rawSize compression:(YYKVStorageCompression)compression filename:(NSString *)filename extendedData:(NSData *)extendedData {
+    if (key.length == 0 || value.length == 0) return NO;
     if (_type == YYKVStorageTypeFile && filename.length == 0) {
         return NO;
     }
@@ -752,7 +856,7 @@ static UIApplication *_YYSharedApplication() {
         if (![self _fileWriteWithName:filename data:value]) {
             return NO;
         }
-        if (![self _dbSaveWithKey:key value:value fileName:filename extendedData:extendedData]) {
+        if (![self _dbSaveWithKey:key value:value rawSize:rawSize compression:compression fileName:filename extendedData:extendedData]) {
             [self _fileDeleteWithName:filename];
             return NO;
         }
@@ -764,10 +868,36 @@ static UIApplication *_YYSharedApplication() {
                 [self _fileDeleteWithName:filename];
             }
         }
-        return [self _dbSaveWithKey:key value:value fileName:nil extendedData:extendedData];
+        return [self _dbSaveWithKey:key value:value rawSize:rawSize compression:compression fileName:nil extendedData:extendedData];
     }
 }
 
+- (BOOL)saveItems:(NSArray *)items removeItemsForKeys:(NSArray *)keys {
+    if (items.count == 0 && keys.count == 0) return YES;
+    if (![self _dbExecute:@"begin immediate transaction;"]) return NO;
+    
+    BOOL succeed = YES;
+    NSMutableArray *filenames = [NSMutableArray new];
+    for (YYKVStorageItem *item in items) {
+        if ([self saveItem:item]) {
+            if (_type != YYKVStorageTypeSQLite && item.filename.length) [filenames addObject:item.filename];
+        } else {
+            succeed = NO;
+        }
+    }
+    if (keys.count > 0 && ![self removeItemForKeys:keys]) succeed = NO;
+    
+    if (![self _dbExecute:@"commit transaction;"]) {
+        [self _dbExecute:@"rollback transaction;"];
+        // 回滚之后数据库中没有这些文件的记录，删除已经写入的文件
+        for (NSString *filename in filenames) {
+            [self _fileDeleteWithName:filename];
+        }
+        return NO;
+    }
+    return succeed;
+}
+
 - (BOOL)removeItemForKey:(NSString *)key {
     if (key.length == 0) return NO;
     switch (_type) {
@@ -968,6 +1098,10 @@ static UIApplication *_YYSharedApplication() {
                 item = nil;
             }
         }
+        if (item && ![self _decompressItem:item]) {
+            [self removeItemForKey:key];
+            item = nil;
+        }
     }
     return item;
 }
@@ -979,57 +1113,31 @@ static UIApplication *_YYSharedApplication() {
 }
 
 - (NSData *)getItemValueForKey:(NSString *)key {
-    if (key.length == 0) return nil;
-    NSData *value = nil;
-    switch (_type) {
-        case YYKVStorageTypeFile: {
-            NSString *filename = [self _dbGetFilenameWithKey:key];
-            if (filename) {
-                value = [self _fileReadWithName:filename];
-                if (!value) {
-                    [self _dbDeleteItemWithKey:key];
-                    value = nil;
-                }
-            }
-        } break;
-        case YYKVStorageTypeSQLite: {
-            value = [self _dbGetValueWithKey:key];
-        } break;
-        case YYKVStorageTypeMixed: {
-            NSString *filename = [self _dbGetFilenameWithKey:key];
-            if (filename) {
-                value = [self _fileReadWithName:filename];
-                if (!value) {
-                    [self _dbDeleteItemWithKey:key];
-                    value = nil;
-                }
-            } else {
-                value = [self _dbGetValueWithKey:key];
-            }
-        } break;
-    }
-    if (value) {
-        [self _dbUpdateAccessTimeWithKey:key];
-    }
-    return value;
+    // 解压需要记录中的压缩方式和原始大小，直接读取整条记录
+    return [self getItemForKey:key].value;
 }
 
 - (NSArray *)getItemForKeys:(NSArray *)keys {
     if (keys.count == 0) return nil;
     NSMutableArray *items = [self _dbGetItemWithKeys:keys excludeInlineData:NO];
-    if (_type != YYKVStorageTypeSQLite) {
-        for (NSInteger i = 0, max = items.count; i < max; i++) {
-            YYKVStorageItem *item = items[i];
-            if (item.filename) {
-                item.value = [self _fileReadWithName:item.filename];
-                if (!item.value) {
-                    if (item.key) [self _dbDeleteItemWithKey:item.key];
-                    [items removeObjectAtIndex:i];
-                    i--;
-                    max--;
-                }
+    for (NSInteger i = 0, max = items.count; i < max; i++) {
+        YYKVStorageItem *item = items[i];
+        if (item.filename) {
+            item.value = [self _fileReadWithName:item.filename];
+            if (!item.value) {
+                if (item.key) [self _dbDeleteItemWithKey:item.key];
+                [items removeObjectAtIndex:i];
+                i--;
+                max--;
+                continue;
             }
         }
+        if (![self _decompressItem:item]) {
+            if (item.key) [self removeItemForKey:item.key];
+            [items removeObjectAtIndex:i];
+            i--;
+            max--;
+        }
     }
     if (items.count > 0) {
         [self _dbUpdateAccessTimeWithKeys:keys];
@@ -1066,4 +1174,8 @@ static UIApplication *_YYSharedApplication() {
     return [self _dbGetTotalItemSize];
 }
 
+- (int)getItemsRawSize {
+    return [self _dbGetTotalItemRawSize];
+}
+
 @end
@@ -67,6 +67,10 @@ NS_ASSUME_NONNULL_BEGIN
  @discussion The default value is NSUIntegerMax, which means no limit.
  This is not a strict limit—if the cache goes over the limit, some objects in the
  cache could be evicted later in backgound thread.
+ 
+ When an insertion makes the cache go over the limit, the cache evicts objects
+ until the total cost is 90% of the limit, and only one such trim is queued at a
+ time, so a burst of insertions does not trim the cache once per insertion.
  */
 @property NSUInteger costLimit;
 
@@ -14,34 +14,55 @@
 #import <CoreFoundation/CoreFoundation.h>
 #import <QuartzCore/QuartzCore.h>
 #import <pthread.h>
+#import <stdatomic.h>
 
 
+/// The cost trim triggered by an insertion evicts down to this ratio of the cost limit.
+static const NSUInteger kCostLowWaterPercent = 90;
+
 static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     return dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
 }
 
+/// Index of a node in the node slab of _YYLinkedMap.
+typedef uint32_t _YYLinkedMapHandle;
+static const _YYLinkedMapHandle _YYLinkedMapNilHandle = UINT32_MAX;
+
 /**
  A node in linked map.
- Typically, you should not use this class directly.
+ Typically, you should not use this struct directly.
  */
 /**
  _YYLinkedMap 中的一个节点。
- 通常情况下我们不应该使用这个类。
+ 节点存放在 _YYLinkedMap 的节点数组中，用下标互相链接，删除后回收到空闲链表重复使用，
+ 不再为每个 key 创建和释放一个对象。
+ 通常情况下我们不应该使用这个结构体。
  */
-@interface _YYLinkedMapNode : NSObject {
-    @package
-    // __unsafe_unretained 是为了性能优化，节点被 _YYLinkedMap 的 _dic 强引用
-    __unsafe_unretained _YYLinkedMapNode *_prev; // retained by dic
-    __unsafe_unretained _YYLinkedMapNode *_next; // retained by dic
-    id _key;
-    id _value;
+typedef struct {
+    _YYLinkedMapHandle _prev;
+    _YYLinkedMapHandle _next; // 回收后作为空闲链表的 next
+    const void *_key; // retained, the dic does not retain the key
+    const void *_value; // retained
     NSUInteger _cost;// 记录开销，对应 YYMemoryCache 提供的 cost 控制
     NSTimeInterval _time;// 记录时间，对应 YYMemoryCache 提供的 age 控制
+} _YYLinkedMapNode;
+
+// 字典不持有 key，key 由节点持有；删除节点时先从字典中移除再释放 key
+static const CFDictionaryKeyCallBacks _YYLinkedMapKeyCallBacks = {0, NULL, NULL, CFCopyDescription, CFEqual, CFHash};
+
+static CFMutableDictionaryRef _YYLinkedMapCreateDictionary() {
+    return CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &_YYLinkedMapKeyCallBacks, NULL);
 }
-@end
 
-@implementation _YYLinkedMapNode
-@end
+/// Release the dic, the keys and values in the list, and the node slab.
+static void _YYLinkedMapRelease(CFMutableDictionaryRef dic, _YYLinkedMapNode *nodes, _YYLinkedMapHandle head) {
+    CFRelease(dic);
+    for (_YYLinkedMapHandle handle = head; handle != _YYLinkedMapNilHandle; handle = nodes[handle]._next) {
+        CFRelease(nodes[handle]._key);
+        CFRelease(nodes[handle]._value);
+    }
+    free(nodes);
+}
 
 
 /**
@@ -57,29 +78,41 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
  */
 @interface _YYLinkedMap : NSObject {
     @package
-    CFMutableDictionaryRef _dic; // do not set object directly
+    CFMutableDictionaryRef _dic; // key -> handle, do not set object directly
     NSUInteger _totalCost;
     NSUInteger _totalCount;
-    _YYLinkedMapNode *_head; // MRU, do not change it directlyMRU, 最常用节点，不要直接修改它
-    _YYLinkedMapNode *_tail; // LRU, do not change it directlyLRU, 最少用节点，不要直接修改它
+    _YYLinkedMapNode *_nodes; // node slab, a node pointer is invalid after insert
+    _YYLinkedMapHandle _capacity;
+    _YYLinkedMapHandle _freeList; // recycled nodes, linked by _next
+    _YYLinkedMapHandle _head; // MRU, do not change it directlyMRU, 最常用节点，不要直接修改它
+    _YYLinkedMapHandle _tail; // LRU, do not change it directlyLRU, 最少用节点，不要直接修改它
     BOOL _releaseOnMainThread;
     BOOL _releaseAsynchronously;
+    CFMutableArrayRef _releaseBatch; // keys and values removed by removeNode:, released together
 }
 // 链表操作，
+/// Returns the handle of the node for key, or _YYLinkedMapNilHandle.
+- (_YYLinkedMapHandle)handleForKey:(id)key;
+
 /// Insert a node at head and update the total cost.
-/// Node and node.key should not be nil.
-- (void)insertNodeAtHead:(_YYLinkedMapNode *)node;
+/// Key and value should not be nil, and key should not inside the dic.
+/// Returns _YYLinkedMapNilHandle if the node slab cannot grow.
+- (_YYLinkedMapHandle)insertNodeAtHeadWithKey:(id)key value:(id)value cost:(NSUInteger)cost time:(NSTimeInterval)time;
 
 /// Bring a inner node to header.
 /// Node should already inside the dic.
-- (void)bringNodeToHead:(_YYLinkedMapNode *)node;
+- (void)bringNodeToHead:(_YYLinkedMapHandle)handle;
 
 /// Remove a inner node and update the total cost.
-/// Node should already inside the dic.
-- (void)removeNode:(_YYLinkedMapNode *)node;
+/// Node should already inside the dic. The key and value are moved to `_releaseBatch`,
+/// see `takeReleaseBatch`, so they are never released while the cache is locked.
+- (void)removeNode:(_YYLinkedMapHandle)handle;
+
+/// Returns the keys and values waiting to be released, or NULL. The caller owns the array.
+- (CFMutableArrayRef)takeReleaseBatch CF_RETURNS_RETAINED;
 
-/// Remove tail node if exist.
-- (_YYLinkedMapNode *)removeTailNode;
+/// Remove tail node if exist, and move its key and value to holder.
+- (BOOL)removeTailNodeToHolder:(CFMutableArrayRef)holder;
 
 /// Remove all node in background queue.
 - (void)removeAll;
@@ -90,91 +123,150 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 
 - (instancetype)init {
     self = [super init];
-    _dic = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    _dic = _YYLinkedMapCreateDictionary();
+    _freeList = _head = _tail = _YYLinkedMapNilHandle;
     _releaseOnMainThread = NO;
     _releaseAsynchronously = YES;
     return self;
 }
 
 - (void)dealloc {
-    CFRelease(_dic);
+    if (_releaseBatch) CFRelease(_releaseBatch);
+    _YYLinkedMapRelease(_dic, _nodes, _head);
+}
+
+// 从空闲链表取一个节点，没有空闲节点时把节点数组扩大一倍
+- (_YYLinkedMapHandle)_allocNode {
+    if (_freeList == _YYLinkedMapNilHandle) {
+        if (_capacity == _YYLinkedMapNilHandle) return _YYLinkedMapNilHandle;
+        _YYLinkedMapHandle capacity = _capacity == 0 ? 16 : (_capacity < _YYLinkedMapNilHandle / 2 ? _capacity * 2 : _YYLinkedMapNilHandle);
+        _YYLinkedMapNode *nodes = realloc(_nodes, (size_t)capacity * sizeof(_YYLinkedMapNode));
+        if (!nodes) return _YYLinkedMapNilHandle;
+        for (_YYLinkedMapHandle handle = _capacity; handle < capacity; handle++) {
+            nodes[handle]._next = handle + 1;
+        }
+        nodes[capacity - 1]._next = _YYLinkedMapNilHandle;
+        _freeList = _capacity;
+        _nodes = nodes;
+        _capacity = capacity;
+    }
+    _YYLinkedMapHandle handle = _freeList;
+    _freeList = _nodes[handle]._next;
+    return handle;
+}
+
+// 从链表中摘除节点并回收，key 和 value 转给 holder 或者直接释放
+- (void)_removeNode:(_YYLinkedMapHandle)handle holder:(CFMutableArrayRef)holder {
+    _YYLinkedMapNode *node = &_nodes[handle];
+    CFDictionaryRemoveValue(_dic, node->_key);
+    _totalCost -= node->_cost;
+    _totalCount--;
+    if (node->_next != _YYLinkedMapNilHandle) _nodes[node->_next]._prev = node->_prev;
+    if (node->_prev != _YYLinkedMapNilHandle) _nodes[node->_prev]._next = node->_next;
+    if (_head == handle) _head = node->_next;
+    if (_tail == handle) _tail = node->_prev;
+    
+    if (holder) {
+        CFArrayAppendValue(holder, node->_key);
+        CFArrayAppendValue(holder, node->_value);
+    }
+    CFRelease(node->_key);
+    CFRelease(node->_value);
+    node->_key = NULL;
+    node->_value = NULL;
+    node->_next = _freeList;
+    _freeList = handle;
 }
+
+- (_YYLinkedMapHandle)handleForKey:(id)key {
+    const void *handle = NULL;
+    if (!CFDictionaryGetValueIfPresent(_dic, (__bridge const void *)(key), &handle)) return _YYLinkedMapNilHandle;
+    return (_YYLinkedMapHandle)(uintptr_t)handle;
+}
+
 // 插入到头结点
-- (void)insertNodeAtHead:(_YYLinkedMapNode *)node {
-    CFDictionarySetValue(_dic, (__bridge const void *)(node->_key), (__bridge const void *)(node));
-    _totalCost += node->_cost;
+- (_YYLinkedMapHandle)insertNodeAtHeadWithKey:(id)key value:(id)value cost:(NSUInteger)cost time:(NSTimeInterval)time {
+    _YYLinkedMapHandle handle = [self _allocNode];
+    if (handle == _YYLinkedMapNilHandle) return handle;
+    _YYLinkedMapNode *node = &_nodes[handle];
+    node->_key = CFBridgingRetain(key);
+    node->_value = CFBridgingRetain(value);
+    node->_cost = cost;
+    node->_time = time;
+    node->_prev = _YYLinkedMapNilHandle;
+    node->_next = _head;
+    CFDictionarySetValue(_dic, node->_key, (const void *)(uintptr_t)handle);
+    _totalCost += cost;
     _totalCount++;
-    if (_head) {
-        node->_next = _head;
-        _head->_prev = node;
-        _head = node;
+    if (_head != _YYLinkedMapNilHandle) {
+        _nodes[_head]._prev = handle;
+        _head = handle;
     } else {
-        _head = _tail = node;
+        _head = _tail = handle;
     }
+    return handle;
 }
 // 移动到头结点
-- (void)bringNodeToHead:(_YYLinkedMapNode *)node {
-    if (_head == node) return;
+- (void)bringNodeToHead:(_YYLinkedMapHandle)handle {
+    if (_head == handle) return;
     
-    if (_tail == node) {
+    _YYLinkedMapNode *node = &_nodes[handle];
+    if (_tail == handle) {
         _tail = node->_prev;
-        _tail->_next = nil;
+        _nodes[_tail]._next = _YYLinkedMapNilHandle;
     } else {
-        node->_next->_prev = node->_prev;
-        node->_prev->_next = node->_next;
+        _nodes[node->_next]._prev = node->_prev;
+        _nodes[node->_prev]._next = node->_next;
     }
     node->_next = _head;
-    node->_prev = nil;
-    _head->_prev = node;
-    _head = node;
+    node->_prev = _YYLinkedMapNilHandle;
+    _nodes[_head]._prev = handle;
+    _head = handle;
 }
 
-- (void)removeNode:(_YYLinkedMapNode *)node {
-    CFDictionaryRemoveValue(_dic, (__bridge const void *)(node->_key));
-    _totalCost -= node->_cost;
-    _totalCount--;
-    if (node->_next) node->_next->_prev = node->_prev;
-    if (node->_prev) node->_prev->_next = node->_next;
-    if (_head == node) _head = node->_next;
-    if (_tail == node) _tail = node->_prev;
+// key 和 value 先攒进 _releaseBatch，由 YYMemoryCache 解锁之后释放或者统一提交一次释放
+- (void)removeNode:(_YYLinkedMapHandle)handle {
+    if (!_releaseBatch) _releaseBatch = CFArrayCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeArrayCallBacks);
+    [self _removeNode:handle holder:_releaseBatch];
 }
 
-- (_YYLinkedMapNode *)removeTailNode {
-    if (!_tail) return nil;
-    _YYLinkedMapNode *tail = _tail;
-    CFDictionaryRemoveValue(_dic, (__bridge const void *)(_tail->_key));
-    _totalCost -= _tail->_cost;
-    _totalCount--;
-    if (_head == _tail) {
-        _head = _tail = nil;
-    } else {
-        _tail = _tail->_prev;
-        _tail->_next = nil;
-    }
-    return tail;
+- (CFMutableArrayRef)takeReleaseBatch {
+    CFMutableArrayRef batch = _releaseBatch;
+    _releaseBatch = NULL;
+    return batch;
+}
+
+- (BOOL)removeTailNodeToHolder:(CFMutableArrayRef)holder {
+    if (_tail == _YYLinkedMapNilHandle) return NO;
+    [self _removeNode:_tail holder:holder];
+    return YES;
 }
 
 - (void)removeAll {
     _totalCost = 0;
     _totalCount = 0;
-    _head = nil;
-    _tail = nil;
-    if (CFDictionaryGetCount(_dic) > 0) {
-        CFMutableDictionaryRef holder = _dic;
-        _dic = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        
-        if (_releaseAsynchronously) {
-            dispatch_queue_t queue = _releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-            dispatch_async(queue, ^{
-                CFRelease(holder); // hold and release in specified queue
-            });
-        } else if (_releaseOnMainThread && !pthread_main_np()) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                CFRelease(holder); // hold and release in specified queue
-            });
-        } else {
-            CFRelease(holder);
-        }
+    if (_head == _YYLinkedMapNilHandle) return;
+    
+    // 整个节点数组连同字典一起交给指定队列释放，这里重新开始
+    CFMutableDictionaryRef dic = _dic;
+    _YYLinkedMapNode *nodes = _nodes;
+    _YYLinkedMapHandle head = _head;
+    _dic = _YYLinkedMapCreateDictionary();
+    _nodes = NULL;
+    _capacity = 0;
+    _freeList = _head = _tail = _YYLinkedMapNilHandle;
+    
+    if (_releaseAsynchronously) {
+        dispatch_queue_t queue = _releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
+        dispatch_async(queue, ^{
+            _YYLinkedMapRelease(dic, nodes, head); // hold and release in specified queue
+        });
+    } else if (_releaseOnMainThread && !pthread_main_np()) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            _YYLinkedMapRelease(dic, nodes, head); // hold and release in specified queue
+        });
+    } else {
+        _YYLinkedMapRelease(dic, nodes, head);
     }
 }
 
@@ -186,6 +278,8 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     pthread_mutex_t _lock;
     _YYLinkedMap *_lru;
     dispatch_queue_t _queue;
+    atomic_bool _costTrimPending;
+    BOOL _releaseBatchScheduled; // guarded by _lock
 }
 
 - (void)_trimRecursively {
@@ -206,6 +300,47 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     });
 }
 
+// 超出 costLimit 时安排一次修剪，已有修剪在排队时不再重复提交
+- (void)_scheduleCostTrim {
+    if (atomic_exchange(&_costTrimPending, true)) return;
+    dispatch_async(_queue, ^{
+        // 先清除标记，修剪期间的写入可以再排一次修剪，不会漏掉
+        atomic_store(&self->_costTrimPending, false);
+        pthread_mutex_lock(&self->_lock);
+        NSUInteger costLimit = self->_costLimit;
+        BOOL exceeded = self->_lru->_totalCost > costLimit;
+        pthread_mutex_unlock(&self->_lock);
+        if (!exceeded) return;
+        // 修剪到低水位，避免连续写入时每次写入都触发修剪
+        NSUInteger lowWater = costLimit / 100 * kCostLowWaterPercent + costLimit % 100 * kCostLowWaterPercent / 100;
+        [self _trimToCost:lowWater];
+    });
+}
+
+// 在持有锁时调用。需要在当前线程释放时返回 _lru 攒下的 key 和 value，由调用方解锁之后释放；
+// 否则只提交一次释放，释放之前的删除都并入同一批，返回 NULL
+- (CFMutableArrayRef)_takeReleaseBatchForUnlock CF_RETURNS_RETAINED {
+    if (!_lru->_releaseBatch) return NULL;
+    if (_lru->_releaseAsynchronously || (_lru->_releaseOnMainThread && !pthread_main_np())) {
+        [self _scheduleReleaseBatch];
+        return NULL;
+    }
+    return [_lru takeReleaseBatch];
+}
+
+- (void)_scheduleReleaseBatch {
+    if (!_lru->_releaseBatch || _releaseBatchScheduled) return;
+    _releaseBatchScheduled = YES;
+    dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
+    dispatch_async(queue, ^{
+        pthread_mutex_lock(&self->_lock);
+        CFMutableArrayRef batch = [self->_lru takeReleaseBatch];
+        self->_releaseBatchScheduled = NO;
+        pthread_mutex_unlock(&self->_lock);
+        if (batch) CFRelease(batch); // release in queue
+    });
+}
+
 - (void)_trimToCost:(NSUInteger)costLimit {
     BOOL finish = NO;
     pthread_mutex_lock(&_lock);
@@ -218,12 +353,11 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     pthread_mutex_unlock(&_lock);
     if (finish) return;
     
-    NSMutableArray *holder = [NSMutableArray new];
+    CFMutableArrayRef holder = CFArrayCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeArrayCallBacks);
     while (!finish) {
         if (pthread_mutex_trylock(&_lock) == 0) {
             if (_lru->_totalCost > costLimit) {
-                _YYLinkedMapNode *node = [_lru removeTailNode];
-                if (node) [holder addObject:node];
+                [_lru removeTailNodeToHolder:holder];
             } else {
                 finish = YES;
             }
@@ -232,11 +366,13 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
             usleep(10 * 1000); //10 ms
         }
     }
-    if (holder.count) {
+    if (CFArrayGetCount(holder)) {
         dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
         dispatch_async(queue, ^{
-            [holder count]; // release in queue
+            CFRelease(holder); // release in queue
         });
+    } else {
+        CFRelease(holder);
     }
 }
 
@@ -252,12 +388,11 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     pthread_mutex_unlock(&_lock);
     if (finish) return;
     
-    NSMutableArray *holder = [NSMutableArray new];
+    CFMutableArrayRef holder = CFArrayCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeArrayCallBacks);
     while (!finish) {
         if (pthread_mutex_trylock(&_lock) == 0) {
             if (_lru->_totalCount > countLimit) {
-                _YYLinkedMapNode *node = [_lru removeTailNode];
-                if (node) [holder addObject:node];
+                [_lru removeTailNodeToHolder:holder];
             } else {
                 finish = YES;
             }
@@ -266,11 +401,13 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
             usleep(10 * 1000); //10 ms
         }
     }
-    if (holder.count) {
+    if (CFArrayGetCount(holder)) {
         dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
         dispatch_async(queue, ^{
-            [holder count]; // release in queue
+            CFRelease(holder); // release in queue
         });
+    } else {
+        CFRelease(holder);
     }
 }
 
@@ -281,18 +418,17 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     if (ageLimit <= 0) {
         [_lru removeAll];
         finish = YES;
-    } else if (!_lru->_tail || (now - _lru->_tail->_time) <= ageLimit) {
+    } else if (_lru->_tail == _YYLinkedMapNilHandle || (now - _lru->_nodes[_lru->_tail]._time) <= ageLimit) {
         finish = YES;
     }
     pthread_mutex_unlock(&_lock);
     if (finish) return;
     
-    NSMutableArray *holder = [NSMutableArray new];
+    CFMutableArrayRef holder = CFArrayCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeArrayCallBacks);
     while (!finish) {
         if (pthread_mutex_trylock(&_lock) == 0) {
-            if (_lru->_tail && (now - _lru->_tail->_time) > ageLimit) {
-                _YYLinkedMapNode *node = [_lru removeTailNode];
-                if (node) [holder addObject:node];
+            if (_lru->_tail != _YYLinkedMapNilHandle && (now - _lru->_nodes[_lru->_tail]._time) > ageLimit) {
+                [_lru removeTailNodeToHolder:holder];
             } else {
                 finish = YES;
             }
@@ -301,11 +437,13 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
             usleep(10 * 1000); //10 ms
         }
     }
-    if (holder.count) {
+    if (CFArrayGetCount(holder)) {
         dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
         dispatch_async(queue, ^{
-            [holder count]; // release in queue
+            CFRelease(holder); // release in queue
         });
+    } else {
+        CFRelease(holder);
     }
 }
 
@@ -334,6 +472,7 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     pthread_mutex_init(&_lock, NULL);
     _lru = [_YYLinkedMap new];
     _queue = dispatch_queue_create("com.ibireme.cache.memory", DISPATCH_QUEUE_SERIAL);
+    atomic_init(&_costTrimPending, false);
     
     _countLimit = NSUIntegerMax;
     _costLimit = NSUIntegerMax;
@@ -407,13 +546,16 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 - (id)objectForKey:(id)key {
     if (!key) return nil;
     pthread_mutex_lock(&_lock);
-    _YYLinkedMapNode *node = CFDictionaryGetValue(_lru->_dic, (__bridge const void *)(key));
-    if (node) {
+    id value = nil;
+    _YYLinkedMapHandle handle = [_lru handleForKey:key];
+    if (handle != _YYLinkedMapNilHandle) {
+        _YYLinkedMapNode *node = &_lru->_nodes[handle];
         node->_time = CACurrentMediaTime();
-        [_lru bringNodeToHead:node];
+        value = (__bridge id)(node->_value); // 解锁前持有，避免被其他线程释放
+        [_lru bringNodeToHead:handle];
     }
     pthread_mutex_unlock(&_lock);
-    return node ? node->_value : nil;
+    return value;
 }
 
 - (void)setObject:(id)object forKey:(id)key {
@@ -427,66 +569,48 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
         return;
     }
     pthread_mutex_lock(&_lock);
-    _YYLinkedMapNode *node = CFDictionaryGetValue(_lru->_dic, (__bridge const void *)(key));
+    _YYLinkedMapHandle handle = [_lru handleForKey:key];
     NSTimeInterval now = CACurrentMediaTime();
-    if (node) {
+    if (handle != _YYLinkedMapNilHandle) {
         //1 若缓存中有：修改node的变量，将该节点移动到头部
+        _YYLinkedMapNode *node = &_lru->_nodes[handle];
         _lru->_totalCost -= node->_cost;
         _lru->_totalCost += cost;
         node->_cost = cost;
         node->_time = now;
-        node->_value = object;
-        [_lru bringNodeToHead:node];
+        const void *oldValue = node->_value;
+        node->_value = CFBridgingRetain(object);
+        CFRelease(oldValue);
+        [_lru bringNodeToHead:handle];
     } else {
-        //2 若缓存中没有，创建一个内存，将该节点插入到头部
-        node = [_YYLinkedMapNode new];
-        node->_cost = cost;
-        node->_time = now;
-        node->_key = key;
-        node->_value = object;
-        [_lru insertNodeAtHead:node];
+        //2 若缓存中没有，从节点池取一个节点，插入到头部
+        [_lru insertNodeAtHeadWithKey:key value:object cost:cost time:now];
     }
     //3 判断是否需要修剪内存占用，若需要：异步修剪，保证写入的性能
     if (_lru->_totalCost > _costLimit) {
-        dispatch_async(_queue, ^{
-            [self trimToCost:_costLimit];
-        });
+        [self _scheduleCostTrim];
     }
     //4 判断是否需要修剪内存块数量，若需要：默认在非主队列释放无用内存，保证写入的性能
+    CFMutableArrayRef releaseBatch = NULL;
     if (_lru->_totalCount > _countLimit) {
-        _YYLinkedMapNode *node = [_lru removeTailNode];
-        if (_lru->_releaseAsynchronously) {
-            dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-            dispatch_async(queue, ^{
-                [node class]; //hold and release in queue
-            });
-        } else if (_lru->_releaseOnMainThread && !pthread_main_np()) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [node class]; //hold and release in queue
-            });
-        }
+        [_lru removeNode:_lru->_tail];
+        releaseBatch = [self _takeReleaseBatchForUnlock];
     }
     pthread_mutex_unlock(&_lock);
+    if (releaseBatch) CFRelease(releaseBatch); // 解锁之后释放，value 的 dealloc 可以再访问缓存
 }
 
 - (void)removeObjectForKey:(id)key {
     if (!key) return;
     pthread_mutex_lock(&_lock);
-    _YYLinkedMapNode *node = CFDictionaryGetValue(_lru->_dic, (__bridge const void *)(key));
-    if (node) {
-        [_lru removeNode:node];
-        if (_lru->_releaseAsynchronously) {
-            dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-            dispatch_async(queue, ^{
-                [node class]; //hold and release in queue
-            });
-        } else if (_lru->_releaseOnMainThread && !pthread_main_np()) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [node class]; //hold and release in queue
-            });
-        }
+    _YYLinkedMapHandle handle = [_lru handleForKey:key];
+    CFMutableArrayRef releaseBatch = NULL;
+    if (handle != _YYLinkedMapNilHandle) {
+        [_lru removeNode:handle];
+        releaseBatch = [self _takeReleaseBatchForUnlock];
     }
     pthread_mutex_unlock(&_lock);
+    if (releaseBatch) CFRelease(releaseBatch); // 解锁之后释放
 }
 
 - (void)removeAllObjects {
@@ -0,0 +1,260 @@
+//
+//  AFHTTPSessionManagerChunkedUploadTests.m
+//  RequestTest1Tests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFHTTPSessionManager.h"
+
+static NSString * const AFChunkedUploadTestHost = @"chunked-upload.test";
+static const NSUInteger AFChunkedUploadTestChunkSize = 1024;
+
+/**
+ The state of the stub upload server, shared by all requests of a test.
+ */
+@interface AFChunkedUploadStubServer : NSObject
+@property (nonatomic, strong) NSMutableData *receivedBody;
+@property (nonatomic, assign) NSUInteger queryCount;
+// 按块的起始位置统计收到的请求数
+@property (nonatomic, strong) NSCountedSet<NSNumber *> *chunkRequests;
+// 这些位置的块返回503的剩余次数
+@property (nonatomic, strong) NSMutableDictionary<NSNumber *, NSNumber *> *failures;
+// 这些位置的块收下之后断开连接，客户端收不到响应
+@property (nonatomic, strong) NSMutableSet<NSNumber *> *lostResponses;
+@property (nonatomic, strong) NSMutableArray<NSDate *> *chunkRequestDates;
+@end
+
+@implementation AFChunkedUploadStubServer
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _receivedBody = [NSMutableData data];
+        _chunkRequests = [NSCountedSet set];
+        _failures = [NSMutableDictionary dictionary];
+        _lostResponses = [NSMutableSet set];
+        _chunkRequestDates = [NSMutableArray array];
+    }
+    return self;
+}
+
+@end
+
+static AFChunkedUploadStubServer *AFChunkedUploadTestServer = nil;
+
+static NSData * AFDataFromStream(NSInputStream *stream) {
+    NSMutableData *data = [NSMutableData data];
+    uint8_t buffer[4096];
+    [stream open];
+    while (YES) {
+        NSInteger length = [stream read:buffer maxLength:sizeof(buffer)];
+        if (length <= 0) {
+            break;
+        }
+        [data appendBytes:buffer length:(NSUInteger)length];
+    }
+    [stream close];
+    return data;
+}
+
+/**
+ A resumable upload endpoint: a chunk with `Content-Range: bytes <first>-<last>/<total>` is
+ committed if it starts at the committed length, and a status query with
+ `Content-Range: bytes *\/<total>` is answered with `308` and the committed `Range`.
+ */
+@interface AFChunkedUploadURLProtocol : NSURLProtocol
+@end
+
+@implementation AFChunkedUploadURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+    return [request.URL.host isEqualToString:AFChunkedUploadTestHost];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+    return request;
+}
+
+- (void)startLoading
+{
+    AFChunkedUploadStubServer *server = AFChunkedUploadTestServer;
+    NSString *contentRange = [self.request valueForHTTPHeaderField:@"Content-Range"];
+    NSData *body = self.request.HTTPBodyStream ? AFDataFromStream(self.request.HTTPBodyStream) : (self.request.HTTPBody ?: [NSData data]);
+
+    @synchronized (server) {
+        if ([contentRange hasPrefix:@"bytes */"]) {
+            server.queryCount++;
+            NSDictionary *headers = server.receivedBody.length > 0 ? @{@"Range": [NSString stringWithFormat:@"bytes=0-%lu", (unsigned long)server.receivedBody.length - 1]} : @{};
+            [self respondWithStatusCode:308 headers:headers];
+            return;
+        }
+
+        unsigned long long first = 0;
+        unsigned long long last = 0;
+        unsigned long long total = 0;
+        NSScanner *scanner = [NSScanner scannerWithString:contentRange];
+        [scanner scanString:@"bytes " intoString:NULL];
+        [scanner scanUnsignedLongLong:&first];
+        [scanner scanString:@"-" intoString:NULL];
+        [scanner scanUnsignedLongLong:&last];
+        [scanner scanString:@"/" intoString:NULL];
+        [scanner scanUnsignedLongLong:&total];
+
+        NSNumber *offset = @(first);
+        [server.chunkRequests addObject:offset];
+        [server.chunkRequestDates addObject:[NSDate date]];
+
+        NSUInteger failures = [server.failures[offset] unsignedIntegerValue];
+        if (failures > 0) {
+            server.failures[offset] = @(failures - 1);
+            [self respondWithStatusCode:503 headers:@{}];
+            return;
+        }
+
+        if (first == server.receivedBody.length) {
+            [server.receivedBody appendData:body];
+        }
+
+        if ([server.lostResponses containsObject:offset]) {
+            [server.lostResponses removeObject:offset];
+            [self.client URLProtocol:self didFailWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil]];
+            return;
+        }
+
+        [self respondWithStatusCode:(server.receivedBody.length == total ? 201 : 200) headers:@{}];
+    }
+}
+
+- (void)stopLoading
+{
+}
+
+- (void)respondWithStatusCode:(NSInteger)statusCode headers:(NSDictionary *)headers
+{
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL statusCode:statusCode HTTPVersion:@"HTTP/1.1" headerFields:headers];
+    [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    [self.client URLProtocolDidFinishLoading:self];
+}
+
+@end
+
+
+@interface AFHTTPSessionManagerChunkedUploadTests : XCTestCase
+@property (nonatomic, strong) AFHTTPSessionManager *manager;
+@property (nonatomic, strong) NSData *payload;
+@end
+
+@implementation AFHTTPSessionManagerChunkedUploadTests
+
+- (void)setUp
+{
+    [super setUp];
+    AFChunkedUploadTestServer = [[AFChunkedUploadStubServer alloc] init];
+
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[AFChunkedUploadURLProtocol class]];
+    NSURL *baseURL = [NSURL URLWithString:[NSString stringWithFormat:@"http://%@/", AFChunkedUploadTestHost]];
+    self.manager = [[AFHTTPSessionManager alloc] initWithBaseURL:baseURL sessionConfiguration:configuration];
+    self.manager.responseSerializer = [AFHTTPResponseSerializer serializer];
+    self.manager.chunkedUploadRetryInterval = 0.01;
+
+    NSMutableData *payload = [NSMutableData dataWithLength:10 * AFChunkedUploadTestChunkSize];
+    uint8_t *bytes = payload.mutableBytes;
+    for (NSUInteger i = 0; i < payload.length; i++) {
+        bytes[i] = (uint8_t)(i * 13 + 5);
+    }
+    self.payload = payload;
+}
+
+- (void)tearDown
+{
+    [self.manager invalidateSessionCancelingTasks:YES resetSession:NO];
+    self.manager = nil;
+    AFChunkedUploadTestServer = nil;
+    [super tearDown];
+}
+
+- (NSError *)uploadWithMaximumRetryCount:(NSUInteger)maximumRetryCount
+{
+    __block NSError *uploadError = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"upload finished"];
+    [self.manager POST:@"upload" parameters:nil headers:nil constructingBodyWithBlock:^(id<AFMultipartFormData> formData) {
+        [formData appendPartWithFormData:self.payload name:@"payload"];
+    } chunkSize:AFChunkedUploadTestChunkSize maximumRetryCount:maximumRetryCount progress:nil success:^(NSURLSessionDataTask *task, id responseObject) {
+        [expectation fulfill];
+    } failure:^(NSURLSessionDataTask *task, NSError *error) {
+        uploadError = error;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    return uploadError;
+}
+
+- (void)assertServerReceivedPayload
+{
+    NSData *receivedBody = AFChunkedUploadTestServer.receivedBody;
+    XCTAssertGreaterThan(receivedBody.length, self.payload.length);
+    XCTAssertNotEqual([receivedBody rangeOfData:self.payload options:0 range:NSMakeRange(0, receivedBody.length)].location, (NSUInteger)NSNotFound);
+}
+
+- (void)testUploadWithoutFailuresSendsEachChunkOnce
+{
+    XCTAssertNil([self uploadWithMaximumRetryCount:3]);
+    [self assertServerReceivedPayload];
+    XCTAssertEqual(AFChunkedUploadTestServer.queryCount, (NSUInteger)0);
+    for (NSNumber *offset in AFChunkedUploadTestServer.chunkRequests) {
+        XCTAssertEqual([AFChunkedUploadTestServer.chunkRequests countForObject:offset], (NSUInteger)1);
+    }
+}
+
+- (void)testFailedChunkIsResentAfterQueryingCommittedOffset
+{
+    NSNumber *failedOffset = @(3 * AFChunkedUploadTestChunkSize);
+    AFChunkedUploadTestServer.failures[failedOffset] = @1;
+
+    XCTAssertNil([self uploadWithMaximumRetryCount:3]);
+    [self assertServerReceivedPayload];
+    XCTAssertEqual(AFChunkedUploadTestServer.queryCount, (NSUInteger)1);
+    XCTAssertEqual([AFChunkedUploadTestServer.chunkRequests countForObject:failedOffset], (NSUInteger)2);
+}
+
+- (void)testLostResponseResumesAfterCommittedChunk
+{
+    NSNumber *lostOffset = @(2 * AFChunkedUploadTestChunkSize);
+    [AFChunkedUploadTestServer.lostResponses addObject:lostOffset];
+
+    XCTAssertNil([self uploadWithMaximumRetryCount:3]);
+    [self assertServerReceivedPayload];
+    XCTAssertEqual(AFChunkedUploadTestServer.queryCount, (NSUInteger)1);
+    // 服务器已经收下了这一块，查询之后从下一块继续，不再重传
+    XCTAssertEqual([AFChunkedUploadTestServer.chunkRequests countForObject:lostOffset], (NSUInteger)1);
+}
+
+- (void)testUploadFailsAfterMaximumRetryCount
+{
+    NSNumber *failedOffset = @(AFChunkedUploadTestChunkSize);
+    AFChunkedUploadTestServer.failures[failedOffset] = @100;
+
+    NSError *error = [self uploadWithMaximumRetryCount:2];
+    XCTAssertNotNil(error);
+    XCTAssertEqual([AFChunkedUploadTestServer.chunkRequests countForObject:failedOffset], (NSUInteger)3);
+    XCTAssertEqual(AFChunkedUploadTestServer.queryCount, (NSUInteger)2);
+}
+
+- (void)testRetriesBackOffExponentially
+{
+    self.manager.chunkedUploadRetryInterval = 0.2;
+    NSNumber *failedOffset = @0;
+    AFChunkedUploadTestServer.failures[failedOffset] = @2;
+
+    XCTAssertNil([self uploadWithMaximumRetryCount:3]);
+    NSArray<NSDate *> *dates = AFChunkedUploadTestServer.chunkRequestDates;
+    // 第一次重传等待0.2秒，第二次等待0.4秒
+    XCTAssertGreaterThanOrEqual([dates[1] timeIntervalSinceDate:dates[0]], 0.2);
+    XCTAssertGreaterThanOrEqual([dates[2] timeIntervalSinceDate:dates[1]], 0.4);
+}
+
+@end
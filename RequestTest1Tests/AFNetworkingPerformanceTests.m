@@ -0,0 +1,817 @@
+//
+//  AFNetworkingPerformanceTests.m
+//  RequestTest1Tests
+//
+
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+#import <zlib.h>
+#import "AFHTTPSessionManager.h"
+#import "AFLogging.h"
+#import "AFImageDownloader.h"
+
+static NSString * const AFPerformanceTestHost = @"performance.test";
+static const NSUInteger AFPerformanceTestChunkLength = 16 * 1024;
+static const NSUInteger AFPerformanceTestItemCount = 20000;
+
+// 路径 -> 响应体，在+setUp里注册，URLProtocol的线程上只读
+static NSMutableDictionary<NSString *, NSData *> *AFPerformanceTestBodies;
+
+// 列表接口形式的JSON，每一项都有字符串、数字、布尔、数组和null
+static NSArray * AFPerformanceTestJSONObject(NSUInteger count) {
+    NSMutableArray *items = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [items addObject:@{@"id": @(i),
+                           @"name": [NSString stringWithFormat:@"user-%lu", (unsigned long)i],
+                           @"bio": @"Writes \"networking\" code in Objective-C and Swift, lives in Zürich.",
+                           @"score": @(i * 0.25),
+                           @"active": @(i % 2 == 0),
+                           @"tags": @[@"ios", @"networking", @"cache"],
+                           @"avatar": [NSNull null]}];
+    }
+    return items;
+}
+
+static NSData * AFPerformanceTestJSONData(NSUInteger count) {
+    return [NSJSONSerialization dataWithJSONObject:AFPerformanceTestJSONObject(count) options:0 error:nil];
+}
+
+static NSHTTPURLResponse * AFPerformanceTestResponse(NSURL *URL, NSString *contentType) {
+    return [[NSHTTPURLResponse alloc] initWithURL:URL statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Content-Type": contentType}];
+}
+
+// 多层嵌套的参数，带需要转义的中文、空格和保留字符
+static NSDictionary * AFPerformanceTestNestedParameters(NSUInteger count) {
+    NSMutableDictionary *parameters = [NSMutableDictionary dictionaryWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        parameters[[NSString stringWithFormat:@"filter%lu", (unsigned long)i]] = @{@"name": [NSString stringWithFormat:@"北京 & 上海 #%lu", (unsigned long)i],
+                                                                                 @"range": @{@"from": @(i), @"to": @(i + 100)},
+                                                                                 @"ids": @[@(i), @(i + 1), @(i + 2)],
+                                                                                 @"flags": [NSSet setWithObjects:@"a b", @"c/d", @"e?f", nil]};
+    }
+    return parameters;
+}
+
+// 带常见请求头和已修改属性的序列化器，构建请求时这些都要合并进去
+static AFHTTPRequestSerializer * AFPerformanceTestRequestSerializer(void) {
+    AFHTTPRequestSerializer *serializer = [AFHTTPRequestSerializer serializer];
+    serializer.timeoutInterval = 15;
+    serializer.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    [serializer setValue:@"Bearer 0123456789abcdef0123456789abcdef" forHTTPHeaderField:@"Authorization"];
+    [serializer setValue:@"application/json" forHTTPHeaderField:@"Accept"];
+    [serializer setValue:@"4.2.0" forHTTPHeaderField:@"X-App-Version"];
+    [serializer setValue:@"ios" forHTTPHeaderField:@"X-Platform"];
+    [serializer setValue:@"zh-Hans-CN" forHTTPHeaderField:@"X-Locale"];
+    return serializer;
+}
+
+// 按16像素的色块画一张1024x768的图片，压缩后大小和真实照片相近
+static NSData * AFPerformanceTestImageData(NSString *type) {
+    UIGraphicsBeginImageContextWithOptions(CGSizeMake(1024, 768), YES, 1);
+    for (NSUInteger y = 0; y < 768; y += 16) {
+        for (NSUInteger x = 0; x < 1024; x += 16) {
+            [[UIColor colorWithRed:x / 1024.0 green:y / 768.0 blue:((x ^ y) & 0xff) / 255.0 alpha:1] setFill];
+            UIRectFill(CGRectMake(x, y, 16, 16));
+        }
+    }
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    return [type isEqualToString:@"png"] ? UIImagePNGRepresentation(image) : UIImageJPEGRepresentation(image, 0.8);
+}
+
+// 自动识别gzip和zlib两种格式
+static NSData * AFPerformanceTestInflatedData(NSData *data) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        return nil;
+    }
+
+    NSMutableData *inflated = [NSMutableData dataWithLength:data.length * 4];
+    stream.next_in = (Bytef *)data.bytes;
+    stream.avail_in = (uInt)data.length;
+    int status = Z_OK;
+    while (status == Z_OK) {
+        if (stream.total_out >= inflated.length) {
+            [inflated increaseLengthBy:data.length];
+        }
+        stream.next_out = (Bytef *)inflated.mutableBytes + stream.total_out;
+        stream.avail_out = (uInt)(inflated.length - stream.total_out);
+        status = inflate(&stream, Z_NO_FLUSH);
+    }
+    inflateEnd(&stream);
+
+    if (status != Z_STREAM_END) {
+        return nil;
+    }
+    inflated.length = stream.total_out;
+    return inflated;
+}
+
+// 最近一个POST请求体：线上传输的字节数，以及按Content-Encoding解压后的内容
+static unsigned long long AFPerformanceTestReceivedBodyLength;
+static NSData *AFPerformanceTestReceivedBody;
+
+// 像服务器一样读完请求体再解压
+static void AFPerformanceTestReceiveRequestBody(NSURLRequest *request) {
+    NSMutableData *body = [NSMutableData dataWithData:request.HTTPBody ?: [NSData data]];
+    NSInputStream *bodyStream = request.HTTPBodyStream;
+    if (bodyStream) {
+        uint8_t buffer[32 * 1024];
+        [bodyStream open];
+        NSInteger length = 0;
+        while ((length = [bodyStream read:buffer maxLength:sizeof(buffer)]) > 0) {
+            [body appendBytes:buffer length:(NSUInteger)length];
+        }
+        [bodyStream close];
+    }
+
+    AFPerformanceTestReceivedBodyLength = body.length;
+    AFPerformanceTestReceivedBody = [request valueForHTTPHeaderField:@"Content-Encoding"] ? AFPerformanceTestInflatedData(body) : body;
+}
+
+// CN=performance.test的自签名证书，DER编码，有效期到2126年
+static NSString * const AFPerformanceTestCertificateBase64 =
+    @"MIIDGTCCAgGgAwIBAgIULLEXPhPWWlBsyZ4T1t4HNlVR8V0wDQYJKoZIhvcNAQELBQAwGzEZMBcGA1UEAwwQcGVyZm9ybWFu"
+    @"Y2UudGVzdDAgFw0yNjEwMTcxNDUyMzhaGA8yMTI2MDkyMzE0NTIzOFowGzEZMBcGA1UEAwwQcGVyZm9ybWFuY2UudGVzdDCC"
+    @"ASIwDQYJKoZIhvcNAQEBBQADggEPADCCAQoCggEBALuRu4PnPRppnQmYZJls5hDDnIe7QiC/YVTULwaxV/MXCWGkVbgsTTmk"
+    @"OdcyFEZjVTmoSfg40p3gY0yN9CDVhMZxfpJkNCIoWVD8vb9MVIU8KCl2fZdEAvKDWSkHF5/kM04hDo6EYxodRYyw2KGTJ/0X"
+    @"eibuWnRrCUL+swq/pzFLgc77L6lA7qrf527cNZLLM8NWjNvhGHE3915o1GzngtNnwrryHw0JNmQpn2LfoIUj/ALqN1TDhIpA"
+    @"Cq00J8rt+EAsFS3VP64s4TlcA5SSUmD0hB/ghcwzaLY9Z3z7VEq2YCeOEYfHvYdPnsg7tblg/ZJjdo30FyfX/evlcPtovtMC"
+    @"AwEAAaNTMFEwHQYDVR0OBBYEFGPx6hVvXtKZhpKN0uVhOSCaT7qgMB8GA1UdIwQYMBaAFGPx6hVvXtKZhpKN0uVhOSCaT7qg"
+    @"MA8GA1UdEwEB/wQFMAMBAf8wDQYJKoZIhvcNAQELBQADggEBAKuDb84JY5g5ldaLR/Fc/DnCTFoWtMMsr8y5L8l6fQ/xjGM6"
+    @"5se4+TCc2gxYTJUDJsH72HVbt+IijNxuHZUdtIjcKMqNpSsTJHYL/RLegwL9M418WTXViRxl0vWiicxZYRf0LEi3+LHafpPQ"
+    @"j/1zEk2McM944rDOhaKzMwQSCocLOiQJ9fUQEHc+zIFwjR9B84LAYm1lAFZOGr3Bhh2AN2ZDJ2sNe9nnKUtx4j92eK5QIQEt"
+    @"P7HQ/l12uQC9RTbs/XCSz6csW8xp4Pzj3zigqSWxtLsg39VXEUHPusdrTHDNPTPCXpAhVYtelT2THixVsBgJ08uetCPHXz6Q"
+    @"ytD1ucM=";
+
+static NSArray<NSData *> * AFPerformanceTestChunks(NSData *data) {
+    NSMutableArray<NSData *> *chunks = [NSMutableArray array];
+    for (NSUInteger offset = 0; offset < data.length; offset += AFPerformanceTestChunkLength) {
+        [chunks addObject:[data subdataWithRange:NSMakeRange(offset, MIN(AFPerformanceTestChunkLength, data.length - offset))]];
+    }
+    return chunks;
+}
+
+/**
+ Serves the body registered for a path of `AFPerformanceTestHost` in 16KB chunks. Requests for other paths never finish unless they are cancelled. The bodies of `POST` requests are read and decompressed first.
+ */
+@interface AFPerformanceTestURLProtocol : NSURLProtocol
+@end
+
+@implementation AFPerformanceTestURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+    return [request.URL.host isEqualToString:AFPerformanceTestHost];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+    return request;
+}
+
+- (void)startLoading
+{
+    if ([self.request.HTTPMethod isEqualToString:@"POST"]) {
+        AFPerformanceTestReceiveRequestBody(self.request);
+    }
+
+    NSData *body = AFPerformanceTestBodies[self.request.URL.path];
+    if (!body) {
+        return;
+    }
+
+    NSString *extension = self.request.URL.pathExtension;
+    NSString *contentType = extension.length > 0 ? [@"image/" stringByAppendingString:extension] : @"application/json";
+    NSHTTPURLResponse *response = AFPerformanceTestResponse(self.request.URL, contentType);
+    [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    for (NSData *chunk in AFPerformanceTestChunks(body)) {
+        [self.client URLProtocol:self didLoadData:chunk];
+    }
+    [self.client URLProtocolDidFinishLoading:self];
+}
+
+- (void)stopLoading
+{
+}
+
+@end
+
+#pragma mark -
+
+@interface AFPerformanceTestUser : NSObject
+@property (nonatomic, assign) NSInteger userID;
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, copy) NSString *bio;
+@property (nonatomic, assign) double score;
+@property (nonatomic, assign) BOOL active;
+@property (nonatomic, copy) NSArray<NSString *> *tags;
+@end
+
+@implementation AFPerformanceTestUser
+@end
+
+static AFJSONFieldMap * AFPerformanceTestUserFieldMap(void) {
+    return [AFJSONFieldMap fieldMapWithModelClass:[AFPerformanceTestUser class] propertiesByJSONKey:@{@"id": @"userID", @"name": @"name", @"bio": @"bio", @"score": @"score", @"active": @"active", @"tags": @"tags"}];
+}
+
+#pragma mark -
+
+@interface AFNetworkingPerformanceTests : XCTestCase
+@property (nonatomic, strong) AFHTTPSessionManager *manager;
+@end
+
+@implementation AFNetworkingPerformanceTests
+
++ (void)setUp
+{
+    [super setUp];
+    AFPerformanceTestBodies = [NSMutableDictionary dictionary];
+    AFPerformanceTestBodies[@"/feed"] = AFPerformanceTestJSONData(AFPerformanceTestItemCount);
+    AFPerformanceTestBodies[@"/photo.jpeg"] = AFPerformanceTestImageData(@"jpeg");
+    AFPerformanceTestBodies[@"/photo.png"] = AFPerformanceTestImageData(@"png");
+    AFPerformanceTestBodies[@"/sync"] = [@"{\"ok\":true}" dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (void)tearDown
+{
+    AFPerformanceTestBodies = nil;
+    [super tearDown];
+}
+
+- (void)setUp
+{
+    [super setUp];
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[AFPerformanceTestURLProtocol class]];
+    NSURL *baseURL = [NSURL URLWithString:[NSString stringWithFormat:@"http://%@/", AFPerformanceTestHost]];
+    self.manager = [[AFHTTPSessionManager alloc] initWithBaseURL:baseURL sessionConfiguration:configuration];
+}
+
+- (void)tearDown
+{
+    [self.manager invalidateSessionCancelingTasks:YES resetSession:NO];
+    self.manager = nil;
+    [super tearDown];
+}
+
+- (void)GET:(NSString *)path
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"request finished"];
+    [self.manager GET:path parameters:nil headers:nil progress:nil success:^(NSURLSessionDataTask *task, id responseObject) {
+        XCTAssertNotNil(responseObject);
+        [expectation fulfill];
+    } failure:^(NSURLSessionDataTask *task, NSError *error) {
+        XCTFail(@"%@", error);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+}
+
+#pragma mark - Streaming JSON
+
+// 只计最后一块数据到达之后的耗时：增量解析器在计时前已经吃掉了前面的数据
+- (void)measureTimeFromLastByteWithSerializer:(id <AFURLResponseSerialization>)serializer
+{
+    NSData *data = AFPerformanceTestBodies[@"/feed"];
+    NSArray<NSData *> *chunks = AFPerformanceTestChunks(data);
+    NSHTTPURLResponse *response = AFPerformanceTestResponse([NSURL URLWithString:@"http://performance.test/feed"], @"application/json");
+
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        id <AFURLResponseIncrementalParsing> parser = nil;
+        if ([serializer conformsToProtocol:@protocol(AFURLResponseIncrementalSerialization)]) {
+            parser = [(id <AFURLResponseIncrementalSerialization>)serializer incrementalParserForResponse:response];
+            for (NSUInteger i = 0; i < chunks.count - 1; i++) {
+                [parser appendData:chunks[i]];
+            }
+        }
+
+        [self startMeasuring];
+        id responseObject = nil;
+        if (parser) {
+            [parser appendData:chunks.lastObject];
+            responseObject = [(id <AFURLResponseIncrementalSerialization>)serializer responseObjectForResponse:response data:data incrementalParser:parser error:nil];
+        } else {
+            responseObject = [serializer responseObjectForResponse:response data:data error:nil];
+        }
+        [self stopMeasuring];
+
+        XCTAssertEqual([responseObject count], AFPerformanceTestItemCount);
+    }];
+}
+
+- (void)testJSONSerializerTimeFromLastBytePerformance
+{
+    [self measureTimeFromLastByteWithSerializer:[AFJSONResponseSerializer serializer]];
+}
+
+- (void)testStreamingJSONSerializerTimeFromLastBytePerformance
+{
+    [self measureTimeFromLastByteWithSerializer:[AFStreamingJSONResponseSerializer serializer]];
+}
+
+- (void)testJSONDownloadPerformance
+{
+    self.manager.responseSerializer = [AFJSONResponseSerializer serializer];
+    [self measureBlock:^{
+        [self GET:@"feed"];
+    }];
+}
+
+- (void)testStreamingJSONDownloadPerformance
+{
+    self.manager.responseSerializer = [AFStreamingJSONResponseSerializer serializer];
+    [self measureBlock:^{
+        [self GET:@"feed"];
+    }];
+}
+
+#pragma mark - JSON parser backends
+
+// 去掉null的解析，NSJSONSerialization之后还要再复制一遍对象树
+- (void)measureDecodeWithJSONParser:(id <AFJSONParsing>)parser
+{
+    AFJSONResponseSerializer *serializer = [AFJSONResponseSerializer serializer];
+    serializer.removesKeysWithNullValues = YES;
+    serializer.JSONParser = parser;
+    NSData *data = AFPerformanceTestBodies[@"/feed"];
+    NSHTTPURLResponse *response = AFPerformanceTestResponse([NSURL URLWithString:@"http://performance.test/feed"], @"application/json");
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 5; i++) {
+            NSArray *items = [serializer responseObjectForResponse:response data:data error:nil];
+            XCTAssertEqual(items.count, AFPerformanceTestItemCount);
+            XCTAssertNil(items.firstObject[@"avatar"]);
+        }
+    }];
+}
+
+- (void)testJSONSerializationDecodePerformance
+{
+    [self measureDecodeWithJSONParser:nil];
+}
+
+- (void)testJSONScannerDecodePerformance
+{
+    [self measureDecodeWithJSONParser:[AFJSONScanner scanner]];
+}
+
+#pragma mark - Model decoding
+
+- (void)testParseThenMapPerformance
+{
+    AFJSONResponseSerializer *serializer = [AFJSONResponseSerializer serializer];
+    NSData *data = AFPerformanceTestBodies[@"/feed"];
+    NSHTTPURLResponse *response = AFPerformanceTestResponse([NSURL URLWithString:@"http://performance.test/feed"], @"application/json");
+
+    [self measureBlock:^{
+        NSArray<NSDictionary *> *items = [serializer responseObjectForResponse:response data:data error:nil];
+        NSMutableArray<AFPerformanceTestUser *> *users = [NSMutableArray arrayWithCapacity:items.count];
+        for (NSDictionary *item in items) {
+            AFPerformanceTestUser *user = [AFPerformanceTestUser new];
+            user.userID = [item[@"id"] integerValue];
+            user.name = item[@"name"];
+            user.bio = item[@"bio"];
+            user.score = [item[@"score"] doubleValue];
+            user.active = [item[@"active"] boolValue];
+            user.tags = item[@"tags"];
+            [users addObject:user];
+        }
+        XCTAssertEqual(users.count, AFPerformanceTestItemCount);
+    }];
+}
+
+- (void)testModelDecodePerformance
+{
+    AFJSONModelResponseSerializer *serializer = [AFJSONModelResponseSerializer serializerWithFieldMap:AFPerformanceTestUserFieldMap()];
+    NSData *data = AFPerformanceTestBodies[@"/feed"];
+    NSHTTPURLResponse *response = AFPerformanceTestResponse([NSURL URLWithString:@"http://performance.test/feed"], @"application/json");
+
+    [self measureBlock:^{
+        NSArray<AFPerformanceTestUser *> *users = [serializer responseObjectForResponse:response data:data error:nil];
+        XCTAssertEqual(users.count, AFPerformanceTestItemCount);
+        XCTAssertEqual(users.lastObject.userID, (NSInteger)(AFPerformanceTestItemCount - 1));
+    }];
+}
+
+#pragma mark - Query string
+
+- (void)testQueryStringPerformance
+{
+    NSDictionary *parameters = AFPerformanceTestNestedParameters(2000);
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 5; i++) {
+            XCTAssertGreaterThan(AFQueryStringFromParameters(parameters).length, (NSUInteger)0);
+        }
+    }];
+}
+
+#pragma mark - Request building
+
+- (void)testConcurrentRequestBuildingPerformance
+{
+    AFHTTPRequestSerializer *serializer = AFPerformanceTestRequestSerializer();
+    NSDictionary *parameters = @{@"page": @1, @"count": @20};
+    [self measureBlock:^{
+        dispatch_apply(20000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            NSMutableURLRequest *request = [serializer requestWithMethod:@"GET" URLString:@"http://performance.test/feed" parameters:parameters error:nil];
+            XCTAssertNotNil([request valueForHTTPHeaderField:@"Authorization"]);
+        });
+    }];
+}
+
+#pragma mark - Request templates
+
+- (void)testRequestWithMethodPerformance
+{
+    AFHTTPRequestSerializer *serializer = AFPerformanceTestRequestSerializer();
+    NSURL *baseURL = [NSURL URLWithString:@"http://performance.test/api/"];
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 20000; i++) {
+            NSString *URLString = [[NSURL URLWithString:[NSString stringWithFormat:@"users/%lu", (unsigned long)i] relativeToURL:baseURL] absoluteString];
+            XCTAssertNotNil([serializer requestWithMethod:@"GET" URLString:URLString parameters:@{@"fields": @"name"} error:nil]);
+        }
+    }];
+}
+
+- (void)testRequestTemplatePerformance
+{
+    AFHTTPRequestTemplate *requestTemplate = [AFPerformanceTestRequestSerializer() requestTemplateWithMethod:@"GET" baseURL:[NSURL URLWithString:@"http://performance.test/api/"]];
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 20000; i++) {
+            NSString *path = [NSString stringWithFormat:@"users/%lu", (unsigned long)i];
+            XCTAssertNotNil([requestTemplate requestWithPath:path parameters:@{@"fields": @"name"} error:nil]);
+        }
+    }];
+}
+
+#pragma mark - Logging
+
+// 和数据任务每收到一块数据时记的那条trace日志相同
+- (void)measurePerChunkLogging
+{
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100000; i++) {
+            AFLogTrace(AFLogCategorySession, @"task %lu received %lu bytes", (unsigned long)i, (unsigned long)AFPerformanceTestChunkLength);
+        }
+    }];
+}
+
+// 编译期关闭日志时这条日志不产生代码；打开时按运行时级别被过滤掉
+- (void)testPerChunkLoggingDisabledPerformance
+{
+#if AF_LOGGING_ENABLED
+    AFLogSetLevel(AFLogLevelInfo);
+#endif
+    [self measurePerChunkLogging];
+}
+
+#if AF_LOGGING_ENABLED
+- (void)testPerChunkLoggingEnabledPerformance
+{
+    AFLogSetLevel(AFLogLevelTrace);
+    [self measurePerChunkLogging];
+    AFLogSetLevel(AFLogLevelInfo);
+}
+#endif
+
+#pragma mark - Image decoding
+
+// 8个下载同时完成，各自解码5张图片
+- (void)measureConcurrentDecodeOfImageAtPath:(NSString *)path
+{
+    AFImageResponseSerializer *serializer = [AFImageResponseSerializer serializer];
+    NSData *data = AFPerformanceTestBodies[path];
+    NSURL *URL = [NSURL URLWithString:path relativeToURL:[NSURL URLWithString:@"http://performance.test/"]];
+    NSHTTPURLResponse *response = AFPerformanceTestResponse(URL, [@"image/" stringByAppendingString:path.pathExtension]);
+
+    [self measureBlock:^{
+        dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            for (NSUInteger j = 0; j < 5; j++) {
+                XCTAssertNotNil([serializer responseObjectForResponse:response data:data error:nil]);
+            }
+        });
+    }];
+}
+
+- (void)testConcurrentJPEGDecodePerformance
+{
+    [self measureConcurrentDecodeOfImageAtPath:@"/photo.jpeg"];
+}
+
+- (void)testConcurrentPNGDecodePerformance
+{
+    [self measureConcurrentDecodeOfImageAtPath:@"/photo.png"];
+}
+
+- (void)testConcurrentImageDownloadPerformance
+{
+    self.manager.responseSerializer = [AFImageResponseSerializer serializer];
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 8; i++) {
+            XCTestExpectation *expectation = [self expectationWithDescription:@"image downloaded"];
+            [self.manager GET:(i % 2 == 0 ? @"photo.jpeg" : @"photo.png") parameters:nil headers:nil progress:nil success:^(NSURLSessionDataTask *task, id responseObject) {
+                XCTAssertTrue([responseObject isKindOfClass:[UIImage class]]);
+                [expectation fulfill];
+            } failure:^(NSURLSessionDataTask *task, NSError *error) {
+                XCTFail(@"%@", error);
+                [expectation fulfill];
+            }];
+        }
+        [self waitForExpectationsWithTimeout:30 handler:nil];
+    }];
+}
+
+#pragma mark - Image download queue
+
+// 只允许一个下载，其余请求全部留在等待队列里
+- (void)testPendingDownloadChurnPerformance
+{
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[AFPerformanceTestURLProtocol class]];
+    AFHTTPSessionManager *sessionManager = [[AFHTTPSessionManager alloc] initWithSessionConfiguration:configuration];
+    sessionManager.responseSerializer = [AFImageResponseSerializer serializer];
+    AFImageDownloader *downloader = [[AFImageDownloader alloc] initWithSessionManager:sessionManager downloadPrioritization:AFImageDownloadPrioritizationFIFO maximumActiveDownloads:1 imageCache:nil];
+
+    NSMutableArray<NSURLRequest *> *requests = [NSMutableArray arrayWithCapacity:10000];
+    for (NSUInteger i = 0; i < 10000; i++) {
+        [requests addObject:[NSURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"http://performance.test/pending/%lu.jpeg", (unsigned long)i]]]];
+    }
+
+    [self measureBlock:^{
+        NSMutableArray<AFImageDownloadReceipt *> *receipts = [NSMutableArray arrayWithCapacity:requests.count];
+        for (NSURLRequest *request in requests) {
+            [receipts addObject:[downloader downloadImageForURLRequest:request success:nil failure:nil]];
+        }
+        // 滚动时可见的图片提高优先级，先取消奇数位置的请求，再取消剩下的
+        for (NSUInteger i = 0; i < receipts.count; i += 3) {
+            [downloader setPriority:0.75f forImageDownloadReceipt:receipts[i]];
+        }
+        for (NSUInteger i = 1; i < receipts.count; i += 2) {
+            [downloader cancelTaskForImageDownloadReceipt:receipts[i]];
+        }
+        for (NSUInteger i = 0; i < receipts.count; i += 2) {
+            [downloader cancelTaskForImageDownloadReceipt:receipts[i]];
+        }
+    }];
+
+    [sessionManager invalidateSessionCancelingTasks:YES resetSession:NO];
+}
+
+#pragma mark - Image cache hits
+
+// 模拟列表滚动：200个cell的图片都已在内存缓存中，来回滚动请求10000次
+- (void)measureCacheHitsDeliveringSynchronously:(BOOL)deliversCachedImagesSynchronously
+{
+    AFAutoPurgingImageCache *imageCache = [[AFAutoPurgingImageCache alloc] init];
+    AFImageDownloader *downloader = [[AFImageDownloader alloc] initWithSessionManager:self.manager downloadPrioritization:AFImageDownloadPrioritizationFIFO maximumActiveDownloads:4 imageCache:imageCache];
+    downloader.deliversCachedImagesSynchronously = deliversCachedImagesSynchronously;
+
+    UIGraphicsBeginImageContextWithOptions(CGSizeMake(64, 64), YES, 1);
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    NSMutableArray<NSURLRequest *> *requests = [NSMutableArray arrayWithCapacity:200];
+    for (NSUInteger i = 0; i < 200; i++) {
+        NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"http://performance.test/avatar/%lu.jpeg", (unsigned long)i]]];
+        [imageCache addImage:image forRequest:request withAdditionalIdentifier:nil];
+        [requests addObject:request];
+    }
+
+    [self measureBlock:^{
+        XCTestExpectation *expectation = [self expectationWithDescription:@"images delivered"];
+        __block NSUInteger deliveredCount = 0;
+        for (NSUInteger i = 0; i < 10000; i++) {
+            [downloader downloadImageForURLRequest:requests[i % requests.count] success:^(NSURLRequest *request, NSHTTPURLResponse *response, UIImage *responseObject) {
+                if (++deliveredCount == 10000) {
+                    [expectation fulfill];
+                }
+            } failure:nil];
+        }
+        [self waitForExpectationsWithTimeout:30 handler:nil];
+    }];
+}
+
+- (void)testCacheHitPerformance
+{
+    [self measureCacheHitsDeliveringSynchronously:NO];
+}
+
+- (void)testSynchronousCacheHitPerformance
+{
+    [self measureCacheHitsDeliveringSynchronously:YES];
+}
+
+#pragma mark - Image cache eviction
+
+// 10000张64x64的图片装满缓存，之后继续写入，每超出容量一次淘汰到9000张
+- (void)testImageCacheChurnPerformance
+{
+    UIGraphicsBeginImageContextWithOptions(CGSizeMake(64, 64), YES, 1);
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    UInt64 imageBytes = 64 * 64 * 4;
+
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        AFAutoPurgingImageCache *imageCache = [[AFAutoPurgingImageCache alloc] initWithMemoryCapacity:10000 * imageBytes preferredMemoryCapacity:9000 * imageBytes];
+        for (NSUInteger i = 0; i < 10000; i++) {
+            [imageCache addImage:image withIdentifier:[NSString stringWithFormat:@"image-%lu", (unsigned long)i]];
+        }
+
+        [self startMeasuring];
+        for (NSUInteger i = 10000; i < 20000; i++) {
+            [imageCache addImage:image withIdentifier:[NSString stringWithFormat:@"image-%lu", (unsigned long)i]];
+            [imageCache imageWithIdentifier:[NSString stringWithFormat:@"image-%lu", (unsigned long)(i - 500)]];
+            [imageCache imageWithIdentifier:[NSString stringWithFormat:@"image-%lu", (unsigned long)(i - 5000)]];
+        }
+        [self stopMeasuring];
+
+        XCTAssertLessThanOrEqual(imageCache.memoryUsage, 10000 * imageBytes);
+    }];
+}
+
+#pragma mark - Multipart upload
+
+// 4个4MB的文件加上普通字段，按上传时的方式每次读32KB，读完整个请求体
+- (void)testMultipartFileUploadReadPerformance
+{
+    NSMutableArray<NSURL *> *fileURLs = [NSMutableArray array];
+    NSMutableData *fileData = [NSMutableData dataWithLength:4 * 1024 * 1024];
+    uint8_t *fileBytes = fileData.mutableBytes;
+    for (NSUInteger i = 0; i < fileData.length; i++) {
+        fileBytes[i] = (uint8_t)(i * 31 + 7);
+    }
+    for (NSUInteger i = 0; i < 4; i++) {
+        NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"multipart-performance-%lu.jpg", (unsigned long)i]]];
+        XCTAssertTrue([fileData writeToURL:fileURL atomically:YES]);
+        [fileURLs addObject:fileURL];
+    }
+
+    AFHTTPRequestSerializer *serializer = [AFHTTPRequestSerializer serializer];
+    [self measureBlock:^{
+        NSMutableURLRequest *request = [serializer multipartFormRequestWithMethod:@"POST" URLString:@"http://performance.test/upload" parameters:@{@"album": @"Holiday", @"private": @"1"} constructingBodyWithBlock:^(id<AFMultipartFormData> formData) {
+            for (NSURL *fileURL in fileURLs) {
+                [formData appendPartWithFileURL:fileURL name:@"photos[]" error:nil];
+            }
+        } error:nil];
+
+        NSInputStream *bodyStream = request.HTTPBodyStream;
+        uint8_t buffer[32 * 1024];
+        unsigned long long bodyLength = 0;
+        [bodyStream open];
+        NSInteger length = 0;
+        while ((length = [bodyStream read:buffer maxLength:sizeof(buffer)]) > 0) {
+            bodyLength += (unsigned long long)length;
+        }
+        [bodyStream close];
+
+        XCTAssertEqual(bodyLength, (unsigned long long)[[request valueForHTTPHeaderField:@"Content-Length"] longLongValue]);
+    }];
+
+    for (NSURL *fileURL in fileURLs) {
+        [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+    }
+}
+
+#pragma mark - Request body compression
+
+// 2000项约300KB的JSON，和统计、同步接口一次上传的量相当
+- (void)POSTSyncWithCompression:(AFHTTPRequestBodyCompression)compression
+{
+    AFJSONRequestSerializer *requestSerializer = [AFJSONRequestSerializer serializer];
+    requestSerializer.requestBodyCompression = compression;
+    self.manager.requestSerializer = requestSerializer;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"upload finished"];
+    [self.manager POST:@"sync" parameters:AFPerformanceTestJSONObject(2000) headers:nil progress:nil success:^(NSURLSessionDataTask *task, id responseObject) {
+        [expectation fulfill];
+    } failure:^(NSURLSessionDataTask *task, NSError *error) {
+        XCTFail(@"%@", error);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+}
+
+- (void)testCompressedUploadSendsFewerBytes
+{
+    [self POSTSyncWithCompression:AFHTTPRequestBodyCompressionNone];
+    unsigned long long uncompressedLength = AFPerformanceTestReceivedBodyLength;
+    NSArray *uncompressedItems = [NSJSONSerialization JSONObjectWithData:AFPerformanceTestReceivedBody options:0 error:nil];
+
+    for (NSNumber *compression in @[@(AFHTTPRequestBodyCompressionGzip), @(AFHTTPRequestBodyCompressionDeflate)]) {
+        [self POSTSyncWithCompression:compression.unsignedIntegerValue];
+        XCTAssertLessThan(AFPerformanceTestReceivedBodyLength * 4, uncompressedLength);
+        XCTAssertEqualObjects([NSJSONSerialization JSONObjectWithData:AFPerformanceTestReceivedBody options:0 error:nil], uncompressedItems);
+    }
+}
+
+- (void)testUncompressedUploadPerformance
+{
+    [self measureBlock:^{
+        [self POSTSyncWithCompression:AFHTTPRequestBodyCompressionNone];
+    }];
+}
+
+- (void)testGzipUploadPerformance
+{
+    [self measureBlock:^{
+        [self POSTSyncWithCompression:AFHTTPRequestBodyCompressionGzip];
+    }];
+}
+
+- (void)testDeflateUploadPerformance
+{
+    [self measureBlock:^{
+        [self POSTSyncWithCompression:AFHTTPRequestBodyCompressionDeflate];
+    }];
+}
+
+#pragma mark - JSON request bodies
+
+- (NSURLRequest *)syncRequest
+{
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"http://performance.test/sync"]];
+    request.HTTPMethod = @"POST";
+    return request;
+}
+
+// 原先的做法：先用isValidJSONObject:校验整棵树，再用NSJSONSerialization编码
+- (void)testJSONSerializationRequestBodyPerformance
+{
+    NSArray *items = AFPerformanceTestJSONObject(AFPerformanceTestItemCount);
+    [self measureBlock:^{
+        XCTAssertTrue([NSJSONSerialization isValidJSONObject:items]);
+        XCTAssertNotNil([NSJSONSerialization dataWithJSONObject:items options:0 error:nil]);
+    }];
+}
+
+- (void)testJSONRequestBodyPerformance
+{
+    AFJSONRequestSerializer *serializer = [AFJSONRequestSerializer serializer];
+    NSArray *items = AFPerformanceTestJSONObject(AFPerformanceTestItemCount);
+    NSURLRequest *request = [self syncRequest];
+    [self measureBlock:^{
+        XCTAssertNotNil([serializer requestBySerializingRequest:request withParameters:items error:nil].HTTPBody);
+    }];
+}
+
+- (void)testModelJSONRequestBodyPerformance
+{
+    AFJSONRequestSerializer *serializer = [AFJSONRequestSerializer serializer];
+    serializer.fieldMap = AFPerformanceTestUserFieldMap();
+    NSHTTPURLResponse *response = AFPerformanceTestResponse([NSURL URLWithString:@"http://performance.test/feed"], @"application/json");
+    NSArray<AFPerformanceTestUser *> *users = [[AFJSONModelResponseSerializer serializerWithFieldMap:serializer.fieldMap] responseObjectForResponse:response data:AFPerformanceTestBodies[@"/feed"] error:nil];
+    NSURLRequest *request = [self syncRequest];
+    [self measureBlock:^{
+        XCTAssertNotNil([serializer requestBySerializingRequest:request withParameters:users error:nil].HTTPBody);
+    }];
+}
+
+#pragma mark - Server trust evaluation
+
+// 每次握手都会拿到新的SecTrustRef，这里每次评估也新建一个
+- (void)measureServerTrustEvaluationWithPinningMode:(AFSSLPinningMode)pinningMode evaluationCacheTimeout:(NSTimeInterval)evaluationCacheTimeout
+{
+    NSData *certificateData = [[NSData alloc] initWithBase64EncodedString:AFPerformanceTestCertificateBase64 options:0];
+    SecCertificateRef certificate = SecCertificateCreateWithData(NULL, (__bridge CFDataRef)certificateData);
+    SecPolicyRef policy = SecPolicyCreateBasicX509();
+
+    AFSecurityPolicy *securityPolicy = [AFSecurityPolicy policyWithPinningMode:pinningMode withPinnedCertificates:[NSSet setWithObject:certificateData]];
+    securityPolicy.allowInvalidCertificates = YES;
+    securityPolicy.validatesDomainName = NO;
+    securityPolicy.evaluationCacheTimeout = evaluationCacheTimeout;
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 1000; i++) {
+            SecTrustRef serverTrust = NULL;
+            SecTrustCreateWithCertificates(certificate, policy, &serverTrust);
+            XCTAssertTrue([securityPolicy evaluateServerTrust:serverTrust forDomain:AFPerformanceTestHost]);
+            CFRelease(serverTrust);
+        }
+    }];
+
+    CFRelease(policy);
+    CFRelease(certificate);
+}
+
+- (void)testPublicKeyPinningEvaluationPerformance
+{
+    [self measureServerTrustEvaluationWithPinningMode:AFSSLPinningModePublicKey evaluationCacheTimeout:0];
+}
+
+- (void)testCachedPublicKeyPinningEvaluationPerformance
+{
+    [self measureServerTrustEvaluationWithPinningMode:AFSSLPinningModePublicKey evaluationCacheTimeout:60];
+}
+
+- (void)testCertificatePinningEvaluationPerformance
+{
+    [self measureServerTrustEvaluationWithPinningMode:AFSSLPinningModeCertificate evaluationCacheTimeout:0];
+}
+
+- (void)testCachedCertificatePinningEvaluationPerformance
+{
+    [self measureServerTrustEvaluationWithPinningMode:AFSSLPinningModeCertificate evaluationCacheTimeout:60];
+}
+
+@end
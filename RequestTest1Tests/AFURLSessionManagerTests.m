@@ -0,0 +1,168 @@
+//
+//  AFURLSessionManagerTests.m
+//  RequestTest1Tests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLSessionManager.h"
+
+static NSString * const AFLargeBodyTestHost = @"large-body.test";
+static NSString * const AFSpillFilePrefix = @"com.alamofire.networking.session.manager.data-";
+static const NSUInteger AFLargeBodyChunkLength = 8 * 1024;
+
+static NSData * AFLargeBodyTestData(NSUInteger length) {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    uint8_t *bytes = data.mutableBytes;
+    for (NSUInteger i = 0; i < length; i++) {
+        bytes[i] = (uint8_t)(i * 31 + 7);
+    }
+    return data;
+}
+
+static NSSet<NSString *> * AFSpillFiles(void) {
+    NSArray<NSString *> *names = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:NSTemporaryDirectory() error:nil];
+    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"SELF BEGINSWITH %@", AFSpillFilePrefix];
+    return [NSSet setWithArray:[names filteredArrayUsingPredicate:predicate]];
+}
+
+/**
+ Serves `/bytes/<length>` as a body of `length` bytes in 8KB chunks, and `/fail/<length>`
+ as the same body followed by a lost connection.
+ */
+@interface AFLargeBodyURLProtocol : NSURLProtocol
+@end
+
+@implementation AFLargeBodyURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+    return [request.URL.host isEqualToString:AFLargeBodyTestHost];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+    return request;
+}
+
+- (void)startLoading
+{
+    NSArray<NSString *> *components = self.request.URL.pathComponents;
+    BOOL fails = [components[1] isEqualToString:@"fail"];
+    NSUInteger length = (NSUInteger)[components[2] integerValue];
+
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Content-Type": @"application/octet-stream"}];
+    [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+
+    NSData *body = AFLargeBodyTestData(length);
+    for (NSUInteger offset = 0; offset < length; offset += AFLargeBodyChunkLength) {
+        NSRange range = NSMakeRange(offset, MIN(AFLargeBodyChunkLength, length - offset));
+        [self.client URLProtocol:self didLoadData:[body subdataWithRange:range]];
+    }
+
+    if (fails) {
+        [self.client URLProtocol:self didFailWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil]];
+    } else {
+        [self.client URLProtocolDidFinishLoading:self];
+    }
+}
+
+- (void)stopLoading
+{
+}
+
+@end
+
+
+@interface AFURLSessionManagerTests : XCTestCase
+@property (nonatomic, strong) AFURLSessionManager *manager;
+@property (nonatomic, strong) NSSet<NSString *> *spillFilesBeforeTest;
+@end
+
+@implementation AFURLSessionManagerTests
+
+- (void)setUp
+{
+    [super setUp];
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[AFLargeBodyURLProtocol class]];
+    self.manager = [[AFURLSessionManager alloc] initWithSessionConfiguration:configuration];
+    self.manager.responseSerializer = [AFHTTPResponseSerializer serializer];
+    self.spillFilesBeforeTest = AFSpillFiles();
+}
+
+- (void)tearDown
+{
+    [self.manager invalidateSessionCancelingTasks:YES resetSession:NO];
+    self.manager = nil;
+    [super tearDown];
+}
+
+- (NSSet<NSString *> *)newSpillFiles
+{
+    NSMutableSet<NSString *> *files = [AFSpillFiles() mutableCopy];
+    [files minusSet:self.spillFilesBeforeTest];
+    return files;
+}
+
+// 在 completionHandler 中记录当时的临时文件，并等待完成通知，此时 completionHandler 已经返回
+- (void)runTaskWithPath:(NSString *)path completionHandler:(void (^)(id responseObject, NSError *error, NSSet<NSString *> *spillFiles))completionHandler
+{
+    NSURL *URL = [NSURL URLWithString:[NSString stringWithFormat:@"http://%@%@", AFLargeBodyTestHost, path]];
+    __block id taskResponseObject = nil;
+    __block NSError *taskError = nil;
+    __block NSSet<NSString *> *spillFiles = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completion handler"];
+    NSURLSessionDataTask *task = [self.manager dataTaskWithRequest:[NSURLRequest requestWithURL:URL] uploadProgress:nil downloadProgress:nil completionHandler:^(NSURLResponse *response, id responseObject, NSError *error) {
+        taskResponseObject = responseObject;
+        taskError = error;
+        spillFiles = [self newSpillFiles];
+        [expectation fulfill];
+    }];
+    [self expectationForNotification:AFNetworkingTaskDidCompleteNotification object:task handler:nil];
+    [task resume];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    completionHandler(taskResponseObject, taskError, spillFiles);
+}
+
+- (void)testBodyBelowThresholdStaysInMemory
+{
+    self.manager.responseDataFileThreshold = 64 * 1024;
+    [self runTaskWithPath:@"/bytes/16384" completionHandler:^(id responseObject, NSError *error, NSSet<NSString *> *spillFiles) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(responseObject, AFLargeBodyTestData(16384));
+        XCTAssertEqual(spillFiles.count, (NSUInteger)0);
+    }];
+}
+
+- (void)testBodyAboveThresholdSpillsToFile
+{
+    self.manager.responseDataFileThreshold = 16 * 1024;
+    [self runTaskWithPath:@"/bytes/262144" completionHandler:^(id responseObject, NSError *error, NSSet<NSString *> *spillFiles) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(responseObject, AFLargeBodyTestData(262144));
+        XCTAssertEqual(spillFiles.count, (NSUInteger)1);
+    }];
+}
+
+- (void)testSpillFileIsRemovedAfterCompletionHandler
+{
+    self.manager.responseDataFileThreshold = 16 * 1024;
+    [self runTaskWithPath:@"/bytes/262144" completionHandler:^(id responseObject, NSError *error, NSSet<NSString *> *spillFiles) {
+        XCTAssertEqual(spillFiles.count, (NSUInteger)1);
+    }];
+    XCTAssertEqual([self newSpillFiles].count, (NSUInteger)0);
+}
+
+- (void)testFailedTaskReportsErrorAndRemovesSpillFile
+{
+    self.manager.responseDataFileThreshold = 16 * 1024;
+    [self runTaskWithPath:@"/fail/131072" completionHandler:^(id responseObject, NSError *error, NSSet<NSString *> *spillFiles) {
+        XCTAssertNil(responseObject);
+        XCTAssertEqualObjects(error.domain, NSURLErrorDomain);
+        XCTAssertEqual(error.code, (NSInteger)NSURLErrorNetworkConnectionLost);
+        XCTAssertEqual(spillFiles.count, (NSUInteger)1);
+    }];
+    XCTAssertEqual([self newSpillFiles].count, (NSUInteger)0);
+}
+
+@end
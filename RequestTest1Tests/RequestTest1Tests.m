@@ -7,6 +7,39 @@
 //
 
 #import <XCTest/XCTest.h>
+#import "YYMemoryCache.h"
+
+static const NSUInteger YYCostTrimTestCostLimit = 1000;
+static const NSUInteger YYCostTrimTestLowWater = 900;
+static const NSUInteger YYCostTrimTestObjectCost = 10;
+
+@interface YYMemoryCache (YYCostTrimTests)
+- (void)_trimToCost:(NSUInteger)costLimit;
+@end
+
+/**
+ Counts the trims scheduled by insertions, which trim down to the low-water mark.
+ */
+@interface YYCostTrimCountingCache : YYMemoryCache
+@property (atomic, assign) NSUInteger insertionTrimCount;
+// 修剪完成、修剪任务返回之前调用一次，用来模拟修剪期间的写入
+@property (atomic, copy) void (^didTrimBlock)(YYCostTrimCountingCache *cache);
+@end
+
+@implementation YYCostTrimCountingCache
+
+- (void)_trimToCost:(NSUInteger)costLimit
+{
+    [super _trimToCost:costLimit];
+    if (costLimit == YYCostTrimTestLowWater) {
+        self.insertionTrimCount++;
+        void (^didTrimBlock)(YYCostTrimCountingCache *) = self.didTrimBlock;
+        self.didTrimBlock = nil;
+        if (didTrimBlock) didTrimBlock(self);
+    }
+}
+
+@end
 
 @interface RequestTest1Tests : XCTestCase
 
@@ -31,4 +64,99 @@
     XCTFail(@"No implementation for \"%s\"", __PRETTY_FUNCTION__);
 }
 
+#pragma mark - YYMemoryCache cost trim
+
+- (YYCostTrimCountingCache *)costTrimCache
+{
+    YYCostTrimCountingCache *cache = [YYCostTrimCountingCache new];
+    cache.costLimit = YYCostTrimTestCostLimit;
+    cache.autoTrimInterval = 3600;
+    return cache;
+}
+
+- (void)insertObjectsIntoCache:(YYMemoryCache *)cache fromIndex:(NSUInteger)start count:(NSUInteger)count
+{
+    for (NSUInteger i = start; i < start + count; i++) {
+        [cache setObject:@(i) forKey:@(i) withCost:YYCostTrimTestObjectCost];
+    }
+}
+
+// 等待修剪队列中已经提交的任务执行完
+- (void)waitForTrimQueueOfCache:(YYMemoryCache *)cache
+{
+    dispatch_queue_t queue = [cache valueForKey:@"_queue"];
+    dispatch_sync(queue, ^{});
+}
+
+- (void)testBurstOfInsertionsQueuesOneTrim
+{
+    YYCostTrimCountingCache *cache = [self costTrimCache];
+    dispatch_queue_t queue = [cache valueForKey:@"_queue"];
+    dispatch_semaphore_t blocked = dispatch_semaphore_create(0);
+    dispatch_async(queue, ^{
+        dispatch_semaphore_wait(blocked, DISPATCH_TIME_FOREVER);
+    });
+
+    // 修剪队列被占住，整轮写入期间都超出 costLimit
+    [self insertObjectsIntoCache:cache fromIndex:0 count:500];
+    dispatch_semaphore_signal(blocked);
+    [self waitForTrimQueueOfCache:cache];
+
+    XCTAssertEqual(cache.insertionTrimCount, (NSUInteger)1);
+}
+
+- (void)testTrimReachesLowWaterMark
+{
+    YYCostTrimCountingCache *cache = [self costTrimCache];
+    [self insertObjectsIntoCache:cache fromIndex:0 count:101];
+    [self waitForTrimQueueOfCache:cache];
+
+    XCTAssertEqual(cache.insertionTrimCount, (NSUInteger)1);
+    XCTAssertLessThanOrEqual(cache.totalCost, YYCostTrimTestLowWater);
+    XCTAssertGreaterThan(cache.totalCost, YYCostTrimTestLowWater - YYCostTrimTestObjectCost);
+    // 最近写入的对象保留，最早写入的被淘汰
+    XCTAssertNotNil([cache objectForKey:@100]);
+    XCTAssertNil([cache objectForKey:@0]);
+}
+
+- (void)testInsertionDuringTrimQueuesFollowUpTrim
+{
+    YYCostTrimCountingCache *cache = [self costTrimCache];
+    cache.didTrimBlock = ^(YYCostTrimCountingCache *cache) {
+        [self insertObjectsIntoCache:cache fromIndex:1000 count:200];
+    };
+    [self insertObjectsIntoCache:cache fromIndex:0 count:101];
+    // 第一次修剪期间的写入排入第二次修剪，需要等两轮
+    [self waitForTrimQueueOfCache:cache];
+    [self waitForTrimQueueOfCache:cache];
+
+    XCTAssertEqual(cache.insertionTrimCount, (NSUInteger)2);
+    XCTAssertLessThanOrEqual(cache.totalCost, YYCostTrimTestLowWater);
+}
+
+- (void)testBurstOfInsertionsPerformance
+{
+    [self measureBlock:^{
+        YYCostTrimCountingCache *cache = [self costTrimCache];
+        [self insertObjectsIntoCache:cache fromIndex:0 count:20000];
+        [self waitForTrimQueueOfCache:cache];
+    }];
+}
+
+#pragma mark - YYMemoryCache insert and evict
+
+// 100万次写入，缓存保持1万个对象，写满之后每次写入都淘汰一个最旧的对象
+- (void)testInsertAndEvictPerformance
+{
+    [self measureBlock:^{
+        YYMemoryCache *cache = [YYMemoryCache new];
+        cache.countLimit = 10000;
+        cache.autoTrimInterval = 3600;
+        for (NSUInteger i = 0; i < 1000000; i++) {
+            [cache setObject:@(i) forKey:@(i)];
+        }
+        XCTAssertEqual(cache.totalCount, (NSUInteger)10000);
+    }];
+}
+
 @end
@@ -0,0 +1,225 @@
+//
+//  YYCachePerformanceTests.m
+//  RequestTest1Tests
+//
+
+#import <XCTest/XCTest.h>
+#import "YYDiskCache.h"
+#import "YYBinaryCoder.h"
+
+static const NSUInteger YYPerformanceTestHotKeyCount = 64;
+static const NSUInteger YYPerformanceTestWriteCount = 5000;
+
+// 接口返回的一条记录，约1KB
+static NSDictionary * YYPerformanceTestRecord(NSUInteger i) {
+    return @{@"id": @(i),
+             @"name": [NSString stringWithFormat:@"user-%lu", (unsigned long)i],
+             @"score": @(i * 0.25),
+             @"active": @(i % 2 == 0),
+             @"updated": [NSDate dateWithTimeIntervalSince1970:1500000000 + i],
+             @"bio": [@"" stringByPaddingToLength:900 withString:@"Writes networking code. " startingAtIndex:0]};
+}
+
+// JSON接口缓存：每个值是16到128条记录编码成的JSON，16KB到130KB不等
+static NSArray<NSData *> * YYPerformanceTestJSONCorpus(void) {
+    NSMutableArray<NSData *> *corpus = [NSMutableArray arrayWithCapacity:100];
+    for (NSUInteger i = 0; i < 100; i++) {
+        NSMutableArray *records = [NSMutableArray array];
+        for (NSUInteger j = 0; j < (i % 8 + 1) * 16; j++) {
+            NSMutableDictionary *record = [YYPerformanceTestRecord(i * 1000 + j) mutableCopy];
+            [record removeObjectForKey:@"updated"];
+            [records addObject:record];
+        }
+        [corpus addObject:[NSJSONSerialization dataWithJSONObject:records options:0 error:nil]];
+    }
+    return corpus;
+}
+
+@interface YYCachePerformanceTests : XCTestCase
+@property (nonatomic, copy) NSString *path;
+@end
+
+@implementation YYCachePerformanceTests
+
+- (void)setUp
+{
+    [super setUp];
+    // YYDiskCache 按路径复用实例，每个测试用自己的目录
+    self.path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"yycache-performance-%@", [NSUUID UUID].UUIDString]];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.path error:nil];
+    [super tearDown];
+}
+
+- (YYDiskCache *)diskCacheNamed:(NSString *)name
+{
+    return [[YYDiskCache alloc] initWithPath:[self.path stringByAppendingPathComponent:name]];
+}
+
+#pragma mark - Write-behind
+
+// 少量热点key被反复更新，计调用方写入的耗时
+- (void)writeHotKeysToCache:(YYDiskCache *)cache
+{
+    for (NSUInteger i = 0; i < YYPerformanceTestWriteCount; i++) {
+        NSUInteger key = i % YYPerformanceTestHotKeyCount;
+        [cache setObject:YYPerformanceTestRecord(i) forKey:[NSString stringWithFormat:@"record-%lu", (unsigned long)key]];
+    }
+}
+
+- (void)testWriteThroughHotKeyChurnPerformance
+{
+    YYDiskCache *cache = [self diskCacheNamed:@"write-through"];
+    [self measureBlock:^{
+        [self writeHotKeysToCache:cache];
+    }];
+}
+
+// 只计调用方的耗时，落盘在计时之外
+- (void)testWriteBehindHotKeyChurnCallerPerformance
+{
+    YYDiskCache *cache = [self diskCacheNamed:@"write-behind-caller"];
+    cache.writeBehindEnabled = YES;
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        [self startMeasuring];
+        [self writeHotKeysToCache:cache];
+        [self stopMeasuring];
+        [cache flushPendingWrites];
+    }];
+}
+
+// 包括落盘：每个热点key只写一次磁盘
+- (void)testWriteBehindHotKeyChurnPerformance
+{
+    YYDiskCache *cache = [self diskCacheNamed:@"write-behind"];
+    cache.writeBehindEnabled = YES;
+    [self measureBlock:^{
+        [self writeHotKeysToCache:cache];
+        [cache flushPendingWrites];
+    }];
+    XCTAssertEqual([cache totalCount], (NSInteger)YYPerformanceTestHotKeyCount);
+}
+
+#pragma mark - Binary coding
+
+- (NSArray<NSDictionary *> *)records
+{
+    NSMutableArray<NSDictionary *> *records = [NSMutableArray arrayWithCapacity:1000];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [records addObject:YYPerformanceTestRecord(i)];
+    }
+    return records;
+}
+
+- (void)testBinaryCoderWritesFewerBytes
+{
+    NSArray<NSDictionary *> *records = [self records];
+    NSData *archivedData = [NSKeyedArchiver archivedDataWithRootObject:records];
+    NSData *binaryData = [YYBinaryCoder dataWithObject:records];
+
+    XCTAssertLessThan(binaryData.length, archivedData.length);
+    XCTAssertEqualObjects([YYBinaryCoder objectWithData:binaryData], records);
+}
+
+- (void)testKeyedArchiverRoundTripPerformance
+{
+    NSArray<NSDictionary *> *records = [self records];
+    [self measureBlock:^{
+        NSData *data = [NSKeyedArchiver archivedDataWithRootObject:records];
+        XCTAssertEqual([[NSKeyedUnarchiver unarchiveObjectWithData:data] count], records.count);
+    }];
+}
+
+- (void)testBinaryCoderRoundTripPerformance
+{
+    NSArray<NSDictionary *> *records = [self records];
+    [self measureBlock:^{
+        NSData *data = [YYBinaryCoder dataWithObject:records];
+        XCTAssertEqual([[YYBinaryCoder objectWithData:data] count], records.count);
+    }];
+}
+
+// 磁盘缓存命中：读出数据后解档
+- (void)measureDiskCacheHitsWithBinaryCoding:(BOOL)binaryCodingEnabled
+{
+    YYDiskCache *cache = [self diskCacheNamed:binaryCodingEnabled ? @"binary" : @"keyed"];
+    cache.binaryCodingEnabled = binaryCodingEnabled;
+    for (NSUInteger i = 0; i < 200; i++) {
+        [cache setObject:YYPerformanceTestRecord(i) forKey:[NSString stringWithFormat:@"record-%lu", (unsigned long)i]];
+    }
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 2000; i++) {
+            XCTAssertNotNil([cache objectForKey:[NSString stringWithFormat:@"record-%lu", (unsigned long)(i % 200)]]);
+        }
+    }];
+}
+
+- (void)testKeyedArchiverDiskCacheHitPerformance
+{
+    [self measureDiskCacheHitsWithBinaryCoding:NO];
+}
+
+- (void)testBinaryCodingDiskCacheHitPerformance
+{
+    [self measureDiskCacheHitsWithBinaryCoding:YES];
+}
+
+#pragma mark - Compression
+
+- (void)writeCorpus:(NSArray<NSData *> *)corpus toCache:(YYDiskCache *)cache
+{
+    [corpus enumerateObjectsUsingBlock:^(NSData *data, NSUInteger idx, BOOL *stop) {
+        [cache setObject:data forKey:[NSString stringWithFormat:@"response-%lu", (unsigned long)idx]];
+    }];
+}
+
+- (void)testCompressedValuesUseLessDisk
+{
+    NSArray<NSData *> *corpus = YYPerformanceTestJSONCorpus();
+    YYDiskCache *uncompressedCache = [self diskCacheNamed:@"none"];
+    [self writeCorpus:corpus toCache:uncompressedCache];
+
+    for (NSNumber *compression in @[@(YYKVStorageCompressionLZ4), @(YYKVStorageCompressionLZFSE)]) {
+        YYDiskCache *cache = [self diskCacheNamed:compression.stringValue];
+        cache.compression = compression.unsignedIntegerValue;
+        [self writeCorpus:corpus toCache:cache];
+
+        XCTAssertLessThan([cache totalCost] * 3, [uncompressedCache totalCost]);
+        XCTAssertEqualObjects([cache objectForKey:@"response-7"], corpus[7]);
+    }
+}
+
+// 写入整个语料再全部读出
+- (void)measureCorpusWriteAndReadWithCompression:(YYKVStorageCompression)compression
+{
+    NSArray<NSData *> *corpus = YYPerformanceTestJSONCorpus();
+    YYDiskCache *cache = [self diskCacheNamed:@"corpus"];
+    cache.compression = compression;
+    [self measureBlock:^{
+        [self writeCorpus:corpus toCache:cache];
+        for (NSUInteger i = 0; i < corpus.count; i++) {
+            XCTAssertNotNil([cache objectForKey:[NSString stringWithFormat:@"response-%lu", (unsigned long)i]]);
+        }
+    }];
+}
+
+- (void)testUncompressedWriteAndReadPerformance
+{
+    [self measureCorpusWriteAndReadWithCompression:YYKVStorageCompressionNone];
+}
+
+- (void)testLZ4WriteAndReadPerformance
+{
+    [self measureCorpusWriteAndReadWithCompression:YYKVStorageCompressionLZ4];
+}
+
+- (void)testLZFSEWriteAndReadPerformance
+{
+    [self measureCorpusWriteAndReadWithCompression:YYKVStorageCompressionLZFSE];
+}
+
+@end